@@ -0,0 +1,192 @@
+/*=========================================================================
+ *
+ *   Program:     lcg
+ *   Filename:    lcg-bench-daq.cpp
+ *
+ *   Copyright (C) 2012,2013,2014 Daniele Linaro
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *=========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+#include <vector>
+#include "common.h"
+#include "types.h"
+#include "utils.h"
+#include "channel.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_LIBCOMEDI
+#include "comedi_io.h"
+#endif
+
+using namespace lcg;
+
+struct options {
+        options() : subdevice(0), channels(8), duration(5.), rate(20000.), repetitions(3) {
+                strncpy(device, "/dev/comedi0", FILENAME_MAXLEN);
+        }
+        char device[FILENAME_MAXLEN];
+        uint subdevice, channels;
+        double duration, rate;
+        uint repetitions;
+};
+
+static struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"device", required_argument, NULL, 'D'},
+        {"subdevice", required_argument, NULL, 's'},
+        {"channels", required_argument, NULL, 'n'},
+        {"duration", required_argument, NULL, 'd'},
+        {"rate", required_argument, NULL, 'F'},
+        {"repetitions", required_argument, NULL, 'r'},
+        {NULL, 0, NULL, 0}
+};
+
+const char lcg_bench_daq_usage_string[] =
+        "This program compares the cost of acquiring samples from a DAQ board by reading them\n"
+        "and by mapping the buffer of the board in memory.\n\n"
+        "Usage: lcg-bench-daq [<options> ...]\n"
+        "where options are:\n"
+        "   -h, --help          Print this help message and exit.\n"
+        "   -D, --device        Device file of the board (default /dev/comedi0).\n"
+        "   -s, --subdevice     Analog input subdevice (default 0).\n"
+        "   -n, --channels      Number of acquired channels (default 8).\n"
+        "   -d, --duration      Duration of each acquisition, in seconds (default 5).\n"
+        "   -F, --rate          Sampling rate, in Hz (default 20000).\n"
+        "   -r, --repetitions   Number of acquisitions with each method (default 3).\n";
+
+static void usage()
+{
+        printf("%s\n", lcg_bench_daq_usage_string);
+}
+
+static void parse_args(int argc, char *argv[], options *opts)
+{
+        int ch;
+        while ((ch = getopt_long(argc, argv, "hD:s:n:d:F:r:", longopts, NULL)) != -1) {
+                switch(ch) {
+                case 'h':
+                        usage();
+                        exit(0);
+                case 'D':
+                        strncpy(opts->device, optarg, sizeof(opts->device)-1);
+                        opts->device[sizeof(opts->device)-1] = '\0';
+                        break;
+                case 's':
+                        opts->subdevice = atoi(optarg);
+                        break;
+                case 'n':
+                        opts->channels = atoi(optarg);
+                        break;
+                case 'd':
+                        opts->duration = atof(optarg);
+                        break;
+                case 'F':
+                        opts->rate = atof(optarg);
+                        break;
+                case 'r':
+                        opts->repetitions = atoi(optarg);
+                        break;
+                default:
+                        Logger(Critical, "Enter 'lcg-bench-daq -h' for help on how to run this program.\n");
+                        exit(1);
+                }
+        }
+        if (opts->channels == 0 || opts->duration <= 0 || opts->rate <= 0 || opts->repetitions == 0) {
+                Logger(Critical, "The number of channels, the duration, the rate and the number of repetitions must be positive.\n");
+                exit(1);
+        }
+}
+
+static double elapsed(const struct timespec& start, const struct timespec& stop)
+{
+        return (stop.tv_sec - start.tv_sec) + 1e-9*(stop.tv_nsec - start.tv_nsec);
+}
+
+/*
+ * Acquires the channels once, with the given method, and measures the wall-clock time
+ * and the processor time used by the whole process, which includes the I/O threads.
+ * Returns the number of samples acquired from each channel, or 0 on failure.
+ */
+static size_t acquire(const options& opts, bool memoryMapped, double *wall, double *cpu)
+{
+        std::vector<InputChannel*> channels;
+        struct timespec start[2], stop[2];
+        size_t length = 0;
+        uint initialised;
+        int err;
+        for (uint i=0; i<opts.channels; i++)
+                channels.push_back(new InputChannel(opts.device, opts.subdevice, PLUS_MINUS_TEN, GRSE,
+                                        i, 1., opts.rate, "V", 0., INPUT_CHANNEL_BLOCKS, false, memoryMapped));
+        for (initialised=0; initialised<opts.channels; initialised++) {
+                if (!channels[initialised]->initialise()) {
+                        Logger(Critical, "Unable to initialise channel %d.\n", initialised);
+                        goto end;
+                }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start[0]);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start[1]);
+        for (uint i=0; i<opts.channels; i++)
+                channels[i]->run(opts.duration);
+        for (uint i=0; i<opts.channels; i++)
+                channels[i]->join(&err);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &stop[1]);
+        clock_gettime(CLOCK_MONOTONIC, &stop[0]);
+        *wall = elapsed(start[0], stop[0]);
+        *cpu = elapsed(start[1], stop[1]);
+        if (err == 0)
+                channels[0]->data(&length);
+end:
+        for (uint i=0; i<opts.channels; i++) {
+                if (i < initialised)
+                        channels[i]->terminate();
+                delete channels[i];
+        }
+        return length;
+}
+
+int main(int argc, char *argv[])
+{
+        options opts;
+        parse_args(argc, argv, &opts);
+
+        const char *methods[] = {"read", "mmap"};
+        printf("%d channels of %s, %g s at %g Hz.\n", opts.channels, opts.device, opts.duration, opts.rate);
+        printf("%-6s %10s %10s %12s %14s\n", "method", "wall (s)", "CPU (s)", "samples", "CPU (us/scan)");
+        for (int k=0; k<2; k++) {
+                for (uint r=0; r<opts.repetitions; r++) {
+                        double wall = 0, cpu = 0;
+                        size_t length = acquire(opts, k == 1, &wall, &cpu);
+                        if (length == 0) {
+                                Logger(Critical, "The acquisition with %s failed.\n", methods[k]);
+                                return 1;
+                        }
+                        printf("%-6s %10.3f %10.4f %12llu %14.3f\n", methods[k], wall, cpu,
+                                        (ullong) (length*opts.channels), 1e6*cpu/length);
+                }
+        }
+
+        return 0;
+}
+
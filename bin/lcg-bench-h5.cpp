@@ -0,0 +1,200 @@
+/*=========================================================================
+ *
+ *   Program:     lcg
+ *   Filename:    lcg-bench-h5.cpp
+ *
+ *   Copyright (C) 2012,2013,2014 Daniele Linaro
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *=========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <getopt.h>
+#include <vector>
+#include <string>
+#include "common.h"
+#include "types.h"
+#include "utils.h"
+#include "h5rec.h"
+using namespace lcg;
+
+struct options {
+        options() : channels(8), duration(10.), rate(20000.), resolution(0.01), keep(false) {
+                strncpy(filename, "lcg-bench-h5.h5", FILENAME_MAXLEN);
+        }
+        uint channels;
+        double duration, rate, resolution;
+        bool keep;
+        char filename[FILENAME_MAXLEN];
+};
+
+static struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"channels", required_argument, NULL, 'n'},
+        {"duration", required_argument, NULL, 'd'},
+        {"rate", required_argument, NULL, 'F'},
+        {"resolution", required_argument, NULL, 'r'},
+        {"output", required_argument, NULL, 'o'},
+        {"keep", no_argument, NULL, 'k'},
+        {NULL, 0, NULL, 0}
+};
+
+const char lcg_bench_h5_usage_string[] =
+        "This program measures the throughput of the compression filters available for H5 files.\n\n"
+        "Usage: lcg-bench-h5 [<options> ...]\n"
+        "where options are:\n"
+        "   -h, --help         Print this help message and exit.\n"
+        "   -n, --channels     Number of recorded channels (default 8).\n"
+        "   -d, --duration     Duration of the recording, in seconds (default 10).\n"
+        "   -F, --rate         Sampling rate, in Hz (default 20000).\n"
+        "   -r, --resolution   Resolution of the simulated ADC, in the units of the signal (default 0.01).\n"
+        "   -o, --output       Name of the temporary file (default lcg-bench-h5.h5).\n"
+        "   -k, --keep         Do not remove the file written with the last setting.\n";
+
+static void usage()
+{
+        printf("%s\n", lcg_bench_h5_usage_string);
+}
+
+static void parse_args(int argc, char *argv[], options *opts)
+{
+        int ch;
+        while ((ch = getopt_long(argc, argv, "hn:d:F:r:o:k", longopts, NULL)) != -1) {
+                switch(ch) {
+                case 'h':
+                        usage();
+                        exit(0);
+                case 'n':
+                        opts->channels = atoi(optarg);
+                        break;
+                case 'd':
+                        opts->duration = atof(optarg);
+                        break;
+                case 'F':
+                        opts->rate = atof(optarg);
+                        break;
+                case 'r':
+                        opts->resolution = atof(optarg);
+                        break;
+                case 'o':
+                        strncpy(opts->filename, optarg, sizeof(opts->filename)-1);
+                        opts->filename[sizeof(opts->filename)-1] = '\0';
+                        break;
+                case 'k':
+                        opts->keep = true;
+                        break;
+                default:
+                        Logger(Critical, "Enter 'lcg-bench-h5 -h' for help on how to run this program.\n");
+                        exit(1);
+                }
+        }
+        if (opts->channels == 0 || opts->duration <= 0 || opts->rate <= 0 || opts->resolution <= 0) {
+                Logger(Critical, "The number of channels, the duration, the rate and the resolution must be positive.\n");
+                exit(1);
+        }
+}
+
+/*
+ * A membrane potential-like trace: slow oscillations, noise and sparse spikes,
+ * quantized with the resolution of an ADC.
+ */
+static void make_signal(uint channel, double rate, double resolution, std::vector<double>& data)
+{
+        double v, noise = 0.;
+        srand(5061983 + channel);
+        for (size_t i=0; i<data.size(); i++) {
+                double t = i / rate;
+                noise = 0.95*noise + 0.5*((double) rand() / RAND_MAX - 0.5);
+                v = -65. + 3.*sin(2*M_PI*(2.+channel)*t) + noise;
+                if (i % (size_t) (rate/(5.+channel)) < (size_t) (rate*1e-3))
+                        v += 80.;
+                data[i] = resolution * round(v / resolution);
+        }
+}
+
+static double elapsed(const struct timespec& start, const struct timespec& stop)
+{
+        return (stop.tv_sec - start.tv_sec) + 1e-9*(stop.tv_nsec - start.tv_nsec);
+}
+
+int main(int argc, char *argv[])
+{
+        options opts;
+        parse_args(argc, argv, &opts);
+
+        size_t length = (size_t) (opts.duration * opts.rate);
+        std::vector< std::vector<double> > data(opts.channels, std::vector<double>(length));
+        for (uint i=0; i<opts.channels; i++)
+                make_signal(i, opts.rate, opts.resolution, data[i]);
+        double megabytes = (double) opts.channels * length * sizeof(double) / (1024.*1024.);
+
+        // the number of decimal digits that are preserved by the scale-offset filter
+        int digits = (int) ceil(-log10(opts.resolution));
+        if (digits < 0)
+                digits = 0;
+
+        std::vector< std::pair<compression_filter,int> > settings;
+        settings.push_back(std::make_pair(COMPRESSION_NONE, 0));
+        for (int level=1; level<=9; level+=2)
+                settings.push_back(std::make_pair(COMPRESSION_DEFLATE, level));
+        settings.push_back(std::make_pair(COMPRESSION_FAST, 0));
+        settings.push_back(std::make_pair(COMPRESSION_SCALE_OFFSET, digits));
+
+        // the data is written in blocks as large as the buffers of an H5Recorder
+        size_t block = 20480;
+        double_dict parameters;
+        printf("%d channels, %g s at %g Hz (%.1f MB of data).\n", opts.channels, opts.duration, opts.rate, megabytes);
+        printf("%-12s %6s %10s %10s %8s\n", "filter", "level", "time (s)", "MB/s", "ratio");
+        for (size_t k=0; k<settings.size(); k++) {
+                struct timespec start, stop;
+                struct stat st;
+                unlink(opts.filename);
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                {
+                        ChunkedH5Recorder rec(true, opts.filename);
+                        rec.setCompression(settings[k].first, settings[k].second);
+                        for (uint i=0; i<opts.channels; i++)
+                                rec.addRecord(i, "Channel", "mV", 0, parameters);
+                        for (size_t pos=0; pos<length; pos+=block) {
+                                size_t n = pos+block < length ? block : length-pos;
+                                for (uint i=0; i<opts.channels; i++)
+                                        rec.writeRecord(i, &data[i][pos], n);
+                        }
+                        rec.writeTimeStep(1./opts.rate);
+                        rec.writeRecordingDuration(opts.duration);
+                        if (rec.compressionFilter() != settings[k].first)
+                                printf("%-12s not available\n", CompressionFilterName(settings[k].first));
+                }
+                clock_gettime(CLOCK_MONOTONIC, &stop);
+                if (stat(opts.filename, &st) != 0) {
+                        Logger(Critical, "Unable to stat %s.\n", opts.filename);
+                        return 1;
+                }
+                double t = elapsed(start, stop);
+                printf("%-12s %6d %10.3f %10.1f %8.2f\n", CompressionFilterName(settings[k].first),
+                                settings[k].second, t, megabytes/t, megabytes*1024*1024/st.st_size);
+        }
+        if (!opts.keep)
+                unlink(opts.filename);
+
+        return 0;
+}
+
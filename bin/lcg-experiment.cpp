@@ -184,11 +184,59 @@ int parse_configuration_file(const std::string& filename,
                                 Logger(Info, "Using Runge-Kutta integration method.\n");
                                 lcg::SetIntegrationMethod(lcg::RK4);
                         }
+                        else if (ToUpper(algo).compare("EXPEULER") == 0 || ToUpper(algo).compare("RUSHLARSEN") == 0) {
+                                Logger(Info, "Using exponential Euler integration method.\n");
+                                lcg::SetIntegrationMethod(lcg::EXP_EULER);
+                        }
                         else {
                                 Logger(Important, "Unknown integration method [%s]: will use default.\n", algo.c_str());
                         }
                 } catch(...) {}
 
+                /*** what to do when the real-time loop misses a deadline ***/
+                try {
+                        std::string policy = pt.get<std::string>("lcg.simulation.deadline.policy");
+                        int maxLag = -1;
+                        try {
+                                maxLag = pt.get<int>("lcg.simulation.deadline.maxlag");
+                        } catch(...) {}
+                        if (ToUpper(policy).compare("CATCHUP") == 0) {
+                                SetDeadlineMissPolicy(DEADLINE_CATCH_UP, maxLag);
+                        }
+                        else if (ToUpper(policy).compare("SKIP") == 0) {
+                                SetDeadlineMissPolicy(DEADLINE_SKIP);
+                        }
+                        else if (ToUpper(policy).compare("ABORT") == 0) {
+                                SetDeadlineMissPolicy(DEADLINE_ABORT);
+                        }
+                        else {
+                                Logger(Important, "Unknown deadline miss policy [%s]: will use default.\n", policy.c_str());
+                        }
+                } catch(...) {}
+
+                /*** what paces the main loop ***/
+                try {
+                        std::string clock = pt.get<std::string>("lcg.simulation.clock.source");
+                        uint delay = 2;
+                        try {
+                                delay = pt.get<uint>("lcg.simulation.clock.delay");
+                        } catch(...) {}
+                        if (ToUpper(clock).compare("SOFTWARE") == 0) {
+                                SetLoopClock(LOOP_CLOCK_SOFTWARE);
+                        }
+                        else if (ToUpper(clock).compare("BOARD") == 0) {
+                                SetLoopClock(LOOP_CLOCK_BOARD, delay);
+                        }
+                        else {
+                                Logger(Important, "Unknown loop clock [%s]: will use default.\n", clock.c_str());
+                        }
+                } catch(...) {}
+
+                /*** number of threads used by the non real-time engine ***/
+                try {
+                        SetSimulationThreads(pt.get<int>("lcg.simulation.threads"));
+                } catch(...) {}
+
                 /*** output file name (makes sense only for streams) ***/
                 try {
                         outfilename = pt.get<std::string>("lcg.simulation.outfile");
@@ -61,7 +61,7 @@ AEC::AEC(const char *kernelFile)
                 fclose(fid);
                 m_withKernel = true;
         }
-        Logger(Debug, "The kernel has %d samples.\n", m_length);
+        Logger(Debug, "The kernel has %d samples.\n", (int) m_length);
 }
 
 AEC::AEC(const double *kernel, size_t kernelSize)
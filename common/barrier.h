@@ -0,0 +1,90 @@
+/*=========================================================================
+ *
+ *   Program:     lcg
+ *   Filename:    barrier.h
+ *
+ *   Copyright (C) 2012,2013,2014 Daniele Linaro
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *=========================================================================*/
+
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <sched.h>
+#include "types.h"
+
+/*!
+ * \file barrier.h
+ * \brief A barrier for synchronising the threads of a simulation.
+ */
+
+namespace lcg {
+
+/*!
+ * \class SpinBarrier
+ * \brief A reusable barrier for a fixed number of threads.
+ *
+ * Waiting threads spin for a short while before yielding the processor, which
+ * keeps the cost of a barrier low when it is crossed tens of thousands of times
+ * per second, as happens when the entities are stepped in parallel. The last
+ * thread that reaches the barrier can optionally execute an action before the
+ * others are released: the effects of the action are visible to all threads
+ * after they leave the barrier.
+ */
+class SpinBarrier {
+public:
+        /*! The type of the action executed by the last thread that reaches the barrier. */
+        typedef void (*action_t)(void *arg);
+
+        /*! \param count The number of threads that must call wait before they are all released. */
+        SpinBarrier(uint count)
+                : m_count(count), m_waiting(0), m_generation(0) {}
+
+        /*!
+         * Blocks until count threads have called this method.
+         * \param action An action executed only by the last thread to arrive, before all the threads are released.
+         * \param arg The argument passed to action.
+         * \return true in the thread that executed the action, false in the others.
+         */
+        bool wait(action_t action = NULL, void *arg = NULL) {
+                uint generation = m_generation;
+                if (__sync_add_and_fetch(&m_waiting, 1) == m_count) {
+                        if (action != NULL)
+                                action(arg);
+                        m_waiting = 0;
+                        __sync_fetch_and_add(&m_generation, 1);
+                        return true;
+                }
+                uint spins = 0;
+                while (m_generation == generation) {
+                        if (++spins >= MAX_SPINS)
+                                sched_yield();
+                }
+                __sync_synchronize();
+                return false;
+        }
+
+private:
+        static const uint MAX_SPINS = 4096;
+        const uint m_count;
+        volatile uint m_waiting;
+        volatile uint m_generation;
+};
+
+} // namespace lcg
+
+#endif // BARRIER_H
+
@@ -93,8 +93,11 @@ bool ComediAnalogIO::openDevice()
 
 bool ComediAnalogIO::closeDevice()
 {
-        if (m_device != NULL)
-                return comedi_close(m_device) == 0;
+        if (m_device != NULL) {
+                int retval = comedi_close(m_device);
+                m_device = NULL;
+                return retval == 0;
+        }
         return true;
 }
         
@@ -217,6 +220,550 @@ bool ComediAnalogIOSoftCal::readCalibration()
 
 //~~~
 
+std::map<std::string,ComediIOScheduler*> ComediIOScheduler::m_schedulers;
+bool ComediIOScheduler::m_concurrent = false;
+uint ComediIOScheduler::m_clockPeriod = 0;
+uint ComediIOScheduler::m_clockDelay = 0;
+
+ComediIOScheduler* ComediIOScheduler::acquire(const char *deviceFile)
+{
+        std::map<std::string,ComediIOScheduler*>::iterator it = m_schedulers.find(deviceFile);
+        if (it != m_schedulers.end()) {
+                it->second->m_references++;
+                return it->second;
+        }
+        ComediIOScheduler *scheduler = new ComediIOScheduler(deviceFile);
+        m_schedulers[deviceFile] = scheduler;
+        return scheduler;
+}
+
+void ComediIOScheduler::release(ComediIOScheduler *scheduler)
+{
+        if (--scheduler->m_references == 0) {
+                m_schedulers.erase(scheduler->m_deviceFile);
+                delete scheduler;
+        }
+}
+
+ComediIOScheduler::ComediIOScheduler(const char *deviceFile)
+        : m_deviceFile(deviceFile), m_device(NULL), m_references(1),
+          m_stepping(false), m_acquired(false), m_clocked(false), m_underrun(false),
+          m_inputSubdevice(0), m_outputSubdevice(0), m_inputSampleSize(0), m_outputSampleSize(0)
+{
+        m_device = comedi_open(deviceFile);
+        if (m_device == NULL) {
+                comedi_perror(deviceFile);
+                throw "Unable to open communication with the DAQ board.";
+        }
+        pthread_mutex_init(&m_mutex, NULL);
+}
+
+ComediIOScheduler::~ComediIOScheduler()
+{
+        if (m_clocked)
+                stopCommands();
+        flush();
+        comedi_close(m_device);
+        pthread_mutex_destroy(&m_mutex);
+}
+
+int ComediIOScheduler::addInput(uint subdevice, uint channel, uint range, uint aref,
+                                const comedi_polynomial_t *converter, double conversionFactor)
+{
+        InputSlot slot;
+        slot.active = true;
+        memset(&slot.instruction, 0, sizeof(comedi_insn));
+        slot.instruction.insn = INSN_READ;
+        slot.instruction.n = 1;
+        slot.instruction.subdev = subdevice;
+        slot.instruction.chanspec = CR_PACK(channel, range, aref);
+        for (uint i=0; i<COMEDI_MAX_NUM_POLYNOMIAL_COEFFICIENTS; i++)
+                slot.coefficients[i] = converter->coefficients[i];
+        slot.order = converter->order;
+        slot.origin = converter->expansion_origin;
+        slot.conversionFactor = conversionFactor;
+        m_inputs.push_back(slot);
+        m_values.push_back(0.0);
+        buildInstructions();
+        return m_inputs.size() - 1;
+}
+
+int ComediIOScheduler::addOutput(uint subdevice, uint channel, uint range, uint aref)
+{
+        OutputSlot slot;
+        slot.active = true;
+        slot.staged = false;
+        memset(&slot.instruction, 0, sizeof(comedi_insn));
+        slot.instruction.insn = INSN_WRITE;
+        slot.instruction.n = 1;
+        slot.instruction.subdev = subdevice;
+        slot.instruction.chanspec = CR_PACK(channel, range, aref);
+        m_outputs.push_back(slot);
+        m_outputSamples.push_back(0);
+        buildInstructions();
+        return m_outputs.size() - 1;
+}
+
+void ComediIOScheduler::removeInput(int slot)
+{
+        m_inputs[slot].active = false;
+        buildInstructions();
+}
+
+void ComediIOScheduler::removeOutput(int slot)
+{
+        if (m_outputs[slot].staged)
+                flush();
+        m_outputs[slot].active = false;
+        buildInstructions();
+}
+
+void ComediIOScheduler::buildInstructions()
+{
+        size_t i;
+        m_readInstructions.clear();
+        m_readSlots.clear();
+        for (i=0; i<m_inputs.size(); i++) {
+                if (m_inputs[i].active) {
+                        m_readInstructions.push_back(m_inputs[i].instruction);
+                        m_readSlots.push_back(i);
+                }
+        }
+        m_inputSamples.resize(m_readInstructions.size());
+        for (i=0; i<m_readInstructions.size(); i++)
+                m_readInstructions[i].data = &m_inputSamples[i];
+        m_writeSlots.clear();
+        for (i=0; i<m_outputs.size(); i++) {
+                m_outputs[i].instruction.data = &m_outputSamples[i];
+                if (m_outputs[i].active)
+                        m_writeSlots.push_back(i);
+        }
+        // the transfers must not allocate memory
+        m_instructions.resize(m_outputs.size() + m_readInstructions.size());
+}
+
+bool ComediIOScheduler::transfer(bool readInputs)
+{
+        size_t i, n = 0;
+        comedi_insnlist list;
+
+        for (i=0; i<m_outputs.size(); i++) {
+                if (m_outputs[i].staged) {
+                        m_instructions[n++] = m_outputs[i].instruction;
+                        m_outputs[i].staged = false;
+                }
+        }
+        if (readInputs) {
+                for (i=0; i<m_readInstructions.size(); i++)
+                        m_instructions[n++] = m_readInstructions[i];
+        }
+        if (n == 0)
+                return true;
+
+        list.n_insns = n;
+        list.insns = &m_instructions[0];
+        if (comedi_do_insnlist(m_device, &list) != (int) n) {
+                Logger(Critical, "comedi_do_insnlist: %s.\n", comedi_strerror(comedi_errno()));
+                return false;
+        }
+
+        if (readInputs)
+                convertInputs();
+        return true;
+}
+
+void ComediIOScheduler::convertInputs()
+{
+        size_t i, j;
+        // same as comedi_to_physical, for all the channels at once
+        for (i=0; i<m_readSlots.size(); i++) {
+                InputSlot& slot = m_inputs[m_readSlots[i]];
+                double x = (double) m_inputSamples[i] - slot.origin;
+                double value = slot.coefficients[slot.order];
+                for (j=slot.order; j>0; j--)
+                        value = value*x + slot.coefficients[j-1];
+                m_values[m_readSlots[i]] = value * slot.conversionFactor;
+        }
+}
+
+double ComediIOScheduler::read(int slot)
+{
+        double value;
+        if (m_concurrent)
+                pthread_mutex_lock(&m_mutex);
+        // the first read of a step also sends the samples written before it, as separate
+        // reads and writes would do; when the device is clocked, WaitForScan acquires the inputs
+        if (!m_acquired && !m_clocked) {
+                transfer(true);
+                m_acquired = m_stepping;
+        }
+        value = m_values[slot];
+        if (m_concurrent)
+                pthread_mutex_unlock(&m_mutex);
+        return value;
+}
+
+void ComediIOScheduler::write(int slot, lsampl_t sample)
+{
+        if (m_concurrent)
+                pthread_mutex_lock(&m_mutex);
+        m_outputSamples[slot] = sample;
+        m_outputs[slot].staged = true;
+        if (m_concurrent)
+                pthread_mutex_unlock(&m_mutex);
+}
+
+bool ComediIOScheduler::flush()
+{
+        bool retval = true;
+        if (m_concurrent)
+                pthread_mutex_lock(&m_mutex);
+        // when the device is clocked, the outputs are sent with the next scan
+        if (!m_clocked)
+                retval = transfer(false);
+        if (m_concurrent)
+                pthread_mutex_unlock(&m_mutex);
+        return retval;
+}
+
+void ComediIOScheduler::BeginStep()
+{
+        std::map<std::string,ComediIOScheduler*>::iterator it;
+        for (it=m_schedulers.begin(); it!=m_schedulers.end(); it++) {
+                it->second->m_stepping = true;
+                it->second->m_acquired = false;
+        }
+}
+
+bool ComediIOScheduler::EndStep()
+{
+        std::map<std::string,ComediIOScheduler*>::iterator it;
+        bool retval = true;
+        for (it=m_schedulers.begin(); it!=m_schedulers.end(); it++) {
+                ComediIOScheduler *scheduler = it->second;
+                scheduler->m_stepping = false;
+                scheduler->m_acquired = false;
+                retval = scheduler->flush() && retval;
+        }
+        return retval;
+}
+
+void ComediIOScheduler::SetConcurrent(bool concurrent)
+{
+        m_concurrent = concurrent;
+}
+
+bool ComediIOScheduler::StartClock(double period, uint delay)
+{
+        std::map<std::string,ComediIOScheduler*>::iterator it;
+        bool inputs = false;
+        if (delay == 0) {
+                Logger(Important, "The outputs must lag behind the inputs by at least one scan.\n");
+                delay = 1;
+        }
+        for (it=m_schedulers.begin(); it!=m_schedulers.end(); it++)
+                inputs = inputs || !it->second->m_readSlots.empty();
+        if (!inputs) {
+                Logger(Critical, "The clock of the boards requires at least one analog input.\n");
+                return false;
+        }
+        m_clockPeriod = (uint) (period * NSEC_PER_SEC + 0.5);
+        m_clockDelay = delay;
+        if (!startAllCommands())
+                return false;
+        Logger(Info, "The loop is clocked by the boards, with a period of %g ms.\n", m_clockPeriod*1e-6);
+        return true;
+}
+
+bool ComediIOScheduler::startAllCommands()
+{
+        std::map<std::string,ComediIOScheduler*>::iterator it;
+        for (it=m_schedulers.begin(); it!=m_schedulers.end(); it++) {
+                if (!it->second->startCommands(m_clockPeriod, m_clockDelay)) {
+                        StopClock();
+                        return false;
+                }
+        }
+
+        // the commands of all the devices are started together
+        for (it=m_schedulers.begin(); it!=m_schedulers.end(); it++) {
+                ComediIOScheduler *scheduler = it->second;
+                comedi_insn instructions[2];
+                lsampl_t data = 0;
+                comedi_insnlist list;
+                list.n_insns = 0;
+                list.insns = instructions;
+                if (!scheduler->m_readSlots.empty())
+                        instructions[list.n_insns++].subdev = scheduler->m_inputSubdevice;
+                if (!scheduler->m_writeSlots.empty())
+                        instructions[list.n_insns++].subdev = scheduler->m_outputSubdevice;
+                for (uint i=0; i<list.n_insns; i++) {
+                        instructions[i].insn = INSN_INTTRIG;
+                        instructions[i].n = 1;
+                        instructions[i].data = &data;
+                        instructions[i].chanspec = 0;
+                }
+                if (list.n_insns > 0 && comedi_do_insnlist(scheduler->m_device, &list) != (int) list.n_insns) {
+                        Logger(Critical, "Unable to start the commands of device [%s]: %s.\n",
+                                        scheduler->m_deviceFile.c_str(), comedi_strerror(comedi_errno()));
+                        StopClock();
+                        return false;
+                }
+        }
+
+        // the first scan is the one that the caller processes first
+        for (it=m_schedulers.begin(); it!=m_schedulers.end(); it++) {
+                if (it->second->m_clocked && it->second->receiveScan() < 0) {
+                        StopClock();
+                        return false;
+                }
+        }
+        return true;
+}
+
+int ComediIOScheduler::WaitForScan(bool *underrun)
+{
+        std::map<std::string,ComediIOScheduler*>::iterator it;
+        int backlog, lag = 0;
+        for (it=m_schedulers.begin(); it!=m_schedulers.end(); it++) {
+                ComediIOScheduler *scheduler = it->second;
+                if (!scheduler->m_clocked)
+                        continue;
+                if (!scheduler->sendScan() || (backlog = scheduler->receiveScan()) < 0)
+                        return -1;
+                if (backlog > lag)
+                        lag = backlog;
+        }
+        if (underrun != NULL) {
+                *underrun = false;
+                for (it=m_schedulers.begin(); it!=m_schedulers.end(); it++) {
+                        ComediIOScheduler *scheduler = it->second;
+                        if (!scheduler->m_clocked || scheduler->m_writeSlots.empty())
+                                continue;
+                        // the output commands can run out of samples only if the caller fell behind
+                        // by about as many scans as they were ahead of the inputs
+                        if (!scheduler->m_underrun && lag+1 >= (int) m_clockDelay && !scheduler->outputRunning())
+                                scheduler->m_underrun = true;
+                        *underrun = *underrun || scheduler->m_underrun;
+                }
+        }
+        return lag;
+}
+
+bool ComediIOScheduler::SkipScans(uint n)
+{
+        for (uint i=0; i<n; i++) {
+                if (WaitForScan() < 0)
+                        return false;
+        }
+        return true;
+}
+
+int ComediIOScheduler::ResyncOutputs()
+{
+        std::map<std::string,ComediIOScheduler*>::iterator it;
+        int contents, lag = 0;
+        for (it=m_schedulers.begin(); it!=m_schedulers.end(); it++) {
+                ComediIOScheduler *scheduler = it->second;
+                if (!scheduler->m_clocked || scheduler->m_readSlots.empty())
+                        continue;
+                contents = comedi_get_buffer_contents(scheduler->m_device, scheduler->m_inputSubdevice);
+                if (contents > 0 && contents / (int) scheduler->m_inputScan.size() > lag)
+                        lag = contents / scheduler->m_inputScan.size();
+        }
+        // an output command restarted on its own would not be in phase with the scans of the inputs:
+        // all the commands are restarted together instead, as by StartClock, and the scans that are
+        // waiting are discarded
+        StopClock();
+        if (!startAllCommands())
+                return -1;
+        Logger(Debug, "Restarted the commands of all the devices, discarding %d scans.\n", lag);
+        return lag;
+}
+
+void ComediIOScheduler::StopClock()
+{
+        std::map<std::string,ComediIOScheduler*>::iterator it;
+        for (it=m_schedulers.begin(); it!=m_schedulers.end(); it++) {
+                if (it->second->m_clocked)
+                        it->second->stopCommands();
+        }
+}
+
+/*!
+ * Prepares a command that samples the given channels of a subdevice every period ns.
+ * \return The size of the samples of the subdevice, or 0 on failure.
+ */
+static int PrepareCommand(comedi_t *device, uint subdevice, comedi_cmd *cmd,
+                          std::vector<uint>& chanlist, uint period)
+{
+        memset(cmd, 0, sizeof(comedi_cmd));
+        if (comedi_get_cmd_generic_timed(device, subdevice, cmd, chanlist.size(), period) < 0) {
+                Logger(Critical, "comedi_get_cmd_generic_timed: %s.\n", comedi_strerror(comedi_errno()));
+                return 0;
+        }
+        cmd->chanlist = &chanlist[0];
+        cmd->chanlist_len = chanlist.size();
+        cmd->start_src = TRIG_INT;
+        cmd->start_arg = 0;
+        cmd->stop_src = TRIG_NONE;
+        cmd->stop_arg = 0;
+        // the samples must be available as soon as each scan ends
+        cmd->flags |= TRIG_WAKE_EOS;
+        if (comedi_command_test(device, cmd) < 0 && comedi_command_test(device, cmd) < 0) {
+                Logger(Critical, "Unable to setup the command of subdevice %d.\n", subdevice);
+                return 0;
+        }
+        DumpCommand(Debug, cmd);
+        if (cmd->scan_begin_src != TRIG_TIMER || cmd->scan_begin_arg != period) {
+                Logger(Critical, "Subdevice %d cannot scan its channels every %d ns.\n", subdevice, period);
+                return 0;
+        }
+        return (comedi_get_subdevice_flags(device, subdevice) & SDF_LSAMPL) ? sizeof(lsampl_t) : sizeof(sampl_t);
+}
+
+bool ComediIOScheduler::startCommands(uint period, uint delay)
+{
+        std::vector<uint> chanlist;
+        comedi_cmd cmd;
+        size_t i;
+
+        if (!m_readSlots.empty()) {
+                m_inputSubdevice = m_readInstructions[0].subdev;
+                for (i=0; i<m_readInstructions.size(); i++) {
+                        if (m_readInstructions[i].subdev != m_inputSubdevice) {
+                                Logger(Critical, "The analog inputs of device [%s] are on different subdevices.\n",
+                                                m_deviceFile.c_str());
+                                return false;
+                        }
+                        chanlist.push_back(m_readInstructions[i].chanspec);
+                }
+                if ((m_inputSampleSize = PrepareCommand(m_device, m_inputSubdevice, &cmd, chanlist, period)) == 0)
+                        return false;
+                if (comedi_command(m_device, &cmd) < 0) {
+                        Logger(Critical, "Unable to issue the command of subdevice %d: %s.\n",
+                                        m_inputSubdevice, comedi_strerror(comedi_errno()));
+                        return false;
+                }
+                m_inputScan.resize(m_readSlots.size() * m_inputSampleSize);
+                // from now on, the inputs cannot be read with instructions
+                m_clocked = true;
+        }
+
+        m_underrun = false;
+        if (!m_writeSlots.empty()) {
+                m_outputSubdevice = m_outputs[m_writeSlots[0]].instruction.subdev;
+                chanlist.clear();
+                for (i=0; i<m_writeSlots.size(); i++) {
+                        const comedi_insn& instruction = m_outputs[m_writeSlots[i]].instruction;
+                        if (instruction.subdev != m_outputSubdevice) {
+                                Logger(Critical, "The analog outputs of device [%s] are on different subdevices.\n",
+                                                m_deviceFile.c_str());
+                                return false;
+                        }
+                        chanlist.push_back(instruction.chanspec);
+                }
+                if ((m_outputSampleSize = PrepareCommand(m_device, m_outputSubdevice, &cmd, chanlist, period)) == 0)
+                        return false;
+                if (comedi_command(m_device, &cmd) < 0) {
+                        Logger(Critical, "Unable to issue the command of subdevice %d: %s.\n",
+                                        m_outputSubdevice, comedi_strerror(comedi_errno()));
+                        return false;
+                }
+                m_outputScan.resize(m_writeSlots.size() * m_outputSampleSize);
+                m_clocked = true;
+                // the outputs hold their current values until the first samples written by the caller are generated
+                for (i=0; i<delay; i++) {
+                        if (!sendScan())
+                                return false;
+                }
+        }
+
+        for (i=0; i<m_outputs.size(); i++)
+                m_outputs[i].staged = false;
+        Logger(Debug, "Started the commands of device [%s].\n", m_deviceFile.c_str());
+        return true;
+}
+
+bool ComediIOScheduler::outputRunning()
+{
+        int flags = comedi_get_subdevice_flags(m_device, m_outputSubdevice);
+        return flags >= 0 && (flags & SDF_RUNNING);
+}
+
+bool ComediIOScheduler::sendScan()
+{
+        size_t i, length, written = 0;
+        ssize_t n;
+        // the samples of a stopped output command are dropped until ResyncOutputs restarts it
+        if (m_writeSlots.empty() || m_underrun)
+                return true;
+        for (i=0; i<m_writeSlots.size(); i++) {
+                if (m_outputSampleSize == sizeof(lsampl_t))
+                        ((lsampl_t *) &m_outputScan[0])[i] = m_outputSamples[m_writeSlots[i]];
+                else
+                        ((sampl_t *) &m_outputScan[0])[i] = (sampl_t) m_outputSamples[m_writeSlots[i]];
+        }
+        length = m_outputScan.size();
+        while (written < length) {
+                n = ::write(comedi_fileno(m_device), &m_outputScan[written], length - written);
+                if (n == 0 || (n < 0 && errno == EPIPE)) {
+                        // the output command ran out of samples
+                        m_underrun = true;
+                        break;
+                }
+                if (n <= 0) {
+                        Logger(Critical, "Unable to write a scan to device [%s]: %s.\n",
+                                        m_deviceFile.c_str(), n < 0 ? strerror(errno) : "the output stopped");
+                        return false;
+                }
+                written += n;
+        }
+        for (i=0; i<m_outputs.size(); i++)
+                m_outputs[i].staged = false;
+        return true;
+}
+
+int ComediIOScheduler::receiveScan()
+{
+        size_t i, length, received = 0;
+        ssize_t n;
+        int contents;
+        if (m_readSlots.empty())
+                return 0;
+        length = m_inputScan.size();
+        while (received < length) {
+                n = ::read(comedi_fileno(m_device), &m_inputScan[received], length - received);
+                if (n <= 0) {
+                        Logger(Critical, "Unable to read a scan from device [%s]: %s.\n",
+                                        m_deviceFile.c_str(), n < 0 ? strerror(errno) : "the acquisition stopped");
+                        return -1;
+                }
+                received += n;
+        }
+        for (i=0; i<m_readSlots.size(); i++) {
+                if (m_inputSampleSize == sizeof(lsampl_t))
+                        m_inputSamples[i] = ((lsampl_t *) &m_inputScan[0])[i];
+                else
+                        m_inputSamples[i] = ((sampl_t *) &m_inputScan[0])[i];
+        }
+        convertInputs();
+        contents = comedi_get_buffer_contents(m_device, m_inputSubdevice);
+        return contents > 0 ? contents / length : 0;
+}
+
+void ComediIOScheduler::stopCommands()
+{
+        if (!m_readSlots.empty())
+                comedi_cancel(m_device, m_inputSubdevice);
+        if (!m_writeSlots.empty())
+                comedi_cancel(m_device, m_outputSubdevice);
+        m_clocked = false;
+        Logger(Debug, "Stopped the commands of device [%s].\n", m_deviceFile.c_str());
+}
+
+//~~~
+
 ComediAnalogInputSoftCal::ComediAnalogInputSoftCal(const char *deviceFile, uint inputSubdevice,
                                                    uint readChannel, double inputConversionFactor,
                                                    uint range, uint aref)
@@ -230,10 +777,15 @@ ComediAnalogInputSoftCal::ComediAnalogInputSoftCal(const char *deviceFile, uint
                 Logger(Critical, "comedi_get_softcal_converter: %s.\n", comedi_strerror(comedi_errno()));
                 throw "Error in comedi_get_softcal_converter()";
         }
+        m_scheduler = ComediIOScheduler::acquire(m_deviceFile);
+        m_slot = m_scheduler->addInput(m_subdevice, m_channels[0], m_range, m_aref,
+                        &m_converter, m_inputConversionFactor);
 }
 
 ComediAnalogInputSoftCal::~ComediAnalogInputSoftCal()
 {
+        m_scheduler->removeInput(m_slot);
+        ComediIOScheduler::release(m_scheduler);
 }
 
 bool ComediAnalogInputSoftCal::initialise()
@@ -248,9 +800,7 @@ double ComediAnalogInputSoftCal::inputConversionFactor() const
 
 double ComediAnalogInputSoftCal::read()
 {
-        lsampl_t sample;
-        comedi_data_read(m_device, m_subdevice, m_channels[0], m_range, m_aref, &sample);
-        return comedi_to_physical(sample, &m_converter) * m_inputConversionFactor;
+        return m_scheduler->read(m_slot);
 }
 
 //~~~
@@ -271,7 +821,7 @@ ComediAnalogOutputSoftCal::ComediAnalogOutputSoftCal(const char *deviceFile, uin
 #ifdef TRIM_ANALOG_OUTPUT
         // get physical data range for subdevice (min, max, phys. units)
         m_dataRange = comedi_get_range(m_device, m_subdevice, m_channels[0], m_range);
-        Logger(Debug, "Range for 0x%x (%s):\n\tmin = %g\n\tmax = %g\n", m_dataRange,
+        Logger(Debug, "Range for %p (%s):\n\tmin = %g\n\tmax = %g\n", (void *) m_dataRange,
                         (m_dataRange->unit == UNIT_volt ? "volts" : "milliamps"),
                         m_dataRange->min, m_dataRange->max);
         if(m_dataRange == NULL) {
@@ -279,18 +829,26 @@ ComediAnalogOutputSoftCal::ComediAnalogOutputSoftCal(const char *deviceFile, uin
                 throw "Error in comedi_get_range()";
         }
 #endif
+        m_scheduler = ComediIOScheduler::acquire(m_deviceFile);
+        m_slot = m_scheduler->addOutput(m_subdevice, m_channels[0], m_range, m_aref);
 }
 
 ComediAnalogOutputSoftCal::~ComediAnalogOutputSoftCal()
 {
-        if (m_resetOutput)
+        if (m_resetOutput) {
                 write(0.0);
+                flush();
+        }
+        m_scheduler->removeOutput(m_slot);
+        ComediIOScheduler::release(m_scheduler);
 }
 
 bool ComediAnalogOutputSoftCal::initialise()
 {
-        if (m_resetOutput)
+        if (m_resetOutput) {
                 write(0.0);
+                flush();
+        }
         return true;
 }
 
@@ -312,8 +870,12 @@ void ComediAnalogOutputSoftCal::write(double data)
 		//Logger(Debug, "[%f] - Trimming upper limit of the DAQ card.\n", GetGlobalTime());
 	}
 #endif
-        comedi_data_write(m_device, m_subdevice, m_channels[0], m_range, m_aref,
-                comedi_from_physical(sample, &m_converter));
+        m_scheduler->write(m_slot, comedi_from_physical(sample, &m_converter));
+}
+
+void ComediAnalogOutputSoftCal::flush()
+{
+        m_scheduler->flush();
 }
 
 //~~~
@@ -331,7 +893,7 @@ bool ComediAnalogInputHardCal::initialise()
 {
         // get physical data range for subdevice (min, max, phys. units)
         m_dataRange = comedi_get_range(m_device, m_subdevice, m_channels[0], m_range);
-        Logger(Debug, "Range for 0x%x (%s):\n\tmin = %g\n\tmax = %g\n", m_dataRange,
+        Logger(Debug, "Range for %p (%s):\n\tmin = %g\n\tmax = %g\n", (void *) m_dataRange,
                         (m_dataRange->unit == UNIT_volt ? "volts" : "milliamps"),
                         m_dataRange->min, m_dataRange->max);
         if(m_dataRange == NULL) {
@@ -342,7 +904,7 @@ bool ComediAnalogInputHardCal::initialise()
         
         // read max data value
         m_maxData = comedi_get_maxdata(m_device, m_subdevice, m_channels[0]);
-        Logger(Debug, "Max data = %ld\n", m_maxData);
+        Logger(Debug, "Max data = %ld\n", (long) m_maxData);
 }
 
 double ComediAnalogInputHardCal::inputConversionFactor() const
@@ -380,7 +942,7 @@ bool ComediAnalogOutputHardCal::initialise()
 {
         // get physical data range for subdevice (min, max, phys. units)
         m_dataRange = comedi_get_range(m_device, m_subdevice, m_channels[0], m_range);
-        Logger(Debug, "Range for 0x%x (%s):\n\tmin = %g\n\tmax = %g\n", m_dataRange,
+        Logger(Debug, "Range for %p (%s):\n\tmin = %g\n\tmax = %g\n", (void *) m_dataRange,
                         (m_dataRange->unit == UNIT_volt ? "volts" : "milliamps"),
                         m_dataRange->min, m_dataRange->max);
         if(m_dataRange == NULL) {
@@ -391,7 +953,7 @@ bool ComediAnalogOutputHardCal::initialise()
         
         // read max data value
         m_maxData = comedi_get_maxdata(m_device, m_subdevice, m_channels[0]);
-        Logger(Debug, "Max data = %ld\n", m_maxData);
+        Logger(Debug, "Max data = %ld\n", (long) m_maxData);
 }
 
 double ComediAnalogOutputHardCal::outputConversionFactor() const
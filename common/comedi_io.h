@@ -30,6 +30,8 @@
 #ifdef HAVE_LIBCOMEDI
 #include <string>
 #include <map>
+#include <vector>
+#include <pthread.h>
 #include <comedilib.h>
 #include "types.h"
 #include "entity.h"
@@ -104,6 +106,164 @@ protected:
         comedi_calibration_t *m_calibration;
 };
 
+/**
+ * \brief Groups the analog reads and writes of a step on a device into instruction lists.
+ *
+ * The scheduler of a device is shared by all the ComediAnalogInputSoftCal and
+ * ComediAnalogOutputSoftCal objects that use the same device file, each of which
+ * registers its channel with it. Written samples are staged. Within a step of the
+ * engine, delimited by BeginStep and EndStep, the first read of a channel issues a
+ * single call to comedi_do_insnlist that sends the samples staged so far and then
+ * reads all the input channels, whose samples are converted to physical units in one
+ * pass and returned by the other reads of the step; EndStep sends the samples written
+ * after that, as soon as all the entities have been stepped. The outputs are therefore
+ * updated and the inputs sampled at the same points of the period as when every channel
+ * issues its own read and write. Outside of a step, every read acquires new samples
+ * and the staged samples are sent by flush.
+ *
+ * Between StartClock and StopClock, the channels of all the devices are instead
+ * sampled by Comedi commands, timed by the scan clock of the boards: WaitForScan
+ * blocks until every device has acquired its next scan of the input channels,
+ * which is then returned by read, and sends to the boards the samples written
+ * since the previous scan. The output commands are preloaded with a number of
+ * scans, so that a sample written after a scan is generated that number of scans
+ * later. If the caller falls behind by as many scans, the output commands run out
+ * of samples and stop: ResyncOutputs then restarts all the commands, so that the
+ * outputs lag behind the inputs by the same number of scans as before. The input
+ * channels of a device must be on the same subdevice, as must its output channels,
+ * and the subdevices cannot be used by other instructions while they are clocked.
+ */
+class ComediIOScheduler {
+public:
+        /*! Returns the scheduler of a device, creating it if necessary. */
+        static ComediIOScheduler* acquire(const char *deviceFile);
+        /*! Releases a scheduler obtained with acquire, which is destroyed when it is no longer used. */
+        static void release(ComediIOScheduler *scheduler);
+
+        /*!
+         * Starts the commands that sample the channels of all the devices every period seconds
+         * and waits for the first scan.
+         * \param period The interval between consecutive scans, which the boards must be able to generate exactly.
+         * \param delay The number of scans by which the outputs lag behind the inputs: at least 1.
+         *              The outputs run out of samples when the caller lags behind by delay scans.
+         * \return false if the commands could not be started on all the devices, which are then left unclocked.
+         */
+        static bool StartClock(double period, uint delay = 2);
+        /*!
+         * Sends the samples written since the previous scan and waits for the next scan of the inputs.
+         * \param underrun If not NULL, set to whether the output command of a device ran out of samples.
+         * \return The number of scans that were already waiting after this one, i.e., by how many periods
+         *         the caller lags behind the boards, or -1 if the acquisition stopped.
+         */
+        static int WaitForScan(bool *underrun = NULL);
+        /*! Discards the next n scans of the inputs, while the outputs hold their last value. */
+        static bool SkipScans(uint n);
+        /*!
+         * Restarts the commands of all the devices after an output command ran out of samples, so that
+         * the outputs lag behind the inputs by the delay passed to StartClock again, and waits for the
+         * first scan. The scans of the inputs that were waiting are discarded and the outputs hold their
+         * last value until the samples written after the first scan are generated.
+         * \return The number of scans that were discarded, or -1 if the commands could not be restarted.
+         */
+        static int ResyncOutputs();
+        /*! Stops the commands started by StartClock. */
+        static void StopClock();
+
+        /*! Marks the beginning of a step: the inputs of each device are then read once, by the first read. */
+        static void BeginStep();
+        /*! Marks the end of a step and sends to all the devices the samples that are still staged. */
+        static bool EndStep();
+        /*!
+         * Tells whether the entities are stepped by more than one thread: only then are the reads and
+         * writes of a device serialised, so that the single-threaded engines do not take a lock per sample.
+         */
+        static void SetConcurrent(bool concurrent);
+
+        /*! Registers an input channel and returns the slot that identifies it. */
+        int addInput(uint subdevice, uint channel, uint range, uint aref,
+                     const comedi_polynomial_t *converter, double conversionFactor);
+        /*! Registers an output channel and returns the slot that identifies it. */
+        int addOutput(uint subdevice, uint channel, uint range, uint aref);
+        void removeInput(int slot);
+        void removeOutput(int slot);
+
+        /*! Returns the value of an input channel acquired in the current step, in physical units. */
+        double read(int slot);
+        /*! Stages a sample for an output channel, which is sent by EndStep or flush. */
+        void write(int slot, lsampl_t sample);
+        /*! Sends the staged samples without reading the input channels. */
+        bool flush();
+
+private:
+        struct InputSlot {
+                bool active;
+                comedi_insn instruction;
+                double coefficients[COMEDI_MAX_NUM_POLYNOMIAL_COEFFICIENTS];
+                uint order;
+                double origin;
+                double conversionFactor;
+        };
+        struct OutputSlot {
+                bool active;
+                bool staged;
+                comedi_insn instruction;
+        };
+
+        ComediIOScheduler(const char *deviceFile);
+        ~ComediIOScheduler();
+        void buildInstructions();
+        bool transfer(bool readInputs);
+        /*! Converts m_inputSamples to physical units. */
+        void convertInputs();
+
+        /*! Starts the commands of all the devices with m_clockPeriod and m_clockDelay and waits for the first scan. */
+        static bool startAllCommands();
+        bool startCommands(uint period, uint delay);
+        /*! Returns false if the output command stopped because it ran out of samples. */
+        bool outputRunning();
+        bool sendScan();
+        /*! Reads a scan of the inputs and returns the number of complete scans that remain in the buffer. */
+        int receiveScan();
+        void stopCommands();
+
+private:
+        static std::map<std::string,ComediIOScheduler*> m_schedulers;
+        /*! Whether read, write and flush can be called by different threads at the same time. */
+        static bool m_concurrent;
+        /*! The period (in ns) and the delay of the outputs passed to StartClock. */
+        static uint m_clockPeriod, m_clockDelay;
+
+        std::string m_deviceFile;
+        comedi_t *m_device;
+        uint m_references;
+        std::vector<InputSlot> m_inputs;
+        std::vector<OutputSlot> m_outputs;
+        /*! The instructions that read the active input channels. */
+        std::vector<comedi_insn> m_readInstructions;
+        /*! The instructions of a transfer: the staged writes followed by the reads. */
+        std::vector<comedi_insn> m_instructions;
+        /*! For each instruction in m_readInstructions, the slot of the corresponding input. */
+        std::vector<int> m_readSlots;
+        std::vector<lsampl_t> m_inputSamples;
+        std::vector<lsampl_t> m_outputSamples;
+        /*! The values of the inputs, in physical units, already multiplied by the conversion factors. */
+        std::vector<double> m_values;
+        /*! Whether a step is in progress and whether the inputs have already been read in it. */
+        bool m_stepping, m_acquired;
+        /*! Serialises the reads and writes of entities that are stepped by different threads, if m_concurrent. */
+        pthread_mutex_t m_mutex;
+        /*! For each active output, in the order of the output command, the corresponding slot. */
+        std::vector<int> m_writeSlots;
+        /*! Whether the channels are sampled by the commands started by StartClock. */
+        bool m_clocked;
+        /*! Whether the output command ran out of samples: no scans are sent until it is restarted. */
+        bool m_underrun;
+        uint m_inputSubdevice, m_outputSubdevice;
+        int m_inputSampleSize, m_outputSampleSize;
+        /*! The raw samples of a scan, as they are read from and written to the device. */
+        std::vector<char> m_inputScan, m_outputScan;
+};
+
 /**
  * \brief Class for analog input from a single channel with software calibration.
  */
@@ -120,6 +280,8 @@ public:
 private:
         comedi_polynomial_t m_converter;
         double m_inputConversionFactor;
+        ComediIOScheduler *m_scheduler;
+        int m_slot;
 };
 
 /**
@@ -133,7 +295,10 @@ public:
         ~ComediAnalogOutputSoftCal();
         bool initialise();
         double outputConversionFactor() const;
+        /*! Writes a value, which is sent to the device with the next transfer of its scheduler. */
         void write(double data);
+        /*! Sends to the device the values written to all the output channels of the device. */
+        void flush();
 private:
         comedi_polynomial_t m_converter;
 #ifdef TRIM_ANALOG_OUTPUT
@@ -141,6 +306,8 @@ private:
 #endif
         double m_outputConversionFactor;
         bool m_resetOutput;
+        ComediIOScheduler *m_scheduler;
+        int m_slot;
 };
 
 /**
@@ -1,3 +1,4 @@
+#include <math.h>
 #include <algorithm>
 #include "h5rec.h"
 #include "utils.h"
@@ -6,6 +7,90 @@ namespace lcg {
 
 const hsize_t H5RecorderCore::unlimitedSize = H5S_UNLIMITED;
 const double  H5RecorderCore::fillValue     = 0.0;
+const int     H5RecorderCore::defaultDeflateLevel      = 9;
+const int     H5RecorderCore::defaultScaleOffsetDigits = 3;
+const H5Z_filter_t H5RecorderCore::lz4Filter  = 32004;
+const hsize_t H5RecorderCore::minChunkSize         = 1024;
+const hsize_t H5RecorderCore::fullTraceChunkBytes  = 1024*1024;
+const hsize_t H5RecorderCore::timeWindowChunkBytes = 64*1024;
+const hsize_t H5RecorderCore::maxBuffersMemory     = 64*1024*1024;
+
+bool ParseCompressionFilter(const std::string& name, compression_filter *filter)
+{
+        std::string str(name);
+        str = ToLower(str);
+        if (str.compare("none") == 0)
+                *filter = COMPRESSION_NONE;
+        else if (str.compare("deflate") == 0 || str.compare("gzip") == 0)
+                *filter = COMPRESSION_DEFLATE;
+        else if (str.compare("fast") == 0 || str.compare("lz4") == 0)
+                *filter = COMPRESSION_FAST;
+        else if (str.compare("scaleoffset") == 0)
+                *filter = COMPRESSION_SCALE_OFFSET;
+        else
+                return false;
+        return true;
+}
+
+bool ParseAccessPattern(const std::string& name, access_pattern *pattern)
+{
+        std::string str(name);
+        str = ToLower(str);
+        if (str.compare("trace") == 0)
+                *pattern = ACCESS_FULL_TRACE;
+        else if (str.compare("window") == 0)
+                *pattern = ACCESS_TIME_WINDOW;
+        else
+                return false;
+        return true;
+}
+
+void ComputeChunking(double rate, uint numberOfTraces, uint numberOfBuffers, double flushInterval,
+                     access_pattern pattern, hsize_t *chunkSize, uint *numberOfChunks)
+{
+        hsize_t samples, maxSamples, chunk = *chunkSize;
+
+        // the number of samples acquired between two writes to file
+        samples = (hsize_t) ceil(rate * flushInterval);
+        if (numberOfTraces > 0 && numberOfBuffers > 0) {
+                maxSamples = H5RecorderCore::maxBuffersMemory / (numberOfTraces * numberOfBuffers * sizeof(double));
+                if (samples > maxSamples) {
+                        Logger(Info, "Reducing the buffers from %lld to %lld samples to limit memory usage.\n",
+                                        (long long) samples, (long long) maxSamples);
+                        samples = maxSamples;
+                }
+        }
+        if (samples < H5RecorderCore::minChunkSize)
+                samples = H5RecorderCore::minChunkSize;
+
+        if (chunk == 0) {
+                if (pattern == ACCESS_TIME_WINDOW)
+                        chunk = H5RecorderCore::timeWindowChunkBytes / sizeof(double);
+                else
+                        chunk = H5RecorderCore::fullTraceChunkBytes / sizeof(double);
+                if (chunk > samples)
+                        chunk = samples;
+                if (chunk < H5RecorderCore::minChunkSize)
+                        chunk = H5RecorderCore::minChunkSize;
+        }
+        *chunkSize = chunk;
+        *numberOfChunks = (uint) ((samples + chunk - 1) / chunk);
+}
+
+const char* CompressionFilterName(compression_filter filter)
+{
+        switch (filter) {
+        case COMPRESSION_NONE:
+                return "none";
+        case COMPRESSION_DEFLATE:
+                return "deflate";
+        case COMPRESSION_FAST:
+                return "fast";
+        case COMPRESSION_SCALE_OFFSET:
+                return "scaleoffset";
+        }
+        return "unknown";
+}
 
 H5RecorderCore::H5RecorderCore(bool compress, hsize_t bufferSize, const char *filename)
         : m_fid(-1), m_bufferSize(bufferSize),
@@ -18,10 +103,7 @@ H5RecorderCore::H5RecorderCore(bool compress, hsize_t bufferSize, const char *fi
                 m_makeFilename = false;
                 strncpy(m_filename, filename, FILENAME_MAXLEN);
         }
-        if (compress && isCompressionAvailable())
-                m_compress = true;
-        else
-                m_compress = false;
+        setCompression(compress ? COMPRESSION_DEFLATE : COMPRESSION_NONE);
 
         if (m_bufferSize % 1024 == 0) {
                 m_chunkSize = 1024;
@@ -36,7 +118,7 @@ H5RecorderCore::H5RecorderCore(bool compress, hsize_t bufferSize, const char *fi
 H5RecorderCore::H5RecorderCore(bool compress, hsize_t chunkSize, uint numberOfChunks, const char *filename)
         : m_fid(-1), m_bufferSize(chunkSize*numberOfChunks),
           m_chunkSize(chunkSize), m_numberOfChunks(numberOfChunks),
-          m_groups(), m_dataspaces(), m_datasets()
+          m_groups(), m_dataspaces(), m_datasets(), m_hasEvents(false)
 {
         if (filename == NULL || !strlen(filename)) {
                 m_makeFilename = true;
@@ -45,10 +127,7 @@ H5RecorderCore::H5RecorderCore(bool compress, hsize_t chunkSize, uint numberOfCh
                 m_makeFilename = false;
                 strncpy(m_filename, filename, FILENAME_MAXLEN);
         }
-        if (compress && isCompressionAvailable())
-                m_compress = true;
-        else
-                m_compress = false;
+        setCompression(compress ? COMPRESSION_DEFLATE : COMPRESSION_NONE);
 
 }
 
@@ -62,6 +141,32 @@ void H5RecorderCore::addComment(const char *message, const time_t *timestamp)
         m_comments.push_back(new Comment(message, timestamp));
 }
 
+void H5RecorderCore::addInfo(const char *name, double value)
+{
+        m_infoDoubles.push_back(std::make_pair(std::string(name), value));
+}
+
+void H5RecorderCore::addInfo(const char *name, long value)
+{
+        m_infoLongs.push_back(std::make_pair(std::string(name), value));
+}
+
+void H5RecorderCore::addInfo(const char *name, const char *value)
+{
+        m_infoStrings.push_back(std::make_pair(std::string(name), std::string(value)));
+}
+
+void H5RecorderCore::addInfo(const char *name, const double *data, size_t rows, size_t cols, const char *label)
+{
+        InfoMatrix info;
+        info.name = name;
+        info.label = label;
+        info.rows = rows;
+        info.cols = cols;
+        info.data.assign(data, data + rows*cols);
+        m_infoMatrices.push_back(info);
+}
+
 void H5RecorderCore::deleteComments()
 {
         std::deque<Comment*>::iterator it;
@@ -84,6 +189,78 @@ uint H5RecorderCore::numberOfChunks() const
         return m_numberOfChunks;
 }
 
+void H5RecorderCore::setBufferLayout(hsize_t chunkSize, uint numberOfChunks)
+{
+        m_chunkSize = chunkSize;
+        m_numberOfChunks = numberOfChunks;
+        m_bufferSize = chunkSize * numberOfChunks;
+}
+
+void H5RecorderCore::setCompression(compression_filter filter, int level)
+{
+        if (filter != COMPRESSION_NONE && !isCompressionAvailable())
+                filter = COMPRESSION_NONE;
+        switch (filter) {
+        case COMPRESSION_DEFLATE:
+                if (level > 9) {
+                        Logger(Important, "The deflate level must be between 1 and 9: using 9 instead of %d.\n", level);
+                        level = 9;
+                }
+                else if (level < 1) {
+                        level = defaultDeflateLevel;
+                }
+                break;
+        case COMPRESSION_SCALE_OFFSET:
+                if (level < 0)
+                        level = defaultScaleOffsetDigits;
+                break;
+        default:
+                level = 0;
+        }
+        m_compressionFilter = filter;
+        m_compressionLevel = level;
+        m_compress = filter != COMPRESSION_NONE;
+}
+
+compression_filter H5RecorderCore::compressionFilter() const
+{
+        return m_compressionFilter;
+}
+
+int H5RecorderCore::compressionLevel() const
+{
+        return m_compressionLevel;
+}
+
+bool H5RecorderCore::addCompressionFilters(hid_t cparms, hid_t dataTypeID) const
+{
+        // The order in which the filters are added to the property list is the order
+        // in which they are invoked when writing data: shuffling the bytes of the values
+        // before compressing them gives much better results.
+        switch (m_compressionFilter) {
+        case COMPRESSION_DEFLATE:
+                return H5Pset_shuffle(cparms) >= 0 && H5Pset_deflate(cparms, m_compressionLevel) >= 0;
+        case COMPRESSION_FAST:
+                if (H5Pset_shuffle(cparms) < 0)
+                        return false;
+                if (H5Zfilter_avail(lz4Filter) > 0)
+                        return H5Pset_filter(cparms, lz4Filter, H5Z_FLAG_MANDATORY, 0, NULL) >= 0;
+                Logger(Debug, "The LZ4 filter is not available: using deflate with level 1.\n");
+                return H5Pset_deflate(cparms, 1) >= 0;
+        case COMPRESSION_SCALE_OFFSET:
+                if (H5Tget_class(dataTypeID) == H5T_FLOAT) {
+                        if (H5Pset_scaleoffset(cparms, H5Z_SO_FLOAT_DSCALE, m_compressionLevel) < 0)
+                                return false;
+                }
+                else if (H5Pset_scaleoffset(cparms, H5Z_SO_INT, H5Z_SO_INT_MINBITS_DEFAULT) < 0) {
+                        return false;
+                }
+                return H5Pset_deflate(cparms, 1) >= 0;
+        default:
+                return true;
+        }
+}
+
 bool H5RecorderCore::isCompressionAvailable()
 {
         htri_t avail;
@@ -167,6 +344,7 @@ void H5RecorderCore::closeFile()
                 int i;
                 addComment("Closed file.");
                 writeComments();
+                writeInfo();
                 for (i=0; i<m_datasets.size(); i++)
                         H5Dclose(m_datasets[i]);
                 for (i=0; i<m_dataspaces.size(); i++)
@@ -205,6 +383,31 @@ void H5RecorderCore::writeComments()
         }
 }
 
+void H5RecorderCore::writeInfo()
+{
+        char datasetName[DATASET_NAME_LEN];
+        while (m_infoDoubles.size() > 0) {
+                writeScalarAttribute(m_infoGroup, m_infoDoubles.front().first.c_str(), m_infoDoubles.front().second);
+                m_infoDoubles.pop_front();
+        }
+        while (m_infoLongs.size() > 0) {
+                writeScalarAttribute(m_infoGroup, m_infoLongs.front().first.c_str(), m_infoLongs.front().second);
+                m_infoLongs.pop_front();
+        }
+        while (m_infoStrings.size() > 0) {
+                writeStringAttribute(m_infoGroup, m_infoStrings.front().first.c_str(), m_infoStrings.front().second.c_str());
+                m_infoStrings.pop_front();
+        }
+        while (m_infoMatrices.size() > 0) {
+                const InfoMatrix& info = m_infoMatrices.front();
+                hsize_t dims[2] = {info.rows, info.cols};
+                sprintf(datasetName, "%s/%s", INFO_GROUP, info.name.c_str());
+                if (info.rows > 0 && !writeData(datasetName, 2, dims, &info.data[0], info.label.c_str()))
+                        Logger(Important, "Unable to save [%s].\n", datasetName);
+                m_infoMatrices.pop_front();
+        }
+}
+
 void H5RecorderCore::setHasEvents(bool hasEvents) {
 	m_hasEvents = hasEvents;
 }
@@ -274,17 +477,10 @@ bool H5RecorderCore::createUnlimitedDataset(const char *datasetName,
         }
 
         if (m_compress) {
-                // Add the shuffle filter and the gzip compression filter to the
-                // dataset creation property list.
-                // The order in which the filters are added here is significant -
-                // we will see much greater results when the shuffle is applied
-                // first.  The order in which the filters are added to the property
-                // list is the order in which they will be invoked when writing
-                // data.
-                if (H5Pset_shuffle(cparms) < 0 || H5Pset_deflate(cparms, 9) < 0)
+                if (!addCompressionFilters(cparms, dataTypeID))
                         Logger(Important, "Unable to enable compression.\n");
                 else 
-                        Logger(Debug, "Successfully enabled compression.\n");
+                        Logger(Debug, "Successfully enabled %s compression.\n", CompressionFilterName(m_compressionFilter));
         }
 
         // create a new dataset within the file using cparms creation properties.
@@ -375,7 +571,7 @@ bool H5RecorderCore::writeStringAttribute(hid_t dataset,
 
 bool H5RecorderCore::writeScalarAttribute(hid_t dataset, const char *attrName, long attrValue)
 {
-        Logger(Debug, "H5RecorderCore::writeScalarAttribute(%d, %s, %g)\n", dataset, attrName, attrValue);
+        Logger(Debug, "H5RecorderCore::writeScalarAttribute(%ld, %s, %ld)\n", (long) dataset, attrName, attrValue);
         hid_t aid, attr;
         herr_t status;
 
@@ -407,7 +603,7 @@ bool H5RecorderCore::writeScalarAttribute(hid_t dataset, const char *attrName, l
 
 bool H5RecorderCore::writeScalarAttribute(hid_t dataset, const char *attrName, double attrValue)
 {
-        Logger(Debug, "H5RecorderCore::writeScalarAttribute(%d, %s, %g)\n", dataset, attrName, attrValue);
+        Logger(Debug, "H5RecorderCore::writeScalarAttribute(%ld, %s, %g)\n", (long) dataset, attrName, attrValue);
         hid_t aid, attr;
         herr_t status;
 
@@ -532,18 +728,18 @@ bool H5RecorderCore::writeData(const char *datasetName, int rank, const hsize_t
 //~~~
 
 struct thread_data {
-        thread_data(ChunkedH5Recorder *recorder, uint id, const double *data, size_t length)
+        thread_data(ChunkedH5Recorder *recorder, uint id, const void *data, size_t length)
                 : m_self(recorder), m_id(id), m_data(data), m_length(length) {}
         ChunkedH5Recorder *m_self;
         uint m_id;
-        const double *m_data;
+        const void *m_data;
         hsize_t m_length;
 };
 
 const int ChunkedH5Recorder::rank = 1;
 
 ChunkedH5Recorder::ChunkedH5Recorder(bool compress, const char *filename)
-        : H5RecorderCore(compress, 1024, 20, filename), m_ids(), m_datasetSizes(), m_writerThreads()
+        : H5RecorderCore(compress, 1024, 20, filename), m_ids(), m_datasetSizes(), m_memoryTypes(), m_writerThreads()
 {
         if (m_makeFilename)
                 MakeFilename(m_filename, "h5");
@@ -554,14 +750,14 @@ ChunkedH5Recorder::ChunkedH5Recorder(bool compress, const char *filename)
 ChunkedH5Recorder::~ChunkedH5Recorder()
 {
         waitForWriterThreads();
-        for (int i=0; i<m_writerThreads.size(); i++)
-                delete m_writerThreads[i];
         closeFile();
+        for (size_t i=0; i<m_memoryTypes.size(); i++)
+                H5Tclose(m_memoryTypes[i]);
 }
 
 bool ChunkedH5Recorder::addRecord(uint id, const char *name, const char *units,
                 size_t recordLength, const double_dict& parameters,
-                const double *metadata, const size_t *metadataDims)
+                const double *metadata, const size_t *metadataDims, hid_t dataTypeID)
 {
         if (std::find(m_ids.begin(), m_ids.end(), id) != m_ids.end()) {
                 Logger(Critical, "ID %d already present.\n", id);
@@ -585,7 +781,7 @@ bool ChunkedH5Recorder::addRecord(uint id, const char *name, const char *units,
 
         // dataset for actual data (i.e., /Entities/0001/Data)
         sprintf(datasetName, "%s/%04d/%s", ENTITIES_GROUP, id, DATA_DATASET);
-        if (!createUnlimitedDataset(datasetName, 1, &bufsz, &maxbufsz, &chunksz, &dspace, &dset)) {
+        if (!createUnlimitedDataset(datasetName, 1, &bufsz, &maxbufsz, &chunksz, &dspace, &dset, dataTypeID)) {
                 Logger(Critical, "Unable to create dataset [%s].\n", datasetName);
                 return false;
         }
@@ -622,22 +818,31 @@ bool ChunkedH5Recorder::addRecord(uint id, const char *name, const char *units,
 
         m_ids.push_back(id);
         m_datasetSizes.push_back(0);
-        m_writerThreads.push_back(new pthread_t);
+        m_memoryTypes.push_back(H5Tget_native_type(dataTypeID, H5T_DIR_DEFAULT));
+        m_writerThreads.push_back(NULL);
 
         return true;
 }
 
-bool ChunkedH5Recorder::writeRecord(uint id, const double *data, size_t length)
+bool ChunkedH5Recorder::writeRecord(uint id, const void *data, size_t length)
 {
-        if (std::find(m_ids.begin(), m_ids.end(), id) == m_ids.end()) {
+        std::vector<uint>::iterator it = std::find(m_ids.begin(), m_ids.end(), id);
+        if (it == m_ids.end()) {
                 Logger(Critical, "%d: no such ID.\n", id);
                 return false;
         }
+        size_t index = it - m_ids.begin();
         thread_data *arg = new thread_data(this, id, data, length);
-        //pthread_join(*m_writerThreads[id], NULL);
-        if (pthread_create(m_writerThreads[id], NULL, ChunkedH5Recorder::writerThread, (void *) arg) != 0)
+        m_writerThreads[index] = new pthread_t;
+        if (pthread_create(m_writerThreads[index], NULL, ChunkedH5Recorder::writerThread, (void *) arg) != 0) {
+                delete m_writerThreads[index];
+                m_writerThreads[index] = NULL;
+                delete arg;
                 return false;
-        pthread_join(*m_writerThreads[id], NULL);
+        }
+        pthread_join(*m_writerThreads[index], NULL);
+        delete m_writerThreads[index];
+        m_writerThreads[index] = NULL;
         return true;
 }
 
@@ -668,68 +873,100 @@ void* ChunkedH5Recorder::writerThread(void *arg)
         thread_data *data = static_cast<thread_data*>(arg);
         if (!data)
                 pthread_exit(NULL);
+        if (!data->m_self->appendRecord(data->m_id, data->m_data, data->m_length))
+                Logger(Critical, "Unable to save the data of record %d.\n", data->m_id);
+        delete data;
+        pthread_exit(NULL);
+}
 
-        ChunkedH5Recorder *self = data->m_self;
-        uint id = data->m_id;
-        const double *buffer = data->m_data;
+bool ChunkedH5Recorder::appendRecord(uint id, const void *buffer, size_t length)
+{
+        std::vector<uint>::iterator it = std::find(m_ids.begin(), m_ids.end(), id);
+        if (it == m_ids.end()) {
+                Logger(Critical, "%d: no such ID.\n", id);
+                return false;
+        }
+        size_t index = it - m_ids.begin();
         hid_t filespace;
         herr_t status;
-        hsize_t start = self->m_datasetSizes[id], count = data->m_length;
-        self->m_datasetSizes[id] += count;
-        delete data;
+        hsize_t start = m_datasetSizes[index], count = length;
+        m_datasetSizes[index] += count;
 
         // extend the dataset
-        status = H5Dset_extent(self->m_datasets[id], &self->m_datasetSizes[id]);
-        if (status < 0)
-                throw "Unable to extend dataset.";
-        else
-                Logger(All, "Extended dataset to %d elements.\n", self->m_datasetSizes[id]);
+        status = H5Dset_extent(m_datasets[index], &m_datasetSizes[index]);
+        if (status < 0) {
+                Logger(Critical, "Unable to extend dataset.\n");
+                return false;
+        }
+        Logger(All, "Extended dataset to %llu elements.\n", (ullong) m_datasetSizes[index]);
 
         // get the filespace
-        filespace = H5Dget_space(self->m_datasets[id]);
-        if (filespace < 0)
-                throw "Unable to get filespace.";
-        else
-                Logger(All, "Obtained filespace.\n");
+        filespace = H5Dget_space(m_datasets[index]);
+        if (filespace < 0) {
+                Logger(Critical, "Unable to get filespace.\n");
+                return false;
+        }
+        Logger(All, "Obtained filespace.\n");
 
         // select an hyperslab
         status = H5Sselect_hyperslab(filespace, H5S_SELECT_SET, &start, NULL, &count, NULL);
         if (status < 0) {
                 H5Sclose(filespace);
-                throw "Unable to select hyperslab.";
-        }
-        else {
-                Logger(All, "Selected hyperslab.\n");
+                Logger(Critical, "Unable to select hyperslab.\n");
+                return false;
         }
+        Logger(All, "Selected hyperslab.\n");
 
         // define memory space
-        self->m_dataspaces[id] = H5Screate_simple(ChunkedH5Recorder::rank, &count, NULL);
-        if (self->m_dataspaces[id] < 0) {
+        if (m_dataspaces[index] >= 0)
+                H5Sclose(m_dataspaces[index]);
+        m_dataspaces[index] = H5Screate_simple(ChunkedH5Recorder::rank, &count, NULL);
+        if (m_dataspaces[index] < 0) {
                 H5Sclose(filespace);
-                throw "Unable to define memory space.";
-        }
-        else {
-                Logger(All, "Memory space defined.\n");
+                Logger(Critical, "Unable to define memory space.\n");
+                return false;
         }
+        Logger(All, "Memory space defined.\n");
 
         // write data
-        status = H5Dwrite(self->m_datasets[id], H5T_IEEE_F64LE, self->m_dataspaces[id], filespace, H5P_DEFAULT, buffer);
+        status = H5Dwrite(m_datasets[index], m_memoryTypes[index], m_dataspaces[index], filespace, H5P_DEFAULT, buffer);
+        H5Sclose(filespace);
         if (status < 0) {
-                H5Sclose(filespace);
-                throw "Unable to write data.";
+                Logger(Critical, "Unable to write data.\n");
+                return false;
         }
-        else {
-                Logger(All, "Written data.\n");
+        Logger(All, "Written data.\n");
+        return true;
+}
+
+bool ChunkedH5Recorder::writeConversion(uint id, const double *coefficients, uint order, double origin, double factor)
+{
+        std::vector<uint>::iterator it = std::find(m_ids.begin(), m_ids.end(), id);
+        if (it == m_ids.end()) {
+                Logger(Critical, "%d: no such ID.\n", id);
+                return false;
         }
-        H5Sclose(filespace);
-        pthread_exit(NULL);
+        size_t index = it - m_ids.begin();
+        hsize_t dims = order + 1;
+        return writeArrayAttribute(m_datasets[index], "Coefficients", coefficients, &dims, 1) &&
+                writeScalarAttribute(m_datasets[index], "ExpansionOrigin", origin) &&
+                writeScalarAttribute(m_datasets[index], "ConversionFactor", factor);
 }
 
-void ChunkedH5Recorder::waitForWriterThreads()
+bool ChunkedH5Recorder::flush()
 {
-        for (int i=0; i<m_writerThreads.size(); i++)
-                pthread_join(*m_writerThreads[i], NULL);
+        return H5Fflush(m_fid, H5F_SCOPE_GLOBAL) >= 0;
 }
 
+void ChunkedH5Recorder::waitForWriterThreads()
+{
+        for (size_t i=0; i<m_writerThreads.size(); i++) {
+                if (m_writerThreads[i] != NULL) {
+                        pthread_join(*m_writerThreads[i], NULL);
+                        delete m_writerThreads[i];
+                        m_writerThreads[i] = NULL;
+                }
+        }
 }
 
+}
@@ -27,6 +27,7 @@
 #include <time.h>
 #include <string.h>
 #include <hdf5.h>
+#include <string>
 #include <vector>
 #include <deque>
 #include "types.h"
@@ -67,6 +68,62 @@ private:
         char m_msg[COMMENT_MAXLEN];
 };
 
+/*! The filters used for compressing the datasets. */
+typedef enum {
+        /*! The data is stored uncompressed. */
+        COMPRESSION_NONE = 0,
+        /*! Shuffle followed by deflate (gzip): the level, between 1 and 9, trades speed for compression ratio. */
+        COMPRESSION_DEFLATE,
+        /*! Shuffle followed by LZ4, if the corresponding HDF5 plugin is installed, or by deflate with level 1. */
+        COMPRESSION_FAST,
+        /*!
+         * Lossy scale-offset filter followed by deflate with level 1: floating point values are rounded to
+         * the number of decimal digits given by the level, which is appropriate for signals acquired
+         * with an ADC. Integer values are stored losslessly.
+         */
+        COMPRESSION_SCALE_OFFSET
+} compression_filter;
+
+/*!
+ * Converts the name of a compression filter (none, deflate, fast or scaleoffset) into a compression_filter.
+ * \return false if the name is not valid.
+ */
+bool ParseCompressionFilter(const std::string& name, compression_filter *filter);
+
+/*! Returns the name of a compression filter. */
+const char* CompressionFilterName(compression_filter filter);
+
+/*! How the traces saved in a file are going to be read. */
+typedef enum {
+        /*! Whole traces are loaded at once: large chunks mean fewer reads and a smaller index. */
+        ACCESS_FULL_TRACE = 0,
+        /*! Short time windows are loaded from long traces: small chunks mean less data decompressed and discarded. */
+        ACCESS_TIME_WINDOW
+} access_pattern;
+
+/*!
+ * Converts the name of an access pattern (trace or window) into an access_pattern.
+ * \return false if the name is not valid.
+ */
+bool ParseAccessPattern(const std::string& name, access_pattern *pattern);
+
+/*!
+ * Computes the layout of the buffers of a recorder that saves one-dimensional traces.
+ * Each buffer holds the samples acquired in flushInterval seconds and is made of an integer number
+ * of chunks, so that every write to file covers whole chunks. The size of the chunks follows from the
+ * access pattern, unless chunkSize is non-zero on input. The buffers are shortened if, all together,
+ * they would take more than maxBuffersMemory bytes.
+ * \param rate The sampling rate, in Hz.
+ * \param numberOfTraces The number of traces that are recorded.
+ * \param numberOfBuffers The number of buffers allocated for each trace.
+ * \param flushInterval The time between consecutive writes of a buffer to file, in seconds.
+ * \param pattern How the traces are going to be read.
+ * \param chunkSize On input, the number of samples in a chunk or 0 to compute it. On output, the number of samples in a chunk.
+ * \param numberOfChunks On output, the number of chunks in a buffer.
+ */
+void ComputeChunking(double rate, uint numberOfTraces, uint numberOfBuffers, double flushInterval,
+                     access_pattern pattern, hsize_t *chunkSize, uint *numberOfChunks);
+
 class H5RecorderCore {
 public:
         H5RecorderCore(bool compress, hsize_t bufferSize = 20480, const char *filename = NULL);
@@ -82,11 +139,39 @@ public:
 
         static bool isCompressionAvailable();
 
+        /*!
+         * Sets the filters used for compressing the datasets that are created after this call.
+         * \param filter The compression filter.
+         * \param level The compression level for COMPRESSION_DEFLATE or the number of decimal digits that
+         *              are preserved for COMPRESSION_SCALE_OFFSET: a negative value selects the default.
+         */
+        void setCompression(compression_filter filter, int level = -1);
+        compression_filter compressionFilter() const;
+        int compressionLevel() const;
+
         void addComment(const char *message, const time_t *timestamp = NULL);
 
+        /*! Stores a value that will be saved as an attribute of the Info group when the file is closed. */
+        void addInfo(const char *name, double value);
+        void addInfo(const char *name, long value);
+        void addInfo(const char *name, const char *value);
+        /*! Stores a (rows x cols) matrix that will be saved as a dataset in the Info group when the file is closed. */
+        void addInfo(const char *name, const double *data, size_t rows, size_t cols, const char *label = "");
+
 public:
         static const hsize_t unlimitedSize;
         static const double  fillValue;
+        static const int     defaultDeflateLevel;
+        /*! The smallest chunk used by ComputeChunking, in samples. */
+        static const hsize_t minChunkSize;
+        /*! The size of the chunks chosen by ComputeChunking for each access pattern, in bytes. */
+        static const hsize_t fullTraceChunkBytes;
+        static const hsize_t timeWindowChunkBytes;
+        /*! The largest amount of memory that ComputeChunking assigns to the buffers of a recorder, in bytes. */
+        static const hsize_t maxBuffersMemory;
+        static const int     defaultScaleOffsetDigits;
+        /*! The identifier of the LZ4 filter in the registry of the HDF Group. */
+        static const H5Z_filter_t lz4Filter;
 
 protected:
         virtual bool openFile();
@@ -94,11 +179,16 @@ protected:
         virtual bool initialiseFile();
         virtual void deleteComments();
 
+        /*! Changes the layout of the buffers: it affects only the datasets created after this call. */
+        void setBufferLayout(hsize_t chunkSize, uint numberOfChunks);
+
         virtual bool createGroup(const char *groupName, hid_t *grp);
         virtual bool createUnlimitedDataset(const char *datasetName,
                                             int rank, const hsize_t *dataDims, const hsize_t *maxDataDims, const hsize_t *chunkDims,
                                             hid_t *dspace, hid_t *dset, hid_t dataTypeID = H5T_IEEE_F64LE);
 
+        bool addCompressionFilters(hid_t cparms, hid_t dataTypeID) const;
+
         virtual bool writeStringAttribute(hid_t objId, const char *attrName, const char *attrValue);
         virtual bool writeScalarAttribute(hid_t objId, const char *attrName, double attrValue);
         virtual bool writeScalarAttribute(hid_t objId, const char *attrName, long attrValue);
@@ -108,6 +198,7 @@ protected:
                                const double *data, const char *label = "");
 
         virtual void writeComments();
+        virtual void writeInfo();
 
         virtual bool hasEvents() const;
         virtual void setHasEvents(bool hasEvents);
@@ -115,10 +206,24 @@ protected:
 protected:
         std::deque<Comment*> m_comments;
 
+        // additional information to be saved in the Info group
+        struct InfoMatrix {
+                std::string name, label;
+                size_t rows, cols;
+                std::vector<double> data;
+        };
+        std::deque< std::pair<std::string,double> > m_infoDoubles;
+        std::deque< std::pair<std::string,long> > m_infoLongs;
+        std::deque< std::pair<std::string,std::string> > m_infoStrings;
+        std::deque<InfoMatrix> m_infoMatrices;
+
         // the handle of the file
         hid_t m_fid;
         // whether compression is turned on or off
         bool m_compress;
+        // the filters used for compression and their level
+        compression_filter m_compressionFilter;
+        int m_compressionLevel;
         // the name of the file
         char m_filename[FILENAME_MAXLEN];
         // tells whether the filename should be generated from the timestamp
@@ -134,11 +239,11 @@ protected:
         std::vector<hid_t> m_datasets;
 
 private:
-        // the size of each chunk of data that is saved to the H5 file
+        // the number of samples in each chunk of data that is saved to the H5 file
         hsize_t m_chunkSize;
-        // the number of chunks of data
+        // the number of chunks in a buffer
         uint m_numberOfChunks; 
-        // the total size of the buffer, given by the size of each chunk times the number of chunks
+        // the number of samples in a buffer, always equal to m_chunkSize times m_numberOfChunks
         hsize_t m_bufferSize;
 };
 
@@ -146,10 +251,28 @@ class ChunkedH5Recorder : public H5RecorderCore {
 public:
         ChunkedH5Recorder(bool compress = true, const char *filename = NULL);
         ~ChunkedH5Recorder();
+        /*!
+         * Creates the group and the dataset of a record. The samples of the record are doubles,
+         * unless another type is given by dataTypeID: the samples passed to writeRecord and
+         * appendRecord must then be of the corresponding native type.
+         */
         bool addRecord(uint id, const char *name, const char *units,
                        size_t recordLength, const double_dict& parameters,
-                       const double *metadata = NULL, const size_t *metadataDims = NULL);
-        bool writeRecord(uint id, const double *data, size_t length);
+                       const double *metadata = NULL, const size_t *metadataDims = NULL,
+                       hid_t dataTypeID = H5T_IEEE_F64LE);
+        bool writeRecord(uint id, const void *data, size_t length);
+        /*!
+         * Appends length samples to the dataset of a record, in the calling thread:
+         * used to save the data of a record one block at a time.
+         */
+        bool appendRecord(uint id, const void *data, size_t length);
+        /*!
+         * Saves, as attributes of the dataset of a record, the polynomial that converts its raw
+         * samples into physical units, i.e., factor * sum_{i=0}^{order} coefficients[i] * (x - origin)^i.
+         */
+        bool writeConversion(uint id, const double *coefficients, uint order, double origin, double factor);
+        /*! Writes to disk the data saved so far, so that the file is readable if the program is killed. */
+        bool flush();
         bool writeMetadata(uint id, const double *data, size_t rows, size_t cols);
         bool writeRecordingDuration(double duration);
         bool writeTimeStep(double dt);
@@ -165,6 +288,8 @@ private:
 private:
         std::vector<uint> m_ids;
         std::vector<hsize_t> m_datasetSizes;
+        // the type of the samples of each record in memory
+        std::vector<hid_t> m_memoryTypes;
         std::vector<pthread_t*> m_writerThreads;
 };
 
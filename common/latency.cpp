@@ -0,0 +1,210 @@
+/*=========================================================================
+ *
+ *   Program:     lcg
+ *   Filename:    latency.cpp
+ *
+ *   Copyright (C) 2012,2013,2014 Daniele Linaro
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *=========================================================================*/
+
+#include <assert.h>
+#include <math.h>
+#include <limits>
+#include "latency.h"
+#include "utils.h"
+
+namespace lcg {
+
+LatencyHistogram::LatencyHistogram(int64_t maxValue, int subBucketBits)
+        : m_maxValue(maxValue), m_subBucketBits(subBucketBits),
+          m_subBucketCount(1LL << subBucketBits), m_counts()
+{
+        assert(subBucketBits > 0 && subBucketBits < 16);
+        assert(maxValue >= 2*m_subBucketCount);
+        m_counts.resize(index(m_maxValue)+1);
+        reset();
+}
+
+void LatencyHistogram::reset()
+{
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_count = 0;
+        m_overflows = 0;
+        m_sum = 0.0;
+        m_min = std::numeric_limits<int64_t>::max();
+        m_max = 0;
+}
+
+uint64_t LatencyHistogram::count() const
+{
+        return m_count;
+}
+
+uint64_t LatencyHistogram::overflows() const
+{
+        return m_overflows;
+}
+
+int64_t LatencyHistogram::min() const
+{
+        return m_count > 0 ? m_min : 0;
+}
+
+int64_t LatencyHistogram::max() const
+{
+        return m_max;
+}
+
+double LatencyHistogram::mean() const
+{
+        return m_count > 0 ? m_sum / m_count : 0.0;
+}
+
+int64_t LatencyHistogram::percentile(double p) const
+{
+        if (m_count == 0)
+                return 0;
+        if (p < 0.)
+                p = 0.;
+        if (p > 100.)
+                p = 100.;
+        uint64_t target = (uint64_t) ceil(p / 100. * m_count), cumulative = 0;
+        if (target == 0)
+                target = 1;
+        for (size_t i=0; i<m_counts.size(); i++) {
+                cumulative += m_counts[i];
+                if (cumulative >= target) {
+                        if (i+1 == m_counts.size())
+                                return m_max;
+                        return std::min(lowerEdge(i+1)-1, m_max);
+                }
+        }
+        return m_max;
+}
+
+size_t LatencyHistogram::numberOfBins() const
+{
+        return m_counts.size();
+}
+
+int64_t LatencyHistogram::lowerEdge(size_t i) const
+{
+        if ((int64_t) i < 2*m_subBucketCount)
+                return (int64_t) i;
+        int exponent = (int) (i / m_subBucketCount) - 1;
+        return ((int64_t) (i % m_subBucketCount) + m_subBucketCount) << exponent;
+}
+
+uint64_t LatencyHistogram::binCount(size_t i) const
+{
+        return m_counts[i];
+}
+
+size_t LatencyHistogram::toMatrix(std::vector<double>& data) const
+{
+        size_t n = 0;
+        data.clear();
+        for (size_t i=0; i<m_counts.size(); i++) {
+                if (m_counts[i] > 0) {
+                        data.push_back((double) lowerEdge(i) / NSEC_PER_SEC);
+                        data.push_back((double) m_counts[i]);
+                        n++;
+                }
+        }
+        return n;
+}
+
+//~~~
+
+LoopTimingStatistics::LoopTimingStatistics()
+        : m_wakeupLatency(), m_computeTime()
+{
+        reset();
+}
+
+void LoopTimingStatistics::reset()
+{
+        m_wakeupLatency.reset();
+        m_computeTime.reset();
+        m_iterations = 0;
+        m_overruns = 0;
+        m_skippedPeriods = 0;
+        m_resyncs = 0;
+        m_maxLag = 0;
+        m_aborted = false;
+}
+
+uint64_t LoopTimingStatistics::iterations() const
+{
+        return m_iterations;
+}
+
+uint64_t LoopTimingStatistics::overruns() const
+{
+        return m_overruns;
+}
+
+uint64_t LoopTimingStatistics::skippedPeriods() const
+{
+        return m_skippedPeriods;
+}
+
+uint64_t LoopTimingStatistics::resyncs() const
+{
+        return m_resyncs;
+}
+
+int64_t LoopTimingStatistics::maxLag() const
+{
+        return m_maxLag;
+}
+
+bool LoopTimingStatistics::wasAborted() const
+{
+        return m_aborted;
+}
+
+const LatencyHistogram& LoopTimingStatistics::wakeupLatency() const
+{
+        return m_wakeupLatency;
+}
+
+const LatencyHistogram& LoopTimingStatistics::computeTime() const
+{
+        return m_computeTime;
+}
+
+void LoopTimingStatistics::log() const
+{
+        Logger(Info, "Wake-up latency: mean = %.1f us, 99th percentile = %.1f us, max = %.1f us.\n",
+                m_wakeupLatency.mean()*1e-3, m_wakeupLatency.percentile(99.)*1e-3, m_wakeupLatency.max()*1e-3);
+        Logger(Info, "Compute time: mean = %.1f us, 99th percentile = %.1f us, max = %.1f us.\n",
+                m_computeTime.mean()*1e-3, m_computeTime.percentile(99.)*1e-3, m_computeTime.max()*1e-3);
+        Logger(m_overruns > 0 ? Important : Info, "%llu overrun%s in %llu iterations.\n",
+                (ullong) m_overruns, (m_overruns == 1 ? "" : "s"), (ullong) m_iterations);
+        if (m_overruns > 0)
+                Logger(Important, "The loop lagged at most %lld period%s behind schedule, %llu period%s skipped.\n",
+                        (long long) m_maxLag, (m_maxLag == 1 ? "" : "s"),
+                        (ullong) m_skippedPeriods, (m_skippedPeriods == 1 ? " was" : "s were"));
+        if (m_resyncs > 0)
+                Logger(Important, "The analog outputs ran out of samples %llu time%s and were restarted.\n",
+                        (ullong) m_resyncs, (m_resyncs == 1 ? "" : "s"));
+        if (m_aborted)
+                Logger(Critical, "The run was aborted because a deadline was missed.\n");
+}
+
+} // namespace lcg
+
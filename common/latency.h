@@ -0,0 +1,205 @@
+/*=========================================================================
+ *
+ *   Program:     lcg
+ *   Filename:    latency.h
+ *
+ *   Copyright (C) 2012,2013,2014 Daniele Linaro
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *=========================================================================*/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/*!
+ * \file latency.h
+ * \brief Histograms for measuring the timing of the real-time loop.
+ */
+
+namespace lcg {
+
+/*!
+ * \class LatencyHistogram
+ * \brief A log-linear histogram of durations expressed in nanoseconds.
+ *
+ * The layout of the bins follows the one of HDR histograms: values smaller than
+ * 2^(subBucketBits+1) ns are recorded with a resolution of 1 ns, while larger values
+ * are stored in bins whose width doubles at every power of two, so that the relative
+ * error never exceeds 2^-subBucketBits. All the memory is allocated by the constructor:
+ * record() never allocates, never locks and runs in constant time, which makes it
+ * suitable for being called from the real-time thread. A histogram must be written
+ * by one thread only and read only after the writer is done.
+ */
+class LatencyHistogram {
+public:
+        /*!
+         * \param maxValue The largest value (in ns) that can be recorded exactly: larger values
+         *                 are stored in the last bin and counted as overflows.
+         * \param subBucketBits The base 2 logarithm of the number of bins per power of two.
+         */
+        LatencyHistogram(int64_t maxValue = 10*1000000000LL, int subBucketBits = 5);
+
+        /*! Discards all recorded values. */
+        void reset();
+
+        /*! Adds a value (in ns) to the histogram. Negative values are recorded as zero. */
+        inline void record(int64_t value) {
+                if (value < 0)
+                        value = 0;
+                if (value > m_maxValue) {
+                        value = m_maxValue;
+                        m_overflows++;
+                }
+                m_counts[index(value)]++;
+                m_count++;
+                m_sum += value;
+                if (value < m_min)
+                        m_min = value;
+                if (value > m_max)
+                        m_max = value;
+        }
+
+        /*! Returns the number of recorded values. */
+        uint64_t count() const;
+
+        /*! Returns the number of values that exceeded the maximum trackable value. */
+        uint64_t overflows() const;
+
+        int64_t min() const;
+        int64_t max() const;
+        double mean() const;
+
+        /*!
+         * Returns an upper bound on the p-th percentile (0 <= p <= 100) of the recorded values,
+         * i.e. the upper edge of the bin that contains it.
+         */
+        int64_t percentile(double p) const;
+
+        /*! Returns the number of bins in the histogram. */
+        size_t numberOfBins() const;
+
+        /*! Returns the lower edge (in ns) of the i-th bin. */
+        int64_t lowerEdge(size_t i) const;
+
+        /*! Returns the number of values in the i-th bin. */
+        uint64_t binCount(size_t i) const;
+
+        /*!
+         * Fills data with a (n x 2) matrix, stored by rows, that contains the lower edges (in seconds)
+         * and the counts of the non-empty bins. Returns n.
+         */
+        size_t toMatrix(std::vector<double>& data) const;
+
+private:
+        inline size_t index(int64_t value) const {
+                if (value < 2*m_subBucketCount)
+                        return (size_t) value;
+                int exponent = 63 - __builtin_clzll((unsigned long long) value) - m_subBucketBits;
+                return (exponent+1)*m_subBucketCount + (size_t) ((value >> exponent) - m_subBucketCount);
+        }
+
+private:
+        int64_t m_maxValue;
+        int m_subBucketBits;
+        int64_t m_subBucketCount;
+        std::vector<uint64_t> m_counts;
+        uint64_t m_count, m_overflows;
+        int64_t m_min, m_max;
+        double m_sum;
+};
+
+/*!
+ * \class LoopTimingStatistics
+ * \brief Per-iteration timing of a periodic real-time loop.
+ *
+ * For every iteration two quantities are recorded: the wake-up latency, i.e. how late
+ * the thread resumed with respect to its deadline, and the compute time, i.e. the time
+ * elapsed between the wake-up and the moment in which the thread goes to sleep again.
+ * An iteration whose work ends after the following deadline is counted as an overrun.
+ */
+class LoopTimingStatistics {
+public:
+        LoopTimingStatistics();
+
+        void reset();
+
+        /*! Records how late (in ns) the thread woke up with respect to its deadline. */
+        inline void wokeUp(int64_t latency) {
+                m_wakeupLatency.record(latency);
+        }
+
+        /*!
+         * Records the time (in ns) spent computing in the current iteration and whether
+         * the next deadline had already passed when the computation ended.
+         */
+        inline void finished(int64_t computeTime, bool overrun) {
+                m_computeTime.record(computeTime);
+                m_iterations++;
+                if (overrun)
+                        m_overruns++;
+        }
+
+        /*! Records that n periods were dropped in order to get back in sync with the clock. */
+        inline void skipped(int64_t n) {
+                m_skippedPeriods += n;
+        }
+
+        /*! Records that the analog outputs ran out of samples and were restarted. */
+        inline void resynchronised() {
+                m_resyncs++;
+        }
+
+        /*! Records that the loop was lagging n periods behind its schedule. */
+        inline void lagging(int64_t n) {
+                if (n > m_maxLag)
+                        m_maxLag = n;
+        }
+
+        /*! Records that the run was stopped because a deadline was missed. */
+        inline void aborted() {
+                m_aborted = true;
+        }
+
+        uint64_t iterations() const;
+        uint64_t overruns() const;
+        uint64_t skippedPeriods() const;
+        uint64_t resyncs() const;
+        int64_t maxLag() const;
+        bool wasAborted() const;
+        const LatencyHistogram& wakeupLatency() const;
+        const LatencyHistogram& computeTime() const;
+
+        /*! Prints a short summary of the statistics. */
+        void log() const;
+
+private:
+        LatencyHistogram m_wakeupLatency;
+        LatencyHistogram m_computeTime;
+        uint64_t m_iterations;
+        uint64_t m_overruns;
+        uint64_t m_skippedPeriods;
+        uint64_t m_resyncs;
+        int64_t m_maxLag;
+        bool m_aborted;
+};
+
+} // namespace lcg
+
+#endif
+
@@ -0,0 +1,146 @@
+/*=========================================================================
+ *
+ *   Program:     lcg
+ *   Filename:    lock_free_queue.h
+ *
+ *   Copyright (C) 2012,2013,2014 Daniele Linaro
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *=========================================================================*/
+
+#ifndef LOCK_FREE_QUEUE_H
+#define LOCK_FREE_QUEUE_H
+
+#include <new>
+#include <assert.h>
+#include <stddef.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace lcg {
+
+/*!
+ * \class LockFreeQueue
+ * \brief A bounded queue with multiple producers and a single consumer.
+ *
+ * The elements are copied into a ring of slots that is allocated once by the
+ * constructor: pushing an element never allocates memory, never takes a lock
+ * and never blocks, which makes the queue suitable for being used from a
+ * real-time thread. Every slot carries a sequence number that tells whether it
+ * is free or holds an element ready to be consumed (see D. Vyukov, "Bounded
+ * MPMC queue"). Only one thread at a time may call front and pop.
+ */
+template <typename T>
+class LockFreeQueue : private boost::noncopyable
+{
+public:
+        /*! \param capacity The maximum number of elements in the queue: must be a power of two. */
+        LockFreeQueue(size_t capacity)
+                : m_mask(capacity-1), m_slots(new Slot[capacity]), m_head(0), m_tail(0)
+        {
+                assert(capacity >= 2 && (capacity & (capacity-1)) == 0);
+                for (size_t i=0; i<capacity; i++)
+                        m_slots[i].sequence = i;
+        }
+
+        ~LockFreeQueue()
+        {
+                while (front() != NULL)
+                        pop();
+                delete [] m_slots;
+        }
+
+        /*! Returns the maximum number of elements in the queue. */
+        size_t capacity() const
+        {
+                return m_mask + 1;
+        }
+
+        /*! Returns the number of elements in the queue, including those that are still being pushed. */
+        size_t size() const
+        {
+                return m_tail - m_head;
+        }
+
+        /*!
+         * Copies an element at the end of the queue.
+         * \return false if the queue was full, in which case the element is not inserted.
+         */
+        bool push(const T& elem)
+        {
+                Slot *slot;
+                size_t pos = m_tail;
+                while (true) {
+                        slot = &m_slots[pos & m_mask];
+                        ptrdiff_t diff = (ptrdiff_t) slot->sequence - (ptrdiff_t) pos;
+                        if (diff == 0) {
+                                size_t prev = __sync_val_compare_and_swap(&m_tail, pos, pos+1);
+                                if (prev == pos)
+                                        break;
+                                pos = prev;
+                        }
+                        else if (diff < 0) {
+                                return false;
+                        }
+                        else {
+                                pos = m_tail;
+                        }
+                }
+                new (slot->storage) T(elem);
+                __sync_synchronize();
+                slot->sequence = pos + 1;
+                return true;
+        }
+
+        /*!
+         * Returns a pointer to the first element in the queue, or NULL if the queue is empty
+         * or the first element has not been completely pushed yet. The element remains valid
+         * until pop is called.
+         */
+        T* front()
+        {
+                Slot *slot = &m_slots[m_head & m_mask];
+                if (slot->sequence != m_head + 1)
+                        return NULL;
+                __sync_synchronize();
+                return reinterpret_cast<T*>(slot->storage);
+        }
+
+        /*! Destroys the first element in the queue and makes its slot available again. Must follow a successful call to front. */
+        void pop()
+        {
+                Slot *slot = &m_slots[m_head & m_mask];
+                reinterpret_cast<T*>(slot->storage)->~T();
+                __sync_synchronize();
+                slot->sequence = m_head + m_mask + 1;
+                m_head++;
+        }
+
+private:
+        struct Slot {
+                volatile size_t sequence;
+                char storage[sizeof(T)] __attribute__((aligned(__alignof__(T))));
+        };
+
+        const size_t m_mask;
+        Slot *m_slots;
+        volatile size_t m_head;
+        volatile size_t m_tail;
+};
+
+} // namespace lcg
+
+#endif // LOCK_FREE_QUEUE_H
+
@@ -1,5 +1,7 @@
 #include "randlib.h"
 #include <time.h>
+#include <vector>
+#include <algorithm>
 
 bool shuffle(int start, int stop, int *data)
 {
@@ -107,3 +109,188 @@ void sobseq(int *n, float *x)
                 }
         }
 }
+
+/** All the RandomBuffer objects that exist. */
+static std::vector<RandomBuffer*> randomBuffers;
+
+RandomBuffer::RandomBuffer(ullong seed, uint size)
+        : m_buffer(NULL), m_size(1), m_read(0), m_written(0)
+{
+        while (m_size < size)
+                m_size <<= 1;
+        m_mask = m_size - 1;
+        if (posix_memalign((void **) &m_buffer, 64, m_size * sizeof(double)) != 0)
+                throw "Unable to allocate the buffer of random numbers.";
+        setSeed(seed);
+        randomBuffers.push_back(this);
+}
+
+RandomBuffer::~RandomBuffer()
+{
+        randomBuffers.erase(std::find(randomBuffers.begin(), randomBuffers.end(), this));
+        free(m_buffer);
+}
+
+void RandomBuffer::setSeed(ullong seed)
+{
+        ullong z = seed + 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        m_key = z ^ (z >> 31);
+        m_read = m_written = 0;
+}
+
+uint RandomBuffer::refill(uint count)
+{
+        uint start, n, g = granularity();
+        ullong available = m_size - (m_written - m_read);
+        if (count > available)
+                count = available;
+        count -= count % g;
+        // the buffer wraps around at most once: generate the two parts separately
+        start = m_written & m_mask;
+        n = (start + count > m_size ? m_size - start : count);
+        generate(m_buffer + start, m_written, n);
+        if (n < count)
+                generate(m_buffer, m_written + n, count - n);
+        m_written += count;
+        return count;
+}
+
+uint RandomBuffer::granularity() const
+{
+        return 1;
+}
+
+UniformRandomBuffer::UniformRandomBuffer(ullong seed, uint size)
+        : RandomBuffer(seed, size)
+{}
+
+void UniformRandomBuffer::generate(double *x, ullong first, uint n) const
+{
+        for (uint i=0; i<n; i++)
+                x[i] = uniform(first+i);
+}
+
+NormalRandomBuffer::NormalRandomBuffer(double mu, double sigma, ullong seed, uint size)
+        : RandomBuffer(seed, size < 2 ? 2 : size), m_mu(mu), m_sigma(sigma)
+{}
+
+void NormalRandomBuffer::generate(double *x, ullong first, uint n) const
+{
+        double r, theta;
+        for (uint i=0; i<n; i+=2) {
+                r = m_sigma * sqrt(-2.0 * log(uniform(first+i)));
+                theta = 2.0 * M_PI * uniform(first+i+1);
+                x[i] = m_mu + r * cos(theta);
+                x[i+1] = m_mu + r * sin(theta);
+        }
+}
+
+uint NormalRandomBuffer::granularity() const
+{
+        return 2;
+}
+
+void RefillRandomBuffers(uint maxCount)
+{
+        for (size_t i=0; i<randomBuffers.size(); i++)
+                randomBuffers[i]->refill(maxCount);
+}
+
+UniformRandomHW::UniformRandomHW(int size)
+        : m_size(size > 0 ? size : 1), m_current(NULL),
+          m_filled(0), m_released(0), m_threadRun(false), m_software(time(NULL)), m_fallbacks(0)
+{
+        m_buffers[0] = new ullong[2*m_size];
+        m_buffers[1] = m_buffers[0] + m_size;
+        // no buffer is available until the first one has been filled
+        m_position = m_size;
+        m_fid = open(RANDOMDEVICE, O_RDONLY);
+        if (m_fid == -1)
+                return;
+        // the first buffer is filled here, the second one by the background thread
+        if (fillBuffer(m_buffers[0])) {
+                m_software.setSeed(m_buffers[0][0] ^ m_software.int64());
+                m_filled = 1;
+                m_current = m_buffers[0];
+                m_position = 0;
+        }
+        sem_init(&m_wakeup, 0, 0);
+        m_threadRun = true;
+        if (pthread_create(&m_thread, NULL, refillThread, this) != 0)
+                m_threadRun = false;
+}
+
+UniformRandomHW::~UniformRandomHW()
+{
+        if (m_threadRun) {
+                m_threadRun = false;
+                sem_post(&m_wakeup);
+                pthread_join(m_thread, NULL);
+        }
+        if (m_fid != -1) {
+                sem_destroy(&m_wakeup);
+                close(m_fid);
+        }
+        delete [] m_buffers[0];
+}
+
+bool UniformRandomHW::nextBuffer()
+{
+        if (m_current != NULL) {
+                // the current buffer has been used up: hand it back to the background thread
+                __sync_synchronize();
+                m_released++;
+                m_current = NULL;
+                sem_post(&m_wakeup);
+        }
+        if (m_filled == m_released)
+                return false;
+        // make sure that the content of the buffer is read after the counter
+        __sync_synchronize();
+        m_current = m_buffers[m_released % 2];
+        m_position = 0;
+        return true;
+}
+
+ullong UniformRandomHW::fallback()
+{
+        m_fallbacks++;
+        return m_software.int64();
+}
+
+bool UniformRandomHW::fillBuffer(ullong *buffer)
+{
+        size_t count = 0, length = m_size * sizeof(ullong);
+        ssize_t n;
+        while (count < length) {
+                n = read(m_fid, (char *) buffer + count, length - count);
+                if (n <= 0)
+                        return false;
+                count += n;
+        }
+        return true;
+}
+
+void* UniformRandomHW::refillThread(void *arg)
+{
+        UniformRandomHW *self = static_cast<UniformRandomHW*>(arg);
+        struct timespec pause = {0, 1000000};
+        while (self->m_threadRun) {
+                if (self->m_filled - self->m_released == 2) {
+                        // wait until the reader releases a buffer
+                        sem_wait(&self->m_wakeup);
+                }
+                else if (self->fillBuffer(self->m_buffers[self->m_filled % 2])) {
+                        // make sure that the content of the buffer is visible before publishing it
+                        __sync_synchronize();
+                        self->m_filled++;
+                }
+                else {
+                        // the device could not be read: try again later
+                        nanosleep(&pause, NULL);
+                }
+        }
+        return NULL;
+}
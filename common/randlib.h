@@ -29,10 +29,17 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 #define RANDOMDEVICE	"/dev/urandom"
 #define BUFSIZE			8192
 
+/*! The number of deviates stored by a RandomBuffer: must be a power of 2. */
+#define RANDOM_BUFFER_SIZE      1024
+/*! The maximum number of deviates generated by each buffer at every call to RefillRandomBuffers. */
+#define RANDOM_REFILL_CHUNK     64
+
 typedef unsigned long long ullong;
 typedef unsigned int uint;
 
@@ -206,59 +213,148 @@ private:
 	double logfact[1024];
 };
 
+/**
+ * A generator of random numbers that produces them in blocks and stores them in a
+ * cache-aligned ring buffer, from which random() takes them in constant time.
+ *
+ * The numbers are produced by a counter-based generator: the i-th uniform number of the
+ * sequence is a hash (the output function of SplitMix64) of the seed and of i. Therefore,
+ * the sequence generated with a given seed does not depend on when and in how many blocks
+ * the buffer is refilled. The buffer is refilled by RefillRandomBuffers, which the engine
+ * calls in the idle part of each period, or, one chunk at a time, by random() itself
+ * when it finds it empty.
+ * Refills and calls to random() must not be concurrent.
+ */
+class RandomBuffer {
+public:
+        RandomBuffer(ullong seed, uint size = RANDOM_BUFFER_SIZE);
+        virtual ~RandomBuffer();
+
+        /** Restarts the sequence of numbers from the beginning of the one given by seed. */
+        void setSeed(ullong seed);
+
+        inline double random() {
+                if (m_read == m_written)
+                        refill(RANDOM_REFILL_CHUNK);
+                return m_buffer[(m_read++) & m_mask];
+        }
+
+        /**
+         * Generates at most count new numbers, without overwriting the ones that have not been used yet.
+         * \return the number of numbers generated.
+         */
+        uint refill(uint count);
+
+protected:
+        /** The i-th uniform deviate of the sequence, in the open interval (0,1). */
+        inline double uniform(ullong i) const {
+                ullong z = m_key + (i+1) * 0x9e3779b97f4a7c15ULL;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                z ^= z >> 31;
+                return ((z >> 11) + 0.5) * 1.1102230246251565E-16;
+        }
+
+        /**
+         * Stores in x the n numbers of the sequence that start at position first.
+         * first and n are always multiples of granularity().
+         */
+        virtual void generate(double *x, ullong first, uint n) const = 0;
+
+        /** The number of consecutive numbers that are generated together. */
+        virtual uint granularity() const;
+
+private:
+        double *m_buffer;
+        uint m_size, m_mask;
+        ullong m_key;
+        /** The number of numbers that have been read and generated since the last call to setSeed. */
+        ullong m_read, m_written;
+};
+
+/** Uniform random numbers in the open interval (0,1). */
+class UniformRandomBuffer : public RandomBuffer {
+public:
+        UniformRandomBuffer(ullong seed, uint size = RANDOM_BUFFER_SIZE);
+protected:
+        virtual void generate(double *x, ullong first, uint n) const;
+};
+
+/**
+ * Normal random numbers, obtained with the Box-Muller transform, which
+ * turns two uniform numbers into two normal ones without rejection.
+ */
+class NormalRandomBuffer : public RandomBuffer {
+public:
+        NormalRandomBuffer(double mu, double sigma, ullong seed, uint size = RANDOM_BUFFER_SIZE);
+protected:
+        virtual void generate(double *x, ullong first, uint n) const;
+        virtual uint granularity() const;
+private:
+        double m_mu, m_sigma;
+};
+
+/**
+ * Refills, with at most maxCount numbers each, the buffers of all the RandomBuffer objects
+ * that exist: called by the engine when the entities are not being stepped.
+ */
+void RefillRandomBuffers(uint maxCount = RANDOM_REFILL_CHUNK);
+
+/**
+ * Random numbers read from RANDOMDEVICE. A background thread reads them, size at a time,
+ * into two buffers: while one buffer is used, the other one is refilled, so that the thread
+ * that draws the numbers never blocks on the device and, when the current buffer is
+ * exhausted, only switches to the other one and wakes up the background thread. If the
+ * other buffer is not ready yet, the numbers are taken from a software generator until it
+ * is: fallbacks() returns how many numbers were generated this way.
+ * Only one thread at a time may draw numbers from an object of this class.
+ */
 class UniformRandomHW {
 public:
-	UniformRandomHW(int size = BUFSIZE) {
-		bufsize = sizeof(ullong)*size;
-		buffer = new unsigned char[bufsize];
-		fid = open(RANDOMDEVICE, O_RDONLY);
-		FillBuffer();
-	}
-	
-	~UniformRandomHW() {
-		close(fid);
-		delete buffer;
-	}
+	UniformRandomHW(int size = BUFSIZE);
+	~UniformRandomHW();
 	
 	inline ullong int64() {
-		FillUnion();
-		return n.aLong;
+		if (m_position == m_size && !nextBuffer())
+			return fallback();
+		return m_current[m_position++];
 	}
 	
 	inline uint int32() {
-		FillUnion();
-		return n.aInt[0];
+		return (uint) int64();
 	}
 	
 	inline double doub() {
 		return ((double) int64()) / maxlong;
 	}
-	
-private:
-	union _number {
-		unsigned char s[sizeof(ullong)];
-		ullong aLong;
-		uint aInt[2];
-	};
-	
-	inline void FillBuffer() {
-		read(fid, buffer, bufsize);
-		k=0;
+
+	/** The number of numbers that were taken from the software generator because the device was late. */
+	ullong fallbacks() const {
+		return m_fallbacks;
 	}
 	
-	inline void FillUnion() {
-		if(k > bufsize-(int)sizeof(ullong)) {
-			FillBuffer();
-		}
-		memcpy((void *) &n.s, (const void *) (buffer+k), sizeof(ullong));
-		k += sizeof(ullong);
-	}
+private:
+	UniformRandomHW(const UniformRandomHW&);
+	UniformRandomHW& operator=(const UniformRandomHW&);
+
+	/** Switches to the other buffer, if it is ready. */
+	bool nextBuffer();
+	ullong fallback();
+	bool fillBuffer(ullong *buffer);
+	static void* refillThread(void *arg);
 	
-	union _number n;
-	int bufsize;
-	int k;
-	int fid;
-	unsigned char *buffer;
+	int m_fid;
+	uint m_size, m_position;
+	ullong *m_buffers[2];
+	ullong *m_current;
+	/** The number of buffers filled by the background thread and released by the reader. */
+	volatile ullong m_filled, m_released;
+	volatile bool m_threadRun;
+	pthread_t m_thread;
+	/** Posted whenever a buffer is released, to wake up the background thread. */
+	sem_t m_wakeup;
+	UniformRandom m_software;
+	ullong m_fallbacks;
 };
 
 class NormalRandomHW : UniformRandomHW {
@@ -266,6 +362,8 @@ private:
 	double mu,sig;
 	double storedval;
 public:
+	using UniformRandomHW::fallbacks;
+
 	NormalRandomHW(double mmu, double ssig, ullong bufsize = BUFSIZE) 
 	: UniformRandomHW(bufsize), mu(mmu), sig(ssig), storedval(0.) {} 
 	
@@ -0,0 +1,991 @@
+/*=========================================================================
+ *
+ *   Program:     lcg
+ *   Filename:    simulated_daq.cpp
+ *
+ *   Copyright (C) 2012,2013,2014 Daniele Linaro
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *=========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include "comedilib.h"
+#include "types.h"
+#include "utils.h"
+
+using lcg::Critical;
+using lcg::Info;
+using lcg::Debug;
+
+enum {
+        AI_SUBDEVICE = 0,
+        AO_SUBDEVICE,
+        DIO_SUBDEVICE,
+        NUMBER_OF_SUBDEVICES
+};
+
+enum {
+        SIMULATED_NO_ERROR = 0,
+        SIMULATED_BAD_SUBDEVICE,
+        SIMULATED_BAD_CHANNEL,
+        SIMULATED_BAD_RANGE,
+        SIMULATED_BAD_COMMAND,
+        SIMULATED_BAD_INSTRUCTION,
+        SIMULATED_BUFFER_OVERFLOW,
+        SIMULATED_BUFFER_UNDERRUN,
+        SIMULATED_SYSTEM_ERROR
+};
+
+static const char *errorMessages[] = {
+        "Success",
+        "Invalid subdevice",
+        "Invalid channel",
+        "Invalid range",
+        "Invalid command",
+        "Invalid instruction",
+        "Buffer overflow",
+        "Buffer underrun",
+        "System error"
+};
+
+static const lsampl_t maxData = 65535;
+static comedi_range inputRanges[] = {
+        {-10., 10., UNIT_volt}, {-5., 5., UNIT_volt}, {-1., 1., UNIT_volt}, {-0.2, 0.2, UNIT_volt}
+};
+static comedi_range outputRanges[] = {
+        {-10., 10., UNIT_volt}
+};
+static comedi_range digitalRange = {0., 5., UNIT_volt};
+
+static int lastError = SIMULATED_NO_ERROR;
+
+static int SetError(int error)
+{
+        lastError = error;
+        return -1;
+}
+
+static double Now()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+/*! Simulates the conversion time of an instruction, without yielding the processor. */
+static void Convert(double latency)
+{
+        if (latency <= 0)
+                return;
+        double end = Now() + latency;
+        while (Now() < end) ;
+}
+
+/*!
+ * The state of a simulated board, shared by all the handles opened on the same device file.
+ * All members are protected by the mutex.
+ */
+struct SimulatedBoard {
+        SimulatedBoard(const std::string& name);
+        ~SimulatedBoard();
+
+        /*! Parses the options in the LCG_SIMULATED_DAQ environment variable. */
+        bool configure(const char *options);
+        /*! Computes the state of the board up to time t. */
+        void advance(double t);
+        /*! Returns the voltage at an analog input. */
+        double input(uint channel);
+        /*! Returns a uniform random number in (0,1). */
+        double uniform();
+
+        std::string name;
+        uint references;
+        pthread_mutex_t mutex;
+
+        uint channels[NUMBER_OF_SUBDEVICES];
+        double rate, latency, noise;
+        size_t bufferSize;
+        std::vector<int> loopback;
+        int neuronOutput, neuronInput;
+        double commandGain, signalGain;
+
+        std::vector<double> outputs;
+        std::vector<uint> lines;
+        double time;
+        uint seed;
+
+        // a leaky integrate-and-fire neuron
+        double V, tSpike;
+        static const double C, tau, Er, Vth, Vreset, Vspike, tarp, spikeDuration;
+};
+
+const double SimulatedBoard::C = 200.;               // (pF)
+const double SimulatedBoard::tau = 20e-3;            // (s)
+const double SimulatedBoard::Er = -65.;              // (mV)
+const double SimulatedBoard::Vth = -50.;             // (mV)
+const double SimulatedBoard::Vreset = -70.;          // (mV)
+const double SimulatedBoard::Vspike = 20.;           // (mV)
+const double SimulatedBoard::tarp = 2e-3;            // (s)
+const double SimulatedBoard::spikeDuration = 1e-3;   // (s)
+
+SimulatedBoard::SimulatedBoard(const std::string& name_)
+        : name(name_), references(0), rate(100000.), latency(0.), noise(0.), bufferSize(65536),
+          neuronOutput(-1), neuronInput(-1), commandGain(400.), signalGain(0.01),
+          time(Now()), seed(5061983), V(Er), tSpike(-1.)
+{
+        channels[AI_SUBDEVICE] = 16;
+        channels[AO_SUBDEVICE] = 2;
+        channels[DIO_SUBDEVICE] = 8;
+        pthread_mutex_init(&mutex, NULL);
+}
+
+SimulatedBoard::~SimulatedBoard()
+{
+        pthread_mutex_destroy(&mutex);
+}
+
+bool SimulatedBoard::configure(const char *options)
+{
+        std::vector< std::pair<int,int> > pairs;
+        if (options != NULL) {
+                std::string str(options);
+                size_t start = 0;
+                while (start < str.size()) {
+                        size_t stop = str.find(';', start);
+                        if (stop == std::string::npos)
+                                stop = str.size();
+                        std::string option = str.substr(start, stop-start);
+                        start = stop + 1;
+                        size_t eq = option.find('=');
+                        if (eq == std::string::npos) {
+                                if (!option.empty())
+                                        Logger(Critical, "Simulated DAQ: option [%s] has no value.\n", option.c_str());
+                                continue;
+                        }
+                        std::string key = option.substr(0, eq), value = option.substr(eq+1);
+                        int ao, ai, n;
+                        if (key == "ai")
+                                channels[AI_SUBDEVICE] = atoi(value.c_str());
+                        else if (key == "ao")
+                                channels[AO_SUBDEVICE] = atoi(value.c_str());
+                        else if (key == "dio")
+                                channels[DIO_SUBDEVICE] = atoi(value.c_str());
+                        else if (key == "rate")
+                                rate = atof(value.c_str());
+                        else if (key == "latency")
+                                latency = atof(value.c_str());
+                        else if (key == "noise")
+                                noise = atof(value.c_str());
+                        else if (key == "buffer")
+                                bufferSize = atol(value.c_str());
+                        else if (key == "command_gain")
+                                commandGain = atof(value.c_str());
+                        else if (key == "signal_gain")
+                                signalGain = atof(value.c_str());
+                        else if (key == "neuron" && sscanf(value.c_str(), "%d:%d", &neuronOutput, &neuronInput) == 2)
+                                ;
+                        else if (key == "loopback") {
+                                const char *p = value.c_str();
+                                while (sscanf(p, "%d:%d%n", &ao, &ai, &n) == 2) {
+                                        pairs.push_back(std::make_pair(ao, ai));
+                                        p += n;
+                                        if (*p == ',')
+                                                p++;
+                                }
+                        }
+                        else {
+                                Logger(Critical, "Simulated DAQ: unknown or malformed option [%s].\n", option.c_str());
+                                return false;
+                        }
+                }
+        }
+        if (rate <= 0) {
+                Logger(Critical, "Simulated DAQ: the rate must be positive.\n");
+                return false;
+        }
+        if (bufferSize == 0 || bufferSize % sizeof(lsampl_t)) {
+                Logger(Critical, "Simulated DAQ: the size of the buffer must be a positive multiple of %d bytes.\n",
+                       (int) sizeof(lsampl_t));
+                return false;
+        }
+        loopback.assign(channels[AI_SUBDEVICE], -1);
+        for (size_t i=0; i<pairs.size(); i++) {
+                if (pairs[i].first < 0 || pairs[i].first >= (int) channels[AO_SUBDEVICE] ||
+                    pairs[i].second < 0 || pairs[i].second >= (int) channels[AI_SUBDEVICE]) {
+                        Logger(Critical, "Simulated DAQ: invalid loopback %d:%d.\n", pairs[i].first, pairs[i].second);
+                        return false;
+                }
+                loopback[pairs[i].second] = pairs[i].first;
+        }
+        if ((neuronOutput >= 0 || neuronInput >= 0) &&
+            (neuronOutput < 0 || neuronOutput >= (int) channels[AO_SUBDEVICE] ||
+             neuronInput < 0 || neuronInput >= (int) channels[AI_SUBDEVICE])) {
+                Logger(Critical, "Simulated DAQ: invalid neuron %d:%d.\n", neuronOutput, neuronInput);
+                return false;
+        }
+        outputs.assign(channels[AO_SUBDEVICE], 0.);
+        lines.assign(channels[DIO_SUBDEVICE], 0);
+        Logger(Info, "Simulated DAQ [%s]: %d analog inputs, %d analog outputs, %d digital lines, "
+                        "updated at %g Hz with a latency of %g s per instruction.\n", name.c_str(),
+                        channels[AI_SUBDEVICE], channels[AO_SUBDEVICE], channels[DIO_SUBDEVICE], rate, latency);
+        return true;
+}
+
+void SimulatedBoard::advance(double t)
+{
+        double dt = 1. / rate;
+        // do not integrate the idle time between experiments
+        if (t - time > 1.)
+                time = t - 1.;
+        while (time + dt <= t) {
+                time += dt;
+                if (neuronOutput < 0)
+                        continue;
+                if (time < tSpike + tarp) {
+                        V = Vreset;
+                        continue;
+                }
+                double I = outputs[neuronOutput] * commandGain;         // (pA)
+                V += dt * ((Er - V) / tau + I / C * 1e3);               // (mV)
+                if (V >= Vth) {
+                        tSpike = time;
+                        V = Vreset;
+                }
+        }
+}
+
+double SimulatedBoard::uniform()
+{
+        return (rand_r(&seed) + 1.) / (RAND_MAX + 2.);
+}
+
+double SimulatedBoard::input(uint channel)
+{
+        double value = 0.;
+        if (loopback[channel] >= 0)
+                value = outputs[loopback[channel]];
+        else if ((int) channel == neuronInput)
+                value = (time < tSpike + spikeDuration ? Vspike : V) * signalGain;
+        if (noise > 0)
+                value += noise * sqrt(-2.*log(uniform())) * cos(2.*M_PI*uniform());
+        return value;
+}
+
+static lsampl_t Quantize(double value, const comedi_range *range)
+{
+        double sample = nearbyint((value - range->min) / (range->max - range->min) * maxData);
+        if (sample < 0)
+                return 0;
+        if (sample > maxData)
+                return maxData;
+        return (lsampl_t) sample;
+}
+
+/*! The state of an asynchronous acquisition or generation. */
+struct SimulatedCommand {
+        SimulatedCommand() : issued(false), running(false), scans(0), next(0.), period(0.) {}
+        bool issued, running;
+        comedi_cmd cmd;
+        std::vector<uint> chanlist;
+        ullong scans;
+        double next, period;
+};
+
+/*!
+ * The asynchronous buffer of an analog subdevice, used instead of the socket when the user maps
+ * it in memory. produced and consumed are the number of bytes written to and read from the
+ * buffer since the command was issued.
+ */
+struct SimulatedBuffer {
+        SimulatedBuffer() : mapped(false), overflow(false), underrun(false), produced(0), consumed(0) {}
+        std::vector<char> data;
+        bool mapped, overflow, underrun;
+        ullong produced, consumed;
+};
+
+struct comedi_t_struct {
+        SimulatedBoard *board;
+        /*! The user reads and writes fds[0], the command thread fds[1]. */
+        int fds[2];
+        SimulatedCommand commands[2];
+        SimulatedBuffer buffers[2];
+        std::deque<sampl_t> queue;
+        std::vector<char> partial;
+        pthread_t thread;
+        bool threadRunning;
+        volatile bool stopThread;
+};
+
+static std::map<std::string,SimulatedBoard*> boards;
+static pthread_mutex_t boardsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*! Moves the samples written by the user to the queue of the analog output command. Called with the board locked. */
+static void DrainOutput(comedi_t *device)
+{
+        char buffer[4096];
+        ssize_t n;
+        while ((n = recv(device->fds[1], buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+                device->partial.insert(device->partial.end(), buffer, buffer+n);
+                size_t i, nSamples = device->partial.size() / sizeof(sampl_t);
+                for (i=0; i<nSamples; i++)
+                        device->queue.push_back(((sampl_t *) &device->partial[0])[i]);
+                device->partial.erase(device->partial.begin(), device->partial.begin() + nSamples*sizeof(sampl_t));
+        }
+}
+
+/*!
+ * Runs the asynchronous commands of a device: analog input scans are written to the
+ * socket read by the user and analog output scans are taken from the samples the user
+ * wrote, or to and from the buffers of the subdevices, if the user mapped them.
+ * Scans are executed at the times dictated by the command, catching up if the
+ * thread was delayed.
+ */
+static void* CommandThread(void *arg)
+{
+        comedi_t *device = static_cast<comedi_t*>(arg);
+        SimulatedBoard *board = device->board;
+        std::vector<sampl_t> scans;
+        while (!device->stopThread) {
+                double now = Now(), wake = now + 1e-4;
+                bool finished = false;
+                scans.clear();
+                pthread_mutex_lock(&board->mutex);
+                DrainOutput(device);
+                SimulatedCommand *ao = &device->commands[AO_SUBDEVICE];
+                SimulatedBuffer *aob = &device->buffers[AO_SUBDEVICE];
+                while (ao->running && ao->next <= now) {
+                        board->advance(ao->next);
+                        if (aob->mapped ? aob->produced - aob->consumed < ao->chanlist.size()*sizeof(sampl_t) :
+                            device->queue.size() < ao->chanlist.size()) {
+                                // as a real board, stop the generation if the user does not fill the buffer in
+                                // time: the outputs hold their last value
+                                aob->underrun = true;
+                                ao->running = false;
+                                break;
+                        }
+                        for (size_t i=0; i<ao->chanlist.size(); i++) {
+                                uint chanspec = ao->chanlist[i];
+                                sampl_t sample;
+                                if (aob->mapped) {
+                                        sample = *(sampl_t *) &aob->data[aob->consumed % aob->data.size()];
+                                        aob->consumed += sizeof(sampl_t);
+                                }
+                                else {
+                                        sample = device->queue.front();
+                                        device->queue.pop_front();
+                                }
+                                board->outputs[CR_CHAN(chanspec)] = comedi_to_phys(sample,
+                                                &outputRanges[CR_RANGE(chanspec)], maxData);
+                        }
+                        ao->scans++;
+                        ao->next += ao->period;
+                        if (ao->cmd.stop_src == TRIG_COUNT && ao->scans >= ao->cmd.stop_arg)
+                                ao->running = false;
+                }
+                SimulatedCommand *ai = &device->commands[AI_SUBDEVICE];
+                SimulatedBuffer *aib = &device->buffers[AI_SUBDEVICE];
+                while (ai->running && ai->next <= now) {
+                        board->advance(ai->next);
+                        if (aib->mapped && aib->produced - aib->consumed + ai->chanlist.size()*sizeof(sampl_t) > aib->data.size()) {
+                                // as a real board, stop the acquisition if the user does not empty the buffer in time
+                                aib->overflow = true;
+                                ai->running = false;
+                                finished = true;
+                                break;
+                        }
+                        for (size_t i=0; i<ai->chanlist.size(); i++) {
+                                uint chanspec = ai->chanlist[i];
+                                sampl_t sample = (sampl_t) Quantize(board->input(CR_CHAN(chanspec)),
+                                                                    &inputRanges[CR_RANGE(chanspec)]);
+                                if (aib->mapped) {
+                                        *(sampl_t *) &aib->data[aib->produced % aib->data.size()] = sample;
+                                        aib->produced += sizeof(sampl_t);
+                                }
+                                else {
+                                        scans.push_back(sample);
+                                }
+                        }
+                        ai->scans++;
+                        ai->next += ai->period;
+                        if (ai->cmd.stop_src == TRIG_COUNT && ai->scans >= ai->cmd.stop_arg) {
+                                ai->running = false;
+                                finished = true;
+                        }
+                }
+                if (ao->running && ao->next < wake)
+                        wake = ao->next;
+                if (ai->running && ai->next < wake)
+                        wake = ai->next;
+                pthread_mutex_unlock(&board->mutex);
+
+                size_t length = scans.size()*sizeof(sampl_t), written = 0;
+                while (written < length) {
+                        ssize_t n = send(device->fds[1], (char *) &scans[0] + written, length - written, MSG_NOSIGNAL);
+                        if (n < 0)
+                                break;
+                        written += n;
+                }
+                // the end of the acquisition is signalled to the reader as the end of the file
+                if (finished)
+                        shutdown(device->fds[1], SHUT_WR);
+
+                now = Now();
+                if (wake > now) {
+                        struct timespec ts;
+                        ts.tv_sec = (time_t) (wake - now);
+                        ts.tv_nsec = (long) ((wake - now - ts.tv_sec) * 1e9);
+                        nanosleep(&ts, NULL);
+                }
+        }
+        return NULL;
+}
+
+static void StopCommandThread(comedi_t *device)
+{
+        if (device->threadRunning) {
+                device->stopThread = true;
+                pthread_join(device->thread, NULL);
+                device->threadRunning = false;
+        }
+        if (device->fds[0] >= 0) {
+                close(device->fds[0]);
+                close(device->fds[1]);
+                device->fds[0] = device->fds[1] = -1;
+        }
+        device->queue.clear();
+        device->partial.clear();
+        device->buffers[AI_SUBDEVICE].mapped = device->buffers[AO_SUBDEVICE].mapped = false;
+}
+
+static bool IsAnalog(uint subdevice)
+{
+        return subdevice == AI_SUBDEVICE || subdevice == AO_SUBDEVICE;
+}
+
+static const comedi_range* Range(comedi_t *device, uint subdevice, uint channel, uint range)
+{
+        if (subdevice >= NUMBER_OF_SUBDEVICES) {
+                SetError(SIMULATED_BAD_SUBDEVICE);
+                return NULL;
+        }
+        if (channel >= device->board->channels[subdevice]) {
+                SetError(SIMULATED_BAD_CHANNEL);
+                return NULL;
+        }
+        if (subdevice == AI_SUBDEVICE && range < sizeof(inputRanges)/sizeof(comedi_range))
+                return &inputRanges[range];
+        if (subdevice == AO_SUBDEVICE && range < sizeof(outputRanges)/sizeof(comedi_range))
+                return &outputRanges[range];
+        if (subdevice == DIO_SUBDEVICE && range == 0)
+                return &digitalRange;
+        SetError(SIMULATED_BAD_RANGE);
+        return NULL;
+}
+
+extern "C" {
+
+comedi_t* comedi_open(const char *filename)
+{
+        SimulatedBoard *board;
+        pthread_mutex_lock(&boardsMutex);
+        std::map<std::string,SimulatedBoard*>::iterator it = boards.find(filename);
+        if (it == boards.end()) {
+                board = new SimulatedBoard(filename);
+                if (!board->configure(getenv("LCG_SIMULATED_DAQ"))) {
+                        delete board;
+                        pthread_mutex_unlock(&boardsMutex);
+                        SetError(SIMULATED_SYSTEM_ERROR);
+                        return NULL;
+                }
+                boards[filename] = board;
+        }
+        else {
+                board = it->second;
+        }
+        board->references++;
+        pthread_mutex_unlock(&boardsMutex);
+
+        comedi_t *device = new comedi_t;
+        device->board = board;
+        device->fds[0] = device->fds[1] = -1;
+        device->threadRunning = false;
+        device->stopThread = false;
+        device->buffers[AI_SUBDEVICE].data.resize(board->bufferSize);
+        device->buffers[AO_SUBDEVICE].data.resize(board->bufferSize);
+        return device;
+}
+
+int comedi_close(comedi_t *device)
+{
+        StopCommandThread(device);
+        pthread_mutex_lock(&boardsMutex);
+        if (--device->board->references == 0) {
+                boards.erase(device->board->name);
+                delete device->board;
+        }
+        pthread_mutex_unlock(&boardsMutex);
+        delete device;
+        return 0;
+}
+
+int comedi_fileno(comedi_t *device)
+{
+        if (device->fds[0] < 0 && socketpair(AF_UNIX, SOCK_STREAM, 0, device->fds) != 0) {
+                device->fds[0] = device->fds[1] = -1;
+                return SetError(SIMULATED_SYSTEM_ERROR);
+        }
+        return device->fds[0];
+}
+
+int comedi_errno(void)
+{
+        return lastError;
+}
+
+const char* comedi_strerror(int errnum)
+{
+        if (errnum < 0 || errnum > SIMULATED_SYSTEM_ERROR)
+                return "Unknown error";
+        return errorMessages[errnum];
+}
+
+void comedi_perror(const char *s)
+{
+        fprintf(stderr, "%s: %s\n", s, comedi_strerror(lastError));
+}
+
+int comedi_get_subdevice_type(comedi_t *device, unsigned int subdevice)
+{
+        switch (subdevice) {
+        case AI_SUBDEVICE:
+                return COMEDI_SUBD_AI;
+        case AO_SUBDEVICE:
+                return COMEDI_SUBD_AO;
+        case DIO_SUBDEVICE:
+                return COMEDI_SUBD_DIO;
+        }
+        return SetError(SIMULATED_BAD_SUBDEVICE);
+}
+
+int comedi_get_subdevice_flags(comedi_t *device, unsigned int subdevice)
+{
+        if (subdevice >= NUMBER_OF_SUBDEVICES)
+                return SetError(SIMULATED_BAD_SUBDEVICE);
+        if (IsAnalog(subdevice))
+                return SDF_SOFT_CALIBRATED | SDF_MMAP |
+                        (device->commands[subdevice].running ? SDF_BUSY | SDF_RUNNING : 0);
+        return 0;
+}
+
+int comedi_get_n_channels(comedi_t *device, unsigned int subdevice)
+{
+        if (subdevice >= NUMBER_OF_SUBDEVICES)
+                return SetError(SIMULATED_BAD_SUBDEVICE);
+        return device->board->channels[subdevice];
+}
+
+lsampl_t comedi_get_maxdata(comedi_t *device, unsigned int subdevice, unsigned int channel)
+{
+        if (Range(device, subdevice, channel, 0) == NULL)
+                return 0;
+        return IsAnalog(subdevice) ? maxData : 1;
+}
+
+comedi_range* comedi_get_range(comedi_t *device, unsigned int subdevice, unsigned int channel, unsigned int range)
+{
+        return const_cast<comedi_range*>(Range(device, subdevice, channel, range));
+}
+
+char* comedi_get_default_calibration_path(comedi_t *device)
+{
+        std::string path = "simulated:" + device->board->name;
+        return strdup(path.c_str());
+}
+
+struct comedi_calibration_struct {
+        char *path;
+};
+
+comedi_calibration_t* comedi_parse_calibration_file(const char *path)
+{
+        comedi_calibration_t *calibration = (comedi_calibration_t *) malloc(sizeof(comedi_calibration_t));
+        calibration->path = strdup(path);
+        return calibration;
+}
+
+void comedi_cleanup_calibration(comedi_calibration_t *calibration)
+{
+        if (calibration != NULL) {
+                free(calibration->path);
+                free(calibration);
+        }
+}
+
+int comedi_get_softcal_converter(unsigned int subdevice, unsigned int channel, unsigned int range,
+                                 enum comedi_conversion_direction direction,
+                                 const comedi_calibration_t *calibration, comedi_polynomial_t *converter)
+{
+        const comedi_range *r;
+        if (calibration == NULL || !IsAnalog(subdevice))
+                return SetError(SIMULATED_BAD_SUBDEVICE);
+        if (subdevice == AI_SUBDEVICE && range < sizeof(inputRanges)/sizeof(comedi_range))
+                r = &inputRanges[range];
+        else if (subdevice == AO_SUBDEVICE && range < sizeof(outputRanges)/sizeof(comedi_range))
+                r = &outputRanges[range];
+        else
+                return SetError(SIMULATED_BAD_RANGE);
+        // the simulated converters are ideal: a linear map between the samples and the range
+        memset(converter, 0, sizeof(comedi_polynomial_t));
+        converter->order = 1;
+        converter->expansion_origin = 0.;
+        if (direction == COMEDI_TO_PHYSICAL) {
+                converter->coefficients[0] = r->min;
+                converter->coefficients[1] = (r->max - r->min) / maxData;
+        }
+        else {
+                converter->coefficients[0] = -r->min * maxData / (r->max - r->min);
+                converter->coefficients[1] = maxData / (r->max - r->min);
+        }
+        return 0;
+}
+
+double comedi_to_physical(lsampl_t data, const comedi_polynomial_t *converter)
+{
+        double x = (double) data - converter->expansion_origin, value = 0., term = 1.;
+        for (unsigned i=0; i<=converter->order; i++) {
+                value += converter->coefficients[i] * term;
+                term *= x;
+        }
+        return value;
+}
+
+lsampl_t comedi_from_physical(double data, const comedi_polynomial_t *converter)
+{
+        double x = data - converter->expansion_origin, value = 0., term = 1.;
+        for (unsigned i=0; i<=converter->order; i++) {
+                value += converter->coefficients[i] * term;
+                term *= x;
+        }
+        if (value < 0)
+                return 0;
+        return (lsampl_t) nearbyint(value);
+}
+
+double comedi_to_phys(lsampl_t data, const comedi_range *range, lsampl_t maxdata)
+{
+        return range->min + (range->max - range->min) * data / maxdata;
+}
+
+lsampl_t comedi_from_phys(double data, const comedi_range *range, lsampl_t maxdata)
+{
+        double value = nearbyint((data - range->min) / (range->max - range->min) * maxdata);
+        if (value < 0)
+                return 0;
+        if (value > maxdata)
+                return maxdata;
+        return (lsampl_t) value;
+}
+
+int comedi_data_read(comedi_t *device, unsigned int subdevice, unsigned int channel,
+                     unsigned int range, unsigned int aref, lsampl_t *data)
+{
+        comedi_insn insn;
+        memset(&insn, 0, sizeof(comedi_insn));
+        insn.insn = INSN_READ;
+        insn.n = 1;
+        insn.data = data;
+        insn.subdev = subdevice;
+        insn.chanspec = CR_PACK(channel, range, aref);
+        return comedi_do_insn(device, &insn);
+}
+
+int comedi_data_write(comedi_t *device, unsigned int subdevice, unsigned int channel,
+                      unsigned int range, unsigned int aref, lsampl_t data)
+{
+        comedi_insn insn;
+        memset(&insn, 0, sizeof(comedi_insn));
+        insn.insn = INSN_WRITE;
+        insn.n = 1;
+        insn.data = &data;
+        insn.subdev = subdevice;
+        insn.chanspec = CR_PACK(channel, range, aref);
+        return comedi_do_insn(device, &insn);
+}
+
+int comedi_do_insn(comedi_t *device, comedi_insn *insn)
+{
+        SimulatedBoard *board = device->board;
+        uint channel = CR_CHAN(insn->chanspec);
+        const comedi_range *range;
+
+        if (insn->insn == INSN_INTTRIG) {
+                if (!IsAnalog(insn->subdev) || !device->commands[insn->subdev].issued)
+                        return SetError(SIMULATED_BAD_INSTRUCTION);
+                pthread_mutex_lock(&board->mutex);
+                device->commands[insn->subdev].running = true;
+                device->commands[insn->subdev].next = Now();
+                pthread_mutex_unlock(&board->mutex);
+                return insn->n;
+        }
+        if (insn->insn != INSN_READ && insn->insn != INSN_WRITE)
+                return SetError(SIMULATED_BAD_INSTRUCTION);
+        if ((range = Range(device, insn->subdev, channel, CR_RANGE(insn->chanspec))) == NULL)
+                return -1;
+
+        Convert(board->latency * insn->n);
+        pthread_mutex_lock(&board->mutex);
+        board->advance(Now());
+        for (uint i=0; i<insn->n; i++) {
+                switch (insn->subdev) {
+                case AI_SUBDEVICE:
+                        if (insn->insn == INSN_READ)
+                                insn->data[i] = Quantize(board->input(channel), range);
+                        break;
+                case AO_SUBDEVICE:
+                        if (insn->insn == INSN_READ)
+                                insn->data[i] = Quantize(board->outputs[channel], range);
+                        else
+                                board->outputs[channel] = comedi_to_phys(insn->data[i], range, maxData);
+                        break;
+                case DIO_SUBDEVICE:
+                        if (insn->insn == INSN_READ)
+                                insn->data[i] = board->lines[channel];
+                        else
+                                board->lines[channel] = (insn->data[i] != 0);
+                        break;
+                }
+        }
+        pthread_mutex_unlock(&board->mutex);
+        return insn->n;
+}
+
+int comedi_do_insnlist(comedi_t *device, comedi_insnlist *list)
+{
+        uint i;
+        for (i=0; i<list->n_insns; i++) {
+                if (comedi_do_insn(device, &list->insns[i]) < 0)
+                        break;
+        }
+        return i > 0 ? i : -1;
+}
+
+int comedi_dio_config(comedi_t *device, unsigned int subdevice, unsigned int channel, unsigned int direction)
+{
+        if (Range(device, subdevice, channel, 0) == NULL)
+                return -1;
+        return subdevice == DIO_SUBDEVICE ? 0 : SetError(SIMULATED_BAD_SUBDEVICE);
+}
+
+int comedi_dio_read(comedi_t *device, unsigned int subdevice, unsigned int channel, unsigned int *bit)
+{
+        lsampl_t sample;
+        if (comedi_data_read(device, subdevice, channel, 0, AREF_GROUND, &sample) < 0)
+                return -1;
+        *bit = sample;
+        return 1;
+}
+
+int comedi_dio_write(comedi_t *device, unsigned int subdevice, unsigned int channel, unsigned int bit)
+{
+        return comedi_data_write(device, subdevice, channel, 0, AREF_GROUND, bit);
+}
+
+int comedi_set_routing(comedi_t *device, unsigned int subdevice, unsigned int channel, unsigned int routing)
+{
+        return comedi_dio_config(device, subdevice, channel, COMEDI_OUTPUT);
+}
+
+int comedi_get_cmd_generic_timed(comedi_t *device, unsigned int subdevice, comedi_cmd *cmd,
+                                 unsigned int chanlist_len, unsigned int scan_period_ns)
+{
+        if (!IsAnalog(subdevice))
+                return SetError(SIMULATED_BAD_SUBDEVICE);
+        memset(cmd, 0, sizeof(comedi_cmd));
+        cmd->subdev = subdevice;
+        cmd->start_src = TRIG_NOW;
+        cmd->scan_begin_src = TRIG_TIMER;
+        cmd->scan_begin_arg = scan_period_ns;
+        cmd->convert_src = TRIG_TIMER;
+        cmd->convert_arg = chanlist_len > 0 ? scan_period_ns / chanlist_len : 0;
+        cmd->scan_end_src = TRIG_COUNT;
+        cmd->scan_end_arg = chanlist_len;
+        cmd->stop_src = TRIG_NONE;
+        cmd->chanlist_len = chanlist_len;
+        return 0;
+}
+
+int comedi_command_test(comedi_t *device, comedi_cmd *cmd)
+{
+        int fixed = 0;
+        if (!IsAnalog(cmd->subdev))
+                return SetError(SIMULATED_BAD_SUBDEVICE);
+        if (cmd->chanlist_len == 0 || cmd->chanlist == NULL || cmd->scan_begin_src != TRIG_TIMER ||
+            (cmd->start_src != TRIG_NOW && cmd->start_src != TRIG_INT) ||
+            (cmd->stop_src != TRIG_NONE && cmd->stop_src != TRIG_COUNT))
+                return SetError(SIMULATED_BAD_COMMAND);
+        for (uint i=0; i<cmd->chanlist_len; i++) {
+                if (Range(device, cmd->subdev, CR_CHAN(cmd->chanlist[i]), CR_RANGE(cmd->chanlist[i])) == NULL)
+                        return SetError(SIMULATED_BAD_COMMAND);
+        }
+        uint minPeriod = (uint) ceil(1e9 / device->board->rate);
+        if (cmd->scan_begin_arg < minPeriod) {
+                cmd->scan_begin_arg = minPeriod;
+                fixed = 1;
+        }
+        if (cmd->convert_arg * cmd->chanlist_len > cmd->scan_begin_arg || cmd->convert_arg == 0) {
+                cmd->convert_arg = cmd->scan_begin_arg / cmd->chanlist_len;
+                fixed = 1;
+        }
+        if (cmd->scan_end_arg != cmd->chanlist_len) {
+                cmd->scan_end_arg = cmd->chanlist_len;
+                fixed = 1;
+        }
+        return fixed ? 4 : 0;
+}
+
+int comedi_command(comedi_t *device, comedi_cmd *cmd)
+{
+        if (comedi_command_test(device, cmd) < 0 || comedi_fileno(device) < 0)
+                return -1;
+        SimulatedCommand *command = &device->commands[cmd->subdev];
+        pthread_mutex_lock(&device->board->mutex);
+        command->cmd = *cmd;
+        command->chanlist.assign(cmd->chanlist, cmd->chanlist + cmd->chanlist_len);
+        command->cmd.chanlist = NULL;
+        command->issued = true;
+        command->running = (cmd->start_src == TRIG_NOW);
+        command->scans = 0;
+        command->period = 1e-9 * cmd->scan_begin_arg;
+        command->next = Now();
+        device->buffers[cmd->subdev].produced = device->buffers[cmd->subdev].consumed = 0;
+        device->buffers[cmd->subdev].overflow = device->buffers[cmd->subdev].underrun = false;
+        if (cmd->subdev == AO_SUBDEVICE) {
+                // the samples written for a previous command are discarded
+                DrainOutput(device);
+                device->queue.clear();
+                device->partial.clear();
+        }
+        pthread_mutex_unlock(&device->board->mutex);
+        if (!device->threadRunning) {
+                device->stopThread = false;
+                if (pthread_create(&device->thread, NULL, CommandThread, device) != 0)
+                        return SetError(SIMULATED_SYSTEM_ERROR);
+                device->threadRunning = true;
+        }
+        return 0;
+}
+
+int comedi_cancel(comedi_t *device, unsigned int subdevice)
+{
+        if (!IsAnalog(subdevice))
+                return SetError(SIMULATED_BAD_SUBDEVICE);
+        pthread_mutex_lock(&device->board->mutex);
+        device->commands[subdevice].issued = false;
+        device->commands[subdevice].running = false;
+        bool idle = !device->commands[AI_SUBDEVICE].issued && !device->commands[AO_SUBDEVICE].issued;
+        pthread_mutex_unlock(&device->board->mutex);
+        if (idle)
+                StopCommandThread(device);
+        return 0;
+}
+
+int comedi_get_buffer_size(comedi_t *device, unsigned int subdevice)
+{
+        if (!IsAnalog(subdevice))
+                return SetError(SIMULATED_BAD_SUBDEVICE);
+        return device->buffers[subdevice].data.size();
+}
+
+int comedi_get_buffer_contents(comedi_t *device, unsigned int subdevice)
+{
+        int contents;
+        if (!IsAnalog(subdevice))
+                return SetError(SIMULATED_BAD_SUBDEVICE);
+        SimulatedBuffer *buffer = &device->buffers[subdevice];
+        // the scans that are not read from a mapped buffer wait in the socket
+        if (subdevice == AI_SUBDEVICE && !buffer->mapped) {
+                if (device->fds[0] < 0 || ioctl(device->fds[0], FIONREAD, &contents) != 0)
+                        contents = 0;
+                return contents;
+        }
+        pthread_mutex_lock(&device->board->mutex);
+        if (buffer->mapped || subdevice == AI_SUBDEVICE) {
+                contents = buffer->produced - buffer->consumed;
+        }
+        else {
+                // the samples written to the socket are moved to the queue by the command thread
+                DrainOutput(device);
+                contents = (device->queue.size() * sizeof(sampl_t)) + device->partial.size();
+        }
+        if (buffer->overflow && contents == 0)
+                contents = SetError(SIMULATED_BUFFER_OVERFLOW);
+        else if (buffer->underrun)
+                contents = SetError(SIMULATED_BUFFER_UNDERRUN);
+        pthread_mutex_unlock(&device->board->mutex);
+        return contents;
+}
+
+int comedi_mark_buffer_read(comedi_t *device, unsigned int subdevice, unsigned int bytes)
+{
+        if (subdevice != AI_SUBDEVICE)
+                return SetError(SIMULATED_BAD_SUBDEVICE);
+        SimulatedBuffer *buffer = &device->buffers[subdevice];
+        pthread_mutex_lock(&device->board->mutex);
+        if (bytes > buffer->produced - buffer->consumed)
+                bytes = buffer->produced - buffer->consumed;
+        buffer->consumed += bytes;
+        pthread_mutex_unlock(&device->board->mutex);
+        return bytes;
+}
+
+int comedi_mark_buffer_written(comedi_t *device, unsigned int subdevice, unsigned int bytes)
+{
+        if (subdevice != AO_SUBDEVICE)
+                return SetError(SIMULATED_BAD_SUBDEVICE);
+        SimulatedBuffer *buffer = &device->buffers[subdevice];
+        pthread_mutex_lock(&device->board->mutex);
+        if (bytes > buffer->data.size() - (buffer->produced - buffer->consumed))
+                bytes = buffer->data.size() - (buffer->produced - buffer->consumed);
+        buffer->produced += bytes;
+        pthread_mutex_unlock(&device->board->mutex);
+        return bytes;
+}
+
+void* comedi_simulated_map_buffer(comedi_t *device, unsigned int subdevice)
+{
+        if (!IsAnalog(subdevice)) {
+                SetError(SIMULATED_BAD_SUBDEVICE);
+                return NULL;
+        }
+        pthread_mutex_lock(&device->board->mutex);
+        device->buffers[subdevice].mapped = true;
+        pthread_mutex_unlock(&device->board->mutex);
+        return &device->buffers[subdevice].data[0];
+}
+
+} // extern "C"
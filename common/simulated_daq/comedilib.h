@@ -0,0 +1,233 @@
+/*=========================================================================
+ *
+ *   Program:     lcg
+ *   Filename:    comedilib.h
+ *
+ *   Copyright (C) 2012,2013,2014 Daniele Linaro
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *=========================================================================*/
+
+/*!
+ * \file comedilib.h
+ * \brief A software DAQ board that replaces comedilib.
+ *
+ * When lcg is configured with --enable-simulated-daq, this header is found before
+ * the one of comedilib, so that the Comedi analog and digital I/O classes, the
+ * streams, RealNeuron and the triggering of the engine are compiled unchanged
+ * against a simulated board, implemented in simulated_daq.cpp. Only the part of
+ * the comedilib API that is used by lcg is provided.
+ *
+ * Every device file names a board with three subdevices: analog input (0),
+ * analog output (1) and digital I/O (2). The board is configured by the
+ * environment variable LCG_SIMULATED_DAQ, which contains a list of options
+ * of the form key=value, separated by semicolons:
+ *  - ai, ao, dio: the number of channels of each subdevice (16, 2 and 8).
+ *  - rate: the rate, in Hz, at which the state of the board is updated, which
+ *    is also the maximum rate of the commands (100000).
+ *  - latency: the time, in seconds, taken by each read or write instruction (0).
+ *  - noise: the standard deviation, in volts, of the noise added to the inputs (0).
+ *  - buffer: the size, in bytes, of the asynchronous buffers of the analog subdevices (65536).
+ *  - loopback: a comma-separated list of pairs ao:ai, which connect an
+ *    output channel to an input channel.
+ *  - neuron: a pair ao:ai, which connects a leaky integrate-and-fire neuron
+ *    to the output channel that injects its current and to the input channel
+ *    that records its membrane potential.
+ *  - command_gain: the current injected into the neuron, in pA/V (400).
+ *  - signal_gain: the voltage recorded from the neuron, in V/mV (0.01).
+ *
+ * For example, LCG_SIMULATED_DAQ="ai=4;latency=2e-6;neuron=0:0;loopback=1:1".
+ * Inputs that are not connected read 0 V and digital lines read back the
+ * value that was last written to them.
+ *
+ * The asynchronous buffers of the analog subdevices cannot be mapped with mmap on the
+ * file of the device, which is a socket: comedi_simulated_map_buffer, which is not part
+ * of comedilib, returns them instead. COMEDI_SIMULATED_DAQ is defined to tell the
+ * code that maps the buffers to call it.
+ */
+
+#ifndef SIMULATED_COMEDILIB_H
+#define SIMULATED_COMEDILIB_H
+
+#define COMEDI_SIMULATED_DAQ
+
+#define COMEDI_MAX_NUM_POLYNOMIAL_COEFFICIENTS 4
+
+#define CR_PACK(chan, rng, aref)        ((((aref)&0x3)<<24) | (((rng)&0xff)<<16) | (chan))
+#define CR_CHAN(a)                      ((a)&0xffff)
+#define CR_RANGE(a)                     (((a)>>16)&0xff)
+#define CR_AREF(a)                      (((a)>>24)&0x03)
+
+#define AREF_GROUND     0x00
+#define AREF_COMMON     0x01
+#define AREF_DIFF       0x02
+#define AREF_OTHER      0x03
+
+#define TRIG_NONE       0x00000001
+#define TRIG_NOW        0x00000002
+#define TRIG_FOLLOW     0x00000004
+#define TRIG_TIME       0x00000008
+#define TRIG_TIMER      0x00000010
+#define TRIG_COUNT      0x00000020
+#define TRIG_EXT        0x00000040
+#define TRIG_INT        0x00000080
+#define TRIG_OTHER      0x00000100
+
+#define TRIG_WAKE_EOS   0x00000020
+
+#define SDF_BUSY                0x0001
+#define SDF_MMAP                0x04000000
+#define SDF_RUNNING             0x08000000
+#define SDF_LSAMPL              0x10000000
+#define SDF_SOFT_CALIBRATED     0x2000
+
+#define INSN_READ       0x04000000
+#define INSN_WRITE      0x08000001
+#define INSN_INTTRIG    0x0c000012
+
+#define UNIT_volt       0
+#define UNIT_mA         1
+#define UNIT_none       2
+
+#define COMEDI_INPUT    0
+#define COMEDI_OUTPUT   1
+
+#define NI_PFI_OUTPUT_PFI_DO    16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned int lsampl_t;
+typedef unsigned short sampl_t;
+
+enum comedi_subdevice_type {
+        COMEDI_SUBD_UNUSED,
+        COMEDI_SUBD_AI,
+        COMEDI_SUBD_AO,
+        COMEDI_SUBD_DI,
+        COMEDI_SUBD_DO,
+        COMEDI_SUBD_DIO
+};
+
+enum comedi_conversion_direction {
+        COMEDI_TO_PHYSICAL,
+        COMEDI_FROM_PHYSICAL
+};
+
+typedef struct comedi_t_struct comedi_t;
+typedef struct comedi_calibration_struct comedi_calibration_t;
+
+typedef struct {
+        double min;
+        double max;
+        unsigned int unit;
+} comedi_range;
+
+typedef struct {
+        double coefficients[COMEDI_MAX_NUM_POLYNOMIAL_COEFFICIENTS];
+        double expansion_origin;
+        unsigned order;
+} comedi_polynomial_t;
+
+typedef struct comedi_insn_struct {
+        unsigned int insn;
+        unsigned int n;
+        lsampl_t *data;
+        unsigned int subdev;
+        unsigned int chanspec;
+        unsigned int unused[3];
+} comedi_insn;
+
+typedef struct comedi_insnlist_struct {
+        unsigned int n_insns;
+        comedi_insn *insns;
+} comedi_insnlist;
+
+typedef struct comedi_cmd_struct {
+        unsigned int subdev;
+        unsigned int flags;
+        unsigned int start_src;
+        unsigned int start_arg;
+        unsigned int scan_begin_src;
+        unsigned int scan_begin_arg;
+        unsigned int convert_src;
+        unsigned int convert_arg;
+        unsigned int scan_end_src;
+        unsigned int scan_end_arg;
+        unsigned int stop_src;
+        unsigned int stop_arg;
+        unsigned int *chanlist;
+        unsigned int chanlist_len;
+        sampl_t *data;
+        unsigned int data_len;
+} comedi_cmd;
+
+comedi_t* comedi_open(const char *filename);
+int comedi_close(comedi_t *device);
+int comedi_fileno(comedi_t *device);
+
+int comedi_errno(void);
+const char* comedi_strerror(int errnum);
+void comedi_perror(const char *s);
+
+int comedi_get_subdevice_type(comedi_t *device, unsigned int subdevice);
+int comedi_get_subdevice_flags(comedi_t *device, unsigned int subdevice);
+int comedi_get_n_channels(comedi_t *device, unsigned int subdevice);
+lsampl_t comedi_get_maxdata(comedi_t *device, unsigned int subdevice, unsigned int channel);
+comedi_range* comedi_get_range(comedi_t *device, unsigned int subdevice, unsigned int channel, unsigned int range);
+
+char* comedi_get_default_calibration_path(comedi_t *device);
+comedi_calibration_t* comedi_parse_calibration_file(const char *path);
+void comedi_cleanup_calibration(comedi_calibration_t *calibration);
+int comedi_get_softcal_converter(unsigned int subdevice, unsigned int channel, unsigned int range,
+                                 enum comedi_conversion_direction direction,
+                                 const comedi_calibration_t *calibration, comedi_polynomial_t *converter);
+
+double comedi_to_physical(lsampl_t data, const comedi_polynomial_t *converter);
+lsampl_t comedi_from_physical(double data, const comedi_polynomial_t *converter);
+double comedi_to_phys(lsampl_t data, const comedi_range *range, lsampl_t maxdata);
+lsampl_t comedi_from_phys(double data, const comedi_range *range, lsampl_t maxdata);
+
+int comedi_data_read(comedi_t *device, unsigned int subdevice, unsigned int channel,
+                     unsigned int range, unsigned int aref, lsampl_t *data);
+int comedi_data_write(comedi_t *device, unsigned int subdevice, unsigned int channel,
+                      unsigned int range, unsigned int aref, lsampl_t data);
+int comedi_do_insn(comedi_t *device, comedi_insn *instruction);
+int comedi_do_insnlist(comedi_t *device, comedi_insnlist *list);
+
+int comedi_dio_config(comedi_t *device, unsigned int subdevice, unsigned int channel, unsigned int direction);
+int comedi_dio_read(comedi_t *device, unsigned int subdevice, unsigned int channel, unsigned int *bit);
+int comedi_dio_write(comedi_t *device, unsigned int subdevice, unsigned int channel, unsigned int bit);
+int comedi_set_routing(comedi_t *device, unsigned int subdevice, unsigned int channel, unsigned int routing);
+
+int comedi_get_cmd_generic_timed(comedi_t *device, unsigned int subdevice, comedi_cmd *cmd,
+                                 unsigned int chanlist_len, unsigned int scan_period_ns);
+int comedi_command_test(comedi_t *device, comedi_cmd *cmd);
+int comedi_command(comedi_t *device, comedi_cmd *cmd);
+int comedi_cancel(comedi_t *device, unsigned int subdevice);
+
+int comedi_get_buffer_size(comedi_t *device, unsigned int subdevice);
+int comedi_get_buffer_contents(comedi_t *device, unsigned int subdevice);
+int comedi_mark_buffer_read(comedi_t *device, unsigned int subdevice, unsigned int bytes);
+int comedi_mark_buffer_written(comedi_t *device, unsigned int subdevice, unsigned int bytes);
+void* comedi_simulated_map_buffer(comedi_t *device, unsigned int subdevice);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIMULATED_COMEDILIB_H
+
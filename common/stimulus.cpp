@@ -76,7 +76,7 @@ bool Stimulus::parseStimulusFile()
                 return false;
         }
         Logger(Debug,"The number of points in the stimulus is: %d, which will last for: %lf (s).\n",
-                        m_length,m_length*m_dt);
+                        (int) m_length,m_length*m_dt);
         metadata = new double*[MAXROWS];
         if (!metadata) {
                 Logger(Critical, "Unable to allocate memory for <parsed_data>.\n");
@@ -19,6 +19,7 @@
 #include <iostream>
 
 #include "utils.h"
+#include "lock_free_queue.h"
 
 /* colors */
 #define ESC ''
@@ -27,6 +28,12 @@
 #define YELLOW "[33m"
 #define NORMAL "[00m"
 
+/* asynchronous logging */
+#define LOG_QUEUE_SIZE          1024
+#define LOG_MAX_ARGS            8
+#define LOG_STRINGS_SIZE        256
+#define LOG_MESSAGE_SIZE        1024
+
 namespace lcg
 {
 
@@ -255,26 +262,254 @@ LogLevel GetLoggingLevel()
         return verbosity;
 }
 
-#ifndef NDEBUG
-void Logger(LogLevel level, const char *fmt, ...)
+static void PrintMessage(LogLevel level, const char *message)
 {
-	if (level >= verbosity) {
-		va_list argp;
-		va_start(argp, fmt);
-                switch (level) {
-                case Critical:
-                        fprintf(stderr, "%c%s", ESC, RED);
+        switch (level) {
+        case Critical:
+                fprintf(stderr, "%c%s%s%c%s", ESC, RED, message, ESC, NORMAL);
+                break;
+        case Important:
+                fprintf(stderr, "%c%s%s%c%s", ESC, YELLOW, message, ESC, NORMAL);
+                break;
+        default:
+                fprintf(stderr, "%s%c%s", message, ESC, NORMAL);
+        }
+}
+
+/*!
+ * A message in the queue of the logger thread: the format string, which identifies
+ * the message, and the binary values of the arguments, with a copy of the strings.
+ */
+struct LogRecord {
+        LogLevel level;
+        const char *fmt;
+        int nargs;
+        union {
+                long long i;
+                double d;
+                const void *p;
+                size_t s;
+        } args[LOG_MAX_ARGS];
+        char strings[LOG_STRINGS_SIZE];
+};
+
+static LockFreeQueue<LogRecord> *logQueue = NULL;
+static pthread_t loggerThread;
+static volatile bool loggerThreadRun = false;
+/*! The messages that did not fit in the queue. */
+static volatile size_t droppedMessages = 0;
+
+/*!
+ * Finds the next conversion specification in fmt, copying it in spec.
+ * \return a pointer to the conversion character, or NULL if there are no more specifications.
+ */
+static const char* NextConversion(const char *fmt, const char **start, char *spec)
+{
+        size_t len;
+        while ((fmt = strchr(fmt, '%')) != NULL) {
+                if (fmt[1] == '%') {
+                        fmt += 2;
+                        continue;
+                }
+                *start = fmt;
+                len = strspn(fmt+1, "-+ #0123456789.hlLqjzt") + 1;
+                if (fmt[len] == '\0' || len > 30)
+                        return NULL;
+                memcpy(spec, fmt, len+1);
+                spec[len+1] = '\0';
+                return fmt + len;
+        }
+        return NULL;
+}
+
+/*! Tells whether the conversion specification has the given length modifier. */
+static inline bool HasModifier(const char *spec, const char *modifier)
+{
+        return strstr(spec, modifier) != NULL;
+}
+
+static void RecordMessage(LogLevel level, const char *fmt, va_list argp)
+{
+        LogRecord record;
+        const char *start, *conv = fmt;
+        char spec[32];
+        size_t used = 0, len;
+        record.level = level;
+        record.fmt = fmt;
+        record.nargs = 0;
+        while (record.nargs < LOG_MAX_ARGS && (conv = NextConversion(conv, &start, spec)) != NULL) {
+                switch (*conv) {
+                case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+                        if (HasModifier(spec, "ll") || HasModifier(spec, "q") || HasModifier(spec, "j"))
+                                record.args[record.nargs].i = va_arg(argp, long long);
+                        else if (HasModifier(spec, "l"))
+                                record.args[record.nargs].i = va_arg(argp, long);
+                        else if (HasModifier(spec, "z") || HasModifier(spec, "t"))
+                                record.args[record.nargs].s = va_arg(argp, size_t);
+                        else
+                                record.args[record.nargs].i = va_arg(argp, int);
+                        break;
+                case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+                        record.args[record.nargs].d = va_arg(argp, double);
                         break;
-                case Important:
-                        fprintf(stderr, "%c%s", ESC, YELLOW);
+                case 's': {
+                        const char *str = va_arg(argp, const char*);
+                        if (str == NULL)
+                                str = "(null)";
+                        len = strlen(str);
+                        if (len > LOG_STRINGS_SIZE - used - 1)
+                                len = LOG_STRINGS_SIZE - used - 1;
+                        memcpy(record.strings + used, str, len);
+                        record.strings[used+len] = '\0';
+                        record.args[record.nargs].s = used;
+                        // when the space is over, the next strings are empty
+                        used = (used + len + 1 < LOG_STRINGS_SIZE ? used + len + 1 : LOG_STRINGS_SIZE - 1);
                         break;
                 }
-		vfprintf(stderr, fmt, argp);
-                fprintf(stderr, "%c%s", ESC, NORMAL);
-		va_end(argp);
-	}
+                case 'p':
+                        record.args[record.nargs].p = va_arg(argp, const void*);
+                        break;
+                default:
+                        // an unknown conversion: the arguments that follow cannot be read
+                        record.fmt = "Unable to log a message with format \"%s\".\n";
+                        record.args[0].s = 0;
+                        strncpy(record.strings, fmt, LOG_STRINGS_SIZE-1);
+                        record.strings[LOG_STRINGS_SIZE-1] = '\0';
+                        record.nargs = 1;
+                        conv = NULL;
+                        break;
+                }
+                if (conv == NULL)
+                        break;
+                record.nargs++;
+                conv++;
+        }
+        if (!logQueue->push(record))
+                __sync_fetch_and_add(&droppedMessages, 1);
+}
+
+/*! Appends the text between from and to to the message, replacing %% with %. */
+static void AppendText(char *message, size_t *len, size_t size, const char *from, const char *to)
+{
+        while (from < to && *len < size-1) {
+                if (from[0] == '%' && from+1 < to && from[1] == '%')
+                        from++;
+                message[(*len)++] = *from++;
+        }
+        message[*len] = '\0';
+}
+
+/*! Formats a message with the arguments stored by RecordMessage. */
+static void FormatMessage(const LogRecord *record, char *message, size_t size)
+{
+        const char *start, *conv, *fmt = record->fmt;
+        char spec[32];
+        size_t len = 0;
+        int i, n = 0;
+        message[0] = '\0';
+        for (i=0; i<record->nargs; i++) {
+                if ((conv = NextConversion(fmt, &start, spec)) == NULL)
+                        break;
+                AppendText(message, &len, size, fmt, start);
+                switch (*conv) {
+                case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+                        if (HasModifier(spec, "ll") || HasModifier(spec, "q") || HasModifier(spec, "j"))
+                                n = snprintf(message+len, size-len, spec, record->args[i].i);
+                        else if (HasModifier(spec, "l"))
+                                n = snprintf(message+len, size-len, spec, (long) record->args[i].i);
+                        else if (HasModifier(spec, "z") || HasModifier(spec, "t"))
+                                n = snprintf(message+len, size-len, spec, record->args[i].s);
+                        else
+                                n = snprintf(message+len, size-len, spec, (int) record->args[i].i);
+                        break;
+                case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+                        n = snprintf(message+len, size-len, spec, record->args[i].d);
+                        break;
+                case 's':
+                        n = snprintf(message+len, size-len, spec, record->strings + record->args[i].s);
+                        break;
+                case 'p':
+                        n = snprintf(message+len, size-len, spec, record->args[i].p);
+                        break;
+                }
+                len = (len + n < size ? len + n : size - 1);
+                fmt = conv + 1;
+        }
+        // the text after the last conversion
+        AppendText(message, &len, size, fmt, fmt + strlen(fmt));
+}
+
+static void* LoggerThread(void *arg)
+{
+        char message[LOG_MESSAGE_SIZE];
+        struct timespec pause = {0, 1000000};
+        LogRecord *record;
+        while (true) {
+                record = logQueue->front();
+                if (record == NULL) {
+                        if (!loggerThreadRun)
+                                break;
+                        nanosleep(&pause, NULL);
+                        continue;
+                }
+                FormatMessage(record, message, LOG_MESSAGE_SIZE);
+                PrintMessage(record->level, message);
+                logQueue->pop();
+        }
+        return NULL;
+}
+
+bool StartLoggerThread()
+{
+        if (loggerThreadRun)
+                return true;
+        if (logQueue == NULL)
+                logQueue = new LockFreeQueue<LogRecord>(LOG_QUEUE_SIZE);
+        droppedMessages = 0;
+        loggerThreadRun = true;
+        int err = pthread_create(&loggerThread, NULL, LoggerThread, NULL);
+        if (err) {
+                loggerThreadRun = false;
+                Logger(Critical, "pthread_create: %s\n", strerror(err));
+                return false;
+        }
+        return true;
+}
+
+void StopLoggerThread()
+{
+        if (!loggerThreadRun)
+                return;
+        __sync_synchronize();
+        loggerThreadRun = false;
+        pthread_join(loggerThread, NULL);
+        // print the messages that were queued while the thread was terminating
+        char message[LOG_MESSAGE_SIZE];
+        LogRecord *record;
+        while ((record = logQueue->front()) != NULL) {
+                FormatMessage(record, message, LOG_MESSAGE_SIZE);
+                PrintMessage(record->level, message);
+                logQueue->pop();
+        }
+        if (droppedMessages > 0)
+                Logger(Important, "%lu log message%s dropped because the queue was full.\n",
+                       (unsigned long) droppedMessages, droppedMessages == 1 ? " was" : "s were");
+}
+
+void LogMessage(LogLevel level, const char *fmt, ...)
+{
+        va_list argp;
+        va_start(argp, fmt);
+        if (loggerThreadRun) {
+                RecordMessage(level, fmt, argp);
+        }
+        else {
+                char message[LOG_MESSAGE_SIZE];
+                vsnprintf(message, LOG_MESSAGE_SIZE, fmt, argp);
+                PrintMessage(level, message);
+        }
+        va_end(argp);
 }
-#endif
 
 void ResetIds()
 {
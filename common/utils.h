@@ -47,14 +47,48 @@ typedef enum
         All = 0, Debug, Info, Important, Critical
 } LogLevel;
 
-void SetLoggingLevel(LogLevel level);
-LogLevel GetLoggingLevel();
+/*!
+ * Messages with a level lower than LCG_MIN_LOG_LEVEL are removed at compile time, together
+ * with the evaluation of their arguments. It is set by configure --with-log-level and
+ * defining NDEBUG removes all the messages.
+ */
+#ifndef LCG_MIN_LOG_LEVEL
 #ifdef NDEBUG
-#define Logger(level, fmt, ...) asm("nop")
+#define LCG_MIN_LOG_LEVEL       (Critical+1)
 #else
-void Logger(LogLevel level, const char *fmt, ...);
+#define LCG_MIN_LOG_LEVEL       All
+#endif
 #endif
 
+extern LogLevel verbosity;
+
+void SetLoggingLevel(LogLevel level);
+LogLevel GetLoggingLevel();
+
+/*! Tells whether messages with the given level are printed: constant when level is. */
+inline bool LogEnabled(LogLevel level)
+{
+        return level >= LCG_MIN_LOG_LEVEL && level >= verbosity;
+}
+
+void LogMessage(LogLevel level, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+
+/*!
+ * Prints a message with printf-like syntax, if its level is enabled. The arguments are
+ * evaluated only in that case. fmt must be a string literal, because, while the logger
+ * thread runs, the message is formatted after Logger has returned.
+ */
+#define Logger(level, ...) LogEnabled(level) && (lcg::LogMessage(level, __VA_ARGS__), true)
+
+/*!
+ * Starts the thread that prints the messages: until StopLoggerThread is called, Logger
+ * does not write to the terminal, but copies the format and the arguments of each message
+ * into a lock-free queue, so that it can be called from the real-time thread.
+ */
+bool StartLoggerThread();
+/*! Prints the messages that are still in the queue and stops the logger thread. */
+void StopLoggerThread();
+
 void ResetIds();
 uint GetId();
 
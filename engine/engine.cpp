@@ -3,12 +3,17 @@
 #include <assert.h>
 #include <iostream>
 #include <errno.h>
+#include <unistd.h>
 #include "engine.h"
 #include "entity.h"
 #include "stream.h"
 #include "utils.h"
 #include "common.h"
 #include "h5rec.h"
+#include "latency.h"
+#include "schedule.h"
+#include "barrier.h"
+#include "randlib.h"
 
 
 #ifdef HAVE_LIBLXRT
@@ -27,6 +32,7 @@
 
 #ifdef HAVE_LIBCOMEDI
 #include <comedilib.h>
+#include "comedi_io.h"
 #endif // HAVE_LIBCOMEDI
 
 namespace lcg {
@@ -40,6 +46,9 @@ struct simulation_data {
 	trigger_data m_trigger;
 };
 
+/*! The execution plan of the entities, built at the beginning of every simulation. */
+static StepSchedule schedule;
+
 
 bool WaitForTrigger(const trigger_data* t)
 {
@@ -120,6 +129,139 @@ bool WaitForTrigger(const trigger_data* t)
         return true;
 }
 
+deadline_miss_policy deadlinePolicy = DEADLINE_CATCH_UP;
+int deadlineMaxLag = -1;
+const char *deadlinePolicyNames[] = {"catchup", "skip", "abort"};
+
+void SetDeadlineMissPolicy(deadline_miss_policy policy, int maxLag)
+{
+        deadlinePolicy = policy;
+        deadlineMaxLag = (policy == DEADLINE_SKIP ? 0 : maxLag);
+        Logger(Debug, "Deadline miss policy: %s (maximum lag = %d).\n", deadlinePolicyNames[policy], deadlineMaxLag);
+}
+
+loop_clock loopClock = LOOP_CLOCK_SOFTWARE;
+uint loopClockDelay = 2;
+const char *loopClockNames[] = {"software", "board"};
+
+void SetLoopClock(loop_clock clock, uint delay)
+{
+#if !defined(HAVE_LIBCOMEDI) || defined(HAVE_LIBLXRT) || defined(HAVE_LIBANALOGY)
+        if (clock == LOOP_CLOCK_BOARD) {
+                Logger(Important, "The loop can be clocked by the boards only with Comedi and the POSIX engines: "
+                                  "the software clock will be used.\n");
+                clock = LOOP_CLOCK_SOFTWARE;
+        }
+#endif
+        loopClock = clock;
+        loopClockDelay = delay;
+        Logger(Debug, "Loop clock: %s (delay = %d).\n", loopClockNames[clock], delay);
+}
+
+/*! Starts the commands that clock the main loop and acquires the first scan, if the boards are the clock. */
+static inline bool StartLoopClock()
+{
+#ifdef HAVE_LIBCOMEDI
+        if (loopClock == LOOP_CLOCK_BOARD)
+                return ComediIOScheduler::StartClock(GetGlobalDt(), loopClockDelay);
+#endif
+        return true;
+}
+
+/*!
+ * Waits for the next scan of the boards.
+ * \param underrun If not NULL, set to whether the analog outputs ran out of samples.
+ * \return The number of scans by which the loop lags behind the boards, or -1 on error.
+ */
+static inline int WaitForLoopClock(bool *underrun = NULL)
+{
+#ifdef HAVE_LIBCOMEDI
+        return ComediIOScheduler::WaitForScan(underrun);
+#else
+        if (underrun)
+                *underrun = false;
+        return 0;
+#endif
+}
+
+/*!
+ * Restarts the clock of the boards after the analog outputs ran out of samples, so that they are generated
+ * again loopClockDelay scans after the inputs they were computed from.
+ * \return The number of scans that were dropped in order to do so, or -1 on error.
+ */
+static inline int ResyncLoopClock()
+{
+#ifdef HAVE_LIBCOMEDI
+        return ComediIOScheduler::ResyncOutputs();
+#else
+        return 0;
+#endif
+}
+
+/*! Waits for the next scan of the boards and resynchronises the analog outputs if they ran out of samples. */
+static inline bool WaitForLoopClockAndResync()
+{
+        bool underrun;
+        if (WaitForLoopClock(&underrun) < 0)
+                return false;
+        return !underrun || ResyncLoopClock() >= 0;
+}
+
+/*! Drops n scans of the boards, which the loop will not process. */
+static inline bool SkipLoopClock(uint n)
+{
+#ifdef HAVE_LIBCOMEDI
+        return ComediIOScheduler::SkipScans(n);
+#else
+        return true;
+#endif
+}
+
+static inline void StopLoopClock()
+{
+#ifdef HAVE_LIBCOMEDI
+        if (loopClock == LOOP_CLOCK_BOARD)
+                ComediIOScheduler::StopClock();
+#endif
+}
+
+/*! Reads the inputs of the boards, which the entities use in the step that is about to begin. */
+static inline void BeginLoopStep()
+{
+#ifdef HAVE_LIBCOMEDI
+        ComediIOScheduler::BeginStep();
+#endif
+}
+
+/*! Sends to the boards the outputs written by the entities, as soon as they have all been stepped. */
+static inline void EndLoopStep()
+{
+#ifdef HAVE_LIBCOMEDI
+        ComediIOScheduler::EndStep();
+#endif
+}
+
+int simulationThreads = 1;
+
+void SetSimulationThreads(int n)
+{
+        // threads wait for each other by spinning, so there should never be more than processors
+        int nProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nProcessors < 1)
+                nProcessors = 1;
+        if (n > nProcessors)
+                Logger(Important, "Cannot use %d threads on %d processors.\n", n, nProcessors);
+        if (n < 1 || n > nProcessors)
+                n = nProcessors;
+        simulationThreads = n;
+#ifdef REALTIME_ENGINE
+        if (simulationThreads > 1)
+                Logger(Important, "The real-time engine does not support multiple threads: only one will be used.\n");
+#else
+        Logger(Debug, "The simulation will use at most %d threads.\n", simulationThreads);
+#endif
+}
+
 #ifdef REALTIME_ENGINE
 double globalTimeOffset = 0.0;
 #endif
@@ -195,24 +337,26 @@ void* RTSimulation(void *arg)
                         pthread_exit((void *) retval);
                 }
         }
+        schedule.build(*entities);
 
         Logger(Important, "Expected duration: %g seconds.\n", tend);
         Logger(Debug, "Starting the main loop.\n");
 
         start = rt_timer_read();
 		// First step can be different from subsequent.	
-		for (i=0; i<nEntities; i++)
-                entities->at(i)->readAndStoreInputs();
-		for (i=0; i<nEntities; i++)
-			    entities->at(i)->firstStep();
+		schedule.readAndStoreInputs();
+		BeginLoopStep();
+		schedule.firstStep();
+		EndLoopStep();
 		rt_task_wait_period();
         IncreaseGlobalTime();
         while (!TERMINATE_TRIAL() && GetGlobalTime() <= tend) {
                 ProcessEvents();
-                for (i=0; i<nEntities; i++)
-                        entities->at(i)->readAndStoreInputs();
-				for (i=0; i<nEntities; i++)
-                        entities->at(i)->step();
+                schedule.readAndStoreInputs();
+                BeginLoopStep();
+                schedule.step();
+                EndLoopStep();
+                RefillRandomBuffers();
                 rt_task_wait_period();
                 IncreaseGlobalTime();
         }
@@ -278,6 +422,7 @@ void RTSimulationTask(void *cookie)
                         return;
                 }
         }
+        schedule.build(arg->entities());
 
         Logger(Important, "Expected duration: %g seconds.\n", tend);
         Logger(Debug, "Starting the main loop.\n");
@@ -289,19 +434,20 @@ void RTSimulationTask(void *cookie)
         }
         start = rt_timer_read();
 		// First step can be different from subsequent.	
-		for (i=0; i<nEntities; i++)
-                entities->at(i)->readAndStoreInputs();
-		for (i=0; i<nEntities; i++)
-			    entities->at(i)->firstStep();
+		schedule.readAndStoreInputs();
+		BeginLoopStep();
+		schedule.firstStep();
+		EndLoopStep();
 		rt_task_wait_period();
         IncreaseGlobalTime();
         while (!TERMINATE_TRIAL() && GetGlobalTime() <= tend) {
                 ProcessEvents();
-                for (i=0; i<nEntities; i++)
-                        arg->entity(i)->readAndStoreInputs();
+                schedule.readAndStoreInputs();
                 IncreaseGlobalTime();
-                for (i=0; i<nEntities; i++)
-                        arg->entity(i)->step();
+                BeginLoopStep();
+                schedule.step();
+                EndLoopStep();
+                RefillRandomBuffers();
                 rt_task_wait_period(NULL);
         }
         stop = rt_timer_read();
@@ -417,6 +563,39 @@ static inline int64_t calcdiff_ns(struct timespec t1, struct timespec t2)
         return diff;
 }
 
+static LoopTimingStatistics loopStatistics;
+
+const LoopTimingStatistics& GetLoopTimingStatistics()
+{
+        return loopStatistics;
+}
+
+static void SaveLoopTimingStatistics(const std::vector<Entity*> *entities, const LoopTimingStatistics& stats)
+{
+        std::vector<double> wakeup, compute;
+        size_t nWakeup = stats.wakeupLatency().toMatrix(wakeup);
+        size_t nCompute = stats.computeTime().toMatrix(compute);
+        for (size_t i=0; i<entities->size(); i++) {
+                H5RecorderCore *rec = dynamic_cast<H5RecorderCore*>(entities->at(i));
+                if (!rec)
+                        continue;
+                rec->addInfo("clock", loopClockNames[loopClock]);
+                rec->addInfo("iterations", (long) stats.iterations());
+                rec->addInfo("overruns", (long) stats.overruns());
+                rec->addInfo("deadlinePolicy", deadlinePolicyNames[deadlinePolicy]);
+                rec->addInfo("skippedPeriods", (long) stats.skippedPeriods());
+                rec->addInfo("maxLag", (long) stats.maxLag());
+                rec->addInfo("outputResyncs", (long) stats.resyncs());
+                rec->addInfo("aborted", (long) stats.wasAborted());
+                rec->addInfo("maxWakeupLatency", (double) stats.wakeupLatency().max() / NSEC_PER_SEC);
+                rec->addInfo("maxComputeTime", (double) stats.computeTime().max() / NSEC_PER_SEC);
+                if (nWakeup)
+                        rec->addInfo("WakeupLatency", &wakeup[0], nWakeup, 2, "Bin_lower_edge_(s)_Count");
+                if (nCompute)
+                        rec->addInfo("ComputeTime", &compute[0], nCompute, 2, "Bin_lower_edge_(s)_Count");
+        }
+}
+
 void* RTSimulation(void *arg)
 {
         simulation_data *data = static_cast<simulation_data*>(arg);
@@ -424,7 +603,10 @@ void* RTSimulation(void *arg)
         double tend = data->m_tend;
 	int priority, flag, i;
         size_t nEntities = entities->size();
-        struct timespec now, period;
+        int64_t late, lag, skipped, periodNs;
+        bool underrun;
+        bool boardClock = (loopClock == LOOP_CLOCK_BOARD);
+        struct timespec now, period, wakeup, done;
         struct sched_param schedp;
         int *retval = new int;
         *retval = -1;
@@ -456,17 +638,26 @@ void* RTSimulation(void *arg)
                         pthread_exit((void *) retval);
                 }
         }
+        schedule.build(*entities);
         Logger(Debug, "Initialised all entities.\n");
         
         // The period of execution of the main loop
 	period.tv_sec = 0;
 	period.tv_nsec = GetGlobalDt() * NSEC_PER_SEC;
+        periodNs = period.tv_nsec;
 
 	// Wait for trigger
 	//FOR DIGITAL TRIGGER ON CTR0 USE SUBDEVICE 7 CHANNEL 8
 	if (data->m_trigger.use) {
 		WaitForTrigger(&data->m_trigger);  
 	}
+
+        // Start the acquisition that paces the loop
+        if (boardClock && !StartLoopClock()) {
+                Logger(Critical, "Unable to start the clock of the boards.\n");
+                pthread_exit((void *) retval);
+        }
+
 	// Get current time
 	flag = clock_gettime(CLOCK_REALTIME, &now);
         if (flag < 0) {
@@ -479,22 +670,34 @@ void* RTSimulation(void *arg)
         SetGlobalTimeOffset(now);
 
         Logger(Important, "Expected duration: %g seconds.\n", tend);
+
+        // Reset the timing statistics of the main loop
+        loopStatistics.reset();
 	
 		// First step can be different from subsequent.	
-		for (i=0; i<nEntities; i++)
-                entities->at(i)->readAndStoreInputs();
-		for (i=0; i<nEntities; i++)
-			    entities->at(i)->firstStep();
+		schedule.readAndStoreInputs();
+		BeginLoopStep();
+		schedule.firstStep();
+		EndLoopStep();
 	        now.tv_sec += period.tv_sec;
 	        now.tv_nsec += period.tv_nsec;
 	        tsnorm(&now);
 
                 // Wait for next period
-		flag = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &now, NULL);
-                if (flag != 0) {
-                        Logger(Critical, "Error in clock_nanosleep.\n");
-					return 0;
-				}
+                if (boardClock) {
+                        if (!WaitForLoopClockAndResync())
+                                TerminateTrial();
+                        clock_gettime(CLOCK_REALTIME, &wakeup);
+                }
+                else {
+                        flag = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &now, NULL);
+                        if (flag != 0) {
+                                Logger(Critical, "Error in clock_nanosleep.\n");
+                                return 0;
+                        }
+                        clock_gettime(CLOCK_REALTIME, &wakeup);
+                        loopStatistics.wokeUp(calcdiff_ns(wakeup, now));
+                }
 
                 // Increase the time of the simulation and step all entities forward
                 IncreaseGlobalTime();
@@ -502,27 +705,115 @@ void* RTSimulation(void *arg)
                 
                 // Process the events and have all entities read their inputs
                 ProcessEvents();
-                for (i=0; i<nEntities; i++)
-                        entities->at(i)->readAndStoreInputs();
+                schedule.readAndStoreInputs();
+
+                if (boardClock) {
+                        RefillRandomBuffers();
+
+                        // Wait for the next scan: the scans that are already waiting tell by how much the loop is late
+                        clock_gettime(CLOCK_REALTIME, &done);
+                        lag = WaitForLoopClock(&underrun);
+                        if (lag < 0)
+                                break;
+                        loopStatistics.finished(calcdiff_ns(done, wakeup), lag > 0 || underrun);
+                        clock_gettime(CLOCK_REALTIME, &wakeup);
+
+                        // Apply the deadline miss policy: when the loop lagged so much that the analog outputs
+                        // ran out of samples, they are restarted and the scans that are too late are dropped
+                        if (underrun) {
+                                loopStatistics.lagging(lag);
+                                if (deadlinePolicy == DEADLINE_ABORT) {
+                                        Logger(Critical, "The analog outputs ran out of samples at t = %g sec: aborting the trial.\n",
+                                                        GetGlobalTime());
+                                        loopStatistics.aborted();
+                                        TerminateTrial();
+                                        break;
+                                }
+                                if ((skipped = ResyncLoopClock()) < 0)
+                                        break;
+                                loopStatistics.resynchronised();
+                                loopStatistics.skipped(skipped);
+                                lag = 0;
+                        }
+                        if (lag > 0) {
+                                loopStatistics.lagging(lag);
+                                if (deadlinePolicy == DEADLINE_ABORT) {
+                                        Logger(Critical, "Lagging %d scans behind the boards at t = %g sec: aborting the trial.\n",
+                                                        (int) lag, GetGlobalTime());
+                                        loopStatistics.aborted();
+                                        TerminateTrial();
+                                        break;
+                                }
+                                if (deadlineMaxLag >= 0 && lag > deadlineMaxLag) {
+                                        // drop the scans in excess
+                                        lag -= deadlineMaxLag;
+                                        if (!SkipLoopClock(lag))
+                                                break;
+                                        loopStatistics.skipped(lag);
+                                }
+                        }
+
+                        // Increase the time of the simulation and step all entities forward
+                        IncreaseGlobalTime();
+                        BeginLoopStep();
+                        schedule.step();
+                        EndLoopStep();
+                        continue;
+                }
 
                 // Compute the time at which the thread will have to resume
 	        now.tv_sec += period.tv_sec;
 	        now.tv_nsec += period.tv_nsec;
 	        tsnorm(&now);
 
+                // Record how long this iteration took and whether it missed the next deadline
+                clock_gettime(CLOCK_REALTIME, &done);
+                late = calcdiff_ns(done, now);
+                loopStatistics.finished(calcdiff_ns(done, wakeup), late > 0);
+
+                // Apply the deadline miss policy
+                if (late > 0) {
+                        // number of deadlines that have already passed
+                        lag = late / periodNs + 1;
+                        loopStatistics.lagging(lag);
+                        if (deadlinePolicy == DEADLINE_ABORT) {
+                                Logger(Critical, "Missed a deadline by %.1f us at t = %g sec: aborting the trial.\n",
+                                                late*1e-3, GetGlobalTime());
+                                loopStatistics.aborted();
+                                TerminateTrial();
+                                break;
+                        }
+                        if (deadlineMaxLag >= 0 && lag > deadlineMaxLag) {
+                                // drop the periods in excess and resynchronise with the clock
+                                lag -= deadlineMaxLag;
+                                now.tv_sec += (lag * periodNs) / NSEC_PER_SEC;
+                                now.tv_nsec += (lag * periodNs) % NSEC_PER_SEC;
+                                tsnorm(&now);
+                                loopStatistics.skipped(lag);
+                        }
+                }
+
+                // Generate the random numbers for the next steps while waiting
+                RefillRandomBuffers();
+
                 // Wait for next period
 		flag = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &now, NULL);
                 if (flag != 0) {
                         Logger(Critical, "Error in clock_nanosleep.\n");
                         break;
                 }
+                clock_gettime(CLOCK_REALTIME, &wakeup);
+                loopStatistics.wokeUp(calcdiff_ns(wakeup, now));
 
                 // Increase the time of the simulation and step all entities forward
                 IncreaseGlobalTime();
-                for (i=0; i<nEntities; i++)
-                        entities->at(i)->step();
+                BeginLoopStep();
+                schedule.step();
+                EndLoopStep();
         }
 
+        StopLoopClock();
+
         // Compute how much time has passed since the beginning
         flag = clock_gettime(CLOCK_REALTIME, &now);
         if (flag == 0) {
@@ -530,6 +821,10 @@ void* RTSimulation(void *arg)
                         ((double) now.tv_sec + ((double) now.tv_nsec / NSEC_PER_SEC)) - GetGlobalTimeOffset());
         }
 
+        // Report the timing of the main loop and save it along with the data
+        loopStatistics.log();
+        SaveLoopTimingStatistics(entities, loopStatistics);
+
         SetTrialRun(false);
 
         // Stop all entities
@@ -550,6 +845,68 @@ void* RTSimulation(void *arg)
 
 #else
 
+/*! The state shared by the threads that step the entities in parallel. */
+struct parallel_simulation {
+        parallel_simulation(size_t nThreads, double tend)
+                : m_barrier(nThreads), m_tend(tend), m_running(true) {}
+        SpinBarrier m_barrier;
+        double m_tend;
+        volatile bool m_running;
+};
+
+struct worker_data {
+        parallel_simulation *m_simulation;
+        StepSchedule *m_schedule;
+};
+
+/*! Executed by one thread only, while all the others wait, before every integration step. */
+static void StartParallelStep(void *arg)
+{
+        parallel_simulation *sim = static_cast<parallel_simulation*>(arg);
+        // all the entities have been stepped
+        EndLoopStep();
+        if (TERMINATE_TRIAL() || GetGlobalTime() > sim->m_tend) {
+                sim->m_running = false;
+        }
+        else {
+                ProcessEvents();
+                RefillRandomBuffers();
+        }
+}
+
+/*! Executed by one thread only, after all the inputs have been read and before the entities are stepped. */
+static void AdvanceParallelTime(void *arg)
+{
+        if (loopClock == LOOP_CLOCK_BOARD && !WaitForLoopClockAndResync())
+                TerminateTrial();
+        IncreaseGlobalTime();
+        BeginLoopStep();
+}
+
+/*!
+ * The main loop of a thread that takes part in a parallel simulation: the barriers guarantee that
+ * no entity is stepped before all the inputs have been read and that events are processed while
+ * no entity is being stepped.
+ */
+static void RunParallelSchedule(parallel_simulation *sim, StepSchedule *schedule)
+{
+        while (true) {
+                sim->m_barrier.wait(StartParallelStep, sim);
+                if (!sim->m_running)
+                        break;
+                schedule->readAndStoreInputs();
+                sim->m_barrier.wait(AdvanceParallelTime);
+                schedule->step();
+        }
+}
+
+static void* ParallelWorker(void *arg)
+{
+        worker_data *data = static_cast<worker_data*>(arg);
+        RunParallelSchedule(data->m_simulation, data->m_schedule);
+        return NULL;
+}
+
 void* NonRTSimulation(void *arg)
 {        
         simulation_data *data = static_cast<simulation_data*>(arg);
@@ -569,20 +926,66 @@ void* NonRTSimulation(void *arg)
                         pthread_exit((void *) retval);
                 }
         }
+        schedule.build(*entities);
+
+        // when the boards clock the loop, each step waits for a scan of the inputs
+        if (!StartLoopClock()) {
+                Logger(Critical, "Unable to start the clock of the boards.\n");
+                pthread_exit((void *) retval);
+        }
+
 		// First step can be different from subsequent.	
-		for (i=0; i<nEntities; i++)
-                entities->at(i)->readAndStoreInputs();
-		for (i=0; i<nEntities; i++)
-			    entities->at(i)->firstStep();
+		schedule.readAndStoreInputs();
+		BeginLoopStep();
+		schedule.firstStep();
+		EndLoopStep();
+        if (loopClock == LOOP_CLOCK_BOARD && !WaitForLoopClockAndResync())
+                TerminateTrial();
         IncreaseGlobalTime();
-        while (!TERMINATE_TRIAL() && GetGlobalTime() <= tend) {
-                ProcessEvents();
-                for (i=0; i<nEntities; i++)
-                        entities->at(i)->readAndStoreInputs();
-                IncreaseGlobalTime();
-                for (i=0; i<nEntities; i++)
-                        entities->at(i)->step();
+
+        std::vector<StepSchedule> parts;
+        int nThreads = 1;
+        if (simulationThreads > 1)
+                nThreads = schedule.partition(simulationThreads, parts);
+
+        if (nThreads > 1) {
+                // the first part is stepped by this thread, the others by a pool of workers
+                // that persist for the whole duration of the simulation
+                parallel_simulation sim(nThreads, tend);
+                std::vector<pthread_t> threads(nThreads-1);
+                std::vector<worker_data> workers(nThreads-1);
+                Logger(Info, "Stepping %d entities with %d threads.\n", nEntities, nThreads);
+#ifdef HAVE_LIBCOMEDI
+                // entities that use the same board may be stepped by different threads
+                ComediIOScheduler::SetConcurrent(true);
+#endif
+                for (i=0; i<nThreads-1; i++) {
+                        workers[i].m_simulation = &sim;
+                        workers[i].m_schedule = &parts[i+1];
+                        pthread_create(&threads[i], NULL, ParallelWorker, (void *) &workers[i]);
+                }
+                RunParallelSchedule(&sim, &parts[0]);
+                for (i=0; i<nThreads-1; i++)
+                        pthread_join(threads[i], NULL);
+#ifdef HAVE_LIBCOMEDI
+                ComediIOScheduler::SetConcurrent(false);
+#endif
         }
+        else {
+                while (!TERMINATE_TRIAL() && GetGlobalTime() <= tend) {
+                        ProcessEvents();
+                        schedule.readAndStoreInputs();
+                        if (loopClock == LOOP_CLOCK_BOARD && !WaitForLoopClockAndResync())
+                                break;
+                        IncreaseGlobalTime();
+                        BeginLoopStep();
+                        schedule.step();
+                        EndLoopStep();
+                        RefillRandomBuffers();
+                }
+        }
+
+        StopLoopClock();
 
         SetTrialRun(false);
 
@@ -621,6 +1024,9 @@ int Simulate(std::vector<Entity*> *entities, double tend, struct trigger_data tr
                 }
         }
 
+        // the messages of the simulation thread are printed by the logger thread
+        StartLoggerThread();
+
 #ifdef REALTIME_ENGINE
         pthread_create(&simulationThread, NULL, RTSimulation, (void *) &data);
 #else
@@ -631,6 +1037,8 @@ int Simulate(std::vector<Entity*> *entities, double tend, struct trigger_data tr
         retval = *success;
         delete success;
 
+        StopLoggerThread();
+
         if (rec) {
                 StopCommentsReaderThread();
                 const std::vector< std::pair<std::string,time_t> >* comments = GetComments();
@@ -646,12 +1054,98 @@ int Simulate(std::vector<Entity*> *entities, double tend, struct trigger_data tr
         return retval;
 }
 
+struct streams_writer_data {
+        streams_writer_data(std::vector<Stream*>* s, ChunkedH5Recorder *r)
+                : streams(s), rec(r), run(true) {}
+        std::vector<Stream*>* streams;
+        ChunkedH5Recorder *rec;
+        volatile bool run;
+};
+
+/*!
+ * Saves the blocks of the streaming streams as they become available, until it is told to stop,
+ * at which point it saves the remaining blocks. The file is flushed after every round of writes,
+ * so that it contains the data acquired so far if the program is killed.
+ */
+static void* StreamsWriter(void *arg)
+{
+        streams_writer_data *data = static_cast<streams_writer_data*>(arg);
+        struct timespec pause = {0, 10000000};
+        const void *block;
+        size_t length;
+        bool stop, written;
+        while (true) {
+                stop = !data->run;
+                written = false;
+                for (size_t i=0; i<data->streams->size(); i++) {
+                        Stream *stream = data->streams->at(i);
+                        if (!stream->isStreaming())
+                                continue;
+                        while ((block = stream->nextBlock(&length)) != NULL) {
+                                data->rec->appendRecord(stream->id(), block, length);
+                                stream->releaseBlock();
+                                written = true;
+                        }
+                }
+                if (written)
+                        data->rec->flush();
+                if (stop)
+                        break;
+                if (!written)
+                        nanosleep(&pause, NULL);
+        }
+        return NULL;
+}
+
+/*!
+ * Adds to the recorder the record of a stream: the raw samples of a stream are saved as unsigned
+ * integers of the same size, together with the polynomial that converts them into physical units.
+ */
+static bool AddStreamRecord(ChunkedH5Recorder *rec, Stream *stream, size_t length)
+{
+        hid_t dataType = H5T_IEEE_F64LE;
+        const double *coefficients;
+        double origin, factor;
+        uint order;
+        switch (stream->rawSampleSize()) {
+        case 0:
+                return rec->addRecord(stream->id(), stream->name().c_str(),
+                                      stream->units().c_str(), length, stream->parameters());
+        case 1:
+                dataType = H5T_STD_U8LE;
+                break;
+        case 2:
+                dataType = H5T_STD_U16LE;
+                break;
+        case 4:
+                dataType = H5T_STD_U32LE;
+                break;
+        default:
+                Logger(Critical, "Stream %d: unsupported size of the raw samples (%d bytes).\n",
+                       stream->id(), (int) stream->rawSampleSize());
+                return false;
+        }
+        if (!rec->addRecord(stream->id(), stream->name().c_str(), stream->units().c_str(),
+                            length, stream->parameters(), NULL, NULL, dataType))
+                return false;
+        coefficients = stream->rawConversion(&order, &origin, &factor);
+        if (coefficients == NULL) {
+                Logger(Critical, "Stream %d: no conversion for the raw samples.\n", stream->id());
+                return false;
+        }
+        return rec->writeConversion(stream->id(), coefficients, order, origin, factor);
+}
+
 int Simulate(std::vector<Stream*>* streams, double tend, const std::string& outfilename)
 {
-        int i, err;
-        size_t len, ndims, *dims;
+        size_t i;
+        int err;
+        size_t len = 0, ndims, *dims;
         char label[1024];
         ChunkedH5Recorder *rec = NULL;
+        pthread_t writerThread;
+        streams_writer_data *writerData = NULL;
+        bool timeStepWritten = false;
 
         // initialise all the streams
         Logger(Debug, "Initializing all streams...\n");
@@ -661,27 +1155,66 @@ int Simulate(std::vector<Stream*>* streams, double tend, const std::string& outf
         SetTrialRun(true);
 	ResetGlobalTime();
 
+        // the streams that save their data while they run need the file from the start
+        for (i=0; i<streams->size(); i++) {
+                if (!streams->at(i)->isStreaming())
+                        continue;
+                if (!rec) {
+                        rec = new ChunkedH5Recorder(true, outfilename.c_str());
+                        timeStepWritten = rec->writeTimeStep(GetGlobalDt());
+                }
+                AddStreamRecord(rec, streams->at(i), 0);
+        }
+        if (rec) {
+                writerData = new streams_writer_data(streams, rec);
+                if (pthread_create(&writerThread, NULL, StreamsWriter, (void *) writerData) != 0) {
+                        Logger(Critical, "Unable to start the thread that saves the streams.\n");
+                        delete writerData;
+                        writerData = NULL;
+                }
+        }
+
         // start the comments-reading thread
         StartCommentsReaderThread();
 
         // start the streams
         Logger(Debug, "Starting all streams...\n");
+        StartLoggerThread();
         for (i=0; i<streams->size(); i++)
                 streams->at(i)->run(tend);
 
-        // wait for each stream to finish, terminate it and then
-        // save its data if there were no errors
+        // wait for each stream to finish
+        for (i=0; i<streams->size(); i++)
+                streams->at(i)->join(&err);
+        StopLoggerThread();
+
+        // save the last blocks of the streaming streams
+        if (writerData) {
+                __sync_synchronize();
+                writerData->run = false;
+                pthread_join(writerThread, NULL);
+                delete writerData;
+        }
+
+        // terminate each stream and then save its data if there were no errors
         for (i=0; i<streams->size(); i++) {
                 streams->at(i)->join(&err);
                 streams->at(i)->terminate();
-                if (!err) {
+                const void *data = streams->at(i)->data(&len);
+                if (streams->at(i)->rawSampleSize() > 0)
+                        data = streams->at(i)->rawData(&len);
+                if (streams->at(i)->isStreaming()) {
+                        if (err)
+                                Logger(Critical, "There were some problems during the recording in stream %d.\n",
+                                                streams->at(i)->id());
+                        else
+                                Logger(Info, "Stream %d run for %.2f seconds.\n", streams->at(i)->id(), len*GetGlobalDt());
+                }
+                else if (!err) {
                         if (!rec)
                                 rec = new ChunkedH5Recorder(true, outfilename.c_str());
-                        double_dict pars;
-                        const double *data = streams->at(i)->data(&len);
-                        rec->addRecord(streams->at(i)->id(), streams->at(i)->name().c_str(),
-                                       streams->at(i)->units().c_str(), len, streams->at(i)->parameters());
-                        rec->writeRecord(streams->at(i)->id(), data, len);
+                        if (AddStreamRecord(rec, streams->at(i), len))
+                                rec->writeRecord(streams->at(i)->id(), data, len);
                         if (streams->at(i)->hasMetadata(&ndims)) {
                                 dims = new size_t[ndims];
                                 const double *metadata = streams->at(i)->metadata(dims, label);
@@ -705,7 +1238,8 @@ int Simulate(std::vector<Stream*>* streams, double tend, const std::string& outf
                 for (int i=0; i<comments->size(); i++)
                         rec->addComment(comments->at(i).first.c_str(), &comments->at(i).second);
                 rec->writeRecordingDuration(len*GetGlobalDt());
-                rec->writeTimeStep(GetGlobalDt());
+                if (!timeStepWritten)
+                        rec->writeTimeStep(GetGlobalDt());
                 delete rec;
         }
 
@@ -64,9 +64,72 @@ struct trigger_data {
 	uint aref;
 };
 
+/*!
+ * What the real-time engine should do when an iteration of the main loop ends after
+ * the deadline of the following one.
+ */
+typedef enum {
+        /*! Run the late iterations back-to-back until the loop is back on schedule. */
+        DEADLINE_CATCH_UP = 0,
+        /*!
+         * Drop the periods that were missed and resume at the next deadline in the future.
+         * Simulation time is not advanced for the dropped periods.
+         */
+        DEADLINE_SKIP,
+        /*! Stop the current trial. */
+        DEADLINE_ABORT
+} deadline_miss_policy;
+
+/*!
+ * Sets the policy used by the real-time engine when a deadline is missed.
+ * \param policy The policy to apply.
+ * \param maxLag Used only with DEADLINE_CATCH_UP: the maximum number of periods the loop is allowed
+ *               to lag behind its schedule before the excess periods are dropped as with DEADLINE_SKIP.
+ *               A negative value means that there is no limit.
+ */
+void SetDeadlineMissPolicy(deadline_miss_policy policy, int maxLag = -1);
+
+/*! What paces the main loop of the engine that steps the entities. */
+typedef enum {
+        /*! The loop waits on a timer of the operating system, in the real-time engine, or does not wait at all. */
+        LOOP_CLOCK_SOFTWARE = 0,
+        /*!
+         * The loop waits for the scans of the analog inputs, which are acquired by Comedi commands timed
+         * by the DAQ boards: each iteration processes one scan and the outputs computed from it are generated
+         * a fixed number of scans later. When the loop falls behind, the scans accumulate in the buffers of
+         * the boards and the deadline miss policy of the real-time engine decides what to do with them.
+         */
+        LOOP_CLOCK_BOARD
+} loop_clock;
+
+/*!
+ * Sets what paces the main loop of the engine that steps the entities.
+ * \param clock The source of the clock.
+ * \param delay Used only with LOOP_CLOCK_BOARD: the number of scans between the acquisition of the inputs
+ *              and the generation of the outputs computed from them. The analog outputs run out of samples
+ *              when the loop lags delay scans behind the boards, so the default tolerates one missed scan:
+ *              they are then restarted, dropping the scans that are too late, or the trial is aborted,
+ *              according to the deadline miss policy.
+ */
+void SetLoopClock(loop_clock clock, uint delay = 2);
+
+/*!
+ * Sets the number of threads used to step the entities by the non real-time engine.
+ * The real-time engines always use a single thread.
+ * \param n The number of threads: a value smaller than one means one thread for each online processor,
+ *          which is also the maximum.
+ */
+void SetSimulationThreads(int n);
+
 int Simulate(std::vector<Entity*> *entities, double tend, struct trigger_data trigger);
 int Simulate(std::vector<Stream*> *streams, double tend, const std::string& outfilename);
 
+#if defined(REALTIME_ENGINE) && !defined(HAVE_LIBLXRT) && !defined(HAVE_LIBANALOGY)
+class LoopTimingStatistics;
+/*! Returns the timing statistics of the main loop of the last real-time simulation. */
+const LoopTimingStatistics& GetLoopTimingStatistics();
+#endif
+
 #ifdef REALTIME_ENGINE
 extern double globalTimeOffset;
 #define GetGlobalTimeOffset() globalTimeOffset
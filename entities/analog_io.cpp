@@ -262,6 +262,7 @@ void AnalogOutput::terminate()
 {
         if (m_resetOutput || ABNORMAL_TERMINATION())
                 m_output.write(0.0);
+        m_output.flush();
 }
 
 bool AnalogOutput::initialise()
@@ -316,12 +317,14 @@ bool AnalogIO::initialise()
                 return false;
         m_data = m_input.read();
         m_output.write(0.0);
+        m_output.flush();
         return true;
 }
 
 void AnalogIO::terminate()
 {
         m_output.write(0.0);
+        m_output.flush();
 }
 
 void AnalogIO::step()
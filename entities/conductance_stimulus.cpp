@@ -31,7 +31,8 @@ namespace lcg {
 
 namespace generators {
 
-ConductanceStimulus::ConductanceStimulus(double E, uint id) : Generator(id), m_neuron(NULL)
+ConductanceStimulus::ConductanceStimulus(double E, uint id) : Generator(id), m_neuron(NULL),
+          m_E(bindParameter("E"))
 {
         m_parameters["E"] = E;
         setName("ConductanceStimulus");
@@ -60,6 +61,11 @@ double ConductanceStimulus::output()
         return m_output;
 }
 
+bool ConductanceStimulus::isCoupledToPost() const
+{
+        return true;
+}
+
 void ConductanceStimulus::addPost(Entity *entity)
 {
         Logger(Debug, "ConductanceStimulus::addPost(Entity*)\n");
@@ -75,7 +81,9 @@ void ConductanceStimulus::addPost(Entity *entity)
 }
 
 NMDAConductanceStimulus::NMDAConductanceStimulus(double E, double K1, double K2, uint id)
-        : ConductanceStimulus(E, id)
+        : ConductanceStimulus(E, id),
+          m_K1(bindParameter("K1")),
+          m_K2(bindParameter("K2"))
 {
         m_parameters["K1"] = K1;
         m_parameters["K2"] = K2;
@@ -29,9 +29,9 @@
 #include "generator.h"
 #include "neurons.h"
 
-#define COND_E  m_parameters["E"]
-#define NMDA_COND_K1 m_parameters["K1"]
-#define NMDA_COND_K2 m_parameters["K2"]
+#define COND_E  m_E
+#define NMDA_COND_K1 m_K1
+#define NMDA_COND_K2 m_K2
 
 namespace lcg {
 
@@ -44,17 +44,25 @@ public:
         virtual bool hasNext() const;
         virtual void step();
         virtual double output();
+        virtual bool isCoupledToPost() const;
 protected:
         virtual void addPost(Entity *entity);
 protected:
         double m_output;
         neurons::Neuron *m_neuron;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_E;
 };
 
 class NMDAConductanceStimulus : public ConductanceStimulus {
 public:
         NMDAConductanceStimulus(double E, double K1, double K2, uint id = GetId());
         virtual void step();
+
+private:
+        // the parameters, bound to the values in m_parameters
+        double &m_K1, &m_K2;
 };
 
 } // namespace lcg
@@ -1,3 +1,5 @@
+#include <math.h>
+#include <algorithm>
 #include "connections.h"
 #include "common.h"
 #include "utils.h"
@@ -34,21 +36,24 @@ lcg::Entity* SynapticConnectionFactory(string_dict& args)
 
 lcg::Entity* VariableDelayConnectionFactory(string_dict& args)
 {
-        return new lcg::VariableDelayConnection(lcg::GetIdFromDictionary(args));
-}
+        uint id;
+        double maxDelay;
 
-namespace lcg {
+        id = lcg::GetIdFromDictionary(args);
+        if (! lcg::CheckAndExtractDouble(args, "maxDelay", &maxDelay))
+                maxDelay = 0;
 
-bool CompareFirst(const std::pair<double,Event*>& p1, 
-                  const std::pair<double,Event*>& p2)
-{
-        return p1.first < p2.first;
+        return new lcg::VariableDelayConnection(maxDelay, id);
 }
 
+namespace lcg {
+
 Connection::Connection(double delay, uint id)
-        : Entity(id), m_events()
+        : Entity(id), m_events(), m_pool(), m_step(0), m_arrivals(0), m_delaySteps(1),
+          m_maxDelay(delay), m_delay(bindParameter("delay"))
 {
-        m_parameters["delay"] = delay;
+        m_delay = delay;
+        registerAllEventTypes();
         setName("Connection");
 }
         
@@ -59,28 +64,62 @@ Connection::~Connection()
 
 void Connection::setDelay(double delay)
 {
-        if (delay >= 0)
-                m_parameters["delay"] = delay;
+        if (delay >= 0) {
+                m_delay = delay;
+                m_delaySteps = DelaySteps(m_delay, GetGlobalDt());
+        }
         else
                 Logger(Important, "Tried to set a negative delay.\n");
 }
 
+ullong Connection::DelaySteps(double delay, double dt)
+{
+        // an event used to wait for delay-dt, decremented by dt at every step until it was not
+        // positive: unless the ratio is close to an integer, where the rounding errors of the
+        // decrements decide the outcome, the number of steps is obtained directly
+        double remaining = delay - dt, ratio = remaining / dt;
+        if (ratio <= 0.)
+                return 1;
+        if (ratio - floor(ratio) > 1e-6 && ceil(ratio) - ratio > 1e-6)
+                return (ullong) ceil(ratio);
+        ullong steps = 0;
+        do {
+                remaining -= dt;
+                steps++;
+        } while (remaining > 0);
+        return steps;
+}
+
+bool Connection::Later(const DelayedEvent& e1, const DelayedEvent& e2)
+{
+        if (e1.step != e2.step)
+                return e1.step > e2.step;
+        return e1.order > e2.order;
+}
+
 void Connection::step()
 {
-        std::list< std::pair<double,Event*> >::iterator it;
-        for (it=m_events.begin(); it!=m_events.end(); it++)
-                it->first -= GetGlobalDt();
-        while (!m_events.empty() && m_events.front().first <= 0) {
-                deliverEvent(m_events.front().second);
-                delete m_events.front().second;
-                m_events.pop_front();
+        m_step++;
+        while (!m_events.empty() && m_events.front().step <= m_step) {
+                std::pop_heap(m_events.begin(), m_events.end(), Later);
+                Event *event = m_events.back().event;
+                m_events.pop_back();
+                deliverEvent(event);
+                m_pool.release(event);
         }
 }
 
 void Connection::deliverEvent(const Event *event)
 {
-        for (int i=0; i<m_post.size(); i++)
-                m_post[i]->handleEvent(event);
+        const std::vector<Entity*>& receivers = eventReceivers(event->type());
+        for (size_t i=0; i<receivers.size(); i++)
+                receivers[i]->handleEvent(event);
+}
+
+bool Connection::isCoupledToPost() const
+{
+        // events are handed directly to the connected entities in step()
+        return true;
 }
 
 double Connection::output()
@@ -91,6 +130,13 @@ double Connection::output()
 bool Connection::initialise()
 {
         clearEventsList();
+        m_step = 0;
+        m_arrivals = 0;
+        m_delaySteps = DelaySteps(m_delay, GetGlobalDt());
+        // enough room for one event per time step during the longest delay
+        size_t capacity = (size_t) ceil((m_delay > m_maxDelay ? m_delay : m_maxDelay) / GetGlobalDt()) + 16;
+        m_pool.reserve(capacity);
+        m_events.reserve(capacity);
         return true;
 }
 
@@ -101,32 +147,46 @@ void Connection::terminate()
 
 void Connection::clearEventsList()
 {
-        if (!m_events.empty()) {
-                std::list< std::pair<double,Event*> >::iterator it;
-                for (it=m_events.begin(); it!=m_events.end(); it++)
-                        delete it->second;
-                m_events.clear();
-        }
+        for (size_t i=0; i<m_events.size(); i++)
+                m_pool.release(m_events[i].event);
+        m_events.clear();
 }
 
 void Connection::handleEvent(const Event *event)
 {
-        m_events.push_back(std::make_pair(m_parameters["delay"] - GetGlobalDt(), new Event(*event)));
-        m_events.sort(CompareFirst);
+        DelayedEvent delayed;
+        // the storage of the events is not grown while the simulation is running
+        if (m_pool.available() == 0) {
+                Logger(Critical, "Connection #%d cannot hold more than %d pending events: an event was dropped.\n",
+                                id(), (int) m_pool.capacity());
+                return;
+        }
+        delayed.step = m_step + m_delaySteps;
+        delayed.order = m_arrivals++;
+        delayed.event = m_pool.acquire(*event);
+        m_events.push_back(delayed);
+        std::push_heap(m_events.begin(), m_events.end(), Later);
 }
 
 //~~~
 
 SynapticConnection::SynapticConnection(double delay, double weight, uint id)
-        : Connection(delay, id)
+        : Connection(delay, id),
+          m_weight(bindParameter("weight"))
 {
-        m_parameters["weight"] = weight;
+        m_weight = weight;
         setName("SynapticConnection");
 }
 
 void SynapticConnection::setWeight(double weight)
 {
-        m_parameters["weight"] = weight;
+        m_weight = weight;
+}
+
+bool SynapticConnection::isCoupledToPost() const
+{
+        // spikes are delivered through the events queue
+        return false;
 }
 
 void SynapticConnection::deliverEvent(const Event *event)
@@ -138,14 +198,15 @@ void SynapticConnection::deliverEvent(const Event *event)
                 syn->handleSpike(m_parameters["weight"]);
         }
         */
-        emitEvent(new SpikeEvent(this, m_parameters["weight"]));
+        emitEvent(SpikeEvent(this, m_weight));
 }
 
 //~~~
 
-VariableDelayConnection::VariableDelayConnection(uint id)
+VariableDelayConnection::VariableDelayConnection(double maxDelay, uint id)
         : Connection(0, id)
 {
+        m_maxDelay = maxDelay;
         setName("VariableDelayConnection");
 }
 
@@ -25,7 +25,7 @@
 
 #include "entity.h"
 #include "functors.h"
-#include <list>
+#include <vector>
 
 namespace lcg {
 
@@ -42,13 +42,43 @@ public:
         virtual bool initialise();
         virtual void terminate();
         virtual void handleEvent(const Event *event);
+        virtual bool isCoupledToPost() const;
 
 protected:
         virtual void deliverEvent(const Event *event);
         void clearEventsList();
 
 protected:
-        std::list< std::pair<double, Event*> > m_events;
+        /*! An event that is waiting to be delivered. */
+        struct DelayedEvent {
+                /*! The step at which the event is delivered. */
+                ullong step;
+                /*! The order of arrival, which breaks ties between events due at the same step. */
+                ullong order;
+                Event *event;
+        };
+
+        /*! Orders the elements of m_events so that the first one is the next event to be delivered. */
+        static bool Later(const DelayedEvent& e1, const DelayedEvent& e2);
+
+        /*! The number of steps after which an event received now is delivered. */
+        static ullong DelaySteps(double delay, double dt);
+
+protected:
+        /*! A binary min-heap of the events that have not been delivered yet. */
+        std::vector<DelayedEvent> m_events;
+        /*! The storage for the events in m_events. */
+        EventPool m_pool;
+        /*! The number of calls to step since initialise. */
+        ullong m_step;
+        /*! The number of events received since initialise. */
+        ullong m_arrivals;
+        /*! The value of DelaySteps for the current delay, updated by initialise and setDelay. */
+        ullong m_delaySteps;
+        /*! The largest delay that the connection can have, which sizes the storage of the events. */
+        double m_maxDelay;
+        // the parameters, bound to the values in m_parameters
+        double &m_delay;
 };
 
 class SynapticConnection : public Connection
@@ -56,14 +86,22 @@ class SynapticConnection : public Connection
 public:
         SynapticConnection(double delay, double weight, uint id = GetId());
         void setWeight(double weight);
+        virtual bool isCoupledToPost() const;
 protected:
         virtual void deliverEvent(const Event *event);
+private:
+        // the parameters, bound to the values in m_parameters
+        double &m_weight;
 };
 
 class VariableDelayConnection : public Connection
 {
 public:
-        VariableDelayConnection(uint id = GetId());
+        /*!
+         * \param maxDelay The largest delay returned by the connected functor, which sizes the storage of
+         *                 the pending events: if it is exceeded, events may be dropped.
+         */
+        VariableDelayConnection(double maxDelay = 0, uint id = GetId());
         virtual void handleEvent(const Event *event);
 protected:
         virtual void addPre(Entity *entity);
@@ -35,16 +35,16 @@ lcg::Entity* ConstantFromFileFactory(string_dict& args)
 namespace lcg {
 
 Constant::Constant(double value, const std::string& units, uint id)
-        : Entity(id)
+        : Entity(id), m_value(bindParameter("value"))
 {
-        m_parameters["value"] = value;
+        m_value = value;
         setName("Constant");
         setUnits(units);
 }
 
 void Constant::setValue(double value) 
 {
-        m_parameters["value"] = value;
+        m_value = value;
 }
 
 bool Constant::initialise()
@@ -54,7 +54,7 @@ bool Constant::initialise()
 
 double Constant::output()
 {
-        return m_parameters["value"];
+        return m_value;
 }
 
 void Constant::step()
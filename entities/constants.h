@@ -37,6 +37,9 @@ public:
         virtual void step();
         virtual double output();
         virtual bool initialise();
+private:
+        // the parameters, bound to the values in m_parameters
+        double &m_value;
 };
 
 class ConstantFromFile : public Constant
@@ -36,6 +36,11 @@ void Converter::step()
         m_previousInput = m_inputs[0];
 }
 
+bool Converter::isCoupledToPost() const
+{
+        return true;
+}
+
 double Converter::output()
 {
         return 0.0;
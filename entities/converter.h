@@ -61,6 +61,9 @@ public:
         /*! Performs required initialisation. */
         virtual bool initialise();
 
+        /*! A Converter modifies the parameters of the entity it is connected to. */
+        virtual bool isCoupledToPost() const;
+
 private:
         /*! The name of the parameter in the post entity to change whenever a change in the input is detected. */
         std::string m_parameterName;
@@ -2,6 +2,24 @@
 #include "currents.h"
 #include "utils.h"
 
+/*!
+ * Enables the tabulation of the rates of a current if the factory arguments contain
+ * the key tableError, which is the maximum error of the interpolated rates.
+ */
+static lcg::Entity* TabulateRatesIfRequested(string_dict& args, lcg::ionic_currents::IonicCurrent *current)
+{
+        double tableError;
+        if (lcg::CheckAndExtractDouble(args, "tableError", &tableError)) {
+                if (tableError <= 0) {
+                        lcg::Logger(lcg::Critical, "The error of the table of rates must be positive.\n");
+                        delete current;
+                        return NULL;
+                }
+                current->tabulateRates(tableError);
+        }
+        return current;
+}
+
 lcg::Entity* HHSodiumFactory(string_dict& args)
 {
         uint id;
@@ -15,7 +33,7 @@ lcg::Entity* HHSodiumFactory(string_dict& args)
                 gbar = 0.12;
         if (!lcg::CheckAndExtractDouble(args, "E", &E))
                 E = 50;
-        return new lcg::ionic_currents::HHSodium(area, gbar, E, id);
+        return TabulateRatesIfRequested(args, new lcg::ionic_currents::HHSodium(area, gbar, E, id));
 }
 
 lcg::Entity* HHPotassiumFactory(string_dict& args)
@@ -31,7 +49,7 @@ lcg::Entity* HHPotassiumFactory(string_dict& args)
                 gbar = 0.036;
         if (!lcg::CheckAndExtractDouble(args, "E", &E))
                 E = -77;
-        return new lcg::ionic_currents::HHPotassium(area, gbar, E, id);
+        return TabulateRatesIfRequested(args, new lcg::ionic_currents::HHPotassium(area, gbar, E, id));
 }
 
 lcg::Entity* HH2SodiumFactory(string_dict& args)
@@ -51,7 +69,7 @@ lcg::Entity* HH2SodiumFactory(string_dict& args)
                 vtraub = -63;
         if (!lcg::CheckAndExtractDouble(args, "temperature", &temperature))
                 temperature = 36;
-        return new lcg::ionic_currents::HH2Sodium(area, gbar, E, vtraub, temperature, id);
+        return TabulateRatesIfRequested(args, new lcg::ionic_currents::HH2Sodium(area, gbar, E, vtraub, temperature, id));
 }
 
 lcg::Entity* HH2PotassiumFactory(string_dict& args)
@@ -71,7 +89,7 @@ lcg::Entity* HH2PotassiumFactory(string_dict& args)
                 vtraub = -63;
         if (!lcg::CheckAndExtractDouble(args, "temperature", &temperature))
                 temperature = 36;
-        return new lcg::ionic_currents::HH2Potassium(area, gbar, E, vtraub, temperature, id);
+        return TabulateRatesIfRequested(args, new lcg::ionic_currents::HH2Potassium(area, gbar, E, vtraub, temperature, id));
 }
 
 lcg::Entity* MCurrentFactory(string_dict& args)
@@ -91,7 +109,7 @@ lcg::Entity* MCurrentFactory(string_dict& args)
                 taumax = 1000;
         if (!lcg::CheckAndExtractDouble(args, "temperature", &temperature))
                 temperature = 36;
-        return new lcg::ionic_currents::MCurrent(area, gbar, E, taumax, temperature, id);
+        return TabulateRatesIfRequested(args, new lcg::ionic_currents::MCurrent(area, gbar, E, taumax, temperature, id));
 }
 
 lcg::Entity* HHSodiumCNFactory(string_dict& args)
@@ -111,7 +129,7 @@ lcg::Entity* HHSodiumCNFactory(string_dict& args)
                 E = 50;
         if (!lcg::CheckAndExtractDouble(args, "gamma", &gamma))
                 gamma = 10;
-        return new lcg::ionic_currents::HHSodiumCN(area, seed, gbar, E, gamma, id);
+        return TabulateRatesIfRequested(args, new lcg::ionic_currents::HHSodiumCN(area, seed, gbar, E, gamma, id));
 }
 
 lcg::Entity* HHPotassiumCNFactory(string_dict& args)
@@ -131,7 +149,7 @@ lcg::Entity* HHPotassiumCNFactory(string_dict& args)
                 E = -77;
         if (!lcg::CheckAndExtractDouble(args, "gamma", &gamma))
                 gamma = 10;
-        return new lcg::ionic_currents::HHPotassiumCN(area, seed, gbar, E, gamma, id);
+        return TabulateRatesIfRequested(args, new lcg::ionic_currents::HHPotassiumCN(area, seed, gbar, E, gamma, id));
 }
 
 lcg::Entity* WBSodiumFactory(string_dict& args)
@@ -147,7 +165,7 @@ lcg::Entity* WBSodiumFactory(string_dict& args)
                 gbar = 0.035;
         if (!lcg::CheckAndExtractDouble(args, "E", &E))
                 E = 55;
-        return new lcg::ionic_currents::WBSodium(area, gbar, E, id);
+        return TabulateRatesIfRequested(args, new lcg::ionic_currents::WBSodium(area, gbar, E, id));
 }
 
 lcg::Entity* WBPotassiumFactory(string_dict& args)
@@ -163,7 +181,7 @@ lcg::Entity* WBPotassiumFactory(string_dict& args)
                 gbar = 0.009;
         if (!lcg::CheckAndExtractDouble(args, "E", &E))
                 E = -90;
-        return new lcg::ionic_currents::WBPotassium(area, gbar, E, id);
+        return TabulateRatesIfRequested(args, new lcg::ionic_currents::WBPotassium(area, gbar, E, id));
 }
 
 namespace lcg {
@@ -172,6 +190,68 @@ extern integration_method integr_algo;
 
 namespace ionic_currents {
 
+RatesTable::RatesTable()
+        : m_nRates(0), m_nIntervals(0), m_vmin(0), m_invStep(0)
+{}
+
+void RatesTable::clear()
+{
+        m_data.clear();
+        m_nRates = m_nIntervals = 0;
+}
+
+bool RatesTable::build(const IonicCurrent *current, uint nRates, double maxError, double vmin, double vmax)
+{
+        std::vector<double> values(nRates), scale(nRates), error(nRates);
+        double step = 1., err = 0.;
+        uint i, j, n;
+
+        clear();
+        while (true) {
+                n = (uint) ceil((vmax - vmin) / step);
+                m_data.resize((n+1) * nRates);
+                for (i=0; i<=n; i++)
+                        current->rates(vmin + i*step, &m_data[i*nRates]);
+                for (j=0; j<nRates; j++) {
+                        scale[j] = 0.;
+                        error[j] = 0.;
+                }
+                for (i=0; i<=n; i++) {
+                        for (j=0; j<nRates; j++)
+                                scale[j] = fmax(scale[j], fabs(m_data[i*nRates+j]));
+                }
+                // the error of linear interpolation is largest halfway between two points of the grid
+                for (i=0; i<n; i++) {
+                        current->rates(vmin + (i+0.5)*step, &values[0]);
+                        for (j=0; j<nRates; j++)
+                                error[j] = fmax(error[j], fabs(0.5*(m_data[i*nRates+j] + m_data[(i+1)*nRates+j]) - values[j]));
+                }
+                err = 0.;
+                for (j=0; j<nRates; j++) {
+                        if (scale[j] > 0)
+                                err = fmax(err, error[j] / scale[j]);
+                }
+                if (err <= maxError || 2*(n+1) > MAX_ROWS)
+                        break;
+                step /= 2;
+        }
+
+        if (err > maxError) {
+                Logger(Critical, "Unable to tabulate the rates of entity #%d with a maximum error of %g "
+                       "(the error with %d points is %g).\n", current->id(), maxError, n+1, err);
+                clear();
+                return false;
+        }
+
+        m_nRates = nRates;
+        m_nIntervals = n;
+        m_vmin = vmin;
+        m_invStep = 1. / step;
+        Logger(Info, "Tabulated %d rates of entity #%d between %g and %g mV with a step of %g mV "
+               "(maximum error = %g).\n", nRates, current->id(), vmin, vmin + n*step, step, err);
+        return true;
+}
+
 double StepEuler(double x, double dt, double xinf, double taux) {
         return x + dt * (xinf - x) / (taux*1e-3);
 }
@@ -186,8 +266,19 @@ double StepRK4(double x, double dt, double xinf, double taux) {
         return x + 0.1666666667 * (k1+2*k2+2*k3+k4);
 }
 
+/*!
+ * Exponential Euler (Rush-Larsen) step: exact if xinf and taux are constant during the step,
+ * and therefore stable for any dt.
+ */
+double StepExpEuler(double x, double dt, double xinf, double taux) {
+        return xinf + (x - xinf) * exp(-dt / (taux*1e-3));
+}
+
 IonicCurrent::IonicCurrent(double area, double gbar, double E, uint id)
-        : DynamicalEntity(id), m_neuron(NULL)
+        : DynamicalEntity(id), m_neuron(NULL), m_ratesTableError(0), m_integratedByNeuron(false),
+          m_area(bindParameter("area")),
+          m_gbar(bindParameter("gbar")),
+          m_E(bindParameter("E"))
 {
         IC_AREA = area;
         IC_GBAR = gbar;
@@ -207,6 +298,9 @@ IonicCurrent::IonicCurrent(double area, double gbar, double E, uint id)
                 case RK4:
                         doStep = StepRK4;
                         break;
+                case EXP_EULER:
+                        doStep = StepExpEuler;
+                        break;
                 default:
                         doStep = StepEuler;
                         break;
@@ -220,6 +314,86 @@ bool IonicCurrent::initialise()
         return true;
 }
 
+void IonicCurrent::rates(double v, double *values) const
+{}
+
+void IonicCurrent::tabulateRates(double maxError)
+{
+        m_ratesTableError = maxError;
+        m_parameters["tableError"] = maxError;
+}
+
+bool IonicCurrent::buildRatesTable(uint nRates)
+{
+        if (m_ratesTableError > 0)
+                return m_ratesTable.build(this, nRates, m_ratesTableError);
+        m_ratesTable.clear();
+        return true;
+}
+
+double IonicCurrent::conductance() const
+{
+        return IC_FRACTION * maximalConductance();
+}
+
+double IonicCurrent::maximalConductance() const
+{
+        ////    ( nS / cm^2 ) * (    cm^2     )
+        return 10 * IC_GBAR * IC_AREA;
+}
+
+double IonicCurrent::reversalPotential() const
+{
+        return IC_E;
+}
+
+uint IonicCurrent::numberOfGates() const
+{
+        return 0;
+}
+
+double IonicCurrent::openFraction(const double *x, const double *r) const
+{
+        return IC_FRACTION;
+}
+
+const double* IonicCurrent::gatingVariables() const
+{
+        return &m_state[1];
+}
+
+void IonicCurrent::setGatingVariables(const double *x, double v)
+{
+        double r[maxNumberOfRates];
+        uint i, n = numberOfGates();
+        for (i=0; i<n; i++)
+                m_state[i+1] = x[i];
+        computeRates(v, r);
+        IC_FRACTION = openFraction(&m_state[1], r);
+}
+
+void IonicCurrent::setIntegratedByNeuron(bool integrated)
+{
+        m_integratedByNeuron = integrated;
+}
+
+void IonicCurrent::step()
+{
+        if (!m_integratedByNeuron)
+                evolve();
+}
+
+void IonicCurrent::evolve()
+{
+        double dt, r[maxNumberOfRates];
+        uint i, n = numberOfGates();
+        dt = GetGlobalDt();
+        computeRates(m_neuron->output(), r);
+        for (i=0; i<n; i++)
+                m_state[i+1] = doStep(m_state[i+1], dt, r[2*i], r[2*i+1]);
+        IC_FRACTION = openFraction(&m_state[1], r);
+}
+
 double IonicCurrent::output()
 {
         ////        (1)      * ( nS / cm^2 ) *            mV               * (    cm^2     )
@@ -227,6 +401,11 @@ double IonicCurrent::output()
         return IC_FRACTION * 10 * IC_GBAR * (IC_E - m_neuron->output()) * IC_AREA; // (pA)
 }
 
+bool IonicCurrent::isCoupledToPost() const
+{
+        return true;
+}
+
 void IonicCurrent::addPost(Entity *entity)
 {
         Logger(Debug, "IonicCurrent::addPost(Entity*)\n");
@@ -256,25 +435,27 @@ bool HHSodium::initialise()
 {
         for (uint i=0; i<m_state.size(); i++)
                 m_state[i] = 0.0;
-        return true;
+        return buildRatesTable(numberOfRates);
 }
 
-void HHSodium::evolve()
+void HHSodium::rates(double v, double *values) const
 {
-        double dt, v, am, bm, ah, bh, minf, hinf, taum, tauh;
-        dt = GetGlobalDt();
-        v = m_neuron->output();
+        double am, bm, ah, bh, taum, tauh;
         am = alpham(v);
         bm = betam(v);
         ah = alphah(v);
         bh = betah(v);
         taum = 1.0 / (am + bm);
         tauh = 1.0 / (ah + bh);
-        minf = am * taum;
-        hinf = ah * tauh;
-        HH_NA_M = doStep(HH_NA_M, dt, minf, taum);
-        HH_NA_H = doStep(HH_NA_H, dt, hinf, tauh);
-        IC_FRACTION = HH_NA_M*HH_NA_M*HH_NA_M*HH_NA_H;
+        values[0] = am * taum;          // minf
+        values[1] = taum;
+        values[2] = ah * tauh;          // hinf
+        values[3] = tauh;
+}
+
+double HHSodium::openFraction(const double *x, const double *r) const
+{
+        return x[0]*x[0]*x[0]*x[1];
 }
 
 //~~
@@ -291,25 +472,30 @@ bool HHPotassium::initialise()
 {
         for (uint i=0; i<m_state.size(); i++)
                 m_state[i] = 0.0;
-        return true;
+        return buildRatesTable(numberOfRates);
 }
-void HHPotassium::evolve()
+
+void HHPotassium::rates(double v, double *values) const
 {
-        double dt, v, an, bn, ninf, taun;
-        dt = GetGlobalDt();
-        v = m_neuron->output();
+        double an, bn, taun;
         an = alphan(v);
         bn = betan(v);
         taun = 1.0 / (an + bn);
-        ninf = an * taun;
-        HH_K_N = doStep(HH_K_N, dt, ninf, taun);
-        IC_FRACTION = HH_K_N*HH_K_N*HH_K_N*HH_K_N;
+        values[0] = an * taun;          // ninf
+        values[1] = taun;
+}
+
+double HHPotassium::openFraction(const double *x, const double *r) const
+{
+        return x[0]*x[0]*x[0]*x[0];
 }
 
 //~~
 
 HH2Sodium::HH2Sodium(double area, double gbar, double E, double vtraub, double temperature, uint id)
-        : IonicCurrent(area, gbar, E, id)
+        : IonicCurrent(area, gbar, E, id),
+          m_vtraub(bindParameter("vtraub")),
+          m_temperature(bindParameter("temperature"))
 {
         m_state.push_back(0);           // m
         m_state.push_back(0);           // h
@@ -324,7 +510,8 @@ bool HH2Sodium::initialise()
 {
         for (uint i=0; i<m_state.size(); i++)
                 m_state[i] = 0.0;
-        return true;
+        m_tadj = pow(3., (HH2_TEMPERATURE - 36.) / 10.);
+        return buildRatesTable(numberOfRates);
 }
 
 double HH2Sodium::alpham(double v) {
@@ -343,30 +530,33 @@ double HH2Sodium::betah(double v) {
 	return 4. / (1. + exp(0.2*(40.-v)));
 }
 
-void HH2Sodium::evolve()
+void HH2Sodium::rates(double v, double *values) const
 {
-        double dt, v, am, bm, ah, bh, minf, hinf, taum, tauh;
-        dt = GetGlobalDt();
-        v = m_neuron->output() - HH2_VTRAUB; // convert to Traub convention
+        double am, bm, ah, bh, taum, tauh;
+        v = v - HH2_VTRAUB; // convert to Traub convention
         am = alpham(v);
         bm = betam(v);
         ah = alphah(v);
         bh = betah(v);
         taum = 1.0 / (am + bm);
         tauh = 1.0 / (ah + bh);
-        minf = am * taum;
-        hinf = ah * tauh;
-        taum = taum / m_tadj;
-        tauh = tauh / m_tadj;
-        HH2_NA_M = doStep(HH2_NA_M, dt, minf, taum);
-        HH2_NA_H = doStep(HH2_NA_H, dt, hinf, tauh);
-        IC_FRACTION = HH2_NA_M*HH2_NA_M*HH2_NA_M*HH2_NA_H;
+        values[0] = am * taum;          // minf
+        values[1] = taum / m_tadj;
+        values[2] = ah * tauh;          // hinf
+        values[3] = tauh / m_tadj;
+}
+
+double HH2Sodium::openFraction(const double *x, const double *r) const
+{
+        return x[0]*x[0]*x[0]*x[1];
 }
 
 //~~
 
 HH2Potassium::HH2Potassium(double area, double gbar, double E, double vtraub, double temperature, uint id)
-        : IonicCurrent(area, gbar, E, id)
+        : IonicCurrent(area, gbar, E, id),
+          m_vtraub(bindParameter("vtraub")),
+          m_temperature(bindParameter("temperature"))
 {
         m_state.push_back(0);           // n
         HH2_VTRAUB = vtraub;
@@ -380,7 +570,8 @@ bool HH2Potassium::initialise()
 {
         for (uint i=0; i<m_state.size(); i++)
                 m_state[i] = 0.0;
-        return true;
+        m_tadj = pow(3., (HH2_TEMPERATURE - 36.) / 10.);
+        return buildRatesTable(numberOfRates);
 }
 
 double HH2Potassium::alphan(double v) {
@@ -391,24 +582,28 @@ double HH2Potassium::betan(double v) {
 	return 0.5 * exp(0.025*(10.-v));
 }
 
-void HH2Potassium::evolve()
+void HH2Potassium::rates(double v, double *values) const
 {
-        double dt, v, an, bn, ninf, taun;
-        dt = GetGlobalDt();
-        v = m_neuron->output() - HH2_VTRAUB;
+        double an, bn, taun;
+        v = v - HH2_VTRAUB;
         an = alphan(v);
         bn = betan(v);
         taun = 1.0 / (an + bn);
-        ninf = an * taun;
-        taun = taun / m_tadj;
-        HH2_K_N = doStep(HH2_K_N, dt, ninf, taun);
-        IC_FRACTION = HH2_K_N*HH2_K_N*HH2_K_N*HH2_K_N;
+        values[0] = an * taun;          // ninf
+        values[1] = taun / m_tadj;
+}
+
+double HH2Potassium::openFraction(const double *x, const double *r) const
+{
+        return x[0]*x[0]*x[0]*x[0];
 }
 
 //~~
 
 MCurrent::MCurrent(double area, double gbar, double E, double taumax, double temperature, uint id)
-        : IonicCurrent(area, gbar, E, id)
+        : IonicCurrent(area, gbar, E, id),
+          m_tauMax(bindParameter("tauMax")),
+          m_temperature(bindParameter("temperature"))
 {
         m_state.push_back(0);           // m
         IM_TAUMAX = taumax;
@@ -423,18 +618,20 @@ bool MCurrent::initialise()
 {
         for (uint i=0; i<m_state.size(); i++)
                 m_state[i] = 0.0;
-        return true;
+        m_tadj = pow(2.3, (IM_TEMPERATURE - 36.) / 10.);
+        m_tauPeak = IM_TAUMAX / m_tadj;
+        return buildRatesTable(numberOfRates);
 }
 
-void MCurrent::evolve()
+void MCurrent::rates(double v, double *values) const
 {
-        double dt, v, minf, taum;
-        dt = GetGlobalDt();
-        v = m_neuron->output();
-        taum = m_tauPeak / (3.3 * exp(0.05*(v+35)) + exp(-0.05*(v+35)));
-        minf = 1. / (1. + exp(-0.1*(v+35)));
-        IM_M = doStep(IM_M, dt, minf, taum);
-        IC_FRACTION = IM_M;
+        values[0] = 1. / (1. + exp(-0.1*(v+35)));                                       // minf
+        values[1] = m_tauPeak / (3.3 * exp(0.05*(v+35)) + exp(-0.05*(v+35)));           // taum
+}
+
+double MCurrent::openFraction(const double *x, const double *r) const
+{
+        return x[0];
 }
 
 //~~
@@ -443,7 +640,14 @@ TCurrent::TCurrent(double area, double gbar, double E,
                    double q10, double shift, double cao,
                    double caiInf, double taur, double depth,
                    double temperature, uint id)
-        : IonicCurrent(area, gbar, E, id)
+        : IonicCurrent(area, gbar, E, id),
+          m_q10(bindParameter("q10")),
+          m_shift(bindParameter("shift")),
+          m_cao(bindParameter("cao")),
+          m_caiInf(bindParameter("caiInf")),
+          m_taur(bindParameter("taur")),
+          m_depth(bindParameter("depth")),
+          m_temperature(bindParameter("temperature"))
 {
         m_state.push_back(0);           // cai
         m_state.push_back(0);           // h
@@ -486,7 +690,9 @@ void TCurrent::evolve()
 //~~
 
 NoisyIonicCurrent::NoisyIonicCurrent(double area, double gbar, double E, double gamma, uint id)
-        : IonicCurrent(area, gbar, E, id)
+        : IonicCurrent(area, gbar, E, id),
+          m_gamma(bindParameter("gamma")),
+          m_N(bindParameter("N"))
 {
         NIC_GAMMA = gamma;
         NIC_NCHANNELS = ceil(10000 * (IC_AREA*IC_GBAR/NIC_GAMMA));
@@ -509,12 +715,12 @@ bool NoisyIonicCurrent::initialise()
 
 HHSodiumCN::HHSodiumCN(double area, ullong seed, double gbar, double E, double gamma, uint id)
         : NoisyIonicCurrent(area, gbar, E, gamma, id),
-          m_rand(new NormalRandom(0, 1, seed))
+          m_rand(new NormalRandomBuffer(0, 1, seed))
 {
         m_parameters["seed"] = seed;
         m_state.push_back(0.0);   // m
         m_state.push_back(0.0);   // h
-        for (uint i=0; i<numberOfStates; i++)
+        for (uint i=0; i<numberOfStates-1; i++)
                 m_z[i] = 0.0;
         setName("HHSodiumWithChannelNoiseCurrent");
         setUnits("pA");
@@ -529,20 +735,23 @@ bool HHSodiumCN::initialise()
 {
         if (! NoisyIonicCurrent::initialise())
                 return false;
-        for (uint i=0; i<numberOfStates; i++)
+        for (uint i=0; i<numberOfStates-1; i++)
                 m_z[i] = 0.0;
-        return true;
+        return buildRatesTable(numberOfRates);
 }
 
-void HHSodiumCN::evolve()
+/*!
+ * The rates are m_inf, tau_m and h_inf, tau_h (in seconds), followed by the decay factors of the
+ * noisy terms over one time step and by the standard deviations of their increments.
+ */
+void HHSodiumCN::rates(double v, double *values) const
 {
-        double dt, v, am, bm, ah, bh, m_inf, h_inf, tau_m, tau_h;
-        double m3_inf, one_minus_m, one_minus_h, fraction;
-        double tau_z[numberOfStates-1], var_z[numberOfStates-1], mu_z[numberOfStates-1], noise_z[numberOfStates-1];
+        double dt, am, bm, ah, bh, m_inf, h_inf, tau_m, tau_h;
+        double m3_inf, one_minus_m, one_minus_h;
+        double tau_z[numberOfStates-1], var_z[numberOfStates-1], *mu_z, *sigma_z;
 	uint i;
 	
         dt = GetGlobalDt();
-        v = m_neuron->output();
 
 	// m
 	am = HHSodium::alpham(v);
@@ -579,18 +788,32 @@ void HHSodiumCN::evolve()
 	var_z[5] = (1.0/NIC_NCHANNELS) * 3*m3_inf*m_inf*h_inf * one_minus_m*one_minus_m*one_minus_h;
 	var_z[6] = (1.0/NIC_NCHANNELS) * m3_inf*h_inf * one_minus_m*one_minus_m*one_minus_m*one_minus_h;	
 
+        values[0] = m_inf;
+        values[1] = tau_m;
+        values[2] = h_inf;
+        values[3] = tau_h;
+        mu_z = values + 4;
+        sigma_z = mu_z + numberOfStates-1;
 	for(i=0; i<numberOfStates-1; i++) {
 		mu_z[i] = exp(-dt/tau_z[i]);
-		noise_z[i] = sqrt(var_z[i]*(1-mu_z[i]*mu_z[i])) * m_rand->random();
+		sigma_z[i] = sqrt(var_z[i]*(1-mu_z[i]*mu_z[i]));
 	}
+}
+
+void HHSodiumCN::evolve()
+{
+        double dt, r[numberOfRates], *mu_z, *sigma_z, noise_z[numberOfStates-1];
+	uint i;
 	
-        Logger(Debug, "Tau:\t");
-        for(i=0; i<numberOfStates-1; i++)
-                Logger(Debug, " %15.6e", tau_z[i]);
-        Logger(Debug, "\nVar:\t");
-        for(i=0; i<numberOfStates-1; i++)
-                Logger(Debug, " %15.6e", var_z[i]);
-        Logger(Debug, "\nMu:\t");
+        dt = GetGlobalDt();
+        computeRates(m_neuron->output(), r);
+        mu_z = r + 4;
+        sigma_z = mu_z + numberOfStates-1;
+
+	for(i=0; i<numberOfStates-1; i++)
+		noise_z[i] = sigma_z[i] * m_rand->random();
+	
+        Logger(Debug, "Mu:\t");
         for(i=0; i<numberOfStates-1; i++)
                 Logger(Debug, " %15.6e", mu_z[i]);
         Logger(Debug, "\nNoise:\t");
@@ -599,8 +822,8 @@ void HHSodiumCN::evolve()
         Logger(Debug, "\n");
 
 	/* forward Euler for m and h (they are deterministic) */
-	HH_NA_CN_M = HH_NA_CN_M + dt * (m_inf - HH_NA_CN_M) / tau_m;
-	HH_NA_CN_H = HH_NA_CN_H + dt * (h_inf - HH_NA_CN_H) / tau_h;
+	HH_NA_CN_M = HH_NA_CN_M + dt * (r[0] - HH_NA_CN_M) / r[1];
+	HH_NA_CN_H = HH_NA_CN_H + dt * (r[2] - HH_NA_CN_H) / r[3];
 	
 	IC_FRACTION = HH_NA_CN_M*HH_NA_CN_M*HH_NA_CN_M*HH_NA_CN_H;
 	for(i=0; i<numberOfStates-1; i++) {
@@ -620,11 +843,11 @@ void HHSodiumCN::evolve()
 
 HHPotassiumCN::HHPotassiumCN(double area, ullong seed, double gbar, double E, double gamma, uint id)
         : NoisyIonicCurrent(area, gbar, E, gamma, id),
-          m_rand(new NormalRandom(0, 1, seed))
+          m_rand(new NormalRandomBuffer(0, 1, seed))
 {
         m_parameters["seed"] = seed;
         m_state.push_back(0.0);   // n
-        for (uint i=0; i<numberOfStates; i++)
+        for (uint i=0; i<numberOfStates-1; i++)
                 m_z[i] = 0.0;
         setName("HHPotassiumWithChannelNoiseCurrent");
         setUnits("pA");
@@ -639,20 +862,23 @@ bool HHPotassiumCN::initialise()
 {
         if (! NoisyIonicCurrent::initialise())
                 return false;
-        for (uint i=0; i<numberOfStates; i++)
+        for (uint i=0; i<numberOfStates-1; i++)
                 m_z[i] = 0.0;
-        return true;
+        return buildRatesTable(numberOfRates);
 }
 
-void HHPotassiumCN::evolve()
+/*!
+ * The rates are n_inf and tau_n (in seconds), followed by the decay factors of the
+ * noisy terms over one time step and by the standard deviations of their increments.
+ */
+void HHPotassiumCN::rates(double v, double *values) const
 {
-        double dt, v, an, bn, n_inf, tau_n;
-        double n4_inf, one_minus_n, fraction;
-        double tau_z[numberOfStates-1], var_z[numberOfStates-1], mu_z[numberOfStates-1], noise_z[numberOfStates-1];
+        double dt, an, bn, n_inf, tau_n;
+        double n4_inf, one_minus_n;
+        double tau_z[numberOfStates-1], var_z[numberOfStates-1], *mu_z, *sigma_z;
 	int i;
 	
         dt = GetGlobalDt();
-        v = m_neuron->output();
 
 	an = HHPotassium::alphan(v);
 	bn = HHPotassium::betan(v);
@@ -666,19 +892,34 @@ void HHPotassiumCN::evolve()
 	var_z[2] = (1.0/NIC_NCHANNELS) * 4*n4_inf*n_inf * one_minus_n*one_minus_n*one_minus_n;
 	var_z[3] = (1.0/NIC_NCHANNELS) * n4_inf * one_minus_n*one_minus_n*one_minus_n*one_minus_n;
 	
+        values[0] = n_inf;
+        values[1] = tau_n;
+        mu_z = values + 2;
+        sigma_z = mu_z + numberOfStates-1;
 	for(i=0; i<numberOfStates-1; i++) {
 		tau_z[i] = tau_n/(i+1);
 		mu_z[i] = exp(-dt/tau_z[i]);
-		noise_z[i] = sqrt(var_z[i]*(1-mu_z[i]*mu_z[i])) * m_rand->random();
+		sigma_z[i] = sqrt(var_z[i]*(1-mu_z[i]*mu_z[i]));
 	}
+}
+
+void HHPotassiumCN::evolve()
+{
+        double dt, r[numberOfRates], *mu_z, *sigma_z;
+	int i;
+	
+        dt = GetGlobalDt();
+        computeRates(m_neuron->output(), r);
+        mu_z = r + 2;
+        sigma_z = mu_z + numberOfStates-1;
 
 	/* forward Euler for n (it is deterministic) */
-        HH_K_CN_N = HH_K_CN_N + dt * (n_inf - HH_K_CN_N)/tau_n;
+        HH_K_CN_N = HH_K_CN_N + dt * (r[0] - HH_K_CN_N)/r[1];
 
 	/* noisy terms */
 	IC_FRACTION = HH_K_CN_N*HH_K_CN_N*HH_K_CN_N*HH_K_CN_N;
 	for(i=0; i<numberOfStates-1; i++) {
-		m_z[i] = m_z[i]*mu_z[i] + noise_z[i];
+		m_z[i] = m_z[i]*mu_z[i] + sigma_z[i] * m_rand->random();
 		IC_FRACTION += m_z[i];
 	}
 
@@ -694,7 +935,6 @@ void HHPotassiumCN::evolve()
 WBSodium::WBSodium(double area, double gbar, double E, uint id)
         : IonicCurrent(area, gbar, E, id)
 {
-        m_state.push_back(0);           // m
         m_state.push_back(0);           // h
         setName("WBSodiumCurrent");
         setUnits("pA");
@@ -705,29 +945,24 @@ bool WBSodium::initialise()
         for (uint i=0; i<m_state.size(); i++)
                 m_state[i] = 0.0;
 	WB_NA_H = 0.9379;
-        return true;
+        return buildRatesTable(numberOfRates);
 }
 
-void WBSodium::evolve()
+void WBSodium::rates(double v, double *values) const
 {
-        double dt, v, am, bm, ah, bh, minf, hinf, taum, tauh;
-        dt = GetGlobalDt();
-        v = m_neuron->output();
+        double am, bm, ah, bh;
         am = alpham(v);
         bm = betam(v);
         ah = alphah(v);
         bh = betah(v);
-        minf = am / (am +bm);
-
-        // Euler
-        WB_NA_M = minf;
-        WB_NA_H +=  dt * 1000. * 5. * (ah * (1 - WB_NA_H) - bh * WB_NA_H);
-
-        // Runge-Kutta 4
-        /*
-        */
+        values[0] = ah / (ah + bh);             // hinf
+        values[1] = 1. / (5. * (ah + bh));      // tauh (ms)
+        values[2] = am / (am + bm);             // minf
+}
 
-        IC_FRACTION = WB_NA_M*WB_NA_M*WB_NA_M*WB_NA_H;
+double WBSodium::openFraction(const double *x, const double *r) const
+{
+        return r[2]*r[2]*r[2]*x[0];
 }
 
 //~~
@@ -745,23 +980,21 @@ bool WBPotassium::initialise()
         for (uint i=0; i<m_state.size(); i++)
                 m_state[i] = 0;
 	WB_K_N = 0.1224;
-        return true;
+        return buildRatesTable(numberOfRates);
 }
-void WBPotassium::evolve()
+
+void WBPotassium::rates(double v, double *values) const
 {
-        double dt, v, an, bn;
-        dt = GetGlobalDt();
-        v = m_neuron->output();
+        double an, bn;
         an = alphan(v);
         bn = betan(v);
-        
-        // Euler
-        WB_K_N +=  dt * 1000. * 5. * (an * (1 - WB_K_N) - bn * WB_K_N);
-        // Runge-Kutta 4
-        /*
-        */
+        values[0] = an / (an + bn);             // ninf
+        values[1] = 1. / (5. * (an + bn));      // taun (ms)
+}
 
-        IC_FRACTION = WB_K_N*WB_K_N*WB_K_N*WB_K_N;
+double WBPotassium::openFraction(const double *x, const double *r) const
+{
+        return x[0]*x[0]*x[0]*x[0];
 }
 
 //~~
@@ -23,6 +23,7 @@
 #ifndef CURRENTS_H
 #define CURRENTS_H
 
+#include <vector>
 #include "dynamical_entity.h"
 #include "neurons.h"
 #include "randlib.h"
@@ -37,22 +38,140 @@ inline double vtrap(double x, double y) {
         return x/(exp(x/y) - 1.);
 }
 
+class IonicCurrent;
+
+/*!
+ * \class RatesTable
+ * \brief Values of the rates of an ionic current, tabulated as functions of the membrane voltage.
+ *
+ * The table contains the quantities computed by IonicCurrent::rates on a regular grid of
+ * voltages and returns their linear interpolation. The step of the grid is halved until the
+ * interpolation error, measured against the analytic rates at the midpoints of the grid, is
+ * below the requested bound.
+ */
+class RatesTable {
+public:
+        RatesTable();
+
+        /*!
+         * Tabulates the rates of an ionic current between vmin and vmax (in mV).
+         * \param maxError the maximum interpolation error, relative to the largest
+         *        absolute value of each quantity over the range of the table.
+         * \return false if the error bound cannot be met with at most MAX_ROWS points.
+         */
+        bool build(const IonicCurrent *current, uint nRates, double maxError,
+                   double vmin = -150., double vmax = 100.);
+        void clear();
+
+        /*!
+         * Interpolates the tabulated quantities at voltage v.
+         * \return false if the table is empty or v is outside its range.
+         */
+        inline bool lookup(double v, double *values) const {
+                double x = (v - m_vmin) * m_invStep;
+                if (!(x >= 0. && x < m_nIntervals))
+                        return false;
+                uint i = (uint) x;
+                double f = x - i;
+                const double *lo = &m_data[i*m_nRates], *hi = lo + m_nRates;
+                for (uint j=0; j<m_nRates; j++)
+                        values[j] = lo[j] + f * (hi[j] - lo[j]);
+                return true;
+        }
+
+public:
+        static const uint MAX_ROWS = 1<<16;
+
+private:
+        std::vector<double> m_data;
+        uint m_nRates, m_nIntervals;
+        double m_vmin, m_invStep;
+};
+
 #define IC_FRACTION     m_state[0]              // (1)
 
-#define IC_AREA         m_parameters["area"]         // (um^2)
-#define IC_GBAR         m_parameters["gbar"]         // (S/cm^2)
-#define IC_E            m_parameters["E"]            // (mV)
+#define IC_AREA         m_area                       // (um^2)
+#define IC_GBAR         m_gbar                       // (S/cm^2)
+#define IC_E            m_E                          // (mV)
 
 class IonicCurrent : public DynamicalEntity {
 public:
         IonicCurrent(double area, double gbar, double E, uint id = GetId());
         virtual bool initialise();
         double output();
+        virtual bool isCoupledToPost() const;
+
+        /*!
+         * Computes the quantities that depend only on the membrane voltage v (in mV),
+         * such as the steady-state values and the time constants of the gating variables.
+         */
+        virtual void rates(double v, double *values) const;
+
+        /*! Stores in values the result of rates, possibly interpolated from the table. */
+        inline void computeRates(double v, double *values) const {
+                if (!m_ratesTable.lookup(v, values))
+                        rates(v, values);
+        }
+
+        /*!
+         * Replaces the computation of the rates in evolve with the interpolation of a table,
+         * which is built by initialise with the given maximum error.
+         */
+        void tabulateRates(double maxError);
+
+        /*! Returns the conductance of the open channels (nS). */
+        double conductance() const;
+        /*! Returns the conductance of the current when all the channels are open (nS). */
+        double maximalConductance() const;
+        /*! Returns the reversal potential of the current (mV). */
+        double reversalPotential() const;
+
+        /*!
+         * Returns the number of gating variables with first-order kinetics, which are stored in
+         * the state after the fraction of open channels. The first values computed by rates are
+         * the steady state and the time constant (ms) of each of these variables.
+         */
+        virtual uint numberOfGates() const;
+
+        /*! Returns the fraction of open channels, given the gating variables x and the rates r. */
+        virtual double openFraction(const double *x, const double *r) const;
+
+        /*! Returns the gating variables. */
+        const double* gatingVariables() const;
+
+        /*! Sets the gating variables and computes the fraction of open channels at voltage v. */
+        void setGatingVariables(const double *x, double v);
+
+        /*!
+         * Tells whether the gating variables are integrated by the neuron, together with its
+         * membrane potential, in which case step does nothing.
+         */
+        void setIntegratedByNeuron(bool integrated);
+
+        virtual void step();
+
+public:
+        static const uint maxNumberOfRates = 32;
+
 protected:
         virtual void addPost(Entity *entity);
+
+        /*! Advances the gating variables with doStep and updates the fraction of open channels. */
+        virtual void evolve();
+
         double (*doStep)(double x, double dt, double xinf, double taux);
+
+        /*! Builds the table of rates, if tabulateRates was called, or clears it. */
+        bool buildRatesTable(uint nRates);
+
 protected:
         neurons::Neuron *m_neuron;
+        RatesTable m_ratesTable;
+        double m_ratesTableError;
+        bool m_integratedByNeuron;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_area, &m_gbar, &m_E;
 };
 
 #define HH_NA_M         m_state[1]
@@ -63,14 +182,15 @@ public:
         HHSodium(double area, double gbar = 0.12, double E = 50, uint id = GetId());
 
         virtual bool initialise();
+        virtual void rates(double v, double *values) const;
+        virtual uint numberOfGates() const { return 2; }
+        virtual double openFraction(const double *x, const double *r) const;
+        static const uint numberOfRates = 4;
 
         static inline double alpham(double v) { return 0.1 * vtrap(-(v+40.),10.); }
 	static inline double betam(double v) { return 4. * exp(-(v+65.)/18.); }
         static inline double alphah(double v) { return 0.07 * exp(-(v+65.)/20.); }
         static inline double betah(double v) { return 1.0 / (exp(-(v+35.)/10.) + 1.); }
-
-protected:
-        void evolve();
 };
 
 #define HH_K_N          m_state[1]
@@ -81,35 +201,41 @@ public:
         HHPotassium(double area, double gbar = 0.036, double E = -77, uint id = GetId());
 
         virtual bool initialise();
+        virtual void rates(double v, double *values) const;
+        virtual uint numberOfGates() const { return 1; }
+        virtual double openFraction(const double *x, const double *r) const;
+        static const uint numberOfRates = 2;
 
         static inline double alphan(double v) { return 0.01*vtrap(-(v+55.),10.); }
 	static inline double betan(double v) {	return 0.125*exp(-(v+65.)/80.); }
-protected:
-        void evolve();
 };
 
 #define HH2_NA_M        m_state[1]
 #define HH2_NA_H        m_state[2]
 
-#define HH2_VTRAUB      m_parameters["vtraub"]         // (mV)
-#define HH2_TEMPERATURE m_parameters["temperature"]    // (celsius)
+#define HH2_VTRAUB      m_vtraub                       // (mV)
+#define HH2_TEMPERATURE m_temperature                  // (celsius)
 
 class HH2Sodium : public IonicCurrent {
 public:
         HH2Sodium(double area, double gbar = 0.003, double E = 50, double vtraub = -63., double temperature = 36., uint id = GetId());
 
         virtual bool initialise();
+        virtual void rates(double v, double *values) const;
+        virtual uint numberOfGates() const { return 2; }
+        virtual double openFraction(const double *x, const double *r) const;
+        static const uint numberOfRates = 4;
 
         static double alpham(double v);
         static double betam(double v);
         static double alphah(double v);
         static double betah(double v);
 
-protected:
-        void evolve();
-
 private:
         double m_tadj;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_vtraub, &m_temperature;
 };
 
 #define HH2_K_N         m_state[1]
@@ -119,21 +245,25 @@ public:
         HH2Potassium(double area, double gbar = 0.005, double E = -90, double vtraub = -63., double temperature = 36., uint id = GetId());
 
         virtual bool initialise();
+        virtual void rates(double v, double *values) const;
+        virtual uint numberOfGates() const { return 1; }
+        virtual double openFraction(const double *x, const double *r) const;
+        static const uint numberOfRates = 2;
 
         static double alphan(double v);
         static double betan(double v);
 
-protected:
-        void evolve();
-
 private:
         double m_tadj;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_vtraub, &m_temperature;
 };
 
 #define IM_M        m_state[1]
 
-#define IM_TAUMAX      m_parameters["tauMax"]         // (ms)
-#define IM_TEMPERATURE m_parameters["temperature"]    // (celsius)
+#define IM_TAUMAX      m_tauMax                       // (ms)
+#define IM_TEMPERATURE m_temperature                  // (celsius)
 
 /*!
  * \class MCurrent
@@ -155,25 +285,29 @@ class MCurrent : public IonicCurrent {
 public:
         MCurrent(double area, double gbar = 0.005, double E = -90, double taumax = 1000., double temperature = 36., uint id = GetId());
         virtual bool initialise();
-
-protected:
-        void evolve();
+        virtual void rates(double v, double *values) const;
+        virtual uint numberOfGates() const { return 1; }
+        virtual double openFraction(const double *x, const double *r) const;
+        static const uint numberOfRates = 2;
 
 private:
         double m_tadj;
         double m_tauPeak;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_tauMax, &m_temperature;
 };
 
 #define IT_CAI      m_state[1]
 #define IT_H        m_state[2]
 
-#define IT_Q10          m_parameters["q10"]           // (1)
-#define IT_SHIFT        m_parameters["shift"]         // (mV)
-#define IT_CAO          m_parameters["cao"]           // (mM)
-#define IT_CAIINF       m_parameters["caiInf"]        // (mM)
-#define IT_TAUR         m_parameters["taur"]          // (ms)
-#define IT_DEPTH        m_parameters["depth"]         // (um)
-#define IT_TEMPERATURE  m_parameters["temperature"]   // (celsius)
+#define IT_Q10          m_q10                         // (1)
+#define IT_SHIFT        m_shift                       // (mV)
+#define IT_CAO          m_cao                         // (mM)
+#define IT_CAIINF       m_caiInf                      // (mM)
+#define IT_TAUR         m_taur                        // (ms)
+#define IT_DEPTH        m_depth                       // (um)
+#define IT_TEMPERATURE  m_temperature                 // (celsius)
 
 #define FARADAY         (96489)
 
@@ -201,17 +335,24 @@ protected:
 
 private:
         double m_phi_h;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_q10, &m_shift, &m_cao, &m_caiInf, &m_taur, &m_depth, &m_temperature;
 };
 
 #define NIC_NOPEN       m_state[1]              // (1)
 
-#define NIC_GAMMA       m_parameters["gamma"]   // (pS)
-#define NIC_NCHANNELS   m_parameters["N"]       // (1)
+#define NIC_GAMMA       m_gamma                 // (pS)
+#define NIC_NCHANNELS   m_N                     // (1)
 
 class NoisyIonicCurrent : public IonicCurrent {
 public:
         NoisyIonicCurrent(double area, double gbar, double E, double gamma, uint id = GetId());
         virtual bool initialise();
+
+protected:
+        // the parameters, bound to the values in m_parameters
+        double &m_gamma, &m_N;
 };
 
 #define HH_NA_CN_M      m_state[2]
@@ -223,15 +364,17 @@ public:
                    uint id = GetId());
         ~HHSodiumCN();
         virtual bool initialise();
+        virtual void rates(double v, double *values) const;
 
 public:
         static const uint numberOfStates = 8;
+        static const uint numberOfRates = 4 + 2*(numberOfStates-1);
 
 protected:
         void evolve();
 
 private:
-        NormalRandom *m_rand;
+        NormalRandomBuffer *m_rand;
         double m_z[numberOfStates-1];
 };
 
@@ -243,20 +386,22 @@ public:
                       uint id = GetId());
         ~HHPotassiumCN();
         virtual bool initialise();
+        virtual void rates(double v, double *values) const;
 
 public:
         static const uint numberOfStates = 5;
+        static const uint numberOfRates = 2 + 2*(numberOfStates-1);
 
 protected:
         void evolve();
 
 private:
-        NormalRandom *m_rand;
+        NormalRandomBuffer *m_rand;
         double m_z[numberOfStates-1];
 };
 
-#define WB_NA_M         m_state[1]
-#define WB_NA_H         m_state[2]
+// the activation m is instantaneous and is not part of the state
+#define WB_NA_H         m_state[1]
 
 /*!
  * \class WBSodium
@@ -273,14 +418,15 @@ public:
         WBSodium(double area, double gbar = 0.035, double E = 55., uint id = GetId());
 
         virtual bool initialise();
+        virtual void rates(double v, double *values) const;
+        virtual uint numberOfGates() const { return 1; }
+        virtual double openFraction(const double *x, const double *r) const;
+        static const uint numberOfRates = 3;
 
         static inline double alpham(double v) { return 0.1 * vtrap(-(v + 35.),10); }
 	static inline double betam(double v) { return 4. * exp(-0.0556 * (v + 60.)); }
         static inline double alphah(double v) { return 0.07 * exp(-0.05 * (v + 58.)); }
         static inline double betah(double v) { return 1. / (1. + exp(-0.1 * (v + 28.))); }
-
-protected:
-        void evolve();
 };
 
 #define WB_K_N          m_state[1]
@@ -299,11 +445,13 @@ public:
         WBPotassium(double area, double gbar = 0.009, double E = -90., uint id = GetId());
 
         virtual bool initialise();
+        virtual void rates(double v, double *values) const;
+        virtual uint numberOfGates() const { return 1; }
+        virtual double openFraction(const double *x, const double *r) const;
+        static const uint numberOfRates = 2;
 
         static inline double alphan(double v) { return 0.01 * vtrap(-(v+34.), 10.); }
 	static inline double betan(double v) {	return 0.125 * exp(-0.0125 * (v+44.)); }
-protected:
-        void evolve();
 };
 
 } // namespace ionic_currents
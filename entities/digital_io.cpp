@@ -103,23 +103,23 @@ void DigitalInput::step()
 	if (m_data - m_previous > 0) {
 		switch (m_eventToSend) {
 			case DIGITAL_RISE:
-				emitEvent(new DigitalRiseEvent(this));
+				emitEvent(DigitalRiseEvent(this));
 				break;
 			case STOPRUN:
-				emitEvent(new StopRunEvent(this));
+				emitEvent(StopRunEvent(this));
 				Logger(Important, "Simulation terminated by DigitalInput(%d).\n", id());
 				break;
 			case RESET:
-				emitEvent(new ResetEvent(this));
+				emitEvent(ResetEvent(this));
 				break;
 			case TOGGLE:
-				emitEvent(new ToggleEvent(this));
+				emitEvent(ToggleEvent(this));
 				break;
 			case TRIGGER: 
-				emitEvent(new TriggerEvent(this));
+				emitEvent(TriggerEvent(this));
 				break;
 			case SPIKE:
-				emitEvent(new SpikeEvent(this));
+				emitEvent(SpikeEvent(this));
 				break;
 			default:
 				Logger(Important, "DigitalInput(%d): Can't send event.\n", id());
@@ -187,23 +187,23 @@ void DigitalOutput::step()
 	if (m_data - m_previous > 0) {
 		switch (m_eventToSend) {
 			case DIGITAL_RISE:
-				emitEvent(new DigitalRiseEvent(this));
+				emitEvent(DigitalRiseEvent(this));
 				break;
 			case STOPRUN:
-				emitEvent(new StopRunEvent(this));
+				emitEvent(StopRunEvent(this));
 				Logger(Important, "Simulation terminated by DigitalOutput(%d).\n", id());
 				break;
 			case RESET:
-				emitEvent(new ResetEvent(this));
+				emitEvent(ResetEvent(this));
 				break;
 			case TOGGLE:
-				emitEvent(new ToggleEvent(this));
+				emitEvent(ToggleEvent(this));
 				break;
 			case TRIGGER: 
-				emitEvent(new TriggerEvent(this));
+				emitEvent(TriggerEvent(this));
 				break;
 			case SPIKE:
-				emitEvent(new SpikeEvent(this));
+				emitEvent(SpikeEvent(this));
 				break;
 			default:
 				Logger(Important, "DigitalOutput(%d): Can't send event.\n", id());
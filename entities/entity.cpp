@@ -23,12 +23,12 @@
 #include <stdio.h>
 #include <dlfcn.h>
 #include "entity.h"
-#include "thread_safe_queue.h"
 
 namespace lcg {
 
 Entity::Entity(uint id)
-        : m_id(id), m_inputs(), m_pre(), m_post(), m_name("Entity"), m_units("N/A"), m_hasOutput(true)
+        : m_id(id), m_inputs(), m_pre(), m_post(), m_name("Entity"), m_units("N/A"), m_hasOutput(true),
+          m_eventTypes(0)
 {}
 
 Entity::~Entity()
@@ -58,6 +58,12 @@ double& Entity::parameter(const std::string name)
         return m_parameters[name];
 }
 
+double& Entity::bindParameter(const std::string& name)
+{
+        // the elements of a std::map are never moved, so the reference stays valid
+        return m_parameters[name];
+}
+
 bool Entity::isPost(const Entity *entity) const
 {
         Logger(All, "--- Entity::isPost(Entity*) ---\n");
@@ -84,6 +90,10 @@ void Entity::connect(Entity *entity)
 
         addPost(entity);
         entity->addPre(this);
+        for (int i=0; i<NUMBER_OF_EVENT_TYPES; i++) {
+                if (entity->handlesEventType((EventType) i))
+                        m_eventReceivers[i].push_back(entity);
+        }
 }
 
 void Entity::terminate()
@@ -128,7 +138,28 @@ void Entity::readAndStoreInputs()
 void Entity::handleEvent(const Event *event)
 {}
 
-void Entity::emitEvent(Event *event) const
+bool Entity::handlesEventType(EventType type) const
+{
+        return (m_eventTypes & (1 << type)) != 0;
+}
+
+const std::vector<Entity*>& Entity::eventReceivers(EventType type) const
+{
+        return m_eventReceivers[type];
+}
+
+void Entity::registerEventType(EventType type)
+{
+        m_eventTypes |= (1 << type);
+}
+
+void Entity::registerAllEventTypes()
+{
+        for (int i=0; i<NUMBER_OF_EVENT_TYPES; i++)
+                registerEventType((EventType) i);
+}
+
+void Entity::emitEvent(const Event& event) const
 {
         EnqueueEvent(event);
 }
@@ -148,6 +179,11 @@ bool Entity::hasOutput() const {
 	return m_hasOutput;
 }
 
+bool Entity::isCoupledToPost() const
+{
+        return false;
+}
+
 void Entity::setHasOutput(bool outputRelevance) {
 	m_hasOutput = outputRelevance;
 }
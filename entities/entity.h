@@ -151,15 +151,26 @@ public:
 
         /*!
          * This method is called when the entity receives an event sent by another entity.
+         * Only events whose type was registered with registerEventType are delivered.
          * \param event The event to handle.
          */
         virtual void handleEvent(const Event *event);
 
+        /*! Returns true if this entity handles events of the given type. */
+        bool handlesEventType(EventType type) const;
+
+        /*!
+         * Returns the entities this entity is connected to that handle events of the given type,
+         * i.e., those that receive the events of that type emitted by this entity.
+         */
+        const std::vector<Entity*>& eventReceivers(EventType type) const;
+
         /*!
          * This method is used for emitting events that have this entity as sender.
-         * \param event The event to send to all the entities connected.
+         * \param event The event to send to all the entities connected: a copy of it is queued,
+         *              so it is usually a temporary object.
          */
-        virtual void emitEvent(Event *event) const;
+        virtual void emitEvent(const Event& event) const;
 
         /*!
          * Should return true if the entity contains additional metadata, i.e. a multidimensional array
@@ -185,6 +196,14 @@ public:
          */
 		virtual bool hasOutput() const;
 
+        /*!
+         * Should return true if the step method of this entity accesses directly (i.e., not
+         * through its inputs) the state of the entities it is connected to. Such entities are
+         * always stepped in the same thread as the ones they are connected to when the
+         * simulation is run on multiple threads. The default implementation returns false.
+         */
+        virtual bool isCoupledToPost() const;
+
 protected:
         /*!
          * Adds an entity to the list of objects that provide inputs to this entity.
@@ -208,7 +227,28 @@ protected:
          * Change the relevance of the output.
          */
 		 virtual void setHasOutput(bool outputRelevance);
+
+        /*!
+         * Declares that this entity handles the events of a given type. Must be called
+         * in the constructor, before the entity is connected to other entities.
+         */
+        void registerEventType(EventType type);
+
+        /*! Declares that this entity handles events of any type. */
+        void registerAllEventTypes();
+
+        /*!
+         * Returns a reference to the value of the parameter with a given name, which is added
+         * with a value of zero if it does not exist. The reference remains valid for the lifetime
+         * of the entity and refers to the same value returned by parameter(), so that changes
+         * made from the outside (e.g., by a Converter) are seen through it. Entities bind their
+         * parameters to reference members when they are constructed, in order not to look them
+         * up by name while the simulation runs.
+         */
+        double& bindParameter(const std::string& name);
 private:
+        friend class StepSchedule;
+
         /*! Checks whether this entity is connected to the entity passed as a parameter of the method. */
         bool isPost(const Entity *entity) const;
 
@@ -236,7 +276,12 @@ private:
 
         /*! The units of measure of the output of this entity. */
         std::string m_units;
-        
+
+        /*! A bit mask of the types of events handled by this entity. */
+        uint m_eventTypes;
+
+        /*! For each type of event, the entities in m_post that handle it. */
+        std::vector<Entity*> m_eventReceivers[NUMBER_OF_EVENT_TYPES];
 };
 
 /*!
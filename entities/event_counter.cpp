@@ -56,6 +56,8 @@ EventCounter::EventCounter(uint maxCount, bool autoReset, EventType eventToCount
         : Entity(id), m_maxCount(maxCount), m_autoReset(autoReset), m_eventToCount(eventToCount), m_eventToSend(eventToSend)
 {
         m_parameters["maxCount"] = maxCount;
+        registerEventType(m_eventToCount);
+        registerEventType(RESET);
         setName("EventCounter");
 }
 
@@ -152,19 +154,19 @@ void EventCounter::dispatch()
 {
         switch (m_eventToSend) {
                 case TRIGGER: 
-                        emitEvent(new TriggerEvent(this));
+                        emitEvent(TriggerEvent(this));
                         break;
                 case SPIKE:
-                        emitEvent(new SpikeEvent(this));
+                        emitEvent(SpikeEvent(this));
                         break;
                 case RESET:
-                        emitEvent(new ResetEvent(this));
+                        emitEvent(ResetEvent(this));
                         break;
                 case TOGGLE:
-                        emitEvent(new ToggleEvent(this));
+                        emitEvent(ToggleEvent(this));
                         break;
 		case STOPRUN:
-                        emitEvent(new StopRunEvent(this));
+                        emitEvent(StopRunEvent(this));
                         Logger(Important, "Simulation terminated by EventCounter(%d). Counted %d events.\n", id(), m_count);
 			break;
                 default:
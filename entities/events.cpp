@@ -20,60 +20,60 @@
  *
  *=========================================================================*/
 
+#include <string.h>
+#include <new>
 #include "events.h"
 #include "entity.h"
-#include "thread_safe_queue.h"
+#include "lock_free_queue.h"
 
 namespace lcg {
 
 /*! The queue where events are stored. */
-ThreadSafeQueue<const Event*> eventsQueue;
+LockFreeQueue<Event> eventsQueue(EVENTS_QUEUE_SIZE);
 
-void EnqueueEvent(const Event *event)
+void EnqueueEvent(const Event& event)
 {
-        eventsQueue.push_back(event);
-        Logger(All, "Enqueued event sent from entity #%d.\n", event->sender()->id());
+        if (!eventsQueue.push(event)) {
+                Logger(Critical, "The events queue is full: dropped event sent from entity #%d.\n", event.sender()->id());
+                return;
+        }
+        Logger(All, "Enqueued event sent from entity #%d.\n", event.sender()->id());
 }
 
 void ProcessEvents()
 {
-        uint i, j, nEvents, nPost;
+        uint i, j, nEvents, nReceivers;
+        const Event *event;
         nEvents = eventsQueue.size();
         Logger(All, "There are %d events in the queue.\n", nEvents);
-        for (i=0; i<nEvents; i++) {
-                const Event *event = eventsQueue.pop_front();
-                const std::vector<Entity*>& post = event->sender()->post();
-                nPost = post.size();
-                for (j=0; j<nPost; j++)
-                        post[j]->handleEvent(event);
-                delete event;
-                Logger(All, "Deleted event sent from entity #%d.\n", event->sender()->id());
+        for (i=0; i<nEvents && (event = eventsQueue.front()) != NULL; i++) {
+                const std::vector<Entity*>& receivers = event->sender()->eventReceivers(event->type());
+                nReceivers = receivers.size();
+                for (j=0; j<nReceivers; j++)
+                        receivers[j]->handleEvent(event);
+                Logger(All, "Delivered event sent from entity #%d.\n", event->sender()->id());
+                eventsQueue.pop();
         }
 }
 
 Event::Event(EventType type, const Entity *sender, size_t nParams, double *params)
-        : m_type(type), m_sender(sender), m_nParams(nParams), m_params(NULL), m_time(GetGlobalTime())
+        : m_type(type), m_sender(sender), m_time(GetGlobalTime()), m_nParams(nParams)
 {
-        if (m_nParams > 0) {
-                m_params = new double[m_nParams];
+        if (m_nParams > EVENT_MAX_PARAMS)
+                throw "Too many parameters.";
+        if (m_nParams > 0)
                 memcpy(m_params, params, m_nParams * sizeof(double));
-        }
 }
 
 Event::Event(const Event& event)
-        : m_type(event.m_type), m_sender(event.m_sender), m_nParams(event.m_nParams), m_params(NULL), m_time(event.m_time)
+        : m_type(event.m_type), m_sender(event.m_sender), m_time(event.m_time), m_nParams(event.m_nParams)
 {
-        if (m_nParams > 0) {
-                m_params = new double[m_nParams];
+        if (m_nParams > 0)
                 memcpy(m_params, event.m_params, m_nParams * sizeof(double));
-        }
 }
 
 Event::~Event()
-{
-        if (m_nParams > 0)
-                delete m_params;
-}
+{}
 
 
 EventType Event::type() const
@@ -134,5 +134,62 @@ StopRunEvent::StopRunEvent(const Entity *sender)
 DigitalRiseEvent::DigitalRiseEvent(const Entity *sender)
         : Event(DIGITAL_RISE, sender)
 {}
+
+//~~~
+
+EventPool::EventPool(size_t capacity)
+        : m_blocks(), m_free(), m_capacity(0)
+{
+        reserve(capacity);
+}
+
+EventPool::~EventPool()
+{
+        if (m_free.size() != m_capacity)
+                Logger(Important, "%d events were not returned to the pool.\n", (int) (m_capacity - m_free.size()));
+        for (size_t i=0; i<m_blocks.size(); i++)
+                delete [] m_blocks[i];
+}
+
+void EventPool::reserve(size_t capacity)
+{
+        if (capacity <= m_capacity)
+                return;
+        size_t i, n = capacity - m_capacity;
+        char *block = new char[n * sizeof(Event)];
+        m_blocks.push_back(block);
+        // the list of free slots must be able to hold all of them, so that release never allocates
+        m_free.reserve(capacity);
+        for (i=n; i>0; i--)
+                m_free.push_back(reinterpret_cast<Event*>(block + (i-1)*sizeof(Event)));
+        m_capacity = capacity;
+}
+
+size_t EventPool::capacity() const
+{
+        return m_capacity;
+}
+
+size_t EventPool::available() const
+{
+        return m_free.size();
+}
+
+Event* EventPool::acquire(const Event& event)
+{
+        if (m_free.empty()) {
+                Logger(Important, "The pool of %d events is exhausted: doubling its size.\n", (int) m_capacity);
+                reserve(m_capacity > 0 ? 2*m_capacity : 16);
+        }
+        Event *slot = m_free.back();
+        m_free.pop_back();
+        return new (slot) Event(event);
+}
+
+void EventPool::release(Event *event)
+{
+        event->~Event();
+        m_free.push_back(event);
+}
 } // namespace lcg
 
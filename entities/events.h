@@ -25,6 +25,7 @@
 
 #include "utils.h"
 #include <string>
+#include <vector>
 
 /*!
  * \file events.h
@@ -70,6 +71,8 @@ typedef enum {
 } EventType;
 
 #define NUMBER_OF_EVENT_TYPES 6
+/*! The maximum number of parameters that an event can carry. */
+#define EVENT_MAX_PARAMS 4
 const std::string eventTypeNames[NUMBER_OF_EVENT_TYPES] = {"spike", "trigger", "reset", "toggle", "stoprun", "digital_rise"};
 
 /*!
@@ -81,7 +84,9 @@ const std::string eventTypeNames[NUMBER_OF_EVENT_TYPES] = {"spike", "trigger", "
  * that sent them, which can be used by the receiving entity.
  *
  * All classes derived from Event should implement one of the event types described by
- * the enumeration EventType.
+ * the enumeration EventType and must not add data members: events are copied into the
+ * events queue as instances of Event. The parameters of an event are stored inside
+ * the event itself, so that creating or copying an event never allocates memory.
  */
 class Event
 {
@@ -89,6 +94,7 @@ public:
         /*!
          * Constructs an event of a given type, with a given sender. It automatically
          * initialises also the time at which the event was created.
+         * Throws an exception if nParams is larger than EVENT_MAX_PARAMS.
          * \sa EventType
          */
         Event(EventType type, const Entity *sender, size_t nParams = 0, double *params = NULL);
@@ -127,7 +133,49 @@ private:
         const Entity *m_sender;
         double m_time;
         size_t m_nParams;
-        double *m_params;
+        double m_params[EVENT_MAX_PARAMS];
+};
+
+/*!
+ * \class EventPool
+ * \brief A free list of preallocated events.
+ *
+ * Entities that need to keep a copy of the events they receive (see, e.g., Connection)
+ * should store it in a pool: the storage is allocated when the pool is created or
+ * reserved, which should happen in Entity::initialise, and it is recycled when an
+ * event is released.
+ */
+class EventPool
+{
+public:
+        /*! Constructs a pool that can contain capacity events. */
+        EventPool(size_t capacity = 0);
+
+        /*! Frees the storage of the pool: all events must have been released. */
+        ~EventPool();
+
+        /*! Makes sure that the pool can contain at least capacity events. */
+        void reserve(size_t capacity);
+
+        /*! Returns the maximum number of events that the pool can contain without growing. */
+        size_t capacity() const;
+
+        /*! Returns the number of events that can still be acquired without growing the pool. */
+        size_t available() const;
+
+        /*!
+         * Returns a copy of the event passed as an argument, stored in the pool. If the pool is
+         * exhausted, its capacity is doubled, which allocates memory.
+         */
+        Event* acquire(const Event& event);
+
+        /*! Returns to the pool an event previously obtained with acquire. */
+        void release(Event *event);
+
+private:
+        std::vector<char*> m_blocks;
+        std::vector<Event*> m_free;
+        size_t m_capacity;
 };
 
 /*!
@@ -201,8 +249,15 @@ public:
         DigitalRiseEvent(const Entity *sender);
 };
 
-/*! Puts the event passed as an argument into the events queue. */
-void EnqueueEvent(const Event *event);
+/*! The maximum number of events that can be waiting to be delivered: must be a power of two. */
+#define EVENTS_QUEUE_SIZE 4096
+
+/*!
+ * Puts a copy of the event passed as an argument into the events queue. The queue is
+ * preallocated and lock-free, so this function can be safely called by any thread, including
+ * the real-time one. If the queue is full the event is discarded.
+ */
+void EnqueueEvent(const Event& event);
 
 /*!
  * This function is called at each time step of the experiment/simulation.
@@ -210,6 +265,8 @@ void EnqueueEvent(const Event *event);
  * receivers, according to the connections between entities. For example, if entity A is connected
  * to entities B and C, when A emits an event, this function will call the method
  * handleEvent of B and C, passing as a parameter a pointer to the event that was emitted by A.
+ * Entities that do not handle the type of the event (see Entity::handlesEventType) are skipped.
+ * Events emitted while the queue is being processed are delivered at the following call.
  */
 void ProcessEvents();
 
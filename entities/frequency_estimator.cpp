@@ -23,12 +23,16 @@ lcg::Entity* FrequencyEstimatorFactory(string_dict& args)
 namespace lcg {
 
 FrequencyEstimator::FrequencyEstimator(double tau, double initialFrequency, uint id)
-        : Entity(id)
+        : Entity(id),
+          m_tau(bindParameter("tau")),
+          m_f0(bindParameter("f0"))
 {
         if (tau <= 0)
                 throw "Tau must be positive";
         m_parameters["tau"] = tau;
         m_parameters["f0"] = initialFrequency;
+        registerEventType(SPIKE);
+        registerEventType(TOGGLE);
         setName("FrequencyEstimator");
         setUnits("Hz");
 }
@@ -91,7 +95,7 @@ void FrequencyEstimator::handleEvent(const Event *event)
 
 void FrequencyEstimator::emitTrigger() const
 {
-        emitEvent(new TriggerEvent(this));
+        emitEvent(TriggerEvent(this));
 }
 
 } // namespace lcg
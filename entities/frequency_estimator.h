@@ -26,8 +26,8 @@
 #include "entity.h"
 #include "utils.h"
 
-#define FE_TAU m_parameters["tau"]
-#define FE_F0  m_parameters["f0"]
+#define FE_TAU m_tau
+#define FE_F0  m_f0
 
 namespace lcg {
 
@@ -47,6 +47,9 @@ private:
 	bool m_state;
         double m_tPrevSpike;
         double m_frequency;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_tau, &m_f0;
 };
 
 } // namespace lcg
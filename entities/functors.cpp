@@ -116,12 +116,12 @@ double SobolDelay::operator()()
 }
 
 PhasicDelay::PhasicDelay(double phase, uint id)
-        : Functor(id)
+        : Functor(id), m_phase(bindParameter("phase"))
 {
-        m_parameters["phase"] = phase;
+        m_phase = phase;
         setName("PhasicDelay");
         setUnits("s");
-	Logger(Debug, "PhasicDelay(%d): Using a delay of %3.3f.\n", id, m_parameters["phase"]);
+	Logger(Debug, "PhasicDelay(%d): Using a delay of %3.3f.\n", id, m_phase);
 }
 
 bool PhasicDelay::initialise()
@@ -134,13 +134,13 @@ double PhasicDelay::operator()()
         double y;
         if (!ConvertUnits(m_inputs[0], &y, pre()[0]->units().c_str(), "s"))
                 throw "Unable to convert.";
-        return m_parameters["phase"] * y;
+        return m_phase * y;
 }
 
 //~~~
 
 RandomDelay::RandomDelay(double interval[2], ullong seed, uint id)
-        : Functor(id), rand(new UniformRandom(seed))
+        : Functor(id), rand(new UniformRandomBuffer(seed))
 {
         m_parameters["min"] = interval[0];
         m_parameters["max"] = interval[1];
@@ -152,7 +152,7 @@ RandomDelay::RandomDelay(double interval[2], ullong seed, uint id)
 }
 
 RandomDelay::RandomDelay(double mean, double stddev, ullong seed, uint id) 
-        : Functor(id), rand(new NormalRandom(0.,1.,seed))
+        : Functor(id), rand(new NormalRandomBuffer(0.,1.,seed))
 {
         m_parameters["mean"] = mean;
         m_parameters["stddev"] = stddev;
@@ -75,6 +75,9 @@ public:
         PhasicDelay(double phase = 0.0, uint id = GetId());
         virtual bool initialise();
         virtual double operator()();
+private:
+        // the parameters, bound to the values in m_parameters
+        double &m_phase;
 };
 
 /*!
@@ -95,7 +98,7 @@ private:
         /*!
          * Either a uniform or a normal RNG, depending on which constructor is used.
          */
-        UniformRandom *rand;
+        RandomBuffer *rand;
 
         /*!
          * These two coefficients are used to compute a uniform and a normal
@@ -1,8 +1,9 @@
 #include <stdio.h>
+#include <math.h>
 #include <sys/stat.h>
 #include "neurons.h"
+#include "currents.h"
 #include "events.h"
-#include "thread_safe_queue.h"
 #include "utils.h"
 
 lcg::Entity* LIFNeuronFactory(string_dict& args)
@@ -176,8 +177,6 @@ lcg::Entity* RealNeuronFactory(string_dict& args)
 
 namespace lcg {
 
-extern ThreadSafeQueue<Event*> eventsQueue;
-
 integration_method integr_algo = EULER;
 
 void SetIntegrationMethod(integration_method algo) {
@@ -217,13 +216,22 @@ double Neuron::output()
 
 void Neuron::emitSpike() const
 {
-        emitEvent(new SpikeEvent(this));
+        emitEvent(SpikeEvent(this));
 }
 
 LIFNeuron::LIFNeuron(double C, double tau, double tarp,
                      double Er, double E0, double Vth, double Iext,
 		     bool holdLastValue, const std::string& holdLastValueFilename, uint id)
-        : Neuron(E0, id), m_holdLastValue(holdLastValue), m_holdLastValueFilename(holdLastValueFilename)
+        : Neuron(E0, id), m_holdLastValue(holdLastValue), m_holdLastValueFilename(holdLastValueFilename),
+          m_C(bindParameter("C")),
+          m_tau(bindParameter("tau")),
+          m_tarp(bindParameter("tarp")),
+          m_Er(bindParameter("Er")),
+          m_E0(bindParameter("E0")),
+          m_Vth(bindParameter("Vth")),
+          m_Iext(bindParameter("Iext")),
+          m_lambda(bindParameter("lambda")),
+          m_Rl(bindParameter("Rl"))
 {
         double dt = GetGlobalDt();
         LIF_C = C;
@@ -350,7 +358,13 @@ void IzhiStepRK4(double *V, double *U, double dt, double I, double a, double b)
 IzhikevichNeuron::IzhikevichNeuron(double a, double b, double c,
                      double d, double Vspk, double Iext,
                      uint id)
-        : Neuron(c, id)
+        : Neuron(c, id),
+          m_a(bindParameter("a")),
+          m_b(bindParameter("b")),
+          m_c(bindParameter("c")),
+          m_d(bindParameter("d")),
+          m_Vspk(bindParameter("Vspk")),
+          m_Iext(bindParameter("Iext"))
 {
         m_state.push_back(b*VM);                  // m_state[1] -> u the membrane recovery variable
         IZH_A = a;
@@ -404,7 +418,15 @@ double CBNStepEuler(double V, double dt, double I, double C, double area)
 ConductanceBasedNeuron::ConductanceBasedNeuron(double C, double gl, double El, double Iext,
                                                double area, double spikeThreshold, double V0,
                                                uint id)
-        : Neuron(V0, id)
+        : Neuron(V0, id),
+          m_C(bindParameter("C")),
+          m_gl(bindParameter("gl")),
+          m_El(bindParameter("El")),
+          m_Iext(bindParameter("Iext")),
+          m_area(bindParameter("area")),
+          m_thresh(bindParameter("thresh")),
+          m_glNs(bindParameter("gl_ns")),
+          m_coeff(bindParameter("coeff"))
 {
         m_state.push_back(V0);                  // m_state[1] -> previous membrane voltage (for spike detection)
 
@@ -420,32 +442,161 @@ ConductanceBasedNeuron::ConductanceBasedNeuron(double C, double gl, double El, d
         setName("ConductanceBasedNeuron");
         setUnits("mV");
 
-        switch (lcg::integr_algo) {
-                case EULER:
-                        doStep = CBNStepEuler;
-                        break;
+        m_integrationMethod = lcg::integr_algo;
+        for (uint i=0; i<4; i++)
+                m_k[i].resize(1);
+}
+
+bool ConductanceBasedNeuron::initialise()
+{
+        uint i, n;
+        ionic_currents::IonicCurrent *current;
+
+        if (! Neuron::initialise())
+                return false;
+        CBN_VM_PREV = VM;
+
+        m_currents.clear();
+        m_currentsInputs.clear();
+        m_gatesOffset.clear();
+        n = 0;
+        for (i=0; i<m_pre.size() && m_integrationMethod != EULER; i++) {
+                current = dynamic_cast<ionic_currents::IonicCurrent*>(m_pre[i]);
+                // with RK4, the currents without gating variables (such as the stochastic ones)
+                // are integrated on their own and treated like the other inputs
+                if (current == NULL || (m_integrationMethod == RK4 && current->numberOfGates() == 0))
+                        continue;
+                current->setIntegratedByNeuron(m_integrationMethod == RK4);
+                m_currents.push_back(current);
+                m_currentsInputs.push_back(i);
+                m_gatesOffset.push_back(n);
+                n += current->numberOfGates();
+        }
+        m_gatesOffset.push_back(n);
+
+        if (m_integrationMethod == RK4) {
+                m_gates.resize(n+1);
+                m_tmp.resize(n+1);
+                for (i=0; i<4; i++)
+                        m_k[i].resize(n+1);
+                Logger(Debug, "Neuron #%d integrates %d gating variables of %d ionic currents.\n",
+                                id(), n, (int) m_currents.size());
+        }
+        return true;
+}
+
+void ConductanceBasedNeuron::evolve()
+{
+        CBN_VM_PREV = VM;
+        switch (m_integrationMethod) {
                 case RK4:
-                        // FIX!!!
-                        doStep = CBNStepEuler;
+                        stepRK4();
+                        break;
+                case EXP_EULER:
+                        stepExpEuler();
                         break;
                 default:
-                        doStep = CBNStepEuler;
+                        stepEuler();
                         break;
         }
+        if (VM >= CBN_SPIKE_THRESH && CBN_VM_PREV < CBN_SPIKE_THRESH)
+                emitSpike();
 }
 
-void ConductanceBasedNeuron::evolve()
+void ConductanceBasedNeuron::stepEuler()
 {
-        double Iinj, v;
+        double Iinj;
         // externally applied current plus leak current
 	Iinj = CBN_IEXT + CBN_GL_NS * (CBN_EL - VM);	// (pA)
         // sum all the ionic currents
 	for(uint i=0; i<m_inputs.size(); i++)
 		Iinj += m_inputs[i];	        // (pA)
-        CBN_VM_PREV = VM;
-        VM = doStep(VM, GetGlobalDt(), Iinj, CBN_C, CBN_AREA);
-        if (VM >= CBN_SPIKE_THRESH && CBN_VM_PREV < CBN_SPIKE_THRESH)
-                emitSpike();
+        VM = CBNStepEuler(VM, GetGlobalDt(), Iinj, CBN_C, CBN_AREA);
+}
+
+void ConductanceBasedNeuron::stepExpEuler()
+{
+        double I, G, g, Vinf;
+        uint i, j = 0;
+        // with constant conductances, the membrane potential relaxes exponentially to Vinf
+        I = CBN_IEXT + CBN_GL_NS * CBN_EL;      // (pA)
+        G = CBN_GL_NS;                          // (nS)
+        for (i=0; i<m_inputs.size(); i++) {
+                if (j < m_currentsInputs.size() && m_currentsInputs[j] == i) {
+                        g = m_currents[j]->conductance();
+                        G += g;
+                        I += g * m_currents[j]->reversalPotential();
+                        j++;
+                }
+                else {
+                        I += m_inputs[i];
+                }
+        }
+        if (G > 0) {
+                Vinf = I / G;
+                VM = Vinf + (VM - Vinf) * exp(-G * CBN_COEFF);
+        }
+        else {
+                VM += CBN_COEFF * I;
+        }
+}
+
+void ConductanceBasedNeuron::derivatives(double V, const double *x, double I, double *dV, double *dx) const
+{
+        double dt, r[ionic_currents::IonicCurrent::maxNumberOfRates];
+        const double *xj;
+        uint i, j, offset, n;
+        dt = GetGlobalDt() * 1e3;               // (ms)
+        I += CBN_GL_NS * (CBN_EL - V);
+        for (j=0; j<m_currents.size(); j++) {
+                offset = m_gatesOffset[j];
+                n = m_gatesOffset[j+1] - offset;
+                xj = x + offset;
+                m_currents[j]->computeRates(V, r);
+                I += m_currents[j]->openFraction(xj, r) * m_currents[j]->maximalConductance() *
+                        (m_currents[j]->reversalPotential() - V);
+                for (i=0; i<n; i++)
+                        dx[offset+i] = dt * (r[2*i] - xj[i]) / r[2*i+1];
+        }
+        *dV = CBN_COEFF * I;
+}
+
+void ConductanceBasedNeuron::stepRK4()
+{
+        double I, V, dV[4];
+        uint i, j = 0, n = m_gatesOffset.back();
+
+        // the current injected by the inputs that are not integrated together with the membrane potential
+        I = CBN_IEXT;
+        for (i=0; i<m_inputs.size(); i++) {
+                if (j < m_currentsInputs.size() && m_currentsInputs[j] == i)
+                        j++;
+                else
+                        I += m_inputs[i];
+        }
+        for (j=0; j<m_currents.size(); j++) {
+                const double *x = m_currents[j]->gatingVariables();
+                for (i=m_gatesOffset[j]; i<m_gatesOffset[j+1]; i++)
+                        m_gates[i] = x[i-m_gatesOffset[j]];
+        }
+
+        V = VM;
+        derivatives(V, &m_gates[0], I, &dV[0], &m_k[0][0]);
+        for (i=0; i<n; i++)
+                m_tmp[i] = m_gates[i] + 0.5*m_k[0][i];
+        derivatives(V + 0.5*dV[0], &m_tmp[0], I, &dV[1], &m_k[1][0]);
+        for (i=0; i<n; i++)
+                m_tmp[i] = m_gates[i] + 0.5*m_k[1][i];
+        derivatives(V + 0.5*dV[1], &m_tmp[0], I, &dV[2], &m_k[2][0]);
+        for (i=0; i<n; i++)
+                m_tmp[i] = m_gates[i] + m_k[2][i];
+        derivatives(V + dV[2], &m_tmp[0], I, &dV[3], &m_k[3][0]);
+
+        VM = V + (dV[0] + 2*dV[1] + 2*dV[2] + dV[3]) / 6.;
+        for (i=0; i<n; i++)
+                m_gates[i] += (m_k[0][i] + 2*m_k[1][i] + 2*m_k[2][i] + m_k[3][i]) / 6.;
+        for (j=0; j<m_currents.size(); j++)
+                m_currents[j]->setGatingVariables(&m_gates[m_gatesOffset[j]], VM);
 }
 
 #ifdef HAVE_LIBCOMEDI
@@ -462,7 +613,8 @@ RealNeuron::RealNeuron(double spikeThreshold, double V0,
           m_input(deviceFile, inputSubdevice, readChannel, inputConversionFactor, inputRange, reference),
           m_output(deviceFile, outputSubdevice, writeChannel, outputConversionFactor, reference),
           m_holdLastValue(holdLastValue),m_holdLastValueFilename(holdLastValueFilename),
-	  m_adaptiveThreshold(adaptiveThreshold)
+	  m_adaptiveThreshold(adaptiveThreshold),
+          m_thresh(bindParameter("thresh"))
 {
         m_state.push_back(V0);        // m_state[1] -> previous membrane voltage (for spike detection)
         RN_SPIKE_THRESH = spikeThreshold;
@@ -483,7 +635,8 @@ RealNeuron::RealNeuron(double spikeThreshold, double V0,
           m_input(deviceFile, inputSubdevice, readChannel, inputConversionFactor, inputRange, reference),
           m_output(deviceFile, outputSubdevice, writeChannel, outputConversionFactor, reference),
           m_holdLastValue(holdLastValue),m_holdLastValueFilename(holdLastValueFilename),
-	  m_adaptiveThreshold(adaptiveThreshold)
+	  m_adaptiveThreshold(adaptiveThreshold),
+          m_thresh(bindParameter("thresh"))
 {
         m_state.push_back(V0);        // m_state[1] -> previous membrane voltage (for spike detection)
         RN_SPIKE_THRESH = spikeThreshold;
@@ -551,6 +704,7 @@ void RealNeuron::terminate()
         Neuron::terminate();
         if (!m_holdLastValue)
                 m_output.write(m_Iinj = 0);
+        m_output.flush();
         FILE *fid = fopen(m_holdLastValueFilename.c_str(), "w");
         if (fid != NULL) {
                 fprintf(fid, "%le", m_Iinj);
@@ -41,46 +41,57 @@
 
 #define IZH_V      m_state[0]
 #define IZH_U      m_state[1]
-#define IZH_A      m_parameters["a"]
-#define IZH_B      m_parameters["b"]
-#define IZH_C      m_parameters["c"]
-#define IZH_D	   m_parameters["d"]
-#define IZH_VSPK   m_parameters["Vspk"]
-#define IZH_IEXT   m_parameters["Iext"]
-
-
-#define LIF_C      m_parameters["C"]
-#define LIF_TAU    m_parameters["tau"]
-#define LIF_TARP   m_parameters["tarp"]
-#define LIF_ER     m_parameters["Er"]
-#define LIF_E0     m_parameters["E0"]
-#define LIF_VTH    m_parameters["Vth"]
-#define LIF_IEXT   m_parameters["Iext"]
-#define LIF_LAMBDA m_parameters["lambda"]
-#define LIF_RL     m_parameters["Rl"]
+#define IZH_A      m_a
+#define IZH_B      m_b
+#define IZH_C      m_c
+#define IZH_D	   m_d
+#define IZH_VSPK   m_Vspk
+#define IZH_IEXT   m_Iext
+
+
+#define LIF_C      m_C
+#define LIF_TAU    m_tau
+#define LIF_TARP   m_tarp
+#define LIF_ER     m_Er
+#define LIF_E0     m_E0
+#define LIF_VTH    m_Vth
+#define LIF_IEXT   m_Iext
+#define LIF_LAMBDA m_lambda
+#define LIF_RL     m_Rl
 //#ifndef REALTIME_ENGINE
 // I don't want to see ``fake'' spikes during real experiments.
 #define LIF_ARTIFICIAL_SPIKE
 //#endif
 
 #define CBN_VM_PREV             m_state[1]
-#define CBN_C                   m_parameters["C"]
-#define CBN_GL                  m_parameters["gl"]
-#define CBN_EL                  m_parameters["El"]
-#define CBN_IEXT                m_parameters["Iext"]
-#define CBN_AREA                m_parameters["area"]
-#define CBN_SPIKE_THRESH        m_parameters["thresh"]
-#define CBN_GL_NS               m_parameters["gl_ns"]
-#define CBN_COEFF               m_parameters["coeff"]
+#define CBN_C                   m_C
+#define CBN_GL                  m_gl
+#define CBN_EL                  m_El
+#define CBN_IEXT                m_Iext
+#define CBN_AREA                m_area
+#define CBN_SPIKE_THRESH        m_thresh
+#define CBN_GL_NS               m_glNs
+#define CBN_COEFF               m_coeff
 
 namespace lcg {
 
+/*!
+ * The integration methods of the neurons and of the ionic currents. With EXP_EULER, the gating
+ * variables are advanced with the exponential Euler (Rush-Larsen) scheme and the membrane
+ * potential of a ConductanceBasedNeuron with the exponential Euler scheme, keeping the
+ * conductances constant during the step. With RK4, a ConductanceBasedNeuron integrates its
+ * membrane potential together with the gating variables of its ionic currents.
+ */
 typedef enum {
-        EULER = 0, RK4
+        EULER = 0, RK4, EXP_EULER
 } integration_method;
 
 void SetIntegrationMethod(integration_method algo);
 
+namespace ionic_currents {
+class IonicCurrent;
+}
+
 namespace neurons {
 
 class Neuron : public DynamicalEntity {
@@ -124,6 +135,9 @@ private:
         double m_Iinj;
         bool m_holdLastValue;
         std::string m_holdLastValueFilename;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_C, &m_tau, &m_tarp, &m_Er, &m_E0, &m_Vth, &m_Iext, &m_lambda, &m_Rl;
 };
 
 class IzhikevichNeuron : public Neuron {
@@ -164,6 +178,9 @@ private:
 
 private:
         double m_tPrevSpike;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_a, &m_b, &m_c, &m_d, &m_Vspk, &m_Iext;
 };
 
 class ConductanceBasedNeuron : public Neuron {
@@ -180,17 +197,40 @@ public:
         ConductanceBasedNeuron(double C, double gl, double El, double Iext,
                                double area, double spikeThreshold, double V0,
                                uint id = GetId());
+        virtual bool initialise();
+
 protected:
         virtual void evolve();
 
 private:
-        double (*doStep)(double V, double dt, double I, double C, double area);
+        void stepEuler();
+        void stepExpEuler();
+        void stepRK4();
+        /*!
+         * Computes the time derivatives, per time step, of the membrane potential V and of the
+         * gating variables x of the currents in m_currents, given the current I injected by
+         * the other inputs.
+         */
+        void derivatives(double V, const double *x, double I, double *dV, double *dx) const;
+
+private:
+        integration_method m_integrationMethod;
+        /*! The ionic currents whose conductance depends on the membrane potential. */
+        std::vector<ionic_currents::IonicCurrent*> m_currents;
+        /*! The positions in m_inputs of the currents in m_currents. */
+        std::vector<uint> m_currentsInputs;
+        /*! The first gating variable of each current in m_gates and the number of gating variables. */
+        std::vector<uint> m_gatesOffset;
+        std::vector<double> m_gates, m_k[4], m_tmp;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_C, &m_gl, &m_El, &m_Iext, &m_area, &m_thresh, &m_glNs, &m_coeff;
 };
 
 #ifdef HAVE_LIBCOMEDI
 
 #define RN_VM_PREV              m_state[1]
-#define RN_SPIKE_THRESH         m_parameters["thresh"]
+#define RN_SPIKE_THRESH         m_thresh
 
 class RealNeuron : public Neuron {
 public:
@@ -237,6 +277,8 @@ private:
         bool m_adaptiveThreshold;
         double m_Vmax, m_Vmin, m_Vth;
 
+        // the parameters, bound to the values in m_parameters
+        double &m_thresh;
 };
 #endif // HAVE_LIBCOMEDI
 
@@ -90,7 +90,16 @@ lcg::Entity* OUNonStationaryFactory(string_dict& args)
 namespace lcg {
 
 OU::OU(double mean, double stddev, double tau, double initialCondition, std::string units, ullong seed, double interval[2], uint id)
-        : DynamicalEntity(id), m_randn(NULL)
+        : DynamicalEntity(id), m_randn(NULL),
+          m_mean(bindParameter("mean")),
+          m_stddev(bindParameter("stddev")),
+          m_tau(bindParameter("tau")),
+          m_ic(bindParameter("ic")),
+          m_const(bindParameter("const")),
+          m_mu(bindParameter("mu")),
+          m_coeff(bindParameter("coeff")),
+          m_start(bindParameter("start")),
+          m_stop(bindParameter("stop"))
 {
         // See the paper [Gillespie, 1994, PRE] for explanation of the meaning of parameters
         // and of the method of solution.
@@ -130,7 +139,7 @@ bool OU::initialise()
                 delete m_randn;
         if (!m_fixSeed)
                 OU_SEED = GetRandomSeed();
-        m_randn = new NormalRandom(0,1,OU_SEED); 
+        m_randn = new NormalRandomBuffer(0,1,OU_SEED); 
         return true;
 }
 
@@ -156,7 +165,12 @@ double OU::output()
 }
 
 OUNonStationary::OUNonStationary(double tau, double initialCondition, std::string units, ullong seed, double interval[2], uint id)
-        : DynamicalEntity(id), m_randn(NULL)
+        : DynamicalEntity(id), m_randn(NULL),
+          m_tau(bindParameter("tau")),
+          m_ic(bindParameter("ic")),
+          m_mu(bindParameter("mu")),
+          m_start(bindParameter("start")),
+          m_stop(bindParameter("stop"))
 {
         // See the paper [Gillespie, 1994, PRE] for explanation of the meaning of parameters
         // and of the method of solution.
@@ -198,7 +212,7 @@ bool OUNonStationary::initialise()
                 delete m_randn;
         if (!m_fixSeed)
                 OU_SEED = GetRandomSeed();
-        m_randn = new NormalRandom(0,1,OU_SEED); 
+        m_randn = new NormalRandomBuffer(0,1,OU_SEED); 
         return true;
 }
 
@@ -30,16 +30,16 @@
 #define OU_ETA      m_state[0]
 #define OU_ETA_AUX  m_state[1]
 
-#define OU_MEAN     m_parameters["mean"]
-#define OU_STDDEV   m_parameters["stddev"]
-#define OU_TAU      m_parameters["tau"]
-#define OU_IC       m_parameters["ic"]
-#define OU_CONST    m_parameters["const"]
-#define OU_MU       m_parameters["mu"]
-#define OU_COEFF    m_parameters["coeff"]
+#define OU_MEAN     m_mean
+#define OU_STDDEV   m_stddev
+#define OU_TAU      m_tau
+#define OU_IC       m_ic
+#define OU_CONST    m_const
+#define OU_MU       m_mu
+#define OU_COEFF    m_coeff
 #define OU_SEED     m_parameters["seed"]
-#define OU_START    m_parameters["start"]
-#define OU_STOP     m_parameters["stop"]
+#define OU_START    m_start
+#define OU_STOP     m_stop
 
 #define OUNS_MEAN    m_inputs[0]
 #define OUNS_STDDEV  m_inputs[1]
@@ -62,9 +62,11 @@ public:
 protected:
         virtual void evolve();
 private:
-        double m_mu, m_noise, m_coeff;
         bool m_fixSeed;
-        NormalRandom *m_randn;
+        NormalRandomBuffer *m_randn;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_mean, &m_stddev, &m_tau, &m_ic, &m_const, &m_mu, &m_coeff, &m_start, &m_stop;
 };
 
 /*! 
@@ -83,9 +85,11 @@ public:
 protected:
         virtual void evolve();
 private:
-        double m_mu;
         bool m_fixSeed;
-        NormalRandom *m_randn;
+        NormalRandomBuffer *m_randn;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_tau, &m_ic, &m_mu, &m_start, &m_stop;
 };
 
 
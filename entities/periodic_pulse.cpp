@@ -31,7 +31,12 @@ namespace lcg {
 namespace generators {
 
 PeriodicPulse::PeriodicPulse(double frequency, double duration, double amplitude, double delay, std::string units, uint id)
-        : Generator(id)
+        : Generator(id),
+          m_frequency(bindParameter("frequency")),
+          m_duration(bindParameter("duration")),
+          m_amplitude(bindParameter("amplitude")),
+          m_period(bindParameter("period")),
+          m_delay(bindParameter("delay"))
 {
         if (frequency <= 0)
                 throw "Periodic pulse: stimulation frequency must be greater than 0";
@@ -74,7 +79,7 @@ void PeriodicPulse::step()
                 if (m_output == 0.0) {
                         Logger(Debug, "Turning output ON @ t = %f s.\n", now);
                         m_output = PP_AMPLITUDE;
-                        emitEvent(new TriggerEvent(this));
+                        emitEvent(TriggerEvent(this));
                 }
                 else if (now >= m_tNextPulse+PP_DURATION) {
                         Logger(Debug, "Turning output OFF @ t = %f s.\n", now);
@@ -91,9 +96,7 @@ double PeriodicPulse::output()
 
 double PeriodicPulse::period() const
 {
-        // we use an iterator to access the parameter because this method is declared
-        // as const, which would conflict with map::operator[]
-        return m_parameters.find("T")->second;
+        return PP_PERIOD;
 }
 
 void PeriodicPulse::setFrequency(double frequency)
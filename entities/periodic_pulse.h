@@ -25,11 +25,11 @@
 
 #include "generator.h"
 
-#define PP_FREQUENCY    m_parameters["frequency"]
-#define PP_DURATION     m_parameters["duration"]
-#define PP_AMPLITUDE    m_parameters["amplitude"]
-#define PP_PERIOD       m_parameters["period"]
-#define PP_DELAY        m_parameters["delay"]
+#define PP_FREQUENCY    m_frequency
+#define PP_DURATION     m_duration
+#define PP_AMPLITUDE    m_amplitude
+#define PP_PERIOD       m_period
+#define PP_DELAY        m_delay
 
 namespace lcg {
 
@@ -56,6 +56,9 @@ public:
 private:
         double m_output;
         double m_tNextPulse;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_frequency, &m_duration, &m_amplitude, &m_period, &m_delay;
 };
 
 } // namespace generators
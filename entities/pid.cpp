@@ -23,12 +23,19 @@ lcg::Entity* PIDFactory(string_dict& args)
 namespace lcg {
 
 PID::PID(double baseline, double gp, double gi, double gd, const std::string& units, uint id)
-        : Entity(id)
+        : Entity(id),
+          m_baseline(bindParameter("baseline")),
+          m_gp(bindParameter("gp")),
+          m_gi(bindParameter("gi")),
+          m_gd(bindParameter("gd"))
 {
         PID_BASELINE = baseline;
         PID_GP = gp;
         PID_GI = gi;
         PID_GD = gd;
+        registerEventType(SPIKE);
+        registerEventType(TRIGGER);
+        registerEventType(TOGGLE);
         setName("PID");
         setUnits(units);
 }
@@ -52,7 +59,7 @@ bool PID::initialise()
         m_erri = 0.0;
         m_errpPrev = 0.0;
         m_state = true;
-        Logger(Info, "PID(%d): %s %s %s %s %s\n", id(), "Time","FirstInput","SecondInput","Perror", "Ierror", "Derror", "Output");                
+        Logger(Info, "PID(%d): %s %s %s %s %s %s %s\n", id(), "Time","FirstInput","SecondInput","Perror", "Ierror", "Derror", "Output");                
         return true;
 }
 
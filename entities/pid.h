@@ -28,10 +28,10 @@
 
 namespace lcg {
 
-#define PID_BASELINE m_parameters["baseline"]
-#define PID_GP       m_parameters["gp"]
-#define PID_GI       m_parameters["gi"]
-#define PID_GD       m_parameters["gd"]
+#define PID_BASELINE m_baseline
+#define PID_GP       m_gp
+#define PID_GI       m_gi
+#define PID_GD       m_gd
 
 /**
 * PID controller entity
@@ -62,6 +62,9 @@ private:
         double m_output;
         double m_erri;
         double m_errpPrev;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_baseline, &m_gp, &m_gi, &m_gd;
 };
 
 } // namespace lcg
@@ -1,6 +1,5 @@
 #include <math.h>
 #include "events.h"
-#include "thread_safe_queue.h"
 #include "poisson_generator.h"
 
 lcg::Entity* PoissonFactory(string_dict& args)
@@ -23,12 +22,12 @@ lcg::Entity* PoissonFactory(string_dict& args)
 
 namespace lcg {
 
-extern ThreadSafeQueue<Event*> eventsQueue;
-
 namespace generators {
 
 Poisson::Poisson(double rate, ullong seed, uint id)
-        : Generator(id), m_random(seed) 
+        : Generator(id), m_random(seed),
+          m_rate(bindParameter("rate")),
+          m_seed(bindParameter("seed")) 
 {
 		setHasOutput(false);
         POISSON_RATE = rate;
@@ -69,7 +68,7 @@ double Poisson::output()
 void Poisson::step()
 {
         if (GetGlobalTime() >= m_tNextSpike) {
-                emitEvent(new SpikeEvent(this));
+                emitEvent(SpikeEvent(this));
                 calculateTimeNextSpike();
         }
 }
@@ -79,7 +78,7 @@ void Poisson::calculateTimeNextSpike()
         if (m_deterministic)
                 m_tNextSpike += m_period;
         else 
-                m_tNextSpike += (- log(m_random.doub()) * m_period);
+                m_tNextSpike += (- log(m_random.random()) * m_period);
         Logger(Debug, "%e\n", m_tNextSpike);
 }
 
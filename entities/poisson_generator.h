@@ -28,8 +28,8 @@
 #include "randlib.h"
 #include "generator.h"
 
-#define POISSON_RATE m_parameters["rate"]
-#define POISSON_SEED m_parameters["seed"]
+#define POISSON_RATE m_rate
+#define POISSON_SEED m_seed
 
 namespace lcg {
 
@@ -47,10 +47,13 @@ private:
         void calculateTimeNextSpike();
 
 private:
-        UniformRandom m_random;
+        UniformRandomBuffer m_random;
         double m_tNextSpike;
         bool m_deterministic;
         double m_period;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_rate, &m_seed;
 };
 
 } // namespace generators
@@ -0,0 +1,491 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "populations.h"
+#include "events.h"
+#include "utils.h"
+
+/*
+ * The integration kernels are written once, in terms of the type vreal. With GCC, vreal is
+ * a vector of POPULATION_BLOCK doubles and each iteration of a kernel advances a whole
+ * block of neurons: on x86-64 a version of each kernel is compiled for AVX-512, for AVX2
+ * and for the baseline instruction set and the one suited to the processor is selected
+ * when the library is loaded. With other compilers, vreal is a double.
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#define POPULATION_VECTOR_KERNELS
+typedef double vreal __attribute__((vector_size(POPULATION_BLOCK*sizeof(double)), aligned(sizeof(double)), may_alias));
+typedef long long vmask __attribute__((vector_size(POPULATION_BLOCK*sizeof(double))));
+#define VREAL_WIDTH POPULATION_BLOCK
+#if defined(__x86_64__) && defined(__linux__)
+#define POPULATION_KERNEL __attribute__((target_clones("avx512f","avx2","default")))
+#endif
+#else
+typedef double vreal;
+typedef bool vmask;
+#define VREAL_WIDTH 1
+#endif
+
+#ifndef POPULATION_KERNEL
+#define POPULATION_KERNEL
+#endif
+
+#define LOAD(p)         (*(const vreal *) (p))
+#define STORE(p,x)      (*(vreal *) (p) = (x))
+// a macro rather than a function, since passing vectors by value changes the ABI between the clones
+#define BROADCAST(x)    (vreal() + (x))
+
+POPULATION_KERNEL
+static void IzhikevichEulerKernel(size_t n, double dt, double *V, double *U, const double *I,
+                                  const double *A, const double *B, const double *C,
+                                  const double *D, const double *Vspk, double *fired)
+{
+        const vreal one = BROADCAST(1.), zero = BROADCAST(0.);
+        for (size_t i=0; i<n; i+=VREAL_WIDTH) {
+                vreal v = LOAD(V+i), u = LOAD(U+i), a = LOAD(A+i), b = LOAD(B+i);
+                vreal vn = v + dt * ((0.04 * v * v) + 5 * v + 140 - u + LOAD(I+i));
+                vreal un = u + dt * (a * (b * v - u));
+                vmask spike = vn >= LOAD(Vspk+i);
+                STORE(V+i, spike ? LOAD(C+i) : vn);
+                STORE(U+i, spike ? un + LOAD(D+i) : un);
+                STORE(fired+i, spike ? one : zero);
+        }
+}
+
+POPULATION_KERNEL
+static void IzhikevichRK4Kernel(size_t n, double dt, double *V, double *U, const double *I,
+                                const double *A, const double *B, const double *C,
+                                const double *D, const double *Vspk, double *fired)
+{
+        const vreal one = BROADCAST(1.), zero = BROADCAST(0.);
+        for (size_t i=0; i<n; i+=VREAL_WIDTH) {
+                vreal v = LOAD(V+i), u = LOAD(U+i), in = LOAD(I+i), a = LOAD(A+i), b = LOAD(B+i);
+                vreal k1, k2, k3, k4, l1, l2, l3, l4, x, y;
+                k1 = (0.04 * v * v) + 5 * v + 140 - u + in;
+                l1 = a * (b * v - u);
+                x = v + dt * 0.5 * k1;
+                y = u + dt * 0.5 * l1;
+                k2 = (0.04 * (x * x) + 5 * x + 140 - y + in);
+                l2 = a * (b * x - y);
+                x = v + dt * 0.5 * k2;
+                y = u + dt * 0.5 * l2;
+                k3 = (0.04 * (x * x) + 5 * x + 140 - y + in);
+                l3 = a * (b * x - y);
+                x = v + dt * k3;
+                y = u + dt * l3;
+                k4 = (0.04 * (x * x) + 5 * x + 140 - y + in);
+                l4 = a * (b * x - y);
+                vreal vn = v + dt * ONE_OVER_SIX * (k1+2*k2+2*k3+k4);
+                vreal un = u + dt * ONE_OVER_SIX * (l1+2*l2+2*l3+l4);
+                vmask spike = vn >= LOAD(Vspk+i);
+                STORE(V+i, spike ? LOAD(C+i) : vn);
+                STORE(U+i, spike ? un + LOAD(D+i) : un);
+                STORE(fired+i, spike ? one : zero);
+        }
+}
+
+POPULATION_KERNEL
+static void LIFKernel(size_t n, double t, double *V, double *tPrevSpike, const double *I,
+                      const double *tarp, const double *Er, const double *E0, const double *Vth,
+                      const double *Rl, const double *decay, double *fired)
+{
+        const vreal one = BROADCAST(1.), zero = BROADCAST(0.), now = BROADCAST(t);
+        for (size_t i=0; i<n; i+=VREAL_WIDTH) {
+                vreal tPrev = LOAD(tPrevSpike+i), vth = LOAD(Vth+i);
+                vreal Vinf = LOAD(Rl+i) * LOAD(I+i) + LOAD(E0+i);
+                vreal v = Vinf - (Vinf - LOAD(V+i)) * LOAD(decay+i);
+                vmask refractory = (now - tPrev) <= LOAD(tarp+i);
+                v = refractory ? LOAD(Er+i) : v;
+                vmask spike = v > vth;
+#ifdef LIF_ARTIFICIAL_SPIKE
+                STORE(V+i, spike ? -vth : v);
+#else
+                STORE(V+i, spike ? LOAD(E0+i) : v);
+#endif
+                STORE(tPrevSpike+i, spike ? now : tPrev);
+                STORE(fired+i, spike ? one : zero);
+        }
+}
+
+/*
+ * Checks that a parameter is positive for all the neurons.
+ */
+static bool AllPositive(const std::vector<double>& values)
+{
+        for (size_t i=0; i<values.size(); i++) {
+                if (values[i] <= 0)
+                        return false;
+        }
+        return true;
+}
+
+lcg::Entity* IzhikevichPopulationFactory(string_dict& args)
+{
+        uint id, size;
+        std::vector<double> a, b, c, d, Vspk, Iext;
+        const double defaults[] = {0.02, 0.2, -65, 2, 30, 0};
+
+        id = lcg::GetIdFromDictionary(args);
+
+        if (! lcg::CheckAndExtractUnsignedInteger(args, "size", &size) || size == 0) {
+                lcg::Logger(lcg::Critical, "IzhikevichPopulation(%d): the size must be a positive integer.\n", id);
+                return NULL;
+        }
+
+        if (! lcg::neurons::Population::ExtractParameter(args, "a", size, a, &defaults[0]) ||
+            ! lcg::neurons::Population::ExtractParameter(args, "b", size, b, &defaults[1]) ||
+            ! lcg::neurons::Population::ExtractParameter(args, "c", size, c, &defaults[2]) ||
+            ! lcg::neurons::Population::ExtractParameter(args, "d", size, d, &defaults[3]) ||
+            ! lcg::neurons::Population::ExtractParameter(args, "Vspk", size, Vspk, &defaults[4]) ||
+            ! lcg::neurons::Population::ExtractParameter(args, "Iext", size, Iext, &defaults[5])) {
+                lcg::Logger(lcg::Critical, "Unable to build an Izhikevich population.\n");
+                return NULL;
+        }
+
+        return new lcg::neurons::IzhikevichPopulation(a, b, c, d, Vspk, Iext, id);
+}
+
+lcg::Entity* LIFPopulationFactory(string_dict& args)
+{
+        uint id, size;
+        std::vector<double> C, tau, tarp, Er, E0, Vth, Iext;
+
+        id = lcg::GetIdFromDictionary(args);
+
+        if (! lcg::CheckAndExtractUnsignedInteger(args, "size", &size) || size == 0) {
+                lcg::Logger(lcg::Critical, "LIFPopulation(%d): the size must be a positive integer.\n", id);
+                return NULL;
+        }
+
+        if ( ! lcg::neurons::Population::ExtractParameter(args, "C", size, C) ||
+             ! lcg::neurons::Population::ExtractParameter(args, "tau", size, tau) ||
+             ! lcg::neurons::Population::ExtractParameter(args, "tarp", size, tarp) ||
+             ! lcg::neurons::Population::ExtractParameter(args, "Er", size, Er) ||
+             ! lcg::neurons::Population::ExtractParameter(args, "E0", size, E0) ||
+             ! lcg::neurons::Population::ExtractParameter(args, "Vth", size, Vth) ||
+             ! lcg::neurons::Population::ExtractParameter(args, "Iext", size, Iext)) {
+                lcg::Logger(lcg::Critical, "Unable to build a LIF population.\n");
+                return NULL;
+        }
+
+        if (! AllPositive(C) || ! AllPositive(tau)) {
+                lcg::Logger(lcg::Critical, "LIFPopulation(%d): C and tau must be positive.\n", id);
+                return NULL;
+        }
+
+        return new lcg::neurons::LIFPopulation(C, tau, tarp, Er, E0, Vth, Iext, id);
+}
+
+lcg::Entity* PopulationNeuronFactory(string_dict& args)
+{
+        uint id, index;
+
+        id = lcg::GetIdFromDictionary(args);
+
+        if (! lcg::CheckAndExtractUnsignedInteger(args, "index", &index)) {
+                lcg::Logger(lcg::Critical, "PopulationNeuron(%d): Unable to build. Need to specify the index of the neuron.\n", id);
+                return NULL;
+        }
+
+        return new lcg::neurons::PopulationNeuron(index, id);
+}
+
+namespace lcg {
+
+extern integration_method integr_algo;
+
+namespace neurons {
+
+Population::Population(uint size, uint id)
+        : Entity(id), m_size(size),
+          m_paddedSize((size + POPULATION_BLOCK - 1) / POPULATION_BLOCK * POPULATION_BLOCK),
+          m_V(m_paddedSize, 0.), m_I(m_paddedSize, 0.), m_fired(m_paddedSize, 0.),
+          m_neurons(size, (PopulationNeuron *) NULL)
+{
+        m_parameters["size"] = size;
+        m_spikes.reserve(size);
+        setName("Population");
+        setUnits("Spikes");
+}
+
+uint Population::size() const
+{
+        return m_size;
+}
+
+double Population::Vm(uint index) const
+{
+        return m_V[index];
+}
+
+const std::vector<uint>& Population::spikes() const
+{
+        return m_spikes;
+}
+
+bool Population::initialise()
+{
+        m_spikes.clear();
+        m_I.assign(m_paddedSize, 0.);
+        m_fired.assign(m_paddedSize, 0.);
+        return true;
+}
+
+void Population::step()
+{
+        uint i, n, nInputs = m_inputs.size();
+        double I = 0.;
+        for (i=0; i<nInputs; i++)
+                I += m_inputs[i];
+        for (i=0; i<m_size; i++)
+                m_I[i] = m_Iext[i] + I;
+        n = m_attached.size();
+        for (i=0; i<n; i++)
+                m_I[m_attached[i]] += m_neurons[m_attached[i]]->input();
+
+        evolve();
+
+        m_spikes.clear();
+        for (i=0; i<m_size; i++) {
+                if (m_fired[i] != 0.) {
+                        m_spikes.push_back(i);
+                        if (m_neurons[i] != NULL)
+                                emitEvent(SpikeEvent(m_neurons[i]));
+                }
+        }
+}
+
+double Population::output()
+{
+        return m_spikes.size();
+}
+
+bool Population::hasMetadata(size_t *ndims) const
+{
+        *ndims = 2;
+        return true;
+}
+
+const double* Population::metadata(size_t *dims, char *label) const
+{
+        size_t i, j, nColumns = m_metadataColumns.size();
+        m_metadata.resize(m_size * nColumns);
+        for (i=0; i<m_size; i++) {
+                for (j=0; j<nColumns; j++)
+                        m_metadata[i*nColumns + j] = m_metadataColumns[j][i];
+        }
+        dims[0] = m_size;
+        dims[1] = nColumns;
+        sprintf(label, "Neurons_Parameters");
+        return &m_metadata[0];
+}
+
+bool Population::ExtractParameter(string_dict& args, const char *key, uint size,
+                                  std::vector<double>& values, const double *defaultValue)
+{
+        std::string str;
+        values.clear();
+        if (! CheckAndExtractValue(args, key, str)) {
+                if (defaultValue == NULL) {
+                        Logger(Critical, "Population: missing parameter [%s].\n", key);
+                        return false;
+                }
+                values.assign(size, *defaultValue);
+                return true;
+        }
+        size_t start = 0, stop;
+        while (true) {
+                stop = str.find(",", start);
+                std::string item = str.substr(start, stop == str.npos ? str.npos : stop - start);
+                char *end;
+                double value = strtod(item.c_str(), &end);
+                if (end == item.c_str() || *end != '\0') {
+                        Logger(Critical, "Population: [%s] is not a valid value of [%s].\n", Trim(item).c_str(), key);
+                        return false;
+                }
+                values.push_back(value);
+                if (stop == str.npos)
+                        break;
+                start = stop + 1;
+        }
+        if (values.size() == 1) {
+                values.assign(size, values[0]);
+        }
+        else if (values.size() != size) {
+                Logger(Critical, "Population: [%s] has %d values instead of %d.\n", key, (int) values.size(), size);
+                return false;
+        }
+        return true;
+}
+
+void Population::setParameter(const std::string& name, const std::vector<double>& values,
+                              std::vector<double>& storage)
+{
+        size_t i;
+        storage.assign(values.begin(), values.end());
+        // the padding neurons have the parameters of the last one
+        storage.resize(m_paddedSize, values.back());
+        for (i=1; i<values.size() && values[i] == values[0]; i++) ;
+        if (i == values.size())
+                m_parameters[name] = values[0];
+        m_metadataColumns.push_back(values);
+}
+
+void Population::attach(PopulationNeuron *neuron, uint index)
+{
+        if (index >= m_size) {
+                Logger(Critical, "PopulationNeuron(%d): index %d is out of range for population #%d of %d neurons.\n",
+                                neuron->id(), index, id(), m_size);
+                throw "Index of the neuron out of range.";
+        }
+        if (m_neurons[index] != NULL) {
+                Logger(Critical, "Neuron %d of population #%d is already attached to entity #%d.\n",
+                                index, id(), m_neurons[index]->id());
+                throw "Neuron already attached.";
+        }
+        m_neurons[index] = neuron;
+        m_attached.push_back(index);
+}
+
+//~~~
+
+IzhikevichPopulation::IzhikevichPopulation(const std::vector<double>& a, const std::vector<double>& b,
+                                           const std::vector<double>& c, const std::vector<double>& d,
+                                           const std::vector<double>& Vspk, const std::vector<double>& Iext,
+                                           uint id)
+        : Population(a.size(), id)
+{
+        setParameter("a", a, m_a);
+        setParameter("b", b, m_b);
+        setParameter("c", c, m_c);
+        setParameter("d", d, m_d);
+        setParameter("Vspk", Vspk, m_Vspk);
+        setParameter("Iext", Iext, m_Iext);
+        m_U.resize(m_paddedSize);
+        setName("IzhikevichPopulation");
+        initialise();
+}
+
+bool IzhikevichPopulation::initialise()
+{
+        if (! Population::initialise())
+                return false;
+        for (uint i=0; i<m_paddedSize; i++) {
+                m_V[i] = m_c[i];
+                m_U[i] = m_b[i] * m_V[i];
+        }
+        return true;
+}
+
+void IzhikevichPopulation::evolve()
+{
+        double dt = GetGlobalDt() * 1e3;
+        if (integr_algo == RK4)
+                IzhikevichRK4Kernel(m_paddedSize, dt, &m_V[0], &m_U[0], &m_I[0], &m_a[0], &m_b[0],
+                                    &m_c[0], &m_d[0], &m_Vspk[0], &m_fired[0]);
+        else
+                IzhikevichEulerKernel(m_paddedSize, dt, &m_V[0], &m_U[0], &m_I[0], &m_a[0], &m_b[0],
+                                      &m_c[0], &m_d[0], &m_Vspk[0], &m_fired[0]);
+}
+
+//~~~
+
+LIFPopulation::LIFPopulation(const std::vector<double>& C, const std::vector<double>& tau,
+                             const std::vector<double>& tarp, const std::vector<double>& Er,
+                             const std::vector<double>& E0, const std::vector<double>& Vth,
+                             const std::vector<double>& Iext, uint id)
+        : Population(C.size(), id)
+{
+        std::vector<double> Cs, taus;
+        setParameter("C", C, Cs);
+        setParameter("tau", tau, taus);
+        setParameter("tarp", tarp, m_tarp);
+        setParameter("Er", Er, m_Er);
+        setParameter("E0", E0, m_E0);
+        setParameter("Vth", Vth, m_Vth);
+        setParameter("Iext", Iext, m_Iext);
+        m_Rl.resize(m_paddedSize);
+        m_decay.resize(m_paddedSize);
+        for (uint i=0; i<m_paddedSize; i++) {
+                m_Rl[i] = taus[i] / Cs[i];
+                m_decay[i] = exp(-GetGlobalDt() / taus[i]);
+        }
+        m_tPrevSpike.resize(m_paddedSize);
+        setName("LIFPopulation");
+        initialise();
+}
+
+bool LIFPopulation::initialise()
+{
+        if (! Population::initialise())
+                return false;
+        m_V.assign(m_E0.begin(), m_E0.end());
+        m_tPrevSpike.assign(m_paddedSize, -1000.0);
+        return true;
+}
+
+void LIFPopulation::evolve()
+{
+        LIFKernel(m_paddedSize, GetGlobalTime(), &m_V[0], &m_tPrevSpike[0], &m_I[0], &m_tarp[0],
+                  &m_Er[0], &m_E0[0], &m_Vth[0], &m_Rl[0], &m_decay[0], &m_fired[0]);
+}
+
+//~~~
+
+PopulationNeuron::PopulationNeuron(uint index, uint id)
+        : Neuron(0., id), m_index(index), m_population(NULL), m_populationInput(-1)
+{
+        m_parameters["index"] = index;
+        setName("PopulationNeuron");
+        setUnits("mV");
+}
+
+uint PopulationNeuron::index() const
+{
+        return m_index;
+}
+
+double PopulationNeuron::output()
+{
+        if (m_population == NULL)
+                return VM;
+        return m_population->Vm(m_index);
+}
+
+double PopulationNeuron::input() const
+{
+        double I = 0.;
+        int nInputs = m_inputs.size();
+        for (int i=0; i<nInputs; i++) {
+                if (i != m_populationInput)
+                        I += m_inputs[i];
+        }
+        return I;
+}
+
+void PopulationNeuron::evolve()
+{
+        VM = output();
+}
+
+void PopulationNeuron::addPre(Entity *entity)
+{
+        Population *population = dynamic_cast<Population*>(entity);
+        if (population != NULL) {
+                if (m_population != NULL) {
+                        Logger(Critical, "PopulationNeuron(%d): already connected to population #%d.\n",
+                                        id(), m_population->id());
+                        throw "PopulationNeuron connected to more than one population.";
+                }
+                population->attach(this, m_index);
+                m_population = population;
+                m_populationInput = m_pre.size();
+        }
+        Neuron::addPre(entity);
+}
+
+} // namespace neurons
+
+} // namespace lcg
+
@@ -0,0 +1,229 @@
+/*=========================================================================
+ *
+ *   Program:     lcg
+ *   Filename:    populations.h
+ *
+ *   Copyright (C) 2012,2013,2014 Daniele Linaro
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *=========================================================================*/
+
+/*!
+ * \file populations.h
+ * \brief Definition of populations of neurons that are integrated together.
+ */
+
+#ifndef POPULATIONS_H
+#define POPULATIONS_H
+
+#include <vector>
+#include "entity.h"
+#include "neurons.h"
+
+/*!
+ * The state of a population is padded to a multiple of this number of neurons,
+ * so that the integration kernels always work on whole blocks.
+ */
+#define POPULATION_BLOCK 8
+
+namespace lcg {
+
+namespace neurons {
+
+class PopulationNeuron;
+
+/*!
+ * \class Population
+ * \brief Base class for a population of neurons of the same type.
+ *
+ * The state variables and the parameters of the neurons are stored as arrays, with one
+ * element per neuron, and all the neurons are advanced by a single call to step, which
+ * processes them in blocks of POPULATION_BLOCK with vector instructions when the compiler
+ * supports them. Every parameter can be either the same for all the neurons or different
+ * for each of them.
+ *
+ * The inputs of the population are injected into all its neurons and its output is the
+ * number of neurons that spiked at the last step, whose indices are returned by spikes.
+ * Single neurons are connected to other entities through a PopulationNeuron, which
+ * outputs the membrane potential of the neuron and sends its spikes.
+ */
+class Population : public Entity {
+public:
+        Population(uint size, uint id = GetId());
+
+        /*! Returns the number of neurons in the population. */
+        uint size() const;
+
+        /*! Returns the membrane potential of the neuron with the given index. */
+        double Vm(uint index) const;
+
+        /*! Returns the indices of the neurons that spiked at the last step, in increasing order. */
+        const std::vector<uint>& spikes() const;
+
+        virtual bool initialise();
+        virtual void step();
+        virtual double output();
+
+        virtual bool hasMetadata(size_t *ndims) const;
+        virtual const double* metadata(size_t *dims, char *label) const;
+
+        /*!
+         * Parses a parameter of the neurons from the arguments of a factory: the value
+         * can be a number, which is used for all the neurons, or a comma-separated list
+         * with one number for each neuron.
+         * \return false if the value is malformed or, when the parameter is missing, if
+         *         no default value is given.
+         */
+        static bool ExtractParameter(string_dict& args, const char *key, uint size,
+                                     std::vector<double>& values, const double *defaultValue = NULL);
+
+protected:
+        /*!
+         * Advances all the neurons by one time step, given the currents in m_I.
+         * Must set to 1 the elements of m_fired that correspond to neurons that spiked.
+         */
+        virtual void evolve() = 0;
+
+        /*!
+         * Stores the values of a parameter, padding them to a whole number of blocks:
+         * the parameter is saved among the metadata and, if it is the same for all the
+         * neurons, also among the parameters of the entity.
+         */
+        void setParameter(const std::string& name, const std::vector<double>& values,
+                          std::vector<double>& storage);
+
+private:
+        friend class PopulationNeuron;
+        void attach(PopulationNeuron *neuron, uint index);
+
+protected:
+        uint m_size;
+        /*! The number of neurons rounded up to a multiple of POPULATION_BLOCK. */
+        uint m_paddedSize;
+        /*! The membrane potentials. */
+        std::vector<double> m_V;
+        /*! The currents injected in the neurons at the current step. */
+        std::vector<double> m_I;
+        /*! The constant currents injected in the neurons. */
+        std::vector<double> m_Iext;
+        /*! Set by evolve to 1 for the neurons that spiked and to 0 for the others. */
+        std::vector<double> m_fired;
+
+private:
+        std::vector<uint> m_spikes;
+        /*! The PopulationNeuron attached to each neuron, or NULL. */
+        std::vector<PopulationNeuron*> m_neurons;
+        /*! The indices of the neurons that have a PopulationNeuron. */
+        std::vector<uint> m_attached;
+        /*! The parameters of the neurons, one row per neuron. */
+        std::vector< std::vector<double> > m_metadataColumns;
+        mutable std::vector<double> m_metadata;
+};
+
+/*!
+ * \class IzhikevichPopulation
+ * \brief A population of Izhikevich neurons, with the same equations as IzhikevichNeuron.
+ */
+class IzhikevichPopulation : public Population {
+public:
+        IzhikevichPopulation(const std::vector<double>& a, const std::vector<double>& b,
+                             const std::vector<double>& c, const std::vector<double>& d,
+                             const std::vector<double>& Vspk, const std::vector<double>& Iext,
+                             uint id = GetId());
+        virtual bool initialise();
+
+protected:
+        virtual void evolve();
+
+private:
+        std::vector<double> m_U;
+        std::vector<double> m_a, m_b, m_c, m_d, m_Vspk;
+};
+
+/*!
+ * \class LIFPopulation
+ * \brief A population of leaky integrate-and-fire neurons, with the same equations as LIFNeuron.
+ */
+class LIFPopulation : public Population {
+public:
+        LIFPopulation(const std::vector<double>& C, const std::vector<double>& tau,
+                      const std::vector<double>& tarp, const std::vector<double>& Er,
+                      const std::vector<double>& E0, const std::vector<double>& Vth,
+                      const std::vector<double>& Iext, uint id = GetId());
+        virtual bool initialise();
+
+protected:
+        virtual void evolve();
+
+private:
+        std::vector<double> m_tPrevSpike;
+        std::vector<double> m_tarp, m_Er, m_E0, m_Vth, m_Rl, m_decay;
+};
+
+/*!
+ * \class PopulationNeuron
+ * \brief A single neuron of a Population.
+ *
+ * A PopulationNeuron must be connected as a post of a Population: its output is the
+ * membrane potential of the neuron with the given index, it sends a spike event whenever
+ * that neuron spikes and the sum of its other inputs is injected into the neuron. It can
+ * therefore be used in place of a neuron, for example as the post of a synapse or as the
+ * input of a recorder.
+ */
+class PopulationNeuron : public Neuron {
+public:
+        PopulationNeuron(uint index, uint id = GetId());
+
+        /*! Returns the index of the neuron in the population. */
+        uint index() const;
+
+        virtual double output();
+
+        /*! Returns the sum of the inputs of this entity, excluding the population. */
+        double input() const;
+
+protected:
+        virtual void evolve();
+        virtual void addPre(Entity *entity);
+
+private:
+        friend class Population;
+        uint m_index;
+        Population *m_population;
+        /*! The position of the population in the inputs of this entity. */
+        int m_populationInput;
+};
+
+} // namespace neurons
+
+} // namespace lcg
+
+/***
+ *   FACTORY METHODS
+ ***/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+lcg::Entity* IzhikevichPopulationFactory(string_dict& args);
+lcg::Entity* LIFPopulationFactory(string_dict& args);
+lcg::Entity* PopulationNeuronFactory(string_dict& args);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
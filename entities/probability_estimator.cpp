@@ -22,7 +22,12 @@ lcg::Entity* ProbabilityEstimatorFactory(string_dict& args)
 namespace lcg {
 
 ProbabilityEstimator::ProbabilityEstimator(double tau, double stimulationFrequency, double window, double initialProbability, uint id)
-        : Entity(id)
+        : Entity(id),
+          m_tau(bindParameter("tau")),
+          m_p0(bindParameter("p0")),
+          m_window(bindParameter("window")),
+          m_frequency(bindParameter("frequency")),
+          m_period(bindParameter("period"))
 {
         if (tau <= 0)
                 throw "Tau must be positive";
@@ -35,6 +40,8 @@ ProbabilityEstimator::ProbabilityEstimator(double tau, double stimulationFrequen
         PE_F = stimulationFrequency;
         PE_T = 1./stimulationFrequency;
         PE_WNDW = window;
+        registerEventType(SPIKE);
+        registerEventType(TRIGGER);
         setName("ProbabilityEstimator");
         setUnits("1");
 }
@@ -94,7 +101,7 @@ void ProbabilityEstimator::handleEvent(const Event *event)
 
 void ProbabilityEstimator::emitTrigger() const
 {
-        emitEvent(new TriggerEvent(this));
+        emitEvent(TriggerEvent(this));
 }
 
 } // namespace lcg
@@ -26,11 +26,11 @@
 #include "entity.h"
 #include "utils.h"
 
-#define PE_TAU  m_parameters["tau"]
-#define PE_P0   m_parameters["p0"]
-#define PE_WNDW m_parameters["window"]
-#define PE_F    m_parameters["frequency"]
-#define PE_T    m_parameters["period"]
+#define PE_TAU  m_tau
+#define PE_P0   m_p0
+#define PE_WNDW m_window
+#define PE_F    m_frequency
+#define PE_T    m_period
 
 namespace lcg {
 
@@ -50,6 +50,9 @@ private:
         double m_delay;
         double m_probability;
         bool m_flag;
+
+        // the parameters, bound to the values in m_parameters
+        double &m_tau, &m_p0, &m_window, &m_frequency, &m_period;
 };
 
 } // namespace lcg
@@ -31,17 +31,64 @@ void current_utc_time(struct timespec *ts) {
 }
 /* END */
 
+/*
+ * Reads the optional parameters compression and compressionLevel, which
+ * take precedence over the parameter compress.
+ */
+static lcg::Entity* SetCompressionFromDictionary(string_dict& args, lcg::recorders::BaseH5Recorder *rec)
+{
+        std::string name;
+        lcg::compression_filter filter;
+        int level;
+        if (!lcg::CheckAndExtractInteger(args, "compressionLevel", &level))
+                level = -1;
+        if (lcg::CheckAndExtractValue(args, "compression", name)) {
+                if (!lcg::ParseCompressionFilter(name, &filter)) {
+                        lcg::Logger(lcg::Critical, "Unknown compression filter [%s].\n", name.c_str());
+                        delete rec;
+                        return NULL;
+                }
+                rec->setCompression(filter, level);
+        }
+        else if (level >= 0) {
+                rec->setCompression(rec->compressionFilter(), level);
+        }
+        return rec;
+}
+
 lcg::Entity* H5RecorderFactory(string_dict& args)
 {       
         uint id;
         std::string filename;
+        std::string access;
         bool compress;
+        uint buffers, chunkSize;
+        double flushInterval;
+        lcg::access_pattern pattern = lcg::ACCESS_FULL_TRACE;
+        lcg::recorders::H5Recorder *rec;
         id = lcg::GetIdFromDictionary(args);
         if (!lcg::CheckAndExtractBool(args, "compress", &compress))
                 compress = true;
+        if (!lcg::CheckAndExtractUnsignedInteger(args, "buffers", &buffers))
+                buffers = lcg::recorders::H5Recorder::defaultNumberOfBuffers;
+        if (!lcg::CheckAndExtractDouble(args, "flushInterval", &flushInterval))
+                flushInterval = lcg::recorders::H5Recorder::defaultFlushInterval;
+        if (!lcg::CheckAndExtractUnsignedInteger(args, "chunkSize", &chunkSize))
+                chunkSize = 0;
+        if (lcg::CheckAndExtractValue(args, "access", access) && !lcg::ParseAccessPattern(access, &pattern)) {
+                lcg::Logger(lcg::Critical, "Unknown access pattern [%s]: it should be either trace or window.\n", access.c_str());
+                return NULL;
+        }
+        if (flushInterval <= 0) {
+                lcg::Logger(lcg::Critical, "The flush interval of an H5Recorder must be positive.\n");
+                return NULL;
+        }
         if (!lcg::CheckAndExtractValue(args, "filename", filename))
-                return new lcg::recorders::H5Recorder(compress, NULL, id);
-        return new lcg::recorders::H5Recorder(compress, filename.c_str(), id);
+                rec = new lcg::recorders::H5Recorder(compress, NULL, id, buffers);
+        else
+                rec = new lcg::recorders::H5Recorder(compress, filename.c_str(), id, buffers);
+        rec->setChunking(flushInterval, pattern, chunkSize);
+        return SetCompressionFromDictionary(args, rec);
 }
 
 lcg::Entity* TriggeredH5RecorderFactory(string_dict& args)
@@ -59,8 +106,8 @@ lcg::Entity* TriggeredH5RecorderFactory(string_dict& args)
         if (!lcg::CheckAndExtractBool(args, "compress", &compress))
                 compress = true;
         if (!lcg::CheckAndExtractValue(args, "filename", filename))
-                return new lcg::recorders::TriggeredH5Recorder(before, after, compress, NULL, id);
-        return new lcg::recorders::TriggeredH5Recorder(before, after, compress, filename.c_str(), id);
+                return SetCompressionFromDictionary(args, new lcg::recorders::TriggeredH5Recorder(before, after, compress, NULL, id));
+        return SetCompressionFromDictionary(args, new lcg::recorders::TriggeredH5Recorder(before, after, compress, filename.c_str(), id));
 }
 
 namespace lcg {
@@ -259,94 +306,90 @@ bool BaseH5Recorder::allocateEventsDatasets(int dataRank,
 
 //~~~
 
-const uint H5Recorder::numberOfBuffers = 2;
-const int  H5Recorder::rank            = 1;
-
-H5Recorder::H5Recorder(bool compress, const char *filename, uint id)
-        : BaseH5Recorder(compress, 1024, 20, filename, id), // 1024 = chunkSize and 20 = numberOfChunks
-          m_data(), m_threadRun(false), m_runCount(0)
+const uint    H5Recorder::defaultNumberOfBuffers = 4;
+const double  H5Recorder::defaultFlushInterval   = 1.0;
+const hsize_t H5Recorder::eventsBufferSize       = 20480;
+const hsize_t H5Recorder::eventsChunkSize        = 1024;
+const int     H5Recorder::rank                   = 1;
+
+H5Recorder::H5Recorder(bool compress, const char *filename, uint id, uint numberOfBuffers)
+        : BaseH5Recorder(compress, 1024, 20, filename, id), // 1024 = chunkSize and 20 = numberOfChunks, until finaliseInit
+          m_numberOfBuffers(numberOfBuffers < 2 ? 2 : numberOfBuffers),
+          m_flushInterval(H5Recorder::defaultFlushInterval), m_accessPattern(ACCESS_FULL_TRACE),
+          m_requestedChunkSize(0), m_allocatedBufferSize(0), m_data(),
+          m_buffersFilled(0), m_buffersSaved(0), m_eventsBuffersFilled(0), m_eventsBuffersSaved(0),
+          m_droppedSamples(0), m_droppedEvents(0), m_threadRun(false)
 {
-        m_bufferLengths = new hsize_t[H5Recorder::numberOfBuffers];
-        m_eventsBufferLengths = new hsize_t[H5Recorder::numberOfBuffers];
+        if (numberOfBuffers < 2)
+                Logger(Important, "H5Recorder needs at least 2 buffers: using 2 instead of %d.\n", numberOfBuffers);
+        m_bufferLengths = new hsize_t[m_numberOfBuffers];
+        m_bufferOffsets = new hsize_t[m_numberOfBuffers];
+        m_eventsBufferLengths = new hsize_t[m_numberOfBuffers];
+        for (int i=0; i<NUMBER_OF_EVENTS_DATASETS; i++) {
+                m_eventsData[i] = new int32_t*[m_numberOfBuffers];
+                for (uint j=0; j<m_numberOfBuffers; j++)
+                        m_eventsData[i][j] = new int32_t[H5Recorder::eventsBufferSize];
+        }
+        registerAllEventTypes();
         setName("H5Recorder");
 }
 
 H5Recorder::~H5Recorder()
 {
+        stopWriterThread();
 	closeFile();
-        for (int i=0; i<m_data.size(); i++) {
-                for(int j=0; j<H5Recorder::numberOfBuffers; j++)
-                        delete m_data[i][j];
-                delete m_data[i];
-        }
-        delete m_bufferLengths;
+        freeBuffers();
+        delete [] m_bufferLengths;
+        delete [] m_bufferOffsets;
 	// Delete events data buffers
         for (int i=0; i<NUMBER_OF_EVENTS_DATASETS; i++) {
-                for(int j=0; j<H5Recorder::numberOfBuffers; j++) 
-                        delete m_eventsData[i][j];
-                delete m_eventsData[i];
+                for(uint j=0; j<m_numberOfBuffers; j++) 
+                        delete [] m_eventsData[i][j];
+                delete [] m_eventsData[i];
         }
-        delete m_eventsBufferLengths;
+        delete [] m_eventsBufferLengths;
+}
+
+void H5Recorder::setChunking(double flushInterval, access_pattern pattern, hsize_t chunkSize)
+{
+        m_flushInterval = flushInterval;
+        m_accessPattern = pattern;
+        m_requestedChunkSize = chunkSize;
 }
 
 bool H5Recorder::finaliseInit()
 {
         Logger(Debug, "H5Recorder::finaliseInit()\n");
-        int err;
-        hsize_t bufsz = bufferSize(), maxbufsz = H5S_UNLIMITED, chunksz = chunkSize(), evbufsz = 1;
 
         stopWriterThread();
-        if (m_runCount) {
-                err = pthread_mutex_destroy(&m_mutex);
-                if (err)
-                        Logger(Critical, "pthread_mutex_destroy: %s.\n", strerror(err));
-                else
-                        Logger(Debug, "Successfully destroyed the mutex.\n");
-                err = pthread_cond_destroy(&m_cv);
-                if (err)
-                        Logger(Critical, "pthread_cond_destroy: %s.\n", strerror(err));
-                else
-                        Logger(Debug, "Successfully destroyed the condition variable.\n");
-        }
 
-        m_bufferInUse = H5Recorder::numberOfBuffers-1;
+        hsize_t chunksz = m_requestedChunkSize;
+        uint nchunks;
+        ComputeChunking(1.0/GetGlobalDt(), m_data.size(), m_numberOfBuffers, m_flushInterval,
+                        m_accessPattern, &chunksz, &nchunks);
+        setBufferLayout(chunksz, nchunks);
+        allocateBuffers();
+        Logger(Debug, "H5Recorder::finaliseInit() >> %d chunks of %llu samples in each buffer.\n", nchunks, (ullong) chunksz);
+
+        hsize_t bufsz = bufferSize(), maxbufsz = H5S_UNLIMITED, evbufsz = 1, evchunksz = H5Recorder::eventsChunkSize;
+
         m_bufferPosition = 0;
+        m_samplesCount = 0;
         m_datasetSize = 0;
+        m_buffersFilled = m_buffersSaved = 0;
+        m_droppedSamples = 0;
         for (int i=0; i<m_pre.size(); i++) {
 		if (!allocateForEntity(m_pre[i], H5Recorder::rank, &bufsz, &maxbufsz, &chunksz))
 		        return false;
         }
 
 	// Initialize events datasets (Code,Origin,Timestamps)	
-        m_eventsBufferInUse = H5Recorder::numberOfBuffers-1;
         m_eventsBufferPosition = 0;
         m_eventsDatasetSize = 0;
-        if (!allocateEventsDatasets(H5Recorder::rank, &evbufsz, &maxbufsz, &chunksz))
+        m_eventsBuffersFilled = m_eventsBuffersSaved = 0;
+        m_droppedEvents = 0;
+        if (!allocateEventsDatasets(H5Recorder::rank, &evbufsz, &maxbufsz, &evchunksz))
         	return false;
-	for (int i=0; i<NUMBER_OF_EVENTS_DATASETS; i++) {
-        	m_eventsData[i] = new int32_t*[H5Recorder::numberOfBuffers];
-        	for (int j=0; j<H5Recorder::numberOfBuffers; j++)
-                	m_eventsData[i][j] = new int32_t[bufferSize()];
-        }
-
-	err = pthread_mutex_init(&m_mutex, NULL);
-        if (err) {
-                Logger(Critical, "pthread_mutex_init: %s.", strerror(err));
-                return false;
-        }
-        else {
-                Logger(Debug, "Successfully initialized the mutex.\n");
-        }
-
-        err = pthread_cond_init(&m_cv, NULL);
-        if (err) {
-                Logger(Critical, "pthread_cond_init: %s.", strerror(err));
-                return false;
-        }
-        else {
-                Logger(Debug, "Successfully initialized the condition variable.\n");
-        }
-
 
         startWriterThread();
         
@@ -364,10 +407,13 @@ void H5Recorder::startWriterThread()
         pthread_attr_init(&attr);
         pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
         err = pthread_create(&m_writerThread, &attr, buffersWriter, this); 
-        if (err)
+        if (err) {
                 Logger(Critical, "pthread_create: %s.\n", strerror(err));
-        else
+                m_threadRun = false;
+        }
+        else {
                 Logger(Debug, "Successfully created the writer thread.\n");
+        }
         pthread_attr_destroy(&attr);
 }
 
@@ -378,34 +424,45 @@ void H5Recorder::stopWriterThread()
                 return;
 
         Logger(Debug, "H5Recorder::stopWriterThread() >> Terminating writer thread.\n");
-        pthread_mutex_lock(&m_mutex);
-        Logger(Debug, "H5Recorder::stopWriterThread() >> Locked the mutex.\n");
-        Logger(Debug, "H5Recorder::stopWriterThread() >> buffer position = %d.\n", m_bufferPosition);
-        if (m_bufferPosition > 0)
-                m_dataQueue.push_back(m_bufferInUse);
-        Logger(Debug, "H5Recorder::stopWriterThread() >> events buffer position = %d.\n", m_eventsBufferPosition);
-        if (m_eventsBufferPosition > 0)
-                m_eventsDataQueue.push_back(m_eventsBufferInUse);
-        Logger(Debug, "H5Recorder::stopWriterThread() >> %d values left to save in buffer #%d.\n",
-                m_bufferLengths[m_bufferInUse], m_bufferInUse);
-        Logger(Debug, "H5Recorder::stopWriterThread() >> %d events left to save in buffer #%d.\n",
-                m_eventsBufferLengths[m_eventsBufferInUse], m_eventsBufferInUse);
-			
+        // hand the partially filled buffers to the writer thread
+        if (m_bufferPosition > 0) {
+                Logger(Debug, "H5Recorder::stopWriterThread() >> %d values left to save in buffer #%d.\n",
+                        m_bufferPosition, (int) (m_buffersFilled % m_numberOfBuffers));
+                __sync_synchronize();
+                m_buffersFilled++;
+                m_bufferPosition = 0;
+        }
+        if (m_eventsBufferPosition > 0) {
+                Logger(Debug, "H5Recorder::stopWriterThread() >> %d events left to save in buffer #%d.\n",
+                        m_eventsBufferPosition, (int) (m_eventsBuffersFilled % m_numberOfBuffers));
+                __sync_synchronize();
+                m_eventsBuffersFilled++;
+                m_eventsBufferPosition = 0;
+        }
+        __sync_synchronize();
         m_threadRun = false;
-        Logger(Debug, "H5Recorder::stopWriterThread() >> before pthread_cond_broadcast.\n");
-        pthread_cond_broadcast(&m_cv);
-        Logger(Debug, "H5Recorder::stopWriterThread() >> after pthread_cond_broadcast.\n");
-        pthread_mutex_unlock(&m_mutex);
-        Logger(Debug, "H5Recorder::stopWriterThread() >> Unlocked the mutex.\n");
         pthread_join(m_writerThread, NULL);
         Logger(Debug, "H5Recorder::stopWriterThread() >> Writer thread has terminated.\n");
+
+        // if the last samples were dropped, extend the datasets so that they span the whole trial
+        if (m_samplesCount > m_datasetSize) {
+                m_datasetSize = m_samplesCount;
+                for (size_t i=0; i<m_data.size(); i++) {
+                        if (H5Dset_extent(m_datasets[i], &m_datasetSize) < 0)
+                                Logger(Critical, "Unable to extend dataset.\n");
+                }
+        }
 }
 
 void H5Recorder::terminate()
 {
         stopWriterThread();
+        writeScalarAttribute(m_infoGroup, "droppedSamples", (long) m_droppedSamples);
+        writeScalarAttribute(m_infoGroup, "droppedEvents", (long) m_droppedEvents);
+        if (m_droppedSamples > 0 || m_droppedEvents > 0)
+                Logger(Critical, "H5Recorder #%d dropped %lld samples and %lld events because "
+                                 "the writer thread could not keep up.\n", id(), m_droppedSamples, m_droppedEvents);
         BaseH5Recorder::terminate();
-        m_runCount++;
 }
 
 void H5Recorder::firstStep()
@@ -422,72 +479,206 @@ void H5Recorder::step()
         if (m_numberOfInputs == 0)
                 return;
 
+        uint buffer = m_buffersFilled % m_numberOfBuffers;
         if (m_bufferPosition == 0) {
-                pthread_mutex_lock(&m_mutex);
-                while (m_dataQueue.size() == H5Recorder::numberOfBuffers) {
-                        //Logger(Debug, "H5Recorder::step() >> The data queue is full.\n");
-                        pthread_cond_wait(&m_cv, &m_mutex);
+                if (!acquireBuffer(m_buffersFilled, m_buffersSaved)) {
+                        // all the buffers are waiting to be saved: this sample is lost
+                        m_droppedSamples++;
+                        m_samplesCount++;
+                        return;
                 }
-                pthread_mutex_unlock(&m_mutex);
-                m_bufferInUse = (m_bufferInUse+1) % H5Recorder::numberOfBuffers;
-                m_bufferLengths[m_bufferInUse] = 0;
-                Logger(Debug, "H5Recorder::step() >> Starting to write in buffer #%d @ t = %g.\n", m_bufferInUse, GetGlobalTime());
+                m_bufferOffsets[buffer] = m_samplesCount;
+                m_bufferLengths[buffer] = 0;
+                Logger(Debug, "H5Recorder::step() >> Starting to write in buffer #%d @ t = %g.\n", buffer, GetGlobalTime());
         }
         for (int i=0, j=0; i<m_numberOfInputs; i++) {
 		if (m_pre[i]->hasOutput()) {
-               		m_data[j][m_bufferInUse][m_bufferPosition] = m_inputs[i];
+               		m_data[j][buffer][m_bufferPosition] = m_inputs[i];
 			j++;
 		}
 	}
-        m_bufferLengths[m_bufferInUse]++;
+        m_bufferLengths[buffer]++;
+        m_samplesCount++;
         m_bufferPosition = (m_bufferPosition+1) % bufferSize();
 
         if (m_bufferPosition == 0) {
-                Logger(Debug, "H5Recorder::step() >> Buffer #%d is full (it contains %d elements).\n",
-                                m_bufferInUse, m_bufferLengths[m_bufferInUse]);
-                Logger(Debug, "H5Recorder::step() >> Trying to acquire the mutex on the data queue.\n");
-                pthread_mutex_lock(&m_mutex);
-                Logger(Debug, "H5Recorder::step() >> Acquired the mutex on the data queue.\n");
-                m_dataQueue.push_back(m_bufferInUse);
-                Logger(Debug, "H5Recorder::step() >> Pushed buffer number in the data queue.\n");
-                pthread_cond_broadcast(&m_cv);
-                Logger(Debug, "H5Recorder::step() >> Signalled the condition variable.\n");
-                pthread_mutex_unlock(&m_mutex);
-                Logger(Debug, "H5Recorder::step() >> Unlocked the mutex.\n");
+                Logger(Debug, "H5Recorder::step() >> Buffer #%d is full (it contains %llu elements).\n",
+                                buffer, (ullong) m_bufferLengths[buffer]);
+                // make sure the data is visible to the writer thread before publishing the buffer
+                __sync_synchronize();
+                m_buffersFilled++;
         }
 }
 
 void H5Recorder::handleEvent(const Event *event) {
 
+        uint buffer = m_eventsBuffersFilled % m_numberOfBuffers;
         if (m_eventsBufferPosition == 0) {
-                pthread_mutex_lock(&m_mutex);
-                while (m_eventsDataQueue.size() == H5Recorder::numberOfBuffers) {
-                        Logger(Critical, "H5Recorder::handleEvent() >> The events data queue is full.\n");
-                        pthread_cond_wait(&m_cv, &m_mutex);
+                if (!acquireBuffer(m_eventsBuffersFilled, m_eventsBuffersSaved)) {
+                        m_droppedEvents++;
+                        return;
                 }
-                pthread_mutex_unlock(&m_mutex);
-                m_eventsBufferInUse = (m_eventsBufferInUse+1) % H5Recorder::numberOfBuffers;
-                m_eventsBufferLengths[m_eventsBufferInUse] = 0;
+                m_eventsBufferLengths[buffer] = 0;
         }
-        m_eventsData[0][m_eventsBufferInUse][m_eventsBufferPosition] = (int32_t) event->type();
-        m_eventsData[1][m_eventsBufferInUse][m_eventsBufferPosition] = (int32_t) event->sender()->id();
-        m_eventsData[2][m_eventsBufferInUse][m_eventsBufferPosition] = (int32_t) (event->time()/GetGlobalDt());
+        m_eventsData[0][buffer][m_eventsBufferPosition] = (int32_t) event->type();
+        m_eventsData[1][buffer][m_eventsBufferPosition] = (int32_t) event->sender()->id();
+        m_eventsData[2][buffer][m_eventsBufferPosition] = (int32_t) (event->time()/GetGlobalDt());
 	
-        m_eventsBufferLengths[m_eventsBufferInUse]++;
-        m_eventsBufferPosition = (m_eventsBufferPosition+1) % bufferSize();
+        m_eventsBufferLengths[buffer]++;
+        m_eventsBufferPosition = (m_eventsBufferPosition+1) % H5Recorder::eventsBufferSize;
 	if (m_eventsBufferPosition == 0) {
-                Logger(Debug, "H5Recorder::handleEvents() >> Buffer #%d is full (it contains %d elements).\n",
-                                m_eventsBufferInUse, m_eventsBufferLengths[m_eventsBufferInUse]);
-                Logger(Debug, "H5Recorder::handleEvents() >> Trying to acquire the mutex on the data queue.\n");
-                pthread_mutex_lock(&m_mutex);
-                Logger(Debug, "H5Recorder::handleEvents() >> Acquired the mutex on the data queue.\n");
-                m_eventsDataQueue.push_back(m_eventsBufferInUse);
-                Logger(Debug, "H5Recorder::handleEvents() >> Pushed buffer number in the data queue.\n");
-                pthread_cond_broadcast(&m_cv);
-                Logger(Debug, "H5Recorder::handleEvents() >> Signalled the condition variable.\n");
-                pthread_mutex_unlock(&m_mutex);
-                Logger(Debug, "H5Recorder::handleEvents() >> Unlocked the mutex.\n");
+                Logger(Debug, "H5Recorder::handleEvents() >> Buffer #%d is full (it contains %llu elements).\n",
+                                buffer, (ullong) m_eventsBufferLengths[buffer]);
+                __sync_synchronize();
+                m_eventsBuffersFilled++;
+        }
+}
+
+bool H5Recorder::acquireBuffer(volatile const ullong& filled, volatile const ullong& saved) const
+{
+        if (filled - saved < m_numberOfBuffers)
+                return true;
+#ifdef REALTIME_ENGINE
+        // waiting for the writer thread would make the real-time loop miss its deadlines
+        return false;
+#else
+        // a non real-time simulation has no deadlines: wait until a buffer has been saved
+        struct timespec pause;
+        pause.tv_sec = 0;
+        pause.tv_nsec = 100000;
+        while (filled - saved == m_numberOfBuffers)
+                nanosleep(&pause, NULL);
+        return true;
+#endif
+}
+
+void H5Recorder::saveBuffer(uint buffer)
+{
+        hid_t filespace, memspace;
+        herr_t status;
+        hsize_t offset = m_bufferOffsets[buffer];
+
+        if (m_bufferLengths[buffer] == 0)
+                return;
+
+        // the offset may be past the end of the datasets if some samples were dropped:
+        // the gap is left to the fill value
+        if (offset + m_bufferLengths[buffer] > m_datasetSize)
+                m_datasetSize = offset + m_bufferLengths[buffer];
+
+        Logger(Debug, "Dataset size = %llu.\n", (ullong) m_datasetSize);
+        Logger(Debug, "Offset = %llu.\n", (ullong) offset);
+        Logger(Debug, "Time = %g sec.\n", m_datasetSize*GetGlobalDt());
+
+        for (size_t i=0; i<m_data.size(); i++) {
+
+                // extend the dataset
+                status = H5Dset_extent(m_datasets[i], &m_datasetSize);
+                if (status < 0)
+                        throw "Unable to extend dataset.";
+                else
+                        Logger(All, "Extended dataset.\n");
+
+                // get the filespace
+                filespace = H5Dget_space(m_datasets[i]);
+                if (filespace < 0)
+                        throw "Unable to get filespace.";
+                else
+                        Logger(All, "Obtained filespace.\n");
+
+                // select an hyperslab
+                status = H5Sselect_hyperslab(filespace, H5S_SELECT_SET, &offset, NULL, &m_bufferLengths[buffer], NULL);
+                if (status < 0) {
+                        H5Sclose(filespace);
+                        throw "Unable to select hyperslab.";
+                }
+                else {
+                        Logger(All, "Selected hyperslab.\n");
+                }
+
+                // define memory space
+                memspace = H5Screate_simple(H5Recorder::rank, &m_bufferLengths[buffer], NULL);
+                if (memspace < 0) {
+                        H5Sclose(filespace);
+                        throw "Unable to define memory space.";
+                }
+                else {
+                        Logger(All, "Memory space defined.\n");
+                }
+
+                // write data
+                status = H5Dwrite(m_datasets[i], H5T_IEEE_F64LE, memspace, filespace, H5P_DEFAULT, m_data[i][buffer]);
+                H5Sclose(memspace);
+                H5Sclose(filespace);
+                if (status < 0)
+                        throw "Unable to write data.";
+                else
+                        Logger(All, "Written data.\n");
+        }
+        Logger(Debug, "H5Recorder::saveBuffer() >> Finished writing data.\n");
+}
+
+void H5Recorder::saveEventsBuffer(uint buffer)
+{
+        hid_t filespace, memspace;
+        herr_t status;
+        hsize_t offset = m_eventsDatasetSize;
+
+        if (m_eventsBufferLengths[buffer] == 0)
+                return;
+
+        m_eventsDatasetSize += m_eventsBufferLengths[buffer];
+
+        Logger(Debug, "Events dataset size = %llu.\n", (ullong) m_eventsDatasetSize);
+        Logger(Debug, "Events offset = %llu.\n", (ullong) offset);
+
+        for (size_t i=m_data.size(); i<m_datasets.size(); i++) {
+                // extend the dataset
+                status = H5Dset_extent(m_datasets[i], &m_eventsDatasetSize);
+                if (status < 0)
+                        throw "Unable to extend dataset.";
+                else
+                        Logger(All, "Extended dataset [%d].\n", (int) i);
+
+                // get the filespace
+                filespace = H5Dget_space(m_datasets[i]);
+                if (filespace < 0)
+                        throw "Unable to get filespace.";
+                else
+                        Logger(All, "Obtained filespace.\n");
+
+                // select an hyperslab
+                status = H5Sselect_hyperslab(filespace, H5S_SELECT_SET, &offset, NULL, &m_eventsBufferLengths[buffer], NULL);
+                if (status < 0) {
+                        H5Sclose(filespace);
+                        throw "Unable to select hyperslab.";
+                }
+                else {
+                        Logger(All, "Selected hyperslab [%d].\n", (int) i);
+                }
+
+                // define memory space
+                memspace = H5Screate_simple(H5Recorder::rank, &m_eventsBufferLengths[buffer], NULL);
+                if (memspace < 0) {
+                        H5Sclose(filespace);
+                        throw "Unable to define memory space.";
+                }
+                else {
+                        Logger(All, "Memory space defined [%d].\n", (int) (i-m_data.size()));
+                }
+
+                // write data
+                status = H5Dwrite(m_datasets[i], H5T_STD_I32LE, memspace, filespace, H5P_DEFAULT,
+                                  m_eventsData[i-m_data.size()][buffer]);
+                H5Sclose(memspace);
+                H5Sclose(filespace);
+                if (status < 0)
+                        throw "Unable to write data.";
+                else
+                        Logger(All, "Written data.\n");
         }
+        setHasEvents(true);
+        Logger(Debug, "H5Recorder::saveEventsBuffer() >> Finished writing data.\n");
 }
 
 void* H5Recorder::buffersWriter(void *arg)
@@ -503,176 +694,35 @@ void* H5Recorder::buffersWriter(void *arg)
         //reducePriority();
 #endif
 
-        uint bufferToSave;
-        while (self->m_threadRun || self->m_dataQueue.size() != 0 || self->m_eventsDataQueue.size() != 0) {
-
-                pthread_mutex_lock(&self->m_mutex);
-                while (self->m_dataQueue.size() == 0 && self->m_eventsDataQueue.size() == 0) {
-                        Logger(Debug, "H5Recorder::buffersWriter() >> The data queues are empty.\n");
-                        pthread_cond_wait(&self->m_cv, &self->m_mutex);
+        struct timespec pause;
+        pause.tv_sec = 0;
+        pause.tv_nsec = 1000000;
+        while (true) {
+                // read the flag before the counters, so that no buffer published
+                // before the flag was cleared can be missed
+                bool run = self->m_threadRun;
+                bool idle = true;
+                __sync_synchronize();
+
+                if (self->m_buffersSaved != self->m_buffersFilled) {
+                        self->saveBuffer(self->m_buffersSaved % self->m_numberOfBuffers);
+                        __sync_synchronize();
+                        self->m_buffersSaved++;
+                        idle = false;
                 }
 
-                Logger(Debug, "H5Recorder::buffersWriter() >> m_threadRun = %s.\n", self->m_threadRun ? "true" : "false");
-
-                if (self->m_dataQueue.size()) {
-                        // there is data to save
-                        bufferToSave = self->m_dataQueue.front();
-                        pthread_mutex_unlock(&self->m_mutex);
-                        Logger(Debug, "H5Recorder::buffersWriter() >> Acquired lock: will save data in buffer #%d.\n", bufferToSave);
-
-                        hid_t filespace;
-                        herr_t status;
-                        hsize_t offset;
-
-                        if (self->m_bufferLengths[bufferToSave] > 0) {
-                                offset = self->m_datasetSize;
-                                self->m_datasetSize += self->m_bufferLengths[bufferToSave];
-
-                                Logger(Debug, "Dataset size = %d.\n", self->m_datasetSize);
-                                Logger(Debug, "Offset = %d.\n", offset);
-                                Logger(Debug, "Time = %g sec.\n", self->m_datasetSize*GetGlobalDt());
-
-                                for (int i=0; i<self->m_data.size(); i++) {
-
-                                        // extend the dataset
-                                        status = H5Dset_extent(self->m_datasets[i], &self->m_datasetSize);
-                                        if (status < 0)
-                                                throw "Unable to extend dataset.";
-                                        else
-                                                Logger(All, "Extended dataset.\n");
-
-                                        // get the filespace
-                                        filespace = H5Dget_space(self->m_datasets[i]);
-                                        if (filespace < 0)
-                                                throw "Unable to get filespace.";
-                                        else
-                                                Logger(All, "Obtained filespace.\n");
-
-                                        // select an hyperslab
-                                        status = H5Sselect_hyperslab(filespace, H5S_SELECT_SET, &offset, NULL,
-                                                        &self->m_bufferLengths[bufferToSave], NULL);
-                                        if (status < 0) {
-                                                H5Sclose(filespace);
-                                                throw "Unable to select hyperslab.";
-                                        }
-                                        else {
-                                                Logger(All, "Selected hyperslab.\n");
-                                        }
-
-                                        // define memory space
-                                        self->m_dataspaces[i] = H5Screate_simple(H5Recorder::rank,
-                                                        &self->m_bufferLengths[bufferToSave], NULL);
-                                        if (self->m_dataspaces[i] < 0) {
-                                                H5Sclose(filespace);
-                                                throw "Unable to define memory space.";
-                                        }
-                                        else {
-                                                Logger(All, "Memory space defined.\n");
-                                        }
-
-                                        // write data
-                                        status = H5Dwrite(self->m_datasets[i], H5T_IEEE_F64LE, self->m_dataspaces[i],
-                                                        filespace, H5P_DEFAULT, self->m_data[i][bufferToSave]);
-                                        if (status < 0) {
-                                                H5Sclose(filespace);
-                                                throw "Unable to write data.";
-                                        }
-                                        else {
-                                                Logger(All, "Written data.\n");
-                                        }
-                                }
-                                H5Sclose(filespace);
-                                Logger(Debug, "H5Recorder::buffersWriter() >> Finished writing data.\n");
-                        }
+                if (self->m_eventsBuffersSaved != self->m_eventsBuffersFilled) {
+                        self->saveEventsBuffer(self->m_eventsBuffersSaved % self->m_numberOfBuffers);
+                        __sync_synchronize();
+                        self->m_eventsBuffersSaved++;
+                        idle = false;
                 }
 
-                if (self->m_eventsDataQueue.size()) {
-                
-                	bufferToSave = self->m_eventsDataQueue.front();
-                	pthread_mutex_unlock(&self->m_mutex);
-                	Logger(Debug, "H5Recorder::buffersWriter() >> Acquired lock: will save data in buffer #%d.\n", bufferToSave);
-
-                	hid_t filespace;
-                	herr_t status;
-                	hsize_t offset;
-
-                	if (self->m_eventsBufferLengths[bufferToSave] > 0) {
-
-                        	offset = self->m_eventsDatasetSize;
-                        	self->m_eventsDatasetSize += self->m_eventsBufferLengths[bufferToSave];
-
-                        	Logger(Debug, "Events dataset size = %d.\n", self->m_eventsDatasetSize);
-                        	Logger(Debug, "Events offset = %d.\n", offset);
-
-                                for (int i=self->m_data.size(); i<self->m_datasets.size(); i++) {
-                                        // extend the dataset
-                                        status = H5Dset_extent(self->m_datasets[i], &self->m_eventsDatasetSize);
-                                        if (status < 0)
-                                                throw "Unable to extend dataset.";
-                                        else
-                                                Logger(All, "Extended dataset [%d].\n",i);
-
-                                        // get the filespace
-                                        filespace = H5Dget_space(self->m_datasets[i]);
-                                        if (filespace < 0)
-                                                throw "Unable to get filespace.";
-                                        else
-                                                Logger(All, "Obtained filespace.\n");
-
-                                        // select an hyperslab
-                                        status = H5Sselect_hyperslab(filespace, H5S_SELECT_SET, &offset, NULL,
-                                                        &self->m_eventsBufferLengths[bufferToSave], NULL);
-                                        if (status < 0) {
-                                                H5Sclose(filespace);
-                                                throw "Unable to select hyperslab.";
-                                        }
-                                        else {
-                                                Logger(All, "Selected hyperslab [%d].\n",i);
-                                        }
-
-                                        // define memory space
-                                        self->m_dataspaces[i] = H5Screate_simple(H5Recorder::rank,
-                                                        &self->m_eventsBufferLengths[bufferToSave], NULL);
-                                        if (self->m_dataspaces[i] < 0) {
-                                                H5Sclose(filespace);
-                                                throw "Unable to define memory space.";
-                                        }
-                                        else {
-                                                Logger(All, "Memory space defined [%d].\n",i-self->m_data.size());
-                                        }
-
-                                        // write data
-                                        status = H5Dwrite(self->m_datasets[i], 
-			        		H5T_STD_I32LE, self->m_dataspaces[i], filespace, H5P_DEFAULT, 
-			        		self->m_eventsData[i-self->m_data.size()][bufferToSave]);
-                                        if (status < 0) {
-                                                H5Sclose(filespace);
-                                                throw "Unable to write data.";
-                                        }
-                                        else {
-                                                Logger(All, "Written data.\n");
-			        		self->setHasEvents(true);
-                                        }
-                                }
-                                H5Sclose(filespace);
-                                Logger(Debug, "H5Recorder::buffersWriter() >> Finished writing data.\n");
-                	}
-		}
-
-                pthread_mutex_lock(&self->m_mutex);
-                Logger(Debug, "H5Recorder::buffersWriter() >> Locked the mutex.\n");
-                if (self->m_dataQueue.size()) {
-                        self->m_dataQueue.pop_front();
-                        Logger(Debug, "H5Recorder::buffersWriter() >> Removed data from the queue.\n");
+                if (idle) {
+                        if (!run)
+                                break;
+                        nanosleep(&pause, NULL);
                 }
-                if (self->m_eventsDataQueue.size()) {
-                        self->m_eventsDataQueue.pop_front();
-                        Logger(Debug, "H5Recorder::buffersWriter() >> Removed data from the events queue.\n");
-                }
-                pthread_cond_broadcast(&self->m_cv);
-                Logger(Debug, "H5Recorder::buffersWriter() >> Signalled the condition variable.\n");
-                pthread_mutex_unlock(&self->m_mutex);
-                Logger(Debug, "H5Recorder::buffersWriter() >> Unlocked the mutex.\n");
         }
 
 endBuffersWriter:
@@ -684,12 +734,36 @@ endBuffersWriter:
 void H5Recorder::finaliseAddPre(Entity *entity)
 {
         Logger(All, "--- H5Recorder::finaliseAddPre(Entity*) ---\n");
-        if (entity->hasOutput()) {
-                double **buffer = new double*[H5Recorder::numberOfBuffers];
-                for (int i=0; i<H5Recorder::numberOfBuffers; i++)
-                        buffer[i] = new double[bufferSize()];
-                m_data.push_back(buffer);
-        }
+        // the buffers are allocated by finaliseInit, when their size is known
+        if (entity->hasOutput())
+                m_data.push_back(NULL);
+}
+
+void H5Recorder::allocateBuffers()
+{
+        if (m_allocatedBufferSize != bufferSize())
+                freeBuffers();
+        for (size_t i=0; i<m_data.size(); i++) {
+                if (m_data[i] != NULL)
+                        continue;
+                m_data[i] = new double*[m_numberOfBuffers];
+                for (uint j=0; j<m_numberOfBuffers; j++)
+                        m_data[i][j] = new double[bufferSize()];
+        }
+        m_allocatedBufferSize = bufferSize();
+}
+
+void H5Recorder::freeBuffers()
+{
+        for (size_t i=0; i<m_data.size(); i++) {
+                if (m_data[i] == NULL)
+                        continue;
+                for (uint j=0; j<m_numberOfBuffers; j++)
+                        delete [] m_data[i][j];
+                delete [] m_data[i];
+                m_data[i] = NULL;
+        }
+        m_allocatedBufferSize = 0;
 }
 
 //~~~
@@ -706,10 +780,12 @@ struct thread_data {
 };
 
 TriggeredH5Recorder::TriggeredH5Recorder(double before, double after, bool compress, const char *filename, uint id)
-        : BaseH5Recorder(compress, ceil((before+after)/GetGlobalDt()), filename, id),
+        // each trace is stored in a single chunk, since traces are always read whole
+        : BaseH5Recorder(compress, ceil((before+after)/GetGlobalDt()), 1, filename, id),
           m_recording(false), m_data(), m_bufferPosition(0), m_bufferInUse(0),
           m_maxSteps(ceil(after/GetGlobalDt())), m_nSteps(0)
 {
+        registerEventType(TRIGGER);
         setName("TriggeredH5Recorder");
         m_tempData = new double[bufferSize()];
 }
@@ -838,11 +914,11 @@ void* TriggeredH5Recorder::buffersWriter(void *arg)
         count[1] = 1;
         self->m_datasetSize[1]++;
 
-        Logger(Debug, "Dataset size = (%dx%d).\n", self->m_datasetSize[0], self->m_datasetSize[1]);
-        Logger(Debug, "Offset = (%d,%d).\n", start[0], start[1]);
+        Logger(Debug, "Dataset size = (%llux%llu).\n", (ullong) self->m_datasetSize[0], (ullong) self->m_datasetSize[1]);
+        Logger(Debug, "Offset = (%llu,%llu).\n", (ullong) start[0], (ullong) start[1]);
 
         uint offset = self->bufferSize() - bufferPosition;
-        Logger(Debug, "buffer size = %d.\n", self->bufferSize());
+        Logger(Debug, "buffer size = %llu.\n", (ullong) self->bufferSize());
         Logger(Debug, "buffer position = %d.\n", bufferPosition);
         Logger(Debug, "offset = %d\n", offset);
         for (int i=0; i<self->m_numberOfInputs; i++) {
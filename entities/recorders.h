@@ -79,21 +79,52 @@ protected:
         uint m_numberOfInputs;
 };
 
+/*!
+ * \class H5Recorder
+ * \brief Saves the inputs and the events it receives to an H5 file.
+ *
+ * The samples are stored in a ring of buffers that is shared with a writer thread:
+ * whenever a buffer is full, it is handed to the writer thread, which saves it to
+ * file while the following buffers are filled. With the real-time engine, the
+ * simulation thread never waits for the writer thread: if all the buffers are waiting
+ * to be saved, the new samples (or events) are discarded and counted. The counts are
+ * saved as the attributes droppedSamples and droppedEvents of the Info group and the
+ * discarded samples are left to the fill value in the datasets, so that the following
+ * samples keep their timing. With the non real-time engine, the simulation thread
+ * waits for a free buffer instead, and no data is lost.
+ */
 class H5Recorder : public BaseH5Recorder {
 public:
-        H5Recorder(bool compress = true, const char *filename = NULL, uint id = GetId());
+        /*!
+         * \param numberOfBuffers The number of buffers in the ring: must be at least 2,
+         * so that the real-time thread writes in one, while the writer thread saves another
+         * to file.
+         */
+        H5Recorder(bool compress = true, const char *filename = NULL, uint id = GetId(),
+                   uint numberOfBuffers = H5Recorder::defaultNumberOfBuffers);
         ~H5Recorder();
         virtual void step();
         virtual void firstStep();
         virtual void terminate();
         void handleEvent(const Event *event);
-public:
+
         /*!
-         * The number of buffers used for storing the input data: they need to be at least 2,
-         * so that the realtime thread writes in one, while the thread created by H5Recorder
-         * saves the data in the other buffer to file.
+         * Sets the layout of the buffers and of the chunks in the file, which is computed by ComputeChunking
+         * when the recorder is initialised, from the sampling rate and the number of inputs.
+         * \param flushInterval The time between consecutive writes of a buffer to file, in seconds.
+         * \param pattern How the file is going to be read.
+         * \param chunkSize The number of samples in a chunk: 0 means that it is chosen from the access pattern.
          */
-        static const uint numberOfBuffers;
+        void setChunking(double flushInterval, access_pattern pattern, hsize_t chunkSize = 0);
+
+public:
+        /*! The default number of buffers used for storing the input data. */
+        static const uint defaultNumberOfBuffers;
+        /*! The default time between consecutive writes of a buffer to file, in seconds. */
+        static const double defaultFlushInterval;
+        /*! The number of events in each buffer and in each chunk of the events datasets. */
+        static const hsize_t eventsBufferSize;
+        static const hsize_t eventsChunkSize;
         static const int  rank;
 
 protected:
@@ -104,36 +135,50 @@ private:
         void startWriterThread();
         void stopWriterThread();
         static void* buffersWriter(void *arg);
+        bool acquireBuffer(volatile const ullong& filled, volatile const ullong& saved) const;
+        void saveBuffer(uint buffer);
+        void saveEventsBuffer(uint buffer);
+        void allocateBuffers();
+        void freeBuffers();
 
 private:
+        // the number of buffers in the ring
+        const uint m_numberOfBuffers;
+        // the parameters used for computing the size of the buffers
+        double m_flushInterval;
+        access_pattern m_accessPattern;
+        hsize_t m_requestedChunkSize;
+        // the number of samples in each of the buffers in m_data
+        hsize_t m_allocatedBufferSize;
         // the data
         std::vector<double**> m_data;
         // the events data
         int32_t **m_eventsData[NUMBER_OF_EVENTS_DATASETS];
-        // the queue of the indices of the buffers to save
-        std::deque<uint> m_dataQueue;
-        // the queue of the indices of the buffers to save
-        std::deque<uint> m_eventsDataQueue;
-        
-	// position in the buffer
+
+	// position in the buffer that is being filled
         uint m_bufferPosition;
         // the length of each buffer
         hsize_t *m_bufferLengths;
-        uint m_bufferInUse;
-        // position in the events buffer
+        // the position in the datasets of the first sample of each buffer
+        hsize_t *m_bufferOffsets;
+        // the number of samples taken since the beginning of the trial, including the dropped ones
+        hsize_t m_samplesCount;
+        // position in the events buffer that is being filled
         uint m_eventsBufferPosition;
         // the length of each events buffer
         hsize_t *m_eventsBufferLengths;
-        // the index of the events buffer in which the main thread saves data
-        uint m_eventsBufferInUse;
-        
-        // the thread that continuosly waits for data to save
+
+        // the number of buffers filled by the real-time thread and saved by the writer thread:
+        // the former is modified only by the real-time thread and the latter only by the writer thread,
+        // and buffer number k is stored at index (k % m_numberOfBuffers) of the ring
+        volatile ullong m_buffersFilled, m_buffersSaved;
+        volatile ullong m_eventsBuffersFilled, m_eventsBuffersSaved;
+        // the number of samples and events that were discarded because the ring was full
+        ullong m_droppedSamples, m_droppedEvents;
+
+        // the thread that saves the buffers to file
         pthread_t m_writerThread;
-        // multithreading stuff for controlling access to the queue m_dataQueue;
-        pthread_mutex_t m_mutex;
-        pthread_cond_t m_cv;
-        bool m_threadRun;
-        uint m_runCount;
+        volatile bool m_threadRun;
 
         hsize_t m_datasetSize;
         hsize_t m_eventsDatasetSize;
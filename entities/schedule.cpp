@@ -0,0 +1,212 @@
+/*=========================================================================
+ *
+ *   Program:     lcg
+ *   Filename:    schedule.cpp
+ *
+ *   Copyright (C) 2012,2013,2014 Daniele Linaro
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *=========================================================================*/
+
+#include <map>
+#include <algorithm>
+#include <typeinfo>
+#include "schedule.h"
+
+namespace lcg {
+
+StepSchedule::StepSchedule()
+        : m_entities(), m_sources(), m_outputs(), m_slots(), m_destinations()
+{}
+
+static size_t FindRoot(std::vector<size_t>& parent, size_t i)
+{
+        while (parent[i] != i) {
+                parent[i] = parent[parent[i]];
+                i = parent[i];
+        }
+        return i;
+}
+
+/*
+ * Joins each entity with the ones whose state it accesses directly in step(): on return,
+ * the entities i and j must be stepped in their original relative order if
+ * FindRoot(parent, i) == FindRoot(parent, j).
+ */
+static void JoinCoupled(const std::vector<Entity*>& entities, std::vector<size_t>& parent)
+{
+        size_t i, j, n = entities.size();
+        std::map<Entity*,size_t> positions;
+        parent.resize(n);
+        for (i=0; i<n; i++) {
+                positions[entities[i]] = i;
+                parent[i] = i;
+        }
+        for (i=0; i<n; i++) {
+                if (!entities[i]->isCoupledToPost())
+                        continue;
+                const std::vector<Entity*>& post = entities[i]->post();
+                for (j=0; j<post.size(); j++) {
+                        std::map<Entity*,size_t>::const_iterator it = positions.find(post[j]);
+                        if (it != positions.end())
+                                parent[FindRoot(parent, i)] = FindRoot(parent, it->second);
+                }
+        }
+}
+
+void StepSchedule::build(const std::vector<Entity*>& entities)
+{
+        size_t i, j, k, placed, n = entities.size();
+        std::map<Entity*,uint> slots;
+        std::vector<const std::type_info*> types;
+        std::vector<size_t> parent, heads;
+        std::vector< std::vector<size_t> > groups;
+        std::map<size_t,size_t> roots;
+
+        m_entities.clear();
+        m_sources.clear();
+        m_slots.clear();
+        m_destinations.clear();
+
+        for (i=0; i<n; i++) {
+                const std::type_info *type = &typeid(*entities[i]);
+                for (j=0; j<types.size(); j++) {
+                        if (*types[j] == *type)
+                                break;
+                }
+                if (j == types.size())
+                        types.push_back(type);
+        }
+
+        // the entities that access each other's state in step() form a group, whose
+        // members must be stepped in the order in which they were passed
+        JoinCoupled(entities, parent);
+        for (i=0; i<n; i++) {
+                size_t root = FindRoot(parent, i);
+                if (roots.count(root) == 0) {
+                        roots[root] = groups.size();
+                        groups.push_back(std::vector<size_t>());
+                }
+                groups[roots[root]].push_back(i);
+        }
+
+        // visit the types in the order of their first appearance, taking from each group the
+        // entities of that type that come next in it, until all the entities have been placed
+        heads.assign(groups.size(), 0);
+        placed = 0;
+        while (placed < n) {
+                for (j=0; j<types.size(); j++) {
+                        for (k=0; k<groups.size(); k++) {
+                                while (heads[k] < groups[k].size() &&
+                                       typeid(*entities[groups[k][heads[k]]]) == *types[j]) {
+                                        m_entities.push_back(entities[groups[k][heads[k]]]);
+                                        heads[k]++;
+                                        placed++;
+                                }
+                        }
+                }
+        }
+
+        // one output slot for every entity that is connected to at least another one
+        for (i=0; i<n; i++) {
+                const std::vector<Entity*>& pre = m_entities[i]->m_pre;
+                for (j=0; j<pre.size(); j++) {
+                        if (slots.count(pre[j]) == 0) {
+                                slots[pre[j]] = m_sources.size();
+                                m_sources.push_back(pre[j]);
+                        }
+                        m_slots.push_back(slots[pre[j]]);
+                        m_destinations.push_back(&m_entities[i]->m_inputs[j]);
+                }
+        }
+        m_outputs.assign(m_sources.size(), 0.0);
+
+        Logger(Debug, "Built a step schedule with %d entities of %d types in %d groups, %d sources and %d connections.\n",
+                        (int) m_entities.size(), (int) types.size(), (int) groups.size(),
+                        (int) m_sources.size(), (int) m_slots.size());
+}
+
+size_t StepSchedule::size() const
+{
+        return m_entities.size();
+}
+
+Entity* StepSchedule::entity(size_t i) const
+{
+        return m_entities[i];
+}
+
+void StepSchedule::firstStep()
+{
+        size_t i, n = m_entities.size();
+        for (i=0; i<n; i++)
+                m_entities[i]->firstStep();
+}
+
+static bool CompareSize(const std::vector<size_t>& a, const std::vector<size_t>& b)
+{
+        return a.size() > b.size();
+}
+
+size_t StepSchedule::partition(size_t n, std::vector<StepSchedule>& parts) const
+{
+        size_t i, j, k, nEntities = m_entities.size();
+        std::vector<size_t> parent;
+        std::vector< std::vector<size_t> > groups;
+        std::map<size_t,size_t> roots;
+
+        JoinCoupled(m_entities, parent);
+        for (i=0; i<nEntities; i++) {
+                size_t root = FindRoot(parent, i);
+                if (roots.count(root) == 0) {
+                        roots[root] = groups.size();
+                        groups.push_back(std::vector<size_t>());
+                }
+                groups[roots[root]].push_back(i);
+        }
+
+        // assign the groups, largest first, to the least loaded schedule
+        if (n > groups.size())
+                n = groups.size();
+        if (n == 0)
+                n = 1;
+        std::stable_sort(groups.begin(), groups.end(), CompareSize);
+        std::vector< std::vector<size_t> > members(n);
+        for (i=0; i<groups.size(); i++) {
+                k = 0;
+                for (j=1; j<n; j++) {
+                        if (members[j].size() < members[k].size())
+                                k = j;
+                }
+                members[k].insert(members[k].end(), groups[i].begin(), groups[i].end());
+        }
+
+        parts.clear();
+        parts.resize(n);
+        for (k=0; k<n; k++) {
+                std::vector<Entity*> entities;
+                std::sort(members[k].begin(), members[k].end());
+                for (i=0; i<members[k].size(); i++)
+                        entities.push_back(m_entities[members[k][i]]);
+                parts[k].build(entities);
+                Logger(Debug, "Schedule #%d contains %d entities.\n", (int) k, (int) entities.size());
+        }
+        Logger(Debug, "Split %d entities in %d groups of coupled entities among %d schedules.\n",
+                        (int) nEntities, (int) groups.size(), (int) n);
+        return n;
+}
+
+} // namespace lcg
+
@@ -0,0 +1,119 @@
+/*=========================================================================
+ *
+ *   Program:     lcg
+ *   Filename:    schedule.h
+ *
+ *   Copyright (C) 2012,2013,2014 Daniele Linaro
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *=========================================================================*/
+
+/*!
+ * \file schedule.h
+ * \brief Definition of the class StepSchedule
+ */
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <vector>
+#include "entity.h"
+
+namespace lcg
+{
+
+/*!
+ * \class StepSchedule
+ * \brief A flattened execution plan for a set of connected entities.
+ *
+ * Calling Entity::readAndStoreInputs on every entity costs one virtual call to output()
+ * for every connection, which in networks with a large fan-out is much more than the
+ * number of entities. A StepSchedule is built once, after all the entities have been
+ * initialised, and stores:
+ *  - a contiguous array with one slot for the output of each entity that is the input of
+ *    some other entity: these slots are refreshed with a single call to output() per entity;
+ *  - a flat list of (slot, destination) pairs that copies the outputs into the inputs of
+ *    the connected entities;
+ *  - the entities, grouped by their concrete type as far as possible, in the order in which
+ *    they are stepped. Entities that access each other's state directly in step() (see
+ *    Entity::isCoupledToPost) keep their original relative order, since the order in which
+ *    they are stepped changes the results; the others can be reordered freely, because
+ *    they only communicate through their inputs.
+ *
+ * The connections between the entities must not change after the schedule has been built.
+ */
+class StepSchedule
+{
+public:
+        StepSchedule();
+
+        /*! Builds the execution plan for the entities passed as a parameter. */
+        void build(const std::vector<Entity*>& entities);
+
+        /*! Returns the number of entities in the schedule. */
+        size_t size() const;
+
+        /*! Returns the i-th entity in stepping order. */
+        Entity* entity(size_t i) const;
+
+        /*! Equivalent to calling Entity::readAndStoreInputs on all the entities. */
+        inline void readAndStoreInputs() {
+                size_t i, n = m_sources.size();
+                for (i=0; i<n; i++)
+                        m_outputs[i] = m_sources[i]->output();
+                n = m_slots.size();
+                for (i=0; i<n; i++)
+                        *m_destinations[i] = m_outputs[m_slots[i]];
+        }
+
+        /*! Calls Entity::step on all the entities. */
+        inline void step() {
+                size_t i, n = m_entities.size();
+                for (i=0; i<n; i++)
+                        m_entities[i]->step();
+        }
+
+        /*! Calls Entity::firstStep on all the entities. */
+        void firstStep();
+
+        /*!
+         * Splits the entities into at most n schedules that can be run in parallel, each by a
+         * different thread, provided that all threads have completed readAndStoreInputs before any
+         * of them calls step. Entities that are coupled to each other (see Entity::isCoupledToPost)
+         * are always placed in the same schedule and the relative order in which the entities are
+         * stepped is preserved, so that each schedule gives the same results as this one.
+         * \param n The maximum number of schedules.
+         * \param parts On return, contains the schedules.
+         * \return The number of schedules.
+         */
+        size_t partition(size_t n, std::vector<StepSchedule>& parts) const;
+
+private:
+        /*! The entities, in stepping order. */
+        std::vector<Entity*> m_entities;
+        /*! The entities whose output is used as an input by at least one other entity. */
+        std::vector<Entity*> m_sources;
+        /*! The outputs of the entities in m_sources. */
+        std::vector<double> m_outputs;
+        /*! For each connection, the slot in m_outputs that holds its value. */
+        std::vector<uint> m_slots;
+        /*! For each connection, the address of the input where the value is stored. */
+        std::vector<double*> m_destinations;
+};
+
+} // namespace lcg
+
+#endif
+
@@ -51,10 +51,12 @@ namespace lcg {
 namespace synapses {
 
 Synapse::Synapse(double E, uint id)
-        : DynamicalEntity(id), m_neuron(NULL), m_spikeTimeouts()
+        : DynamicalEntity(id), m_neuron(NULL), m_spikeTimeouts(),
+          m_E(bindParameter("E"))
 {
         m_state.push_back(0.0);         // m_state[0] -> conductance
         SYN_E = E;
+        registerEventType(SPIKE);
         setName("Synapse");
         setUnits("pA");
 }
@@ -83,6 +85,11 @@ void Synapse::handleEvent(const Event *event)
                 handleSpike(event->param(0));
 }
 
+bool Synapse::isCoupledToPost() const
+{
+        return true;
+}
+
 void Synapse::addPost(Entity *entity)
 {
         Logger(Debug, "Synapse::addPost(Entity*)\n");
@@ -101,7 +108,8 @@ void Synapse::addPost(Entity *entity)
 
 ExponentialSynapse::ExponentialSynapse(double E, double tau,
                                        uint id)
-        : Synapse(E, id)
+        : Synapse(E, id),
+          m_decayTimeConstant(bindParameter("decay_time_constant"))
 {
         EXP_SYN_DECAY = exp(-GetGlobalDt()/tau);
         setName("ExponentialSynapse");
@@ -127,7 +135,12 @@ void ExponentialSynapse::handleSpike(double weight)
 
 Exp2Synapse::Exp2Synapse(double E, double tau[2],
                          uint id) :
-	Synapse(E, id)
+	Synapse(E, id),
+          m_tau1(bindParameter("tau_1")),
+          m_tau2(bindParameter("tau_2")),
+          m_decayTimeConstant1(bindParameter("decay_time_constant_1")),
+          m_decayTimeConstant2(bindParameter("decay_time_constant_2")),
+          m_factor(bindParameter("factor"))
 {
         EXP2_SYN_TAU1 = tau[0];
         EXP2_SYN_TAU2 = tau[1];
@@ -170,7 +183,16 @@ void Exp2Synapse::handleSpike(double weight)
 
 TMGSynapse::TMGSynapse(double E, double U, double tau[3],
                        uint id)
-        : Synapse(E, id)
+        : Synapse(E, id),
+          m_U(bindParameter("U")),
+          m_tau1(bindParameter("tau_1")),
+          m_tauRec(bindParameter("tau_rec")),
+          m_tauFacil(bindParameter("tau_facil")),
+          m_decayTimeConstant(bindParameter("decay_time_constant")),
+          m_tau1Recipr(bindParameter("tau_1_recipr")),
+          m_tauRecRecipr(bindParameter("tau_rec_recipr")),
+          m_tauFacilRecipr(bindParameter("tau_facil_recipr")),
+          m_coeff(bindParameter("coeff"))
 {
         // tau = {tau_1, tau_rec, tau_facil}
         m_state.push_back(0.0);         // m_state[1] -> y
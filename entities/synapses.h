@@ -29,7 +29,7 @@
 #include "dynamical_entity.h"
 
 #define SYN_G m_state[0]
-#define SYN_E m_parameters["E"]
+#define SYN_E m_E
 
 namespace lcg {
 
@@ -46,6 +46,7 @@ public:
 	
         double g() const;
         virtual double output();
+        virtual bool isCoupledToPost() const;
         
         /*!
          * A Synapse ignores all events that are not spikes delivered to it.
@@ -66,11 +67,15 @@ protected:
 
 private:
         neurons::Neuron *m_neuron;
+
+protected:
+        // the parameters, bound to the values in m_parameters
+        double &m_E;
 };
 
 //~~
 
-#define EXP_SYN_DECAY m_parameters["decay_time_constant"]
+#define EXP_SYN_DECAY m_decayTimeConstant
 
 class ExponentialSynapse : public Synapse {
 public:
@@ -79,15 +84,19 @@ public:
 	virtual void handleSpike(double weight);
 protected:
 	virtual void evolve();	
+
+private:
+        // the parameters, bound to the values in m_parameters
+        double &m_decayTimeConstant;
 };
 
 //~~
 
-#define EXP2_SYN_TAU1   m_parameters["tau_1"]
-#define EXP2_SYN_TAU2   m_parameters["tau_2"]
-#define EXP2_SYN_DECAY1 m_parameters["decay_time_constant_1"]
-#define EXP2_SYN_DECAY2 m_parameters["decay_time_constant_2"]
-#define EXP2_SYN_FACTOR m_parameters["factor"]
+#define EXP2_SYN_TAU1   m_tau1
+#define EXP2_SYN_TAU2   m_tau2
+#define EXP2_SYN_DECAY1 m_decayTimeConstant1
+#define EXP2_SYN_DECAY2 m_decayTimeConstant2
+#define EXP2_SYN_FACTOR m_factor
 
 class Exp2Synapse : public Synapse {
 public:
@@ -96,20 +105,24 @@ public:
 	virtual void handleSpike(double weight);
 protected:
 	virtual void evolve();	
+
+private:
+        // the parameters, bound to the values in m_parameters
+        double &m_tau1, &m_tau2, &m_decayTimeConstant1, &m_decayTimeConstant2, &m_factor;
 };
 
 
 //~~
 
-#define TMG_SYN_U                       m_parameters["U"]
-#define TMG_SYN_TAU_1                   m_parameters["tau_1"]
-#define TMG_SYN_TAU_REC                 m_parameters["tau_rec"]
-#define TMG_SYN_TAU_FACIL               m_parameters["tau_facil"]
-#define TMG_SYN_DECAY                   m_parameters["decay_time_constant"]
-#define TMG_SYN_ONE_OVER_TAU_1		m_parameters["tau_1_recipr"]
-#define TMG_SYN_ONE_OVER_TAU_REC	m_parameters["tau_rec_recipr"]
-#define TMG_SYN_ONE_OVER_TAU_FACIL	m_parameters["tau_facil_recipr"]
-#define TMG_SYN_COEFF                   m_parameters["coeff"]
+#define TMG_SYN_U                       m_U
+#define TMG_SYN_TAU_1                   m_tau1
+#define TMG_SYN_TAU_REC                 m_tauRec
+#define TMG_SYN_TAU_FACIL               m_tauFacil
+#define TMG_SYN_DECAY                   m_decayTimeConstant
+#define TMG_SYN_ONE_OVER_TAU_1		m_tau1Recipr
+#define TMG_SYN_ONE_OVER_TAU_REC	m_tauRecRecipr
+#define TMG_SYN_ONE_OVER_TAU_FACIL	m_tauFacilRecipr
+#define TMG_SYN_COEFF                   m_coeff
 
 class TMGSynapse : public Synapse {
 public:
@@ -118,6 +131,10 @@ public:
 	virtual void handleSpike(double weight);
 protected:
 	virtual void evolve();	
+
+private:
+        // the parameters, bound to the values in m_parameters
+        double &m_U, &m_tau1, &m_tauRec, &m_tauFacil, &m_decayTimeConstant, &m_tau1Recipr, &m_tauRecRecipr, &m_tauFacilRecipr, &m_coeff;
 };
 
 } // namespace synapses
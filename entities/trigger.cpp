@@ -37,7 +37,7 @@ double Trigger::output()
 
 void Trigger::emitTrigger() const
 {
-        emitEvent(new TriggerEvent(this));
+        emitEvent(TriggerEvent(this));
 }
 
 PeriodicTrigger::PeriodicTrigger(double frequency, double tdelay, double tend, uint id)
@@ -34,6 +34,7 @@ namespace generators {
 Waveform::Waveform(const char *stimulusFile, bool triggered, const std::string& units, bool emitEventOnEnd, uint id)
         : Generator(id), m_triggered(triggered), m_emitEventOnEnd(emitEventOnEnd)
 {
+        registerEventType(TRIGGER);
         setName("Waveform");
         setUnits(units);
         if (stimulusFile && strlen(stimulusFile))
@@ -114,7 +115,7 @@ double Waveform::output()
                 return m_stimulus->at(m_position);
         if (m_position == m_stimulus->length() && m_emitEventOnEnd && !m_eventSent) {
 		Logger(Debug, "Waveform: emitting event at t = %lf seconds.\n", GetGlobalTime());
-                emitEvent(new TriggerEvent(this));
+                emitEvent(TriggerEvent(this));
 		m_eventSent = true;
 	}
         return m_stimulus->at(m_stimulus->length()-1);
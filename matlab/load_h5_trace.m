@@ -150,6 +150,12 @@ for ii=1:ngroups
             idx = strfind(name, '/');
             entities(jj).id = str2double(name(idx(end)+1:end));
             data = hdf5read(filename, [name,'/Data']);
+            for kk=1:length(info.GroupHierarchy.Groups(ii).Groups(jj).Datasets)
+                dataset = info.GroupHierarchy.Groups(ii).Groups(jj).Datasets(kk);
+                if strcmp(dataset.Name, [name,'/Data'])
+                    data = raw_to_physical(data, dataset.Attributes);
+                end
+            end
             
             if iscolumn(data) && min(size(data))==1
                 data = data';
@@ -198,3 +204,26 @@ info.tend = hdf5read(filename,'/Info/tend');
 info.dt = hdf5read(filename,'/Info/dt');
 info.srate = 1.0 / info.dt;
 info.version = 2;
+
+function data = raw_to_physical(data, attributes)
+% data = raw_to_physical(data, attributes)
+%
+% Converts the raw samples acquired by a board into physical units, using the
+% calibration polynomial saved among the attributes of their dataset.
+
+coefficients = [];
+for k=1:length(attributes)
+    idx = strfind(attributes(k).Name, '/');
+    switch attributes(k).Name(idx(end)+1:end)
+        case 'Coefficients'
+            coefficients = double(attributes(k).Value);
+        case 'ExpansionOrigin'
+            origin = double(attributes(k).Value);
+        case 'ConversionFactor'
+            factor = double(attributes(k).Value);
+    end
+end
+if isempty(coefficients)
+    return;
+end
+data = factor * polyval(coefficients(end:-1:1), double(data) - origin);
@@ -13,15 +13,30 @@ class Entity (XMLEntry):
         super(Entity,self).__init__('Entity',name,id,connections)
 
 class H5Recorder (Entity):
-    def __init__(self, id, connections, compress=True, filename=None):
+    def __init__(self, id, connections, compress=True, filename=None, buffers=None,
+                 compression=None, compression_level=None, flush_interval=None,
+                 access=None, chunk_size=None):
         super(H5Recorder,self).__init__('H5Recorder', id, connections)
         if compress:
             self.add_parameter('compress', compress)
         if not filename is None:
             self.add_parameter('filename', filename)
+        if not buffers is None:
+            self.add_parameter('buffers', buffers)
+        if not compression is None:
+            self.add_parameter('compression', compression)
+        if not compression_level is None:
+            self.add_parameter('compressionLevel', compression_level)
+        if not flush_interval is None:
+            self.add_parameter('flushInterval', flush_interval)
+        if not access is None:
+            self.add_parameter('access', access)
+        if not chunk_size is None:
+            self.add_parameter('chunkSize', chunk_size)
 
 class TriggeredH5Recorder (Entity):
-    def __init__(self, id, connections, before, after, compress=True, filename=None):
+    def __init__(self, id, connections, before, after, compress=True, filename=None,
+                 compression=None, compression_level=None):
         super(TriggeredH5Recorder,self).__init__('TriggeredH5Recorder', id, connections)
         self.add_parameter('before', before)
         self.add_parameter('after', after)
@@ -29,6 +44,10 @@ class TriggeredH5Recorder (Entity):
             self.add_parameter('compress', compress)
         if not filename is None:
             self.add_parameter('filename', filename)
+        if not compression is None:
+            self.add_parameter('compression', compression)
+        if not compression_level is None:
+            self.add_parameter('compressionLevel', compression_level)
 
 class ASCIIRecorder (Entity):
     def __init__(self, id, connections, compress=True, filename=''):
@@ -100,6 +119,44 @@ class IzhikevicNeuron (Entity):
         self.add_parameter('Vspk', Vspk)
         self.add_parameter('Iext', Iext)
 
+def population_parameter(value):
+    '''
+    Formats the parameter of a population: either a single value, used for all the neurons,
+    or a sequence with one value for each neuron.
+    '''
+    try:
+        return ','.join([str(v) for v in value])
+    except TypeError:
+        return value
+
+class IzhikevichPopulation (Entity):
+    def __init__(self, id, connections, size, a=0.02, b=0.2, c=-65, d=2, Vspk=30, Iext=0):
+        super(IzhikevichPopulation,self).__init__('IzhikevichPopulation', id, connections)
+        self.add_parameter('size', size)
+        self.add_parameter('a', population_parameter(a))
+        self.add_parameter('b', population_parameter(b))
+        self.add_parameter('c', population_parameter(c))
+        self.add_parameter('d', population_parameter(d))
+        self.add_parameter('Vspk', population_parameter(Vspk))
+        self.add_parameter('Iext', population_parameter(Iext))
+
+class LIFPopulation (Entity):
+    def __init__(self, id, connections, size, C, tau, tarp, Er, E0, Vth, Iext):
+        super(LIFPopulation,self).__init__('LIFPopulation', id, connections)
+        self.add_parameter('size', size)
+        self.add_parameter('C', population_parameter(C))
+        self.add_parameter('tau', population_parameter(tau))
+        self.add_parameter('tarp', population_parameter(tarp))
+        self.add_parameter('Er', population_parameter(Er))
+        self.add_parameter('E0', population_parameter(E0))
+        self.add_parameter('Vth', population_parameter(Vth))
+        self.add_parameter('Iext', population_parameter(Iext))
+
+class PopulationNeuron (Entity):
+    def __init__(self, id, connections, index):
+        super(PopulationNeuron,self).__init__('PopulationNeuron', id, connections)
+        self.add_parameter('index', index)
+
 class ConductanceBasedNeuron (Entity):
     def __init__(self, id, connections, C, gl, El, Iext, area, spike_threshold, V0):
         super(ConductanceBasedNeuron,self).__init__('ConductanceBasedNeuron', id, connections)
@@ -183,8 +240,10 @@ class SynapticConnection (Entity):
         self.add_parameter('weight', weight)
 
 class VariableDelayConnection (Entity):
-    def __init__(self, id, connections):
+    def __init__(self, id, connections, max_delay=None):
         super(VariableDelayConnection,self).__init__('VariableDelayConnection', id, connections)
+        if not max_delay is None:
+            self.add_parameter('maxDelay', max_delay)
 
 class Constant (Entity):
     def __init__(self, id, connections, value, units=''):
@@ -301,38 +360,40 @@ class TMGSynapse (Synapse):
         self.add_parameter('tau_facil', tau_facil)
 
 class IonicCurrent (Entity):
-    def __init__(self, name, id, connections, area, gbar, E):
+    def __init__(self, name, id, connections, area, gbar, E, table_error=None):
         super(IonicCurrent,self).__init__(name, id, connections)
         self.add_parameter('area', area)
         self.add_parameter('gbar', gbar)
         self.add_parameter('E', E)
+        if not table_error is None:
+            self.add_parameter('tableError', table_error)
 
 class HHSodium (IonicCurrent):
-    def __init__(self, id, connections, area, gbar=0.12, E=50.):
-        super(HHSodium,self).__init__('HHSodium', id, connections, area, gbar, E)
+    def __init__(self, id, connections, area, gbar=0.12, E=50., table_error=None):
+        super(HHSodium,self).__init__('HHSodium', id, connections, area, gbar, E, table_error)
 
 class HHPotassium (IonicCurrent):
-    def __init__(self, id, connections, area, gbar=0.036, E=-77.):
-        super(HHPotassium,self).__init__('HHPotassium', id, connections, area, gbar, E)
+    def __init__(self, id, connections, area, gbar=0.036, E=-77., table_error=None):
+        super(HHPotassium,self).__init__('HHPotassium', id, connections, area, gbar, E, table_error)
 
 class HH2Sodium (IonicCurrent):
     def __init__(self, id, connections, area, gbar=0.003, E=50.,
-                 vtraub=-63., temperature=36):
-        super(HH2Sodium,self).__init__('HH2Sodium', id, connections, area, gbar, E)
+                 vtraub=-63., temperature=36, table_error=None):
+        super(HH2Sodium,self).__init__('HH2Sodium', id, connections, area, gbar, E, table_error)
         self.add_parameter('vtraub', vtraub)
         self.add_parameter('temperature', temperature)
 
 class HH2Potassium (IonicCurrent):
     def __init__(self, id, connections, area, gbar=0.005, E=-90.,
-                 vtraub=-63., temperature=36):
-        super(HH2Potassium,self).__init__('HH2Potassium', id, connections, area, gbar, E)
+                 vtraub=-63., temperature=36, table_error=None):
+        super(HH2Potassium,self).__init__('HH2Potassium', id, connections, area, gbar, E, table_error)
         self.add_parameter('vtraub', vtraub)
         self.add_parameter('temperature', temperature)
 
 class MCurrent (IonicCurrent):
     def __init__(self, id, connections, area, gbar=0.005, E=-90.,
-                 tau_max=1000., temperature=36):
-        super(MCurrent,self).__init__('MCurrent', id, connections, area, gbar, E)
+                 tau_max=1000., temperature=36, table_error=None):
+        super(MCurrent,self).__init__('MCurrent', id, connections, area, gbar, E, table_error)
         self.add_parameter('taumax', tau_max)
         self.add_parameter('temperature', temperature)
 
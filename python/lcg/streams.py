@@ -13,7 +13,8 @@ class Stream (XMLEntry):
 
 class InputChannel (Stream):
     def __init__(self, id, connections, device, subdevice, channel,
-                 conversionFactor, range, reference, units, samplingRate):
+                 conversionFactor, range, reference, units, samplingRate,
+                 streaming=None, blockDuration=None, blocks=None, raw=None, mmap=None):
         super(InputChannel,self).__init__('InputChannel', id, connections)
         self.add_parameter('device', device)
         self.add_parameter('subdevice', subdevice)
@@ -23,11 +24,21 @@ class InputChannel (Stream):
         self.add_parameter('reference', reference)
         self.add_parameter('units', units)
         self.add_parameter('samplingRate', samplingRate)
+        if not streaming is None:
+            self.add_parameter('streaming', streaming)
+        if not blockDuration is None:
+            self.add_parameter('blockDuration', blockDuration)
+        if not blocks is None:
+            self.add_parameter('blocks', blocks)
+        if not raw is None:
+            self.add_parameter('raw', raw)
+        if not mmap is None:
+            self.add_parameter('mmap', mmap)
         
 class OutputChannel (Stream):
     def __init__(self, id, connections, device, subdevice, channel,
                  conversionFactor, reference, units, stimulusFile, samplingRate,
-                 offset, resetOutput):
+                 offset, resetOutput, mmap=None):
         super(OutputChannel,self).__init__('OutputChannel', id, connections)
         self.add_parameter('device', device)
         self.add_parameter('subdevice', subdevice)
@@ -39,3 +50,5 @@ class OutputChannel (Stream):
         self.add_parameter('samplingRate', samplingRate)
         self.add_parameter('offset', offset)
         self.add_parameter('resetOutput', resetOutput)
+        if not mmap is None:
+            self.add_parameter('mmap', mmap)
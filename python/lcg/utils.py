@@ -581,6 +581,21 @@ def loadH5TraceV1(filename):
     fid.close()
     return entities,info
 
+def rawToPhysical(dataset):
+    """
+    Reads a dataset and, if it contains the raw samples acquired by a board, converts
+    them into physical units with the calibration polynomial saved among its attributes.
+    """
+    data = dataset.read()
+    if not 'Coefficients' in dataset.attrs._v_attrnames:
+        return data
+    coefficients = dataset.attrs.Coefficients
+    x = data.astype(np.float64) - dataset.attrs.ExpansionOrigin
+    y = np.zeros(x.shape) + coefficients[-1]
+    for c in coefficients[-2::-1]:
+        y = y*x + c
+    return y * dataset.attrs.ConversionFactor
+
 def loadH5TraceV2(filename):
     fid = tbl.openFile(filename,mode='r')
     try:
@@ -595,7 +610,7 @@ def loadH5TraceV2(filename):
     for node in fid.root.Entities:
         entities.append({
                 'id': int(node._v_name),
-                'data': node.Data.read()})
+                'data': rawToPhysical(node.Data)})
         try:
             entities[-1]['metadata'] = node.Metadata.read()
         except:
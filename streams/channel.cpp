@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <sys/mman.h>
 
 #include "channel.h"
 #include "utils.h"
@@ -9,9 +10,10 @@
 
 lcg::Stream* InputChannelFactory(string_dict& args)
 {
-        uint subdevice, channel, range, reference, id;
+        uint subdevice, channel, range, reference, id, numberOfBlocks;
         std::string device, rangeStr, referenceStr, units;
-        double conversionFactor, samplingRate;
+        double conversionFactor, samplingRate, blockDuration;
+        bool streaming, raw, memoryMapped;
 
         id = lcg::GetIdFromDictionary(args);
 
@@ -78,8 +80,36 @@ lcg::Stream* InputChannelFactory(string_dict& args)
                 units = "mV";
         }
 
+        if (! lcg::CheckAndExtractBool(args, "streaming", &streaming)) {
+                streaming = false;
+        }
+
+        if (! lcg::CheckAndExtractDouble(args, "blockDuration", &blockDuration)) {
+                blockDuration = 1.;
+        }
+
+        if (! lcg::CheckAndExtractUnsignedInteger(args, "blocks", &numberOfBlocks)) {
+                numberOfBlocks = INPUT_CHANNEL_BLOCKS;
+        }
+
+        if (! lcg::CheckAndExtractBool(args, "raw", &raw)) {
+                raw = false;
+        }
+
+        if (! lcg::CheckAndExtractBool(args, "mmap", &memoryMapped)) {
+                memoryMapped = (getenv("LCG_COMEDI_MMAP") == NULL ? false :
+                        (strcmp(getenv("LCG_COMEDI_MMAP"),"yes") ? false : true));
+        }
+
+        if (streaming && (blockDuration <= 0 || numberOfBlocks < 2)) {
+                lcg::Logger(lcg::Critical, "A streaming input channel needs a positive blockDuration and at least 2 blocks.\n");
+                lcg::Logger(lcg::Critical, "Unable to build an input channel.\n");
+                return NULL;
+        }
+
         return new lcg::InputChannel(device.c_str(), subdevice, range, reference,
-                                     channel, conversionFactor, samplingRate, units.c_str(), id);
+                                     channel, conversionFactor, samplingRate, units.c_str(),
+                                     streaming ? blockDuration : 0., numberOfBlocks, raw, memoryMapped, id);
 }
 
 lcg::Stream* OutputChannelFactory(string_dict& args)
@@ -87,7 +117,7 @@ lcg::Stream* OutputChannelFactory(string_dict& args)
         uint subdevice, channel, reference, id;
         std::string device, referenceStr, units, stimfile;
         double conversionFactor, samplingRate, offset;
-        bool resetOutput;
+        bool resetOutput, memoryMapped;
 
         id = lcg::GetIdFromDictionary(args);
 
@@ -133,9 +163,14 @@ lcg::Stream* OutputChannelFactory(string_dict& args)
                         (strcmp(getenv("LCG_RESET_OUTPUT"),"yes") ? false : true));
         }
 
+        if (! lcg::CheckAndExtractBool(args, "mmap", &memoryMapped)) {
+                memoryMapped = (getenv("LCG_COMEDI_MMAP") == NULL ? false :
+                        (strcmp(getenv("LCG_COMEDI_MMAP"),"yes") ? false : true));
+        }
+
         return new lcg::OutputChannel(device.c_str(), subdevice, PLUS_MINUS_TEN, reference,
                                       channel, conversionFactor, samplingRate, units.c_str(),
-                                      stimfile.c_str(), offset, resetOutput, id);
+                                      stimfile.c_str(), offset, resetOutput, memoryMapped, id);
 }
 
 namespace lcg {
@@ -144,15 +179,23 @@ std::map<std::string,ComediDevice*> devices;
 
 ///// HELPER FUNCTIONS AND STRUCTURES - START /////
 
+/*!
+ * The data of the thread that acquires the samples: if map is not NULL, the samples are processed
+ * in the asynchronous buffer of the board, mapped at that address, instead of being read in buffer.
+ */
 struct input_loop_data {
-        input_loop_data(comedi_t *dev, int subdev, char *buf, size_t buflen, comedi_polynomial_t *conv, std::vector<InputChannel*>* chan)
-                : device(dev), subdevice(subdev), buffer(buf), buffer_length(buflen), converters(conv), channels(chan) {}
+        input_loop_data(comedi_t *dev, int subdev, char *buf, size_t buflen, comedi_polynomial_t *conv, std::vector<InputChannel*>* chan,
+                        const char *mapped = NULL, size_t mapped_length = 0)
+                : device(dev), subdevice(subdev), buffer(buf), buffer_length(buflen), converters(conv), channels(chan),
+                  map(mapped), map_length(mapped_length) {}
         comedi_t *device;
         uint subdevice;
         char *buffer;
         size_t buffer_length;
         comedi_polynomial_t *converters;
         std::vector<InputChannel*>* channels;
+        const char *map;
+        size_t map_length;
 };
 
 struct output_loop_data {
@@ -166,38 +209,389 @@ struct output_loop_data {
         int n_channels, bytes_per_sample;
 };
 
+/*
+ * The samples read from and written to the board are converted by kernels that are specialised
+ * on the type of the samples and, for 1, 2, 4 and 8 channels, on the number of channels in a
+ * scan, so that the stride between consecutive samples of a channel is known at compile time.
+ * The samples of each channel are stored contiguously and the calibration polynomials are
+ * evaluated with Horner's method on blocks of CONVERSION_BLOCK samples: with GCC, each block is
+ * a vector and is processed with vector instructions.
+ */
+#define CONVERSION_BLOCK 8
+
+#if defined(__GNUC__)
+#define CONVERSION_VECTOR_KERNELS
+typedef double vsample __attribute__((vector_size(CONVERSION_BLOCK*sizeof(double))));
+#endif
+
+/*!
+ * A calibration polynomial, in which the conversion factor and the offset of a channel are
+ * folded: a value x is converted into sum_{i=0}^{order} coefficients[i] * (scale * x + shift)^i.
+ */
+struct conversion_polynomial {
+        double coefficients[COMEDI_MAX_NUM_POLYNOMIAL_COEFFICIENTS];
+        double scale, shift;
+        int order;
+};
+
+/*! Converts the CONVERSION_BLOCK values in x and stores them in y. */
+static inline void EvaluatePolynomial(const conversion_polynomial *p, const double *x, double *y)
+{
+#ifdef CONVERSION_VECTOR_KERNELS
+        vsample u, v;
+        memcpy(&u, x, sizeof(vsample));
+        u = u * p->scale + p->shift;
+        v = vsample() + p->coefficients[p->order];
+        for (int i=p->order-1; i>=0; i--)
+                v = v * u + p->coefficients[i];
+        memcpy(y, &v, sizeof(vsample));
+#else
+        for (int k=0; k<CONVERSION_BLOCK; k++) {
+                double u = x[k] * p->scale + p->shift;
+                y[k] = p->coefficients[p->order];
+                for (int i=p->order-1; i>=0; i--)
+                        y[k] = y[k] * u + p->coefficients[i];
+        }
+#endif
+}
+
+/*! Converts count samples of a channel, which are n samples apart in src, into physical units. */
+template <typename T, int N>
+static void ConvertInput(const T *src, uint n, size_t count, const conversion_polynomial *p, double *dst)
+{
+        const uint stride = (N > 0 ? N : n);
+        double x[CONVERSION_BLOCK], y[CONVERSION_BLOCK];
+        size_t i, k;
+        for (i=0; i+CONVERSION_BLOCK<=count; i+=CONVERSION_BLOCK) {
+                for (k=0; k<CONVERSION_BLOCK; k++)
+                        x[k] = src[(i+k)*stride];
+                EvaluatePolynomial(p, x, dst+i);
+        }
+        if (i < count) {
+                for (k=0; i+k<count; k++)
+                        x[k] = src[(i+k)*stride];
+                for (; k<CONVERSION_BLOCK; k++)
+                        x[k] = 0.;
+                EvaluatePolynomial(p, x, y);
+                memcpy(dst+i, y, (count-i)*sizeof(double));
+        }
+}
+
+/*! Copies count samples of a channel, which are n samples apart in src. */
+template <typename T, int N>
+static void CopyInput(const T *src, uint n, size_t count, T *dst)
+{
+        const uint stride = (N > 0 ? N : n);
+        for (size_t i=0; i<count; i++)
+                dst[i] = src[i*stride];
+}
+
+/*!
+ * Converts count physical values of a channel into samples, which are stored n samples apart in dst.
+ * As comedi_from_physical, negative values are converted into 0.
+ */
+template <typename T, int N>
+static void ConvertOutput(const double *src, size_t count, const conversion_polynomial *p, uint n, T *dst)
+{
+        const uint stride = (N > 0 ? N : n);
+        double x[CONVERSION_BLOCK], y[CONVERSION_BLOCK];
+        size_t i, k, m;
+        for (i=0; i<count; i+=CONVERSION_BLOCK) {
+                m = MIN(CONVERSION_BLOCK, count-i);
+                memcpy(x, src+i, m*sizeof(double));
+                for (k=m; k<CONVERSION_BLOCK; k++)
+                        x[k] = 0.;
+                EvaluatePolynomial(p, x, y);
+                for (k=0; k<m; k++)
+                        dst[(i+k)*stride] = (T) (y[k] < 0 ? 0 : (lsampl_t) nearbyint(y[k]));
+        }
+}
+
+/*!
+ * Stores in the input channels nsamples samples read from the board: first is the index
+ * in the scan of the channel to which the first sample in the buffer belongs.
+ */
+template <typename T, int N>
+static void DeinterleaveSamples(const char *buffer, size_t nsamples, uint first,
+                                std::vector<InputChannel*>* channels, const conversion_polynomial *polynomials)
+{
+        const uint n = (N > 0 ? N : channels->size());
+        for (uint j=0; j<n; j++) {
+                // the position in the buffer of the first sample of the j-th channel
+                size_t start = (j + n - first) % n, count, m;
+                if (start >= nsamples)
+                        continue;
+                count = (nsamples - start + n - 1) / n;
+                const T *src = (const T *) buffer + start;
+                InputChannel *channel = channels->at(j);
+                while (count > 0) {
+                        m = count;
+                        if (channel->isRaw()) {
+                                T *dst = (T *) channel->reserveRawSamples(&m);
+                                if (dst == NULL)
+                                        break;
+                                CopyInput<T,N>(src, n, m, dst);
+                        }
+                        else {
+                                double *dst = channel->reserveSamples(&m);
+                                if (dst == NULL)
+                                        break;
+                                ConvertInput<T,N>(src, n, m, &polynomials[j], dst);
+                        }
+                        channel->commitSamples(m);
+                        src += m*n;
+                        count -= m;
+                }
+        }
+}
+
+/*!
+ * Fills the buffer with nsamples samples converted from the stimuli of the output channels: first is
+ * the index of the first sample since the beginning of the trial, counting the samples of all channels.
+ */
+template <typename T, int N>
+static void InterleaveSamples(char *buffer, size_t first, size_t nsamples, std::vector<OutputChannel*>* channels,
+                              const conversion_polynomial *polynomials)
+{
+        const uint n = (N > 0 ? N : channels->size());
+        const double zero = 0.;
+        size_t length, start, step, count, converted, i;
+        for (uint j=0; j<n; j++) {
+                // the position in the buffer of the first sample of the j-th channel
+                start = (j + n - first % n) % n;
+                if (start >= nsamples)
+                        continue;
+                count = (nsamples - start + n - 1) / n;
+                step = (first + start) / n;
+                T *dst = (T *) buffer + start;
+                const double *stimulus = channels->at(j)->data(&length);
+                if (length == 0) {
+                        stimulus = &zero;
+                        length = 1;
+                }
+                converted = (step < length ? MIN(count, length - step) : 0);
+                ConvertOutput<T,N>(stimulus + step, converted, &polynomials[j], n, dst);
+                // a stimulus shorter than the command holds its last value
+                if (converted < count) {
+                        ConvertOutput<T,N>(stimulus + length - 1, 1, &polynomials[j], n, dst + converted*n);
+                        for (i=converted+1; i<count; i++)
+                                dst[i*n] = dst[converted*n];
+                }
+        }
+}
+
+typedef void (*deinterleave_kernel)(const char*, size_t, uint, std::vector<InputChannel*>*, const conversion_polynomial*);
+typedef void (*interleave_kernel)(char*, size_t, size_t, std::vector<OutputChannel*>*, const conversion_polynomial*);
+
+template <typename T>
+static deinterleave_kernel DeinterleaveKernel(uint n)
+{
+        switch (n) {
+        case 1: return DeinterleaveSamples<T,1>;
+        case 2: return DeinterleaveSamples<T,2>;
+        case 4: return DeinterleaveSamples<T,4>;
+        case 8: return DeinterleaveSamples<T,8>;
+        default: return DeinterleaveSamples<T,0>;
+        }
+}
+
+template <typename T>
+static interleave_kernel InterleaveKernel(uint n)
+{
+        switch (n) {
+        case 1: return InterleaveSamples<T,1>;
+        case 2: return InterleaveSamples<T,2>;
+        case 4: return InterleaveSamples<T,4>;
+        case 8: return InterleaveSamples<T,8>;
+        default: return InterleaveSamples<T,0>;
+        }
+}
+
+/*!
+ * The data of the thread that writes the samples in the asynchronous buffer of the board,
+ * mapped at the address map: written is the number of samples written since the beginning of the trial.
+ */
+struct mapped_output_data {
+        mapped_output_data(comedi_t *dev, int subdev, char *mapped, size_t mapped_length, size_t nsamples, int bps,
+                           std::vector<OutputChannel*>* chan, const conversion_polynomial *polys)
+                : device(dev), subdevice(subdev), map(mapped), map_length(mapped_length), total(nsamples), written(0),
+                  bytes_per_sample(bps), channels(chan), polynomials(polys) {}
+        comedi_t *device;
+        uint subdevice;
+        char *map;
+        size_t map_length, total, written;
+        int bytes_per_sample;
+        std::vector<OutputChannel*>* channels;
+        const conversion_polynomial *polynomials;
+};
+
+/*!
+ * Maps in memory the asynchronous buffer of a subdevice, which is size bytes long,
+ * for reading or for writing. Returns NULL on failure.
+ */
+static char* MapBuffer(comedi_t *device, uint subdevice, size_t size, bool write)
+{
+#ifdef COMEDI_SIMULATED_DAQ
+        return (char *) comedi_simulated_map_buffer(device, subdevice);
+#else
+        void *map = mmap(NULL, size, write ? PROT_WRITE : PROT_READ, MAP_SHARED, comedi_fileno(device), 0);
+        if (map == MAP_FAILED) {
+                Logger(Important, "Unable to map the buffer of subdevice %d: %s.\n", subdevice, strerror(errno));
+                return NULL;
+        }
+        return (char *) map;
+#endif
+}
+
+static void UnmapBuffer(char *map, size_t size)
+{
+#ifndef COMEDI_SIMULATED_DAQ
+        if (map)
+                munmap(map, size);
+#endif
+}
+
+/*!
+ * Waits until an interval of 1 ms has elapsed: it is used to poll the asynchronous
+ * buffers of the board, which are not read or written with blocking calls when they are mapped.
+ */
+static void WaitForBuffer()
+{
+        struct timespec interval = {0, 1000000};
+        nanosleep(&interval, NULL);
+}
+
 void* input_loop(void *arg)
 {
-        int i, j, k, ret, cnt, total, n_channels, bytes_per_sample, flags;
+        int ret, n_channels, bytes_per_sample, flags;
+        size_t cnt, nsamples, leftover, total, offset, length;
+        uint first;
         int *nsteps = new int;
-        lsampl_t sample;
         input_loop_data *data = static_cast<input_loop_data*>(arg);
-        cnt = total = *nsteps = 0;
+        deinterleave_kernel deinterleave;
+        std::vector<conversion_polynomial> polynomials;
+        cnt = total = leftover = offset = *nsteps = 0;
+        first = 0;
         if (!data)
                 pthread_exit((void *) nsteps);
         n_channels = data->channels->size();
-        flags = comedi_get_subdevice_flags(data->device, data->subdevice);
-        if (flags & SDF_LSAMPL)
+        if (comedi_get_subdevice_flags(data->device, data->subdevice) & SDF_LSAMPL) {
                 bytes_per_sample = sizeof(lsampl_t);
-        else
+                deinterleave = DeinterleaveKernel<lsampl_t>(n_channels);
+        }
+        else {
                 bytes_per_sample = sizeof(sampl_t);
-        while (!KILL_PROGRAM() && (ret = read(comedi_fileno(data->device), data->buffer, data->buffer_length)) > 0) {
-                total += ret;
-                Logger(Debug, "Read %d bytes from the board [%d/%d].\r", ret, total, data->buffer_length);
-                for (i=0; i<ret/bytes_per_sample; i++) {
-                        if (flags & SDF_LSAMPL)
-                                sample = ((lsampl_t *) data->buffer)[i];
-                        else
-                                sample = ((sampl_t *) data->buffer)[i];
-                        j = cnt%n_channels;
-                        k = cnt/n_channels;
-                        cnt++;
-                        data->channels->at(j)->at(k) = comedi_to_physical(sample, &data->converters[j]) *
+                deinterleave = DeinterleaveKernel<sampl_t>(n_channels);
+        }
+        // the conversion factor of each channel is folded in its calibration polynomial
+        polynomials.resize(n_channels);
+        for (int j=0; j<n_channels; j++) {
+                const comedi_polynomial_t *converter = &data->converters[j];
+                for (uint i=0; i<=converter->order; i++)
+                        polynomials[j].coefficients[i] = converter->coefficients[i] *
                                 data->channels->at(j)->conversionFactor();
+                polynomials[j].scale = 1.;
+                polynomials[j].shift = -converter->expansion_origin;
+                polynomials[j].order = converter->order;
+        }
+        if (data->map) {
+                // the samples are converted where the board stored them and the space is then given back to the board
+                while (!KILL_PROGRAM()) {
+                        // the state of the command is checked first, so that no samples are lost when it ends
+                        flags = comedi_get_subdevice_flags(data->device, data->subdevice);
+                        ret = comedi_get_buffer_contents(data->device, data->subdevice);
+                        if (ret < 0) {
+                                Logger(Critical, "Error in the acquisition: %s.\n", comedi_strerror(comedi_errno()));
+                                break;
+                        }
+                        if (ret < bytes_per_sample) {
+                                if (!(flags & SDF_RUNNING))
+                                        break;
+                                WaitForBuffer();
+                                continue;
+                        }
+                        length = MIN(ret - ret % bytes_per_sample, data->map_length - offset);
+                        nsamples = length / bytes_per_sample;
+                        deinterleave(data->map + offset, nsamples, first, data->channels, &polynomials[0]);
+                        comedi_mark_buffer_read(data->device, data->subdevice, length);
+                        first = (first + nsamples) % n_channels;
+                        cnt += nsamples;
+                        total += length;
+                        offset = (offset + length) % data->map_length;
+                        Logger(Debug, "Processed %llu bytes in the buffer of the board [%llu].\r", (ullong) length, (ullong) total);
                 }
         }
+        else {
+                while (!KILL_PROGRAM() && (ret = read(comedi_fileno(data->device), data->buffer + leftover,
+                                                      data->buffer_length - leftover)) > 0) {
+                        total += ret;
+                        Logger(Debug, "Read %d bytes from the board [%llu/%llu].\r", ret, (ullong) total, (ullong) data->buffer_length);
+                        nsamples = (leftover + ret) / bytes_per_sample;
+                        deinterleave(data->buffer, nsamples, first, data->channels, &polynomials[0]);
+                        first = (first + nsamples) % n_channels;
+                        cnt += nsamples;
+                        // an incomplete sample is kept for the next read
+                        leftover = (leftover + ret) % bytes_per_sample;
+                        if (leftover)
+                                memmove(data->buffer, data->buffer + nsamples*bytes_per_sample, leftover);
+                }
+        }
+        for (int j=0; j<n_channels; j++)
+                data->channels->at(j)->flush();
         Logger(Debug, "\n");
-        *nsteps = k+1;
+        *nsteps = (cnt + n_channels - 1) / n_channels;
+        pthread_exit((void *) nsteps);
+}
+
+/*!
+ * Converts as many of the samples that remain to be written as there is free space for in the
+ * mapped buffer of the board and tells the board that they are available.
+ * \return The number of bytes written, or a negative number on error.
+ */
+static int FillMappedOutput(mapped_output_data *data)
+{
+        interleave_kernel interleave;
+        size_t nchannels = data->channels->size(), offset, length, nsamples, written = 0;
+        int contents;
+        if (data->bytes_per_sample == sizeof(lsampl_t))
+                interleave = InterleaveKernel<lsampl_t>(nchannels);
+        else
+                interleave = InterleaveKernel<sampl_t>(nchannels);
+        contents = comedi_get_buffer_contents(data->device, data->subdevice);
+        if (contents < 0)
+                return contents;
+        length = data->map_length - contents;
+        while (length >= (size_t) data->bytes_per_sample && data->written < data->total) {
+                // the free space may wrap around the end of the buffer
+                offset = (data->written * data->bytes_per_sample) % data->map_length;
+                nsamples = MIN(MIN(length, data->map_length - offset) / data->bytes_per_sample,
+                               data->total - data->written);
+                interleave(data->map + offset, data->written, nsamples, data->channels, data->polynomials);
+                comedi_mark_buffer_written(data->device, data->subdevice, nsamples * data->bytes_per_sample);
+                data->written += nsamples;
+                written += nsamples * data->bytes_per_sample;
+                length -= nsamples * data->bytes_per_sample;
+        }
+        return written;
+}
+
+void* mapped_output_loop(void *arg)
+{
+        int *nsteps = new int;
+        mapped_output_data *data = static_cast<mapped_output_data*>(arg);
+        *nsteps = 0;
+        if (!data)
+                pthread_exit((void *) nsteps);
+        while (!KILL_PROGRAM() && data->written < data->total) {
+                int ret = FillMappedOutput(data);
+                if (ret < 0) {
+                        Logger(Critical, "Error while writing: %s.\n", comedi_strerror(comedi_errno()));
+                        break;
+                }
+                if (data->written < data->total)
+                        WaitForBuffer();
+        }
+        *nsteps = data->written / data->channels->size();
         pthread_exit((void *) nsteps);
 }
 
@@ -293,10 +687,11 @@ double Channel::samplingRate() const
 }
 
 ComediChannel::ComediChannel(const char *device, uint subdevice, uint range, uint reference,
-                uint channel, double conversionFactor, double samplingRate, const char *units, uint id)
+                uint channel, double conversionFactor, double samplingRate, const char *units,
+                bool memoryMapped, uint id)
         : Channel(device, channel, samplingRate, units, id),
           m_subdevice(subdevice), m_range(range), m_reference(reference),
-          m_conversionFactor(conversionFactor), m_validDataLength(0)
+          m_conversionFactor(conversionFactor), m_validDataLength(0), m_memoryMapped(memoryMapped)
 {
         setName("ComediChannel");
         m_parameters["subdevice"] = (double) m_subdevice;
@@ -325,6 +720,11 @@ double ComediChannel::conversionFactor() const
         return m_conversionFactor;
 }
 
+bool ComediChannel::memoryMapped() const
+{
+        return m_memoryMapped;
+}
+
 bool ComediChannel::initialise()
 {
         std::string dev = device();
@@ -355,10 +755,20 @@ void ComediChannel::join(int *err)
 }
 
 InputChannel::InputChannel(const char *device, uint subdevice, uint range, uint reference,
-        uint channel, double conversionFactor, double samplingRate, const char *units, uint id)
-        : ComediChannel(device, subdevice, range, reference, channel, conversionFactor, samplingRate, units, id),
-          m_data(NULL), m_dataLength(0)
+        uint channel, double conversionFactor, double samplingRate, const char *units,
+        double blockDuration, uint numberOfBlocks, bool raw, bool memoryMapped, uint id)
+        : ComediChannel(device, subdevice, range, reference, channel, conversionFactor, samplingRate, units, memoryMapped, id),
+          m_dataLength(0), m_data(NULL), m_rawData(NULL), m_raw(raw), m_rawSampleSize(0),
+          m_position(0), m_streaming(blockDuration > 0),
+          m_blockSize(0), m_numberOfBlocks(0), m_ringBlocks(0), m_blocksFilled(0), m_blocksReleased(0)
 {
+        if (m_streaming) {
+                m_blockSize = ceil(blockDuration*samplingRate);
+                m_numberOfBlocks = numberOfBlocks;
+                m_blockLengths.resize(m_numberOfBlocks);
+                m_parameters["block_duration"] = blockDuration;
+        }
+        memset(&m_converter, 0, sizeof(comedi_polynomial_t));
         setName("InputChannel");
 }
 
@@ -366,14 +776,86 @@ InputChannel::~InputChannel()
 {
         if (m_data) {
                 Logger(Debug, "Deallocating data from InputChannel.\n");
-                delete m_data;
+                delete [] m_data;
+        }
+        if (m_rawData)
+                delete [] m_rawData;
+}
+
+bool InputChannel::initialise()
+{
+        if (!ComediChannel::initialise())
+                return false;
+        if (!m_raw)
+                return true;
+
+        // the size of the samples and the calibration polynomial are needed before the acquisition starts
+        comedi_t *dev;
+        char *calibrationFile;
+        comedi_calibration_t *calibration;
+        bool retval = false;
+        dev = comedi_open(device());
+        if (dev == NULL) {
+                Logger(Critical, "Unable to open device [%s].\n", device());
+                return false;
+        }
+        if (comedi_get_subdevice_flags(dev, subdevice()) & SDF_LSAMPL)
+                m_rawSampleSize = sizeof(lsampl_t);
+        else
+                m_rawSampleSize = sizeof(sampl_t);
+        calibrationFile = comedi_get_default_calibration_path(dev);
+        if (calibrationFile == NULL) {
+                Logger(Critical, "Unable to find default calibration file.\n");
+                comedi_close(dev);
+                return false;
+        }
+        calibration = comedi_parse_calibration_file(calibrationFile);
+        if (calibration == NULL) {
+                Logger(Critical, "Unable to parse calibration file.\n");
+        }
+        else {
+                if (comedi_get_softcal_converter(subdevice(), channel(), range(), COMEDI_TO_PHYSICAL,
+                                                 calibration, &m_converter) < 0)
+                        Logger(Critical, "Unable to get converter for channel %d.\n", channel());
+                else
+                        retval = true;
+                comedi_cleanup_calibration(calibration);
         }
+        free(calibrationFile);
+        comedi_close(dev);
+        return retval;
 }
 
 const double* InputChannel::data(size_t *length) const
 {
         *length = m_validDataLength;
-        return m_data;
+        return m_streaming || m_raw ? NULL : m_data;
+}
+
+const void* InputChannel::rawData(size_t *length) const
+{
+        *length = m_validDataLength;
+        return m_streaming || !m_raw ? NULL : m_rawData;
+}
+
+size_t InputChannel::rawSampleSize() const
+{
+        return m_raw ? m_rawSampleSize : 0;
+}
+
+const double* InputChannel::rawConversion(uint *order, double *origin, double *factor) const
+{
+        if (!m_raw)
+                return NULL;
+        *order = m_converter.order;
+        *origin = m_converter.expansion_origin;
+        *factor = conversionFactor();
+        return m_converter.coefficients;
+}
+
+bool InputChannel::isRaw() const
+{
+        return m_raw;
 }
 
 double& InputChannel::operator[](int i)
@@ -388,14 +870,14 @@ const double& InputChannel::operator[](int i) const
 
 double& InputChannel::at(int i)
 {
-        if (i<0 || i>=m_dataLength)
+        if (m_data == NULL || i<0 || (size_t) i>=m_dataLength)
                 throw "Index out of bounds";
         return m_data[i];
 }
 
 const double& InputChannel::at(int i) const
 {
-        if (i<0 || i>=m_dataLength)
+        if (m_data == NULL || i<0 || (size_t) i>=m_dataLength)
                 throw "Index out of bounds";
         return m_data[i];
 }
@@ -408,22 +890,131 @@ void InputChannel::run(double tend)
 
 bool InputChannel::allocateDataBuffer(double tend)
 {
-        m_dataLength = m_validDataLength = ceil(tend*samplingRate());
+        if (m_data) {
+                delete [] m_data;
+                m_data = NULL;
+        }
+        if (m_rawData) {
+                delete [] m_rawData;
+                m_rawData = NULL;
+        }
+        m_validDataLength = ceil(tend*samplingRate());
+        m_position = 0;
+        m_blocksFilled = m_blocksReleased = 0;
+        if (m_streaming) {
+                // no more blocks than those needed for the whole trial
+                m_ringBlocks = MIN(m_numberOfBlocks, (m_validDataLength + m_blockSize - 1) / m_blockSize);
+                m_dataLength = m_ringBlocks * m_blockSize;
+        }
+        else {
+                m_dataLength = m_validDataLength;
+        }
         try {
-                m_data = new double[m_dataLength];
-                if (m_data)
+                if (m_raw)
+                        m_rawData = new char[m_dataLength * m_rawSampleSize];
+                else
+                        m_data = new double[m_dataLength];
+                if (m_data || m_rawData)
                         return true;
         } catch(...) {}
         // we get here only if there were problems in allocating memory
         m_dataLength = m_validDataLength = 0;
+        m_ringBlocks = 0;
         m_data = NULL;
+        m_rawData = NULL;
         return false;
 }
 
+bool InputChannel::isStreaming() const
+{
+        return m_streaming;
+}
+
+double* InputChannel::reserveSamples(size_t *count)
+{
+        size_t index;
+        if (m_raw || !reserve(&index, count))
+                return NULL;
+        return m_data + index;
+}
+
+void* InputChannel::reserveRawSamples(size_t *count)
+{
+        size_t index;
+        if (!m_raw || !reserve(&index, count))
+                return NULL;
+        return m_rawData + index * m_rawSampleSize;
+}
+
+bool InputChannel::reserve(size_t *index, size_t *count)
+{
+        if (!m_streaming) {
+                *index = m_position;
+                *count = MIN(*count, m_dataLength - m_position);
+                return m_position < m_dataLength;
+        }
+        if (m_ringBlocks == 0)
+                return false;
+        if (m_position == 0 && m_blocksFilled - m_blocksReleased == m_ringBlocks) {
+                // all the blocks are waiting to be saved
+                struct timespec pause = {0, 1000000};
+                Logger(Important, "InputChannel(%d): the data is not saved fast enough, waiting.\n", id());
+                while (m_blocksFilled - m_blocksReleased == m_ringBlocks && !KILL_PROGRAM())
+                        nanosleep(&pause, NULL);
+                if (KILL_PROGRAM())
+                        return false;
+        }
+        *index = (m_blocksFilled % m_ringBlocks) * m_blockSize + m_position;
+        *count = MIN(*count, m_blockSize - m_position);
+        return true;
+}
+
+void InputChannel::commitSamples(size_t count)
+{
+        m_position += count;
+        if (m_streaming && m_position == m_blockSize)
+                publishBlock();
+}
+
+void InputChannel::flush()
+{
+        if (m_streaming && m_position > 0)
+                publishBlock();
+}
+
+void InputChannel::publishBlock()
+{
+        m_blockLengths[m_blocksFilled % m_ringBlocks] = m_position;
+        m_position = 0;
+        // make sure that the samples are visible before the block is published
+        __sync_synchronize();
+        m_blocksFilled++;
+}
+
+const void* InputChannel::nextBlock(size_t *length)
+{
+        if (!m_streaming || m_blocksReleased == m_blocksFilled) {
+                *length = 0;
+                return NULL;
+        }
+        __sync_synchronize();
+        uint block = m_blocksReleased % m_ringBlocks;
+        *length = m_blockLengths[block];
+        if (m_raw)
+                return m_rawData + block * m_blockSize * m_rawSampleSize;
+        return m_data + block * m_blockSize;
+}
+
+void InputChannel::releaseBlock()
+{
+        __sync_synchronize();
+        m_blocksReleased++;
+}
+
 OutputChannel::OutputChannel(const char *device, uint subdevice, uint range, uint reference,
                 uint channel, double conversionFactor, double samplingRate, const char *units,
-                const char *stimfile, double offset, bool resetOutput, uint id)
-        : ComediChannel(device, subdevice, range, reference, channel, conversionFactor, samplingRate, units, id),
+                const char *stimfile, double offset, bool resetOutput, bool memoryMapped, uint id)
+        : ComediChannel(device, subdevice, range, reference, channel, conversionFactor, samplingRate, units, memoryMapped, id),
           m_stimulus(1./samplingRate, stimfile), m_offset(offset), m_resetOutput(resetOutput)
 {
         m_validDataLength = m_stimulus.length();
@@ -541,7 +1132,7 @@ double OutputChannel::offset() const
 
 ComediDevice::ComediDevice(const char *device, bool autoDestroy)
         : m_subdevices(), m_autoDestroy(autoDestroy),
-          m_acquiring(false), m_joined(false), m_err(0),
+          m_acquiring(false), m_joined(false), m_memoryMapped(false), m_err(0),
           m_numberOfChannels(0)
 {
         strcpy(m_device, device);
@@ -573,6 +1164,8 @@ bool ComediDevice::addChannel(ComediChannel *channel)
                 return false;
         m_subdevices[channel->subdevice()][channel->channel()] = channel;
         m_numberOfChannels++;
+        if (channel->memoryMapped())
+                m_memoryMapped = true;
         Logger(Debug, "Added channel %d on subdevice %d.\n", channel->channel(), channel->subdevice());
         return true;
 }
@@ -641,18 +1234,23 @@ void* ComediDevice::IOThread(void *arg)
         comedi_calibration_t *calibration;
         
         comedi_polynomial_t *in_converters, *out_converters;
-        uint *in_chanlist, *out_chanlist, in_subdevice, out_subdevice, in_insn_data, out_insn_data;
-        int i, j, k, nsteps, ret;
+        uint *in_chanlist, *out_chanlist, in_subdevice = 0, out_subdevice = 0, in_insn_data, out_insn_data;
+        int i, nsteps, ret;
         int in_bytes_per_sample, out_bytes_per_sample;
         comedi_cmd cmd;
         comedi_insn in_insn, out_insn;
-        size_t input_buffer_length, output_buffer_length;
-        size_t bytes_written;
-        char *input_buffer, *output_buffer;
+        size_t input_buffer_length = 0, output_buffer_length = 0;
+        size_t bytes_written = 0;
+        char *input_buffer = NULL, *output_buffer = NULL;
+        // the asynchronous buffers of the board, if they are mapped in memory
+        char *in_map = NULL, *out_map = NULL;
+        size_t in_map_length = 0, out_map_length = 0;
         pthread_t in_loop_thrd, out_loop_thrd;
         int *in_nsteps = NULL, *out_nsteps = NULL, *err = new int;
         input_loop_data *in_data;
         output_loop_data *out_data;
+        mapped_output_data *out_mapped_data = NULL;
+        std::vector<conversion_polynomial> out_polynomials;
         size_t n_input_channels, n_output_channels;
         std::vector<InputChannel*> input_channels;
         std::vector<OutputChannel*> output_channels;
@@ -708,7 +1306,8 @@ void* ComediDevice::IOThread(void *arg)
         }
         n_input_channels = input_channels.size();
         n_output_channels = output_channels.size();
-        Logger(Debug, "There are %d input channel(s) and %d output channel(s).\n", n_input_channels, n_output_channels);
+        Logger(Debug, "There are %d input channel(s) and %d output channel(s).\n",
+               (int) n_input_channels, (int) n_output_channels);
 
         if (n_input_channels) {
 
@@ -770,12 +1369,27 @@ void* ComediDevice::IOThread(void *arg)
                 }
                 Logger(Debug, "Successfully issued the command.\n");
         
-                // allocate memory for reading at most one second of data
-                input_buffer_length = ceil(MIN(self->m_tend,1.)*input_channels[0]->samplingRate()) *
-                        n_input_channels * in_bytes_per_sample;
-                input_buffer = new char[input_buffer_length];
-                Logger(Debug, "The total size of the input buffer is %ld bytes (= %.2f Mb).\n",
-                                input_buffer_length, (double) input_buffer_length/(1024*1024));
+                if (self->m_memoryMapped) {
+                        if (comedi_get_subdevice_flags(device, in_subdevice) & SDF_MMAP) {
+                                in_map_length = comedi_get_buffer_size(device, in_subdevice);
+                                in_map = MapBuffer(device, in_subdevice, in_map_length, false);
+                        }
+                        if (in_map == NULL)
+                                Logger(Important, "Unable to map the buffer of subdevice %d: samples will be read.\n", in_subdevice);
+                }
+
+                if (in_map) {
+                        Logger(Info, "Samples are acquired from the mapped buffer of subdevice %d (%ld bytes).\n",
+                                        in_subdevice, in_map_length);
+                }
+                else {
+                        // allocate memory for reading at most one second of data
+                        input_buffer_length = ceil(MIN(self->m_tend,1.)*input_channels[0]->samplingRate()) *
+                                n_input_channels * in_bytes_per_sample;
+                        input_buffer = new char[input_buffer_length];
+                        Logger(Debug, "The total size of the input buffer is %ld bytes (= %.2f Mb).\n",
+                                        input_buffer_length, (double) input_buffer_length/(1024*1024));
+                }
 
                 // prepare the triggering instruction
                 in_insn_data = 0;
@@ -847,35 +1461,57 @@ void* ComediDevice::IOThread(void *arg)
                 }
                 Logger(Debug, "Successfully issued the command.\n");
         
-                // allocate memory for the data that will be written
-                output_buffer_length = ceil(self->m_tend*output_channels[0]->samplingRate()) *
-                        n_output_channels * out_bytes_per_sample;
-                output_buffer = new char[output_buffer_length];
-                Logger(Debug, "The total size of the output buffer is %ld bytes (= %.2f Mb).\n",
-                                output_buffer_length, (double) output_buffer_length/(1024*1024));
-		
-                // fill the buffer and FULLY preload it
                 nsteps = ceil(self->m_tend*output_channels[0]->samplingRate());
-                double sample;
-                sampl_t *ptr = (sampl_t*) output_buffer;
-                lsampl_t *lptr = (lsampl_t*) output_buffer;
-                for (i=0; i<nsteps; i++) {
-                        for (j=0; j<n_output_channels; j++) {
-                                sample = (output_channels[j]->offset() + output_channels[j]->at(i))
-                                        * output_channels[j]->conversionFactor();
-                                if (flags & SDF_LSAMPL)
-                                        *lptr = comedi_from_physical(sample, &out_converters[j]);
-                                else
-                                        *ptr = (sampl_t) comedi_from_physical(sample, &out_converters[j]);
-                                ptr++;
-                                lptr++;
+                out_polynomials.resize(n_output_channels);
+                for (size_t j=0; j<n_output_channels; j++) {
+                        // the conversion factor and the offset of each channel are folded in its calibration polynomial
+                        for (uint k=0; k<=out_converters[j].order; k++)
+                                out_polynomials[j].coefficients[k] = out_converters[j].coefficients[k];
+                        out_polynomials[j].scale = output_channels[j]->conversionFactor();
+                        out_polynomials[j].shift = output_channels[j]->offset() * output_channels[j]->conversionFactor() -
+                                out_converters[j].expansion_origin;
+                        out_polynomials[j].order = out_converters[j].order;
+                }
+
+                if (self->m_memoryMapped) {
+                        if (flags & SDF_MMAP) {
+                                out_map_length = comedi_get_buffer_size(device, out_subdevice);
+                                out_map = MapBuffer(device, out_subdevice, out_map_length, true);
                         }
+                        if (out_map == NULL)
+                                Logger(Important, "Unable to map the buffer of subdevice %d: samples will be written.\n", out_subdevice);
                 }
 
-                bytes_written = write(comedi_fileno(device), (void *) output_buffer, output_buffer_length);
-                if (bytes_written < 0)
-                        Logger(Critical, "Error on write: %s.\n", strerror(errno));
-                Logger(Debug, "Number of preloaded bytes: %d.\n", bytes_written);
+                if (out_map) {
+                        Logger(Info, "Samples are written to the mapped buffer of subdevice %d (%ld bytes).\n",
+                                        out_subdevice, out_map_length);
+                        // the samples are converted directly in the buffer of the board, which is preloaded
+                        out_mapped_data = new mapped_output_data(device, out_subdevice, out_map, out_map_length,
+                                        nsteps*n_output_channels, out_bytes_per_sample, &output_channels, &out_polynomials[0]);
+                        if (FillMappedOutput(out_mapped_data) < 0)
+                                Logger(Critical, "Error while preloading the buffer: %s.\n", comedi_strerror(comedi_errno()));
+                        Logger(Debug, "Number of preloaded samples: %llu.\n", (ullong) out_mapped_data->written);
+                }
+                else {
+                        // allocate memory for the data that will be written
+                        output_buffer_length = nsteps * n_output_channels * out_bytes_per_sample;
+                        output_buffer = new char[output_buffer_length];
+                        Logger(Debug, "The total size of the output buffer is %ld bytes (= %.2f Mb).\n",
+                                        output_buffer_length, (double) output_buffer_length/(1024*1024));
+
+                        // fill the buffer and FULLY preload it
+                        if (flags & SDF_LSAMPL)
+                                InterleaveKernel<lsampl_t>(n_output_channels)(output_buffer, 0, nsteps*n_output_channels,
+                                                &output_channels, &out_polynomials[0]);
+                        else
+                                InterleaveKernel<sampl_t>(n_output_channels)(output_buffer, 0, nsteps*n_output_channels,
+                                                &output_channels, &out_polynomials[0]);
+
+                        bytes_written = write(comedi_fileno(device), (void *) output_buffer, output_buffer_length);
+                        if (bytes_written < 0)
+                                Logger(Critical, "Error on write: %s.\n", strerror(errno));
+                        Logger(Debug, "Number of preloaded bytes: %ld.\n", (long) bytes_written);
+                }
 
                 out_insn_data = 0;
                 memset(&out_insn, 0, sizeof(out_insn));
@@ -894,7 +1530,8 @@ void* ComediDevice::IOThread(void *arg)
                         Logger(Critical, "Unable to start the acquisition.\n");
                 else
                         Logger(Debug, "Successfully started the acquisition.\n");
-                in_data = new input_loop_data(device, in_subdevice, input_buffer, input_buffer_length, in_converters, &input_channels);
+                in_data = new input_loop_data(device, in_subdevice, input_buffer, input_buffer_length, in_converters, &input_channels,
+                                in_map, in_map_length);
                 pthread_create(&in_loop_thrd, NULL, input_loop, (void *) in_data);
         }
 
@@ -905,7 +1542,16 @@ void* ComediDevice::IOThread(void *arg)
                         Logger(Critical, "Unable to start the writing: %s.\n", comedi_strerror(comedi_errno()));
                 else
                         Logger(Debug, "Successfully started the writing.\n");
-                if (bytes_written < output_buffer_length) {
+                if (out_mapped_data) {
+                        pthread_create(&out_loop_thrd, NULL, mapped_output_loop, (void *) out_mapped_data);
+                        Logger(Debug, "Waiting for output thread to complete.\n");
+                        pthread_join(out_loop_thrd, (void **) &out_nsteps);
+                        *err = !(*out_nsteps);
+                        for (size_t i=0; i<output_channels.size(); i++)
+                                output_channels[i]->m_validDataLength = *out_nsteps;
+                        delete out_nsteps;
+                }
+                else if (bytes_written < output_buffer_length) {
                         // this part doesn't actually need a separate thread...
                         Logger(Debug, "There are additional samples to be written.\n");
                         out_data = new output_loop_data(device, out_subdevice, output_buffer, output_buffer_length,
@@ -942,11 +1588,14 @@ end_io:
                 delete in_chanlist;
                 delete in_converters;
                 delete input_buffer;
+                UnmapBuffer(in_map, in_map_length);
         }
         if (n_output_channels) {
                 delete out_chanlist;
                 delete out_converters;
                 delete output_buffer;
+                delete out_mapped_data;
+                UnmapBuffer(out_map, out_map_length);
         }
 
         comedi_cleanup_calibration(calibration);
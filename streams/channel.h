@@ -38,6 +38,9 @@
 #include "stimulus.h"
 #include "stream.h"
 
+/*! The default number of blocks in the ring of a streaming InputChannel. */
+#define INPUT_CHANNEL_BLOCKS 8
+
 namespace lcg {
 
 class ComediDevice;
@@ -55,14 +58,25 @@ private:
         double m_samplingRate;
 };
 
+/*!
+ * \class ComediChannel
+ * \brief A channel of a board that is driven by Comedi commands.
+ *
+ * If memoryMapped is true, the ComediDevice of the channel transfers the samples by mapping
+ * the asynchronous buffers of the board in memory, where they are converted in place, instead
+ * of copying them with read and write: the device uses memory mapping if any of its channels
+ * asks for it and falls back to read and write if the subdevice does not support it.
+ */
 class ComediChannel : public Channel {
 public:
         ComediChannel(const char *device, uint subdevice, uint range, uint reference,
-                uint channel, double conversionFactor, double samplingRate, const char *units, uint id = GetId());
+                uint channel, double conversionFactor, double samplingRate, const char *units,
+                bool memoryMapped = false, uint id = GetId());
         uint subdevice() const;
         uint range() const;
         uint reference() const;
         double conversionFactor() const;
+        bool memoryMapped() const;
         virtual bool initialise();
         virtual void terminate();
         virtual void run(double tend);
@@ -77,16 +91,38 @@ protected:
 private:
         uint m_subdevice, m_range, m_reference;
         double m_conversionFactor;
+        bool m_memoryMapped;
 };
 
 //class MCSChannel : public Channel {
 //};
 
+/*!
+ * \class InputChannel
+ * \brief An analog input acquired by a Comedi command.
+ *
+ * By default, the samples of the whole trial are stored in memory and saved when the trial
+ * is over. If blockDuration is greater than zero, the channel streams its data instead:
+ * the samples are stored in a ring of numberOfBlocks blocks, each containing blockDuration
+ * seconds of data, which are handed out by nextBlock as soon as they are full, so that they
+ * can be saved while the acquisition goes on. In this case, data returns NULL and the memory
+ * used by the channel does not depend on the duration of the trial. If the ring is full, the
+ * acquisition waits for a block to be released, relying on the buffer of the driver.
+ *
+ * If raw is true, the channel stores the samples acquired by the board as they are, without
+ * converting them into physical units: they take 2 or 4 bytes each, instead of 8, and are
+ * accessed with rawData or nextBlock. The calibration polynomial of the channel, obtained when
+ * the channel is initialised, is returned by rawConversion, so that the conversion can be
+ * performed when the data is loaded.
+ */
 class InputChannel : public ComediChannel {
 public:
         InputChannel(const char *device, uint subdevice, uint range, uint reference,
-                uint channel, double conversionFactor, double samplingRate, const char *units, uint id = GetId());
+                uint channel, double conversionFactor, double samplingRate, const char *units,
+                double blockDuration = 0., uint numberOfBlocks = INPUT_CHANNEL_BLOCKS,
+                bool raw = false, bool memoryMapped = false, uint id = GetId());
         ~InputChannel();
+        virtual bool initialise();
         const double* data(size_t *length) const;
         bool allocateDataBuffer(double tend);
         double& operator[](int i);
@@ -94,10 +130,62 @@ public:
         double& at(int i);
         const double& at(int i) const;
         virtual void run(double tend);
+
+        virtual bool isStreaming() const;
+        virtual const void* nextBlock(size_t *length);
+        virtual void releaseBlock();
+
+        virtual size_t rawSampleSize() const;
+        virtual const void* rawData(size_t *length) const;
+        virtual const double* rawConversion(uint *order, double *origin, double *factor) const;
+
+        /*! Returns true if the channel stores the raw samples acquired by the board. */
+        bool isRaw() const;
+
+        /*!
+         * Returns where the next samples acquired by the board should be stored, in physical
+         * units or, if the channel is raw, as they are. The samples are stored contiguously
+         * and are made available by commitSamples.
+         * \param count On input, the number of samples to store. On output, the number of
+         *              samples that can be stored at the returned address, at most equal to
+         *              the value on input.
+         * \return NULL if the samples should be discarded.
+         */
+        double* reserveSamples(size_t *count);
+        void* reserveRawSamples(size_t *count);
+        /*! Called after count samples have been stored at the address given by reserveSamples. */
+        void commitSamples(size_t count);
+        /*! Called at the end of the acquisition, to hand out the last block, which may be partially filled. */
+        void flush();
+
+private:
+        /*!
+         * Finds the position in the buffer where the next samples should be stored, waiting for
+         * a block to be released if the ring is full. \return false if the samples should be discarded.
+         */
+        bool reserve(size_t *index, size_t *count);
+        /*! Makes the current block available to nextBlock. */
+        void publishBlock();
+
 private:
         // the REAL size of m_data
         size_t m_dataLength;
         double *m_data;
+        // the samples of a raw channel, each m_rawSampleSize bytes long
+        char *m_rawData;
+        bool m_raw;
+        size_t m_rawSampleSize;
+        comedi_polynomial_t m_converter;
+        // the number of samples stored in the trial (or in the current block, if streaming)
+        size_t m_position;
+        bool m_streaming;
+        size_t m_blockSize;
+        uint m_numberOfBlocks;
+        // the number of blocks in the ring, which can be less than m_numberOfBlocks for short trials
+        uint m_ringBlocks;
+        std::vector<size_t> m_blockLengths;
+        // the number of blocks filled with samples and released after having been saved
+        volatile ullong m_blocksFilled, m_blocksReleased;
 };
 
 class OutputChannel : public ComediChannel {
@@ -105,7 +193,7 @@ public:
         OutputChannel(const char *device, uint subdevice, uint range, uint reference,
                 uint channel, double conversionFactor, double samplingRate,
                 const char *units, const char *stimfile, double offset = 0.,
-                bool resetOutput = false, uint id = GetId());
+                bool resetOutput = false, bool memoryMapped = false, uint id = GetId());
         virtual void terminate();
         const char* stimulusFile() const;
         bool setStimulusFile(const char *filename);
@@ -141,6 +229,8 @@ private:
         char m_device[FILENAME_MAXLEN];
         std::map< int,std::map<int,ComediChannel*> > m_subdevices;
         bool m_autoDestroy, m_acquiring, m_joined;
+        // whether the buffers of the board are mapped in memory
+        bool m_memoryMapped;
         int m_err;
         size_t m_numberOfChannels;
         double m_tend;
@@ -59,7 +59,8 @@ void Stream::addPre(Stream *stream)
         Logger(All, "--- Stream::addPre(Stream*, double) ---\n");
         for (int i=0; i<m_pre.size(); i++) {
                 if (m_pre[i]->id() == stream->id()) {
-                        Logger(Important, "Trying to connect streams #%d and #%d more than once.\n");
+                        Logger(Important, "Trying to connect streams #%d and #%d more than once.\n",
+                               stream->id(), id());
                         return;
                 }
         }
@@ -77,6 +78,36 @@ const double* Stream::metadata(size_t *dims, char *label) const
         return NULL;
 }
 
+size_t Stream::rawSampleSize() const
+{
+        return 0;
+}
+
+const void* Stream::rawData(size_t *length) const
+{
+        *length = 0;
+        return NULL;
+}
+
+const double* Stream::rawConversion(uint *order, double *origin, double *factor) const
+{
+        return NULL;
+}
+
+bool Stream::isStreaming() const
+{
+        return false;
+}
+
+const void* Stream::nextBlock(size_t *length)
+{
+        *length = 0;
+        return NULL;
+}
+
+void Stream::releaseBlock()
+{}
+
 const std::string& Stream::name() const
 {
         return m_name;
@@ -120,6 +120,44 @@ public:
         /*! Provides access to the whole data buffer. */
         virtual const double* data(size_t *length) const = 0;
 
+        /*!
+         * Should return the size, in bytes, of the samples of the stream if they are the raw,
+         * unsigned integer, values acquired by a board instead of doubles in physical units.
+         * In this case, data returns NULL, the samples are accessed with rawData or nextBlock
+         * and they are converted into physical units by the polynomial returned by
+         * rawConversion. The default implementation returns 0, i.e., the samples are doubles.
+         */
+        virtual size_t rawSampleSize() const;
+
+        /*! Provides access to the whole buffer of raw samples. The default implementation returns NULL. */
+        virtual const void* rawData(size_t *length) const;
+
+        /*!
+         * Should return the coefficients c of the polynomial that converts a raw sample x into
+         * physical units, i.e., factor * sum_{i=0}^{order} c[i] * (x - origin)^i.
+         * The default implementation returns NULL.
+         */
+        virtual const double* rawConversion(uint *order, double *origin, double *factor) const;
+
+        /*!
+         * Should return true if the data of the stream is handed out in blocks, with nextBlock,
+         * while the stream runs, instead of being kept in memory for the whole duration of the
+         * trial and accessed with data. The default implementation returns false.
+         */
+        virtual bool isStreaming() const;
+
+        /*!
+         * Returns the oldest block of data that is ready and has not been released yet, or NULL
+         * if there is no such block. The block remains valid until releaseBlock is called.
+         * Only one thread at a time may call nextBlock and releaseBlock.
+         * The samples are doubles or, if rawSampleSize is not 0, raw samples.
+         * \param length The number of samples in the block.
+         */
+        virtual const void* nextBlock(size_t *length);
+
+        /*! Gives back to the stream the block returned by the last call to nextBlock. */
+        virtual void releaseBlock();
+
         /*! Provides access to the i-th element in the internal buffer of this stream. */
         virtual double& operator[](int i) = 0;
 